@@ -5,7 +5,8 @@
  */
  
 #include "extract_connecting_graph.hpp"
-#include <structures/updateable_priority_queue.hpp>
+
+#include <algorithm>
 
 //#define debug_vg_algorithms
 
@@ -21,6 +22,50 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
                                                    bool no_additional_tips,
                                                    bool only_paths,
                                                    bool strict_max_len) {
+    // keep the working tables around for the next call on this thread
+    thread_local ConnectingGraphExtractor extractor;
+    return extractor.extract(source, g, max_len, pos_1, pos_2, include_terminal_positions,
+                             detect_terminal_cycles, no_additional_tips, only_paths, strict_max_len);
+}
+
+ConnectingGraphExtractor::ConnectingGraphExtractor() :
+    queue([](const Traversal& item) {
+        return item.handle;
+    }),
+    local_queue([](const LocalTraversal& item) {
+        return make_pair(item.id, item.rev);
+    }) {
+    // nothing to do
+}
+
+void ConnectingGraphExtractor::clear() {
+    graph.clear();
+    observed_edges.clear();
+    skip_handles.clear();
+    queue.clear();
+    local_queue.clear();
+    forward_trav_dist.clear();
+    reverse_trav_dist.clear();
+    forward_reachable.clear();
+    reverse_reachable.clear();
+    
+    // don't hold on to the tables from an unusually large extraction
+    release_if_large(graph);
+    release_if_large(observed_edges);
+    release_if_large(skip_handles);
+    release_if_large(forward_trav_dist);
+    release_if_large(reverse_trav_dist);
+    release_if_large(forward_reachable);
+    release_if_large(reverse_reachable);
+}
+
+unordered_map<id_t, id_t> ConnectingGraphExtractor::extract(const HandleGraph* source, Graph& g, int64_t max_len,
+                                                            pos_t pos_1, pos_t pos_2,
+                                                            bool include_terminal_positions,
+                                                            bool detect_terminal_cycles,
+                                                            bool no_additional_tips,
+                                                            bool only_paths,
+                                                            bool strict_max_len) {
 #ifdef debug_vg_algorithms
     cerr << "[extract_connecting_graph] max len: " << max_len << ", pos 1: " << pos_1 << ", pos 2: " << pos_2 << endl;
 #endif
@@ -30,25 +75,8 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
         exit(1);
     }
     
-    // a local struct for Nodes that maintains edge lists
-    struct LocalNode {
-        LocalNode() {}
-        LocalNode(string sequence) : sequence(sequence) {}
-        string sequence;
-        // edges are stored as (node id, is reversing?)
-        vector<pair<id_t, bool>> edges_left;
-        vector<pair<id_t, bool>> edges_right;
-    };
-    
-    // a local struct that packages a handle with its distance from the first position
-    struct Traversal {
-        Traversal(handle_t handle, int64_t dist) : handle(handle), dist(dist) {}
-        int64_t dist; // distance from pos to the right side of this node
-        handle_t handle; // Oriented node traversal
-        inline bool operator<(const Traversal& other) const {
-            return dist > other.dist; // opposite order so priority queue selects minimum
-        }
-    };
+    // start from empty working tables, but keep the space they had
+    clear();
     
     // local enum to keep track of the cases where the positions are on the same node
     enum colocation_t {SeparateNodes, SharedNodeReachable, SharedNodeUnreachable, SharedNodeReverse};
@@ -100,13 +128,9 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
     // a translator for node ids in g to node ids in the original graph
     unordered_map<id_t, id_t> id_trans;
     
-    // the edges we have encountered in the traversal
-    unordered_set<pair<handle_t, handle_t>> observed_edges;
-    
     // the representation of the graph we're going to build up before storing in g (allows easier
     // subsetting operations than Graph, XG, or VG objects)
     // TODO: reduce duplicate get_handle calls!
-    unordered_map<id_t, LocalNode> graph;
     graph[id(pos_1)] = LocalNode(source->get_sequence(source->get_handle(id(pos_1), false)));
     if (id(pos_2) != id(pos_1)) {
         graph[id(pos_2)] = LocalNode(source->get_sequence(source->get_handle(id(pos_2), false)));
@@ -115,16 +139,12 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
     // keep track of whether we find a path or not
     bool found_target = false;
     
-    unordered_set<handle_t> skip_handles{source->get_handle(id(pos_1), is_rev(pos_1))};
+    skip_handles.insert(source->get_handle(id(pos_1), is_rev(pos_1)));
     // mark final position for skipping so that we won't look for additional traversals unless that's
     // the only way to find terminal cycles
     if (!(colocation == SharedNodeReverse && detect_terminal_cycles)) {
         skip_handles.insert(source->get_handle(id(pos_2), is_rev(pos_2)));
     }
-    // initialize the queue
-    UpdateablePriorityQueue<Traversal, handle_t> queue([](const Traversal& item) {
-        return item.handle;
-    });
     
     // the distance to the ends of the starting nodes
     int64_t first_traversal_length = graph[id(pos_1)].sequence.size() - offset(pos_1);
@@ -174,7 +194,8 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
             auto& edges_out = source->get_is_reverse(trav.handle) ?
                 graph[source->get_id(trav.handle)].edges_left :
                 graph[source->get_id(trav.handle)].edges_right;
-            source->follow_edges(trav.handle, false, [&](const handle_t& next) {
+            source->get_neighbors(trav.handle, false, neighbors);
+            for (const handle_t& next : neighbors) {
                 // get the orientation and id of the other side of the edge
                 
                 id_t next_id = source->get_id(next);
@@ -219,7 +240,7 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
                     }
                     observed_edges.insert(canonical_edge);
                 }
-            });
+            }
         }
     }
     
@@ -266,7 +287,8 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
                 << " orientation at distance " << trav.dist << endl;
 #endif
             
-            source->follow_edges(trav.handle, false, [&](const handle_t& next) {
+            source->get_neighbors(trav.handle, false, neighbors);
+            for (const handle_t& next : neighbors) {
                 // get the orientation and id of the other side of the edge
                 id_t next_id = source->get_id(next);
                 bool next_rev = source->get_is_reverse(next);
@@ -315,7 +337,7 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
                     }
                     observed_edges.insert(canonical_edge);
                 }
-            });
+            }
         }
     }
     
@@ -990,33 +1012,14 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
     // provide three options for pruning away any unnecessary nodes and edges we've added in the
     // process of searching for the subgraph that has this guarantee
     
-    // Now we need traversals and queues for our exploration of this already-extracted graph.
-    // We don't need to touch handles anymore
-    
-    // Define a traversal for our local-variable-based graph representation
-    struct LocalTraversal {
-        LocalTraversal(id_t id, bool rev, int64_t dist) : id(id), rev(rev), dist(dist) {}
-        int64_t dist; // distance from pos_1 to the right side of this node
-        id_t id;      // node ID
-        bool rev;     // strand
-        inline bool operator<(const LocalTraversal& other) const {
-            return dist > other.dist; // opposite order so priority queue selects minimum
-        }
-    };
-    
-    // Define new queue
-    UpdateablePriorityQueue<LocalTraversal, pair<id_t, bool>> local_queue([](const LocalTraversal& item) {
-        return make_pair(item.id, item.rev);
-    });
+    // Now we explore this already-extracted graph with local_queue, and we don't need to touch
+    // handles anymore
     
     if (strict_max_len) {
         // OPTION 1: PRUNE TO PATHS UNDER MAX LENGTH
         // some nodes in the current graph may not be on paths, or the paths that they are on may be
         // above the maximum distance, so we do a forward-backward distance search to check
         
-        unordered_map<pair<id_t, bool>, int64_t> forward_trav_dist;
-        unordered_map<pair<id_t, bool>, int64_t> reverse_trav_dist;
-        
         // re-initialize the queue in the forward direction
         local_queue.clear();
         local_queue.emplace(id(pos_1), is_rev(pos_1), graph[id(pos_1)].sequence.size());
@@ -1200,9 +1203,6 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
         
         list<pair<id_t, bool>> stack;
         
-        unordered_set<pair<id_t, bool>> forward_reachable;
-        unordered_set<pair<id_t, bool>> reverse_reachable;
-        
         // initialize the stack in the forward direction
         stack.emplace_back(id(pos_1), is_rev(pos_1));
         forward_reachable.emplace(id(pos_1), is_rev(pos_1));
@@ -1417,7 +1417,19 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
         }
     }
     
-    for (const pair<id_t, LocalNode>& node_record : graph) {
+    // add the nodes in ID order, so that the output doesn't depend on the history of the tables
+    vector<const pair<const id_t, LocalNode>*> node_records;
+    node_records.reserve(graph.size());
+    for (const auto& node_record : graph) {
+        node_records.push_back(&node_record);
+    }
+    std::sort(node_records.begin(), node_records.end(), [](const pair<const id_t, LocalNode>* a,
+                                                           const pair<const id_t, LocalNode>* b) {
+        return a->first < b->first;
+    });
+    
+    for (const pair<const id_t, LocalNode>* node_record_ptr : node_records) {
+        const pair<const id_t, LocalNode>& node_record = *node_record_ptr;
         // add in each node
         Node* node = g.add_node();
         node->set_id(node_record.first);
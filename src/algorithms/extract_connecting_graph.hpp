@@ -15,6 +15,9 @@
 #include "../vg.pb.h"
 #include "../hash_map.hpp"
 
+#include <unordered_set>
+#include <structures/updateable_priority_queue.hpp>
+
 namespace vg {
 namespace algorithms {
     
@@ -50,6 +53,94 @@ namespace algorithms {
                                                        bool no_additional_tips = false,
                                                        bool only_paths = false,
                                                        bool strict_max_len = false);
+    
+    /// Extracts connecting graphs like extract_connecting_graph, but keeps its working tables between
+    /// calls so that repeated extractions don't have to build them up from nothing. Not thread safe, so
+    /// each thread needs its own (extract_connecting_graph keeps one per thread).
+    class ConnectingGraphExtractor {
+    public:
+        ConnectingGraphExtractor();
+        
+        /// Fills Graph g with the subgraph of source that connects two positions, exactly as
+        /// extract_connecting_graph does with the same arguments.
+        unordered_map<id_t, id_t> extract(const HandleGraph* source, Graph& g, int64_t max_len,
+                                          pos_t pos_1, pos_t pos_2,
+                                          bool include_terminal_positions = false,
+                                          bool detect_terminal_cycles = false,
+                                          bool no_additional_tips = false,
+                                          bool only_paths = false,
+                                          bool strict_max_len = false);
+        
+    private:
+        
+        /// a node of the graph being extracted, which maintains edge lists
+        struct LocalNode {
+            LocalNode() {}
+            LocalNode(string sequence) : sequence(sequence) {}
+            string sequence;
+            // edges are stored as (node id, is reversing?)
+            vector<pair<id_t, bool>> edges_left;
+            vector<pair<id_t, bool>> edges_right;
+        };
+        
+        /// a handle in the source graph with its distance from the first position
+        struct Traversal {
+            Traversal(handle_t handle, int64_t dist) : handle(handle), dist(dist) {}
+            int64_t dist; // distance from pos to the right side of this node
+            handle_t handle; // Oriented node traversal
+            inline bool operator<(const Traversal& other) const {
+                return dist > other.dist; // opposite order so priority queue selects minimum
+            }
+        };
+        
+        /// a traversal of a node of the graph being extracted
+        struct LocalTraversal {
+            LocalTraversal(id_t id, bool rev, int64_t dist) : id(id), rev(rev), dist(dist) {}
+            int64_t dist; // distance from pos_1 to the right side of this node
+            id_t id;      // node ID
+            bool rev;     // strand
+            inline bool operator<(const LocalTraversal& other) const {
+                return dist > other.dist; // opposite order so priority queue selects minimum
+            }
+        };
+        
+        /// empty all the working tables, keeping their space unless it is unusually large
+        void clear();
+        
+        /// give up the space of a table that has grown past max_retained_size
+        template<typename Table>
+        static void release_if_large(Table& table);
+        
+        /// the number of buckets past which a table is not kept between extractions
+        static const size_t max_retained_size = 1 << 16;
+        
+        /// the graph we're building up before storing in g
+        unordered_map<id_t, LocalNode> graph;
+        /// the edges we have encountered in the traversal
+        unordered_set<pair<handle_t, handle_t>> observed_edges;
+        /// handles that the searches in the source graph do not continue past
+        unordered_set<handle_t> skip_handles;
+        /// the search queue in the source graph
+        structures::UpdateablePriorityQueue<Traversal, handle_t> queue;
+        /// the handles reachable from the one being traversed
+        vector<handle_t> neighbors;
+        
+        /// the search queue in the extracted graph
+        structures::UpdateablePriorityQueue<LocalTraversal, pair<id_t, bool>> local_queue;
+        /// shortest distances to the traversals in the extracted graph from each position
+        unordered_map<pair<id_t, bool>, int64_t> forward_trav_dist;
+        unordered_map<pair<id_t, bool>, int64_t> reverse_trav_dist;
+        /// traversals in the extracted graph that are reachable from each position
+        unordered_set<pair<id_t, bool>> forward_reachable;
+        unordered_set<pair<id_t, bool>> reverse_reachable;
+    };
+    
+    template<typename Table>
+    void ConnectingGraphExtractor::release_if_large(Table& table) {
+        if (table.bucket_count() > max_retained_size) {
+            Table().swap(table);
+        }
+    }
 
 }
 }
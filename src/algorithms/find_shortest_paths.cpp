@@ -35,8 +35,9 @@ unordered_map<handle_t, size_t>  find_shortest_paths(const HandleGraph* g, handl
         return item.second;
     });
     
-    // We keep a current handle
+    // We keep a current handle, and a buffer for the handles after it
     handle_t current = start;
+    vector<handle_t> neighbors;
     size_t distance = 0;
     distances[start] = distance;
     queue.push(make_pair(distance, start));
@@ -60,7 +61,8 @@ unordered_map<handle_t, size_t>  find_shortest_paths(const HandleGraph* g, handl
             distance += g->get_length(current);
         }
             
-        g->follow_edges(current, false, [&](const handle_t& next) {
+        g->get_neighbors(current, false, neighbors);
+        for (const handle_t& next : neighbors) {
             // For each handle to the right of here
             
             if (!distances.count(next) || distance < distances[next]) {
@@ -75,7 +77,7 @@ unordered_map<handle_t, size_t>  find_shortest_paths(const HandleGraph* g, handl
 #endif
                 
             }
-        });
+        }
     }
 
     return distances;
@@ -1,4 +1,9 @@
 #include "topological_sort.hpp"
+#include "weakly_connected_components.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <tuple>
 
 namespace vg {
 namespace algorithms {
@@ -49,213 +54,278 @@ vector<handle_t> tail_nodes(const HandleGraph* g) {
     
 }
 
-vector<handle_t> topological_sort(const HandleGraph* g) {
+/// A point in a component's sort where the set of oriented nodes ran dry and
+/// had to be refilled, either from a seed or from the first unvisited node.
+struct sort_restart_t {
+    /// Where in the component's sorted handles the restart put its node
+    size_t start;
+    /// True if the node came from a seed
+    bool from_seed;
+    /// The node's ID
+    id_t id;
+};
+
+/// Sort one weakly connected component, given as its nodes' locally forward
+/// handles, and write the sorted and oriented handles at out. Nodes are kept
+/// in flat arrays by their rank in ID order, which stands in for the ordered
+/// maps by ID that make the sort stable. Every time the set of oriented nodes
+/// has to be refilled is recorded in restarts, so the components can be
+/// interleaved as if they had been sorted together.
+static void topological_sort_component(const HandleGraph* g, vector<handle_t>& nodes,
+                                       vector<handle_t>::iterator out,
+                                       vector<sort_restart_t>& restarts) {
     
-    // Make a vector to hold the ordered and oriented nodes.
-    vector<handle_t> sorted;
-    sorted.reserve(g->node_size());
+    // Rank the nodes by ID
+    std::sort(nodes.begin(), nodes.end(), [&](const handle_t& a, const handle_t& b) {
+        return g->get_id(a) < g->get_id(b);
+    });
+    vector<id_t> ids(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        ids[i] = g->get_id(nodes[i]);
+    }
+    auto rank_of = [&](const handle_t& handle) {
+        return lower_bound(ids.begin(), ids.end(), g->get_id(handle)) - ids.begin();
+    };
     
-    // Instead of actually removing edges, we add them to this set of masked edges.
-    unordered_set<pair<handle_t, handle_t>> masked_edges;
+    // Instead of actually removing edges, we mark them as masked in a sorted
+    // table of the component's edges.
+    vector<pair<int64_t, int64_t>> edges;
+    for (auto& node : nodes) {
+        g->follow_edges(node, false, [&](const handle_t& next) {
+            auto edge = g->edge_handle(node, next);
+            edges.emplace_back(as_integer(edge.first), as_integer(edge.second));
+        });
+        g->follow_edges(node, true, [&](const handle_t& prev) {
+            auto edge = g->edge_handle(prev, node);
+            edges.emplace_back(as_integer(edge.first), as_integer(edge.second));
+        });
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    vector<bool> masked(edges.size(), false);
+    auto edge_index = [&](const handle_t& left, const handle_t& right) {
+        auto edge = g->edge_handle(left, right);
+        return lower_bound(edges.begin(), edges.end(), make_pair(as_integer(edge.first), as_integer(edge.second))) - edges.begin();
+    };
     
-    // This (s) is our set of oriented nodes.
-    // using a map instead of a set ensures a stable sort across different systems
-    map<id_t, handle_t> s;
-
-    // We find the head and tails, if there are any
-    vector<handle_t> heads{head_nodes(g)};
-    // No need to fetch the tails since we don't use them
-
+    // This (s) is our set of oriented nodes, taken lowest ID first. Each node
+    // only ever enters it once, so a heap of ranks will do.
+    priority_queue<size_t, vector<size_t>, greater<size_t>> s;
+    vector<handle_t> oriented(nodes.size());
     
-    // Maps from node ID to first orientation we suggested for it.
-    map<id_t, handle_t> seeds;
+    // Nodes that have gone into s
+    vector<bool> visited(nodes.size(), false);
+    size_t unvisited_count = nodes.size();
+    // Everything before this rank has been visited
+    size_t first_unvisited = 0;
     
+    // The first orientation we suggested for each node we might start from,
+    // also taken lowest ID first
+    priority_queue<size_t, vector<size_t>, greater<size_t>> seeds;
+    vector<handle_t> seed_handles(nodes.size());
+    vector<bool> is_seed(nodes.size(), false);
     
-    for(handle_t& head : heads) {
-        // Dump all the heads into the oriented set, rather than having them as
-        // seeds. We will only go for cycle-breaking seeds when we run out of
-        // heads. This is bad for contiguity/ordering consistency in cyclic
-        // graphs and reversing graphs, but makes sure we work out to just
-        // topological sort on DAGs. It mimics the effect we used to get when we
-        // joined all the head nodes to a new root head node and seeded that. We
-        // ignore tails since we only orient right from nodes we pick.
-        s[g->get_id(head)] = head;
-    }
-
-    // We will use an ordered map handles by ID for nodes we have not visited
-    // yet. This ensures a consistent sort order across systems.
-    map<id_t, handle_t> unvisited;
-    g->for_each_handle([&](const handle_t& found) {
-        if (!s.count(g->get_id(found))) {
-            // Only nodes that aren't yet in s are unvisited.
-            // Nodes in s are visited but just need to be added tot he ordering.
-            unvisited.emplace(g->get_id(found), found);
+    auto visit = [&](size_t rank, const handle_t& handle) {
+        oriented[rank] = handle;
+        s.push(rank);
+        visited[rank] = true;
+        unvisited_count--;
+    };
+    
+    // Dump all the heads into the oriented set, rather than having them as
+    // seeds, as in the whole graph version.
+    for (size_t i = 0; i < nodes.size(); i++) {
+        bool no_left_edges = g->follow_edges(nodes[i], true, [&](const handle_t& ignored) {
+            return false;
+        });
+        if (no_left_edges) {
+            visit(i, nodes[i]);
         }
-    });
-
-    while(!unvisited.empty() || !s.empty()) {
-
+    }
+    
+    // How many handles we have written
+    size_t emitted = 0;
+    
+    while (unvisited_count != 0 || !s.empty()) {
+        
         // Put something in s. First go through seeds until we can find one
         // that's not already oriented.
-        while(s.empty() && !seeds.empty()) {
-            // Look at the first seed
-            auto first_seed = (*seeds.begin()).second;
-
-            if(unvisited.count(g->get_id(first_seed))) {
-                // We have an unvisited seed. Use it
-#ifdef debug
-#pragma omp critical (cerr)
-                cerr << "Starting from seed " << g->get_id(first_seed) << " orientation " << g->get_is_reverse(first_seed) << endl;
-#endif
-
-                s[g->get_id(first_seed)] = first_seed;
-                unvisited.erase(g->get_id(first_seed));
+        while (s.empty() && !seeds.empty()) {
+            size_t rank = seeds.top();
+            seeds.pop();
+            if (!visited[rank]) {
+                visit(rank, seed_handles[rank]);
+                restarts.push_back(sort_restart_t{emitted, true, ids[rank]});
             }
-            // Whether we used the seed or not, don't keep it around
-            seeds.erase(seeds.begin());
         }
-
-        if(s.empty()) {
-            // If we couldn't find a seed, just grab any old node.
-            // Since map order is stable across systems, we can take the first node by id and put it locally forward.
-#ifdef debug
-#pragma omp critical (cerr)
-            cerr << "Starting from arbitrary node " << unvisited.begin()->first << " locally forward" << endl;
-#endif
-
-            s[unvisited.begin()->first] = unvisited.begin()->second;
-            unvisited.erase(unvisited.begin()->first);
+        
+        if (s.empty()) {
+            // If we couldn't find a seed, take the first unvisited node by ID
+            // and put it locally forward.
+            while (visited[first_unvisited]) {
+                first_unvisited++;
+            }
+            visit(first_unvisited, nodes[first_unvisited]);
+            restarts.push_back(sort_restart_t{emitted, false, ids[first_unvisited]});
         }
-
+        
         while (!s.empty()) {
-            // Grab an oriented node
-            auto n = s.begin()->second;
-            s.erase(g->get_id(n));
-            // Emit it
-            sorted.push_back(n);
-#ifdef debug
-#pragma omp critical (cerr)
-            cerr << "Using oriented node " << g->get_id(n) << " orientation " << g->get_is_reverse(n) << endl;
-#endif
-
-            // See if it has an edge from its start to the start of some node
-            // where both were picked as places to break into cycles. A
-            // reversing self loop on a cycle entry point is a special case of
-            // this.
+            // Grab an oriented node and emit it
+            handle_t n = oriented[s.top()];
+            s.pop();
+            *out = n;
+            ++out;
+            ++emitted;
+            
+            // Mask any edge from its start to the start of some node where
+            // both were picked as places to break into cycles.
             g->follow_edges(n, true, [&](const handle_t& prev_node) {
-                if(!unvisited.count(g->get_id(prev_node))) {
-                    // Look at the edge
-                    auto edge = g->edge_handle(prev_node, n);
-                    if (masked_edges.count(edge)) {
-                        // We removed this edge, so skip it.
-                        return;
-                    }
-                    
-#ifdef debug
-#pragma omp critical (cerr)
-                    cerr << "\tHas left-side edge to cycle entry point " << g->get_id(prev_node)
-                         << " orientation " << g->get_is_reverse(prev_node) << endl;
-#endif
-
-                    // Mask the edge
-                    masked_edges.insert(edge);
-                    
-#ifdef debug
-#pragma omp critical (cerr)
-                    cerr << "\t\tEdge: " << g->get_id(edge.first) << " " << g->get_is_reverse(edge.first)
-                        << " -> " << g->get_id(edge.second) << " " << g->get_is_reverse(edge.second) << endl;
-#endif
+                if (visited[rank_of(prev_node)]) {
+                    masked[edge_index(prev_node, n)] = true;
                 }
             });
-
-            // All other connections and self loops are handled by looking off the right side.
-
-            // See what all comes next, minus deleted edges.
+            
+            // All other connections and self loops are handled by looking off
+            // the right side.
             g->follow_edges(n, false, [&](const handle_t& next_node) {
-
-                // Look at the edge
-                auto edge = g->edge_handle(n, next_node);
-                if (masked_edges.count(edge)) {
+                size_t edge = edge_index(n, next_node);
+                if (masked[edge]) {
                     // We removed this edge, so skip it.
                     return;
                 }
-
-#ifdef debug
-#pragma omp critical (cerr)
-                cerr << "\tHas edge to " << g->get_id(next_node) << " orientation " << g->get_is_reverse(next_node) << endl;
-#endif
-
-                // Mask the edge connecting these nodes in this order and
-                // relative orientation, so we can't traverse it again
-
-#ifdef debug
-#pragma omp critical (cerr)
-                cerr << "\t\tEdge: " << g->get_id(edge.first) << " " << g->get_is_reverse(edge.first)
-                    << " -> " << g->get_id(edge.second) << " " << g->get_is_reverse(edge.second) << endl;
-#endif
-
-                // Mask the edge
-                masked_edges.insert(edge);
-
-                if(unvisited.count(g->get_id(next_node))) {
-                    // We haven't already started here as an arbitrary cycle entry point
-
-#ifdef debug
-#pragma omp critical (cerr)
-                    cerr << "\t\tAnd node hasn't been visited yet" << endl;
-#endif
-
-                    bool unmasked_incoming_edge = false;
-                    g->follow_edges(next_node, true, [&](const handle_t& prev_node) {
-                        // Get a handle for each incoming edge
-                        auto prev_edge = g->edge_handle(prev_node, next_node);
-                        
-                        if (!masked_edges.count(prev_edge)) {
-                            // We found such an edghe and can stop looking
-                            unmasked_incoming_edge = true;
-                            return false;
-                        }
-                        // Otherwise check all the edges on the left of this handle
-                        return true;
+                masked[edge] = true;
+                
+                size_t rank = rank_of(next_node);
+                if (!visited[rank]) {
+                    bool unmasked_incoming_edge = !g->follow_edges(next_node, true, [&](const handle_t& prev_node) {
+                        return masked[edge_index(prev_node, next_node)];
                     });
-
-                    if(!unmasked_incoming_edge) {
-
-#ifdef debug
-#pragma omp critical (cerr)
-                        cerr << "\t\t\tIs last incoming edge" << endl;
-#endif
+                    
+                    if (!unmasked_incoming_edge) {
                         // Keep this orientation and put it here
-                        s[g->get_id(next_node)] = next_node;
-                        // Remember that we've visited and oriented this node, so we
-                        // don't need to use it as a seed.
-                        unvisited.erase(g->get_id(next_node));
-
-                    } else if(!seeds.count(g->get_id(next_node))) {
-                        // We came to this node in this orientation; when we need a
-                        // new node and orientation to start from (i.e. an entry
-                        // point to the node's cycle), we might as well pick this
-                        // one.
-                        // Only take it if we don't already know of an orientation for this node.
-                        seeds[g->get_id(next_node)] = next_node;
-
-#ifdef debug
-#pragma omp critical (cerr)
-                        cerr << "\t\t\tSuggests seed " << g->get_id(next_node) << " orientation " << g->get_is_reverse(next_node) << endl;
-#endif
+                        visit(rank, next_node);
+                    } else if (!is_seed[rank]) {
+                        // We might as well start from here in this
+                        // orientation when we need a way into its cycle
+                        seed_handles[rank] = next_node;
+                        is_seed[rank] = true;
+                        seeds.push(rank);
                     }
-                } else {
-#ifdef debug
-#pragma omp critical (cerr)
-                    cerr << "\t\tAnd node was already visited (to break a cycle)" << endl;
-#endif
                 }
             });
         }
     }
+}
 
+vector<handle_t> topological_sort(const HandleGraph* g) {
+    
+    // Each weakly connected component sorts separately, so we can sort them in
+    // parallel and then interleave them as the whole graph sort would.
+    vector<handle_t> nodes;
+    vector<size_t> labels = weakly_connected_component_labels(g, nodes);
+    
+    // Group the nodes by component, keeping them in order within each one
+    vector<size_t> component_start;
+    for (size_t i = 0; i < labels.size(); i++) {
+        if (labels[i] == component_start.size()) {
+            component_start.push_back(0);
+        }
+        component_start[labels[i]]++;
+    }
+    size_t component_count = component_start.size();
+    size_t total = 0;
+    for (auto& start : component_start) {
+        swap(start, total);
+        total += start;
+    }
+    component_start.push_back(total);
+    
+    vector<handle_t> sorted(nodes.size());
+    {
+        vector<size_t> filled(component_start.begin(), component_start.begin() + component_count);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            sorted[filled[labels[i]]++] = nodes[i];
+        }
+    }
+    
+    vector<vector<sort_restart_t>> restarts(component_count);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t c = 0; c < component_count; c++) {
+        vector<handle_t> component(sorted.begin() + component_start[c], sorted.begin() + component_start[c + 1]);
+        topological_sort_component(g, component, sorted.begin() + component_start[c], restarts[c]);
+    }
+    
+    if (component_count <= 1) {
+        // Send away our sorted ordering.
+        return sorted;
+    }
+    
+    // Sorting the whole graph at once takes the lowest ID out of the set of
+    // oriented nodes for all the components, so it runs the components'
+    // sorts side by side. A component whose set runs dry waits until all of
+    // them have, and then the component with the lowest seed, or failing that
+    // the lowest unvisited node, goes on. So we merge the components back
+    // together the same way.
+    vector<handle_t> merged;
+    merged.reserve(sorted.size());
+    
+    // Where each component is in its sorted handles, and its next restart
+    vector<size_t> next(component_start.begin(), component_start.begin() + component_count);
+    vector<size_t> next_restart(component_count, 0);
+    
+    // Components that are emitting, by the ID of the handle they emit next
+    priority_queue<pair<id_t, size_t>, vector<pair<id_t, size_t>>, greater<pair<id_t, size_t>>> running;
+    // Components waiting to restart, seeds first, then by ID
+    priority_queue<tuple<bool, id_t, size_t>, vector<tuple<bool, id_t, size_t>>, greater<tuple<bool, id_t, size_t>>> waiting;
+    
+    // Stop a component at its next restart, or at its end
+    auto stop = [&](size_t c) {
+        if (next_restart[c] < restarts[c].size()) {
+            auto& restart = restarts[c][next_restart[c]];
+            waiting.emplace(!restart.from_seed, restart.id, c);
+        }
+    };
+    // Run a component up to its next restart, or its end
+    auto run = [&](size_t c) {
+        running.emplace(g->get_id(sorted[next[c]]), c);
+    };
+    
+    for (size_t c = 0; c < component_count; c++) {
+        if (!restarts[c].empty() && restarts[c].front().start == 0) {
+            // This component has no heads
+            stop(c);
+        } else {
+            run(c);
+        }
+    }
+    
+    while (!running.empty() || !waiting.empty()) {
+        if (running.empty()) {
+            size_t c = get<2>(waiting.top());
+            waiting.pop();
+            next_restart[c]++;
+            run(c);
+        }
+        
+        size_t c = running.top().second;
+        running.pop();
+        merged.push_back(sorted[next[c]]);
+        next[c]++;
+        
+        if (next[c] == component_start[c + 1]) {
+            // This component is done
+            continue;
+        }
+        if (next_restart[c] < restarts[c].size() &&
+            restarts[c][next_restart[c]].start == next[c] - component_start[c]) {
+            stop(c);
+        } else {
+            run(c);
+        }
+    }
+    
     // Send away our sorted ordering.
-    return sorted;
+    return merged;
 
 }
 
@@ -54,6 +54,11 @@ vector<handle_t> tail_nodes(const HandleGraph* g);
  *                 put an oriented m on the list of arbitrary places to start when S is empty
  *                     (This helps start at natural entry points to cycles)
  *     return L (a topologically sorted order and orientation)
+ *
+ * Each weakly connected component is sorted on its own, in parallel, and the
+ * components are then interleaved by ID, as if the whole graph had been sorted
+ * at once. Within a component, S, N, and the masked edges are kept in flat
+ * arrays indexed by node rank in ID order.
  */
 vector<handle_t> topological_sort(const HandleGraph* g);
 
@@ -0,0 +1,291 @@
+#include "unchop.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+namespace vg {
+namespace algorithms {
+
+using namespace std;
+
+// Node sides are numbered 2 * (node index) for the left side and 2 * (node
+// index) + 1 for the right side, where the node index is the node's position in
+// for_each_handle order.
+static const size_t NO_SIDE = numeric_limits<size_t>::max();
+
+/// Get the graph's forward handles in for_each_handle order, and a sorted
+/// table to find a node's index from its ID.
+static void index_nodes(const HandleGraph* graph, vector<handle_t>& nodes,
+                        vector<pair<id_t, size_t>>& index_of_id) {
+    nodes.reserve(graph->node_size());
+    graph->for_each_handle([&](const handle_t& handle) {
+        nodes.push_back(handle);
+    });
+    index_of_id.resize(nodes.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < nodes.size(); i++) {
+        index_of_id[i] = make_pair(graph->get_id(nodes[i]), i);
+    }
+    sort(index_of_id.begin(), index_of_id.end());
+}
+
+static size_t find_index(const vector<pair<id_t, size_t>>& index_of_id, id_t id) {
+    return lower_bound(index_of_id.begin(), index_of_id.end(), make_pair(id, (size_t) 0))->second;
+}
+
+vector<vector<handle_t>> simple_components(const HandleGraph* graph,
+                                           const function<bool(const handle_t&, const handle_t&)>& can_join,
+                                           size_t min_size) {
+
+    vector<handle_t> nodes;
+    vector<pair<id_t, size_t>> index_of_id;
+    index_nodes(graph, nodes, index_of_id);
+
+    // Find the side that each side has its only edge to, if that side has no
+    // other edges either.
+    vector<size_t> partner(nodes.size() * 2, NO_SIDE);
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t i = 0; i < nodes.size(); i++) {
+        for (size_t right = 0; right < 2; right++) {
+            // Read out of this side
+            handle_t here = right ? nodes[i] : graph->flip(nodes[i]);
+            handle_t next;
+            size_t count = 0;
+            graph->follow_edges(here, false, [&](const handle_t& other) {
+                next = other;
+                return ++count < 2;
+            });
+            if (count != 1 || graph->get_id(next) == graph->get_id(here)) {
+                continue;
+            }
+            size_t back_count = 0;
+            graph->follow_edges(next, true, [&](const handle_t& other) {
+                return ++back_count < 2;
+            });
+            if (back_count == 1) {
+                // We come in on the right side of a reverse handle
+                partner[2 * i + right] = 2 * find_index(index_of_id, graph->get_id(next)) + graph->get_is_reverse(next);
+            }
+        }
+    }
+
+    // Ask about each join once, from its lower numbered side
+    vector<uint8_t> keep(partner.size(), 1);
+    if (can_join) {
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (size_t side = 0; side < partner.size(); side++) {
+            size_t other = partner[side];
+            if (other != NO_SIDE && side < other) {
+                handle_t left = (side & 1) ? nodes[side / 2] : graph->flip(nodes[side / 2]);
+                handle_t right = (other & 1) ? graph->flip(nodes[other / 2]) : nodes[other / 2];
+                keep[side] = can_join(left, right);
+            }
+        }
+    }
+    auto joined_to = [&](size_t side) {
+        size_t other = partner[side];
+        return (other != NO_SIDE && keep[min(side, other)]) ? other : NO_SIDE;
+    };
+
+    // Every node now has at most one join on each side, so the runs can be
+    // read off directly
+    vector<vector<handle_t>> runs;
+    vector<bool> seen(nodes.size(), false);
+    vector<handle_t> left_part;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (seen[i]) {
+            continue;
+        }
+        seen[i] = true;
+
+        // Go left, reaching each node on the side that faces right in the run
+        left_part.clear();
+        for (size_t side = joined_to(2 * i); side != NO_SIDE && !seen[side / 2]; side = joined_to(side ^ 1)) {
+            seen[side / 2] = true;
+            left_part.push_back((side & 1) ? nodes[side / 2] : graph->flip(nodes[side / 2]));
+        }
+
+        if (left_part.size() + 1 < min_size && joined_to(2 * i + 1) == NO_SIDE) {
+            continue;
+        }
+
+        vector<handle_t> run(left_part.rbegin(), left_part.rend());
+        run.push_back(nodes[i]);
+
+        // Go right, reaching each node on the side that faces left in the run
+        for (size_t side = joined_to(2 * i + 1); side != NO_SIDE && !seen[side / 2]; side = joined_to(side ^ 1)) {
+            seen[side / 2] = true;
+            run.push_back((side & 1) ? graph->flip(nodes[side / 2]) : nodes[side / 2]);
+        }
+
+        if (run.size() >= min_size) {
+            runs.emplace_back(move(run));
+        }
+    }
+
+    return runs;
+}
+
+handle_t concat_nodes(MutableHandleGraph* graph, const vector<handle_t>& run) {
+
+    string sequence;
+    for (auto& handle : run) {
+        sequence += graph->get_sequence(handle);
+    }
+
+    // Collect the outside edges before anything changes
+    vector<handle_t> left_neighbors;
+    graph->follow_edges(run.front(), true, [&](const handle_t& other) {
+        left_neighbors.push_back(other);
+    });
+    vector<handle_t> right_neighbors;
+    graph->follow_edges(run.back(), false, [&](const handle_t& other) {
+        right_neighbors.push_back(other);
+    });
+
+    handle_t merged = graph->create_handle(sequence);
+
+    // Edges between the ends of the run become self loops on the new node
+    auto translate = [&](const handle_t& other) {
+        if (other == run.front() || other == run.back()) {
+            return merged;
+        } else if (other == graph->flip(run.front()) || other == graph->flip(run.back())) {
+            return graph->flip(merged);
+        }
+        return other;
+    };
+    for (auto& other : left_neighbors) {
+        graph->create_edge(translate(other), merged);
+    }
+    for (auto& other : right_neighbors) {
+        graph->create_edge(merged, translate(other));
+    }
+
+    for (auto& handle : run) {
+        graph->destroy_handle(handle);
+    }
+
+    return merged;
+}
+
+size_t unchop(MutableHandleGraph* graph) {
+    auto runs = simple_components(graph);
+
+    // Keep the runs as IDs, since merging may invalidate other handles
+    vector<vector<pair<id_t, bool>>> run_ids(runs.size());
+    for (size_t i = 0; i < runs.size(); i++) {
+        for (auto& handle : runs[i]) {
+            run_ids[i].emplace_back(graph->get_id(handle), graph->get_is_reverse(handle));
+        }
+    }
+    vector<vector<handle_t>>().swap(runs);
+
+    vector<handle_t> run;
+    for (auto& ids : run_ids) {
+        run.clear();
+        for (auto& id : ids) {
+            run.push_back(graph->get_handle(id.first, id.second));
+        }
+        concat_nodes(graph, run);
+    }
+    return run_ids.size();
+}
+
+vector<vector<handle_t>> sibling_sets(const HandleGraph* graph, bool go_left) {
+
+    vector<handle_t> nodes;
+    vector<pair<id_t, size_t>> index_of_id;
+    index_nodes(graph, nodes, index_of_id);
+
+    // Work out each handle's sorted neighbors and their hash. Handles are
+    // numbered 2 * (node index) + (1 if reverse).
+    vector<vector<handle_t>> neighbors(nodes.size() * 2);
+    vector<size_t> hashes(neighbors.size(), 0);
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t i = 0; i < neighbors.size(); i++) {
+        handle_t handle = (i & 1) ? graph->flip(nodes[i / 2]) : nodes[i / 2];
+        auto& found = neighbors[i];
+        graph->follow_edges(handle, go_left, [&](const handle_t& other) {
+            found.push_back(other);
+        });
+        sort(found.begin(), found.end(), [](const handle_t& a, const handle_t& b) {
+            return as_integer(a) < as_integer(b);
+        });
+        found.erase(unique(found.begin(), found.end()), found.end());
+        size_t hash = found.size();
+        for (auto& other : found) {
+            hash ^= wang_hash<handle_t>()(other) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+        }
+        hashes[i] = hash;
+    }
+
+    // Group the handles that have neighbors by hash, and then by the actual
+    // neighbors, in case of collisions
+    vector<size_t> order;
+    order.reserve(neighbors.size());
+    for (size_t i = 0; i < neighbors.size(); i++) {
+        if (!neighbors[i].empty()) {
+            order.push_back(i);
+        }
+    }
+    auto same_neighbors = [&](size_t a, size_t b) {
+        return hashes[a] == hashes[b] && neighbors[a] == neighbors[b];
+    };
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (hashes[a] != hashes[b]) {
+            return hashes[a] < hashes[b];
+        }
+        if (!same_neighbors(a, b)) {
+            return lexicographical_compare(neighbors[a].begin(), neighbors[a].end(),
+                                           neighbors[b].begin(), neighbors[b].end(),
+                                           [](const handle_t& x, const handle_t& y) {
+                                               return as_integer(x) < as_integer(y);
+                                           });
+        }
+        return a < b;
+    });
+
+    // Only sets reached from a forward handle count, and each node may be in
+    // only one of them
+    vector<pair<size_t, size_t>> groups;
+    vector<uint8_t> membership(nodes.size(), 0);
+    for (size_t start = 0, end; start < order.size(); start = end) {
+        bool has_forward = false;
+        for (end = start; end < order.size() && same_neighbors(order[start], order[end]); end++) {
+            has_forward |= !(order[end] & 1);
+        }
+        if (end - start > 1 && has_forward) {
+            groups.emplace_back(start, end);
+            for (size_t i = start; i < end; i++) {
+                membership[order[i] / 2]++;
+            }
+        }
+    }
+
+    vector<vector<handle_t>> sets;
+    for (auto& group : groups) {
+        bool keep = true;
+        for (size_t i = group.first; i < group.second && keep; i++) {
+            // A set with a forward handle in it has to be all forward
+            keep = membership[order[i] / 2] == 1 && !(order[i] & 1);
+        }
+        if (keep) {
+            sets.emplace_back();
+            for (size_t i = group.first; i < group.second; i++) {
+                sets.back().push_back(nodes[order[i] / 2]);
+            }
+        }
+    }
+
+    // Report the sets in node order
+    sort(sets.begin(), sets.end(), [&](const vector<handle_t>& a, const vector<handle_t>& b) {
+        return find_index(index_of_id, graph->get_id(a.front())) < find_index(index_of_id, graph->get_id(b.front()));
+    });
+
+    return sets;
+}
+
+}
+}
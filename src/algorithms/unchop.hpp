@@ -0,0 +1,53 @@
+#ifndef VG_ALGORITHMS_UNCHOP_HPP_INCLUDED
+#define VG_ALGORITHMS_UNCHOP_HPP_INCLUDED
+
+/**
+ * \file unchop.hpp
+ *
+ * Defines algorithms for finding and merging runs of nodes that can be
+ * combined without changing the sequence space of a handle graph, and for
+ * finding sets of sibling nodes that could share their common sequence.
+ */
+
+#include "../handle.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace vg {
+namespace algorithms {
+
+using namespace std;
+
+/// Find the maximal runs of min_size or more nodes that can be merged into
+/// single nodes: each node in a run is joined to the next by the only edge on
+/// either of the sides involved. If can_join is given, runs are also broken
+/// between any left and right handles where it returns false; it is called
+/// from several threads at once. Each run is oriented so that the earliest of
+/// its nodes in for_each_handle order is forward, and the runs are ordered by
+/// that node. Cyclic runs are broken just after it.
+vector<vector<handle_t>> simple_components(const HandleGraph* graph,
+                                           const function<bool(const handle_t&, const handle_t&)>& can_join = nullptr,
+                                           size_t min_size = 2);
+
+/// Replace a run of nodes, as found by simple_components, with a single node
+/// that has the run's sequence and outside edges. Returns the new node, in
+/// the run's orientation. Does not update any stored paths.
+handle_t concat_nodes(MutableHandleGraph* graph, const vector<handle_t>& run);
+
+/// Merge every run found by simple_components. Does not update any stored
+/// paths. Returns the number of runs merged.
+size_t unchop(MutableHandleGraph* graph);
+
+/// Find sets of handles that all have exactly the same, nonempty, set of
+/// neighbors on their left sides (or their right sides, if go_left is false),
+/// so the sequence they share at that end could be factored out. Only sets in
+/// which every handle has the same orientation, and in which no node is also
+/// in another set, are kept. Neighbor sets are compared through their hashes,
+/// which are computed in parallel.
+vector<vector<handle_t>> sibling_sets(const HandleGraph* graph, bool go_left = true);
+
+}
+}
+
+#endif
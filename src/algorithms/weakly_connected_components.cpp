@@ -1,53 +1,116 @@
 #include "weakly_connected_components.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
 namespace vg {
 namespace algorithms {
 
 using namespace std;
 
 vector<unordered_set<id_t>> weakly_connected_components(const HandleGraph* graph) {
-    vector<unordered_set<id_t>> to_return;
     
-    // This only holds locally forward handles
-    unordered_set<handle_t> traversed;
+    vector<handle_t> nodes;
+    vector<size_t> labels = weakly_connected_component_labels(graph, nodes);
+    
+    vector<unordered_set<id_t>> to_return;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (labels[i] == to_return.size()) {
+            // This is the first node of a new component
+            to_return.emplace_back();
+        }
+        to_return[labels[i]].insert(graph->get_id(nodes[i]));
+    }
+    return to_return;
+}
+
+vector<size_t> weakly_connected_component_labels(const HandleGraph* graph, vector<handle_t>& nodes) {
     
+    nodes.clear();
+    nodes.reserve(graph->node_size());
     graph->for_each_handle([&](const handle_t& handle) {
-        
-        // Only think about it in the forward orientation
-        auto forward = graph->forward(handle);
-        
-        if (traversed.count(forward)) {
-            // Already have this node, so don't start a search from it.
-            return;
+        nodes.push_back(handle);
+    });
+    
+    // Make a sorted table to find a node's index from its ID
+    vector<pair<id_t, size_t>> index_of_id(nodes.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < nodes.size(); i++) {
+        index_of_id[i] = make_pair(graph->get_id(nodes[i]), i);
+    }
+    std::sort(index_of_id.begin(), index_of_id.end());
+    auto find_index = [&](id_t id) {
+        return lower_bound(index_of_id.begin(), index_of_id.end(), make_pair(id, (size_t) 0))->second;
+    };
+    
+    // Each node starts in its own set. Roots are only ever linked under smaller
+    // roots, and path halving only moves nodes closer to their roots, so every
+    // node's parent is at or before it and the root of each set is its first
+    // node.
+    vector<atomic<size_t>> parent(nodes.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < nodes.size(); i++) {
+        parent[i].store(i, memory_order_relaxed);
+    }
+    
+    auto find_root = [&](size_t i) {
+        while (true) {
+            size_t up = parent[i].load(memory_order_relaxed);
+            if (up == i) {
+                return i;
+            }
+            size_t up_up = parent[up].load(memory_order_relaxed);
+            if (up_up != up) {
+                // Skip a level, unless someone has already moved us
+                parent[i].compare_exchange_weak(up, up_up, memory_order_relaxed);
+            }
+            i = up;
         }
-        
-        // The stack only holds locally forward handles
-        vector<handle_t> stack{forward};
-        to_return.emplace_back();
-        while (!stack.empty()) {
-            handle_t here = stack.back();
-            stack.pop_back();
-            
-            traversed.insert(here);
-            to_return.back().insert(graph->get_id(here));
-            
-            // We have a function to handle all connected handles
-            auto handle_other = [&](const handle_t& other) {
-                // Again, make it forward
-                auto other_forward = graph->forward(other);
-                
-                if (!traversed.count(other_forward)) {
-                    stack.push_back(other_forward);
+    };
+    
+    auto join = [&](size_t a, size_t b) {
+        while (true) {
+            a = find_root(a);
+            b = find_root(b);
+            if (a == b) {
+                return;
+            }
+            if (a < b) {
+                swap(a, b);
+            }
+            // Try to put the later root under the earlier one, and start over
+            // if another thread got to it first
+            size_t expected = a;
+            if (parent[a].compare_exchange_strong(expected, b, memory_order_relaxed)) {
+                return;
+            }
+        }
+    };
+    
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t i = 0; i < nodes.size(); i++) {
+        for (bool go_left : {false, true}) {
+            graph->follow_edges(nodes[i], go_left, [&](const handle_t& other) {
+                size_t j = find_index(graph->get_id(other));
+                // Each edge is seen from both of its ends, so take it from one
+                if (j > i) {
+                    join(i, j);
                 }
-            };
-            
-            // Look at edges in both directions
-            graph->follow_edges(here, false, handle_other);
-            graph->follow_edges(here, true, handle_other);
-            
+            });
         }
-    });
-    return to_return;
+    }
+    
+    // Roots are the first nodes of their components, so components can be
+    // numbered in one pass
+    vector<size_t> labels(nodes.size());
+    size_t components = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        size_t root = find_root(i);
+        labels[i] = (root == i) ? components++ : labels[root];
+    }
+    
+    return labels;
 }
 
 }
@@ -24,6 +24,13 @@ using namespace std;
 /// connected component is orientation-independent.
 vector<unordered_set<id_t>> weakly_connected_components(const HandleGraph* graph);
 
+/// Number the weakly connected components from 0, in order of their first
+/// nodes in for_each_handle order, and return the component of each node,
+/// indexed by the node's position in that order. The nodes' forward handles
+/// are put in nodes, in the same order. The components are found in parallel
+/// with a concurrent union-find over the edges.
+vector<size_t> weakly_connected_component_labels(const HandleGraph* graph, vector<handle_t>& nodes);
+
 
 }
 }
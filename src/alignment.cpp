@@ -1,6 +1,9 @@
 #include "alignment.hpp"
 #include "stream.hpp"
+#include "threaded_io.hpp"
 
+#include <omp.h>
+#include <cstring>
 #include <regex>
 
 namespace vg {
@@ -43,17 +46,24 @@ int hts_for_each_parallel(string& filename, function<void(Alignment&)> lambda, x
     }
 
     bool more_data = true;
-#pragma omp parallel shared(in, hdr, more_data, rg_sample)
+    // number of records read so far
+    size_t records = 0;
+#pragma omp parallel shared(in, hdr, more_data, rg_sample, records)
     {
         int tid = omp_get_thread_num();
         while (more_data) {
             bam1_t* b = bs[tid];
+            bool got_record = false;
+            size_t sequence = 0;
 #pragma omp critical (hts_input)
             if (more_data) {
                 more_data = sam_read1(in, hdr, b) >= 0;
+                got_record = more_data;
+                sequence = records++;
             }
-            if (more_data) {
+            if (got_record) {
                 Alignment a = bam_to_alignment(b, rg_sample, hdr, xgindex);
+                InputSequenceScope scope(sequence);
                 lambda(a);
             }
         }
@@ -103,49 +113,81 @@ bam_hdr_t* hts_string_header(string& header,
     return h;
 }
 
-bool get_next_alignment_from_fastq(gzFile fp, char* buffer, size_t len, Alignment& alignment) {
-
+/// Fill in an alignment from the text of one FASTQ or FASTA record, which may
+/// start with blank lines.
+static void parse_fastq_record(const char* begin, const char* end, Alignment& alignment) {
     alignment.Clear();
-    bool is_fasta = false;
-    // handle name
-    if (0!=gzgets(fp,buffer,len)) {
-        buffer[strlen(buffer)-1] = '\0';
-        string name = buffer;
-        if (name[0] == '@') {
-            is_fasta = false;
-        } else if (name[0] = '>') {
-            is_fasta = true;
-        } else {
-            throw runtime_error("Found unexpected delimiter " + name.substr(0,1) + " in fastq/fasta input");
+
+    // get the next line, without its line ending
+    auto next_line = [&](const char*& line_begin, const char*& line_end) {
+        if (begin == end) {
+            cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl; exit(1);
         }
-        name = name.substr(1, name.find(' ')); // trim off leading @ and things after the first whitespace
-        // keep trailing /1 /2
-        alignment.set_name(name);
-    } else { return false; }
-    // handle sequence
-    if (0!=gzgets(fp,buffer,len)) {
-        buffer[strlen(buffer)-1] = '\0';
-        alignment.set_sequence(buffer);
+        line_begin = begin;
+        line_end = (const char*) memchr(begin, '\n', end - begin);
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+        begin = line_end == end ? end : line_end + 1;
+        if (line_end != line_begin && *(line_end - 1) == '\r') {
+            line_end--;
+        }
+    };
+
+    const char* line_begin;
+    const char* line_end;
+    // handle name, skipping any blank lines
+    do {
+        next_line(line_begin, line_end);
+    } while (line_begin == line_end);
+    bool is_fasta;
+    if (*line_begin == '@') {
+        is_fasta = false;
+    } else if (*line_begin == '>') {
+        is_fasta = true;
     } else {
-        cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl; exit(1);
+        throw runtime_error("Found unexpected delimiter " + string(1, *line_begin) + " in fastq/fasta input");
     }
-    // handle "+" sep
+    // trim off leading @ and things after the first whitespace
+    // keep trailing /1 /2
+    const char* name_end = line_begin + 1;
+    while (name_end != line_end && *name_end != ' ' && *name_end != '\t') {
+        name_end++;
+    }
+    alignment.set_name(line_begin + 1, name_end - line_begin - 1);
+    // handle sequence
+    next_line(line_begin, line_end);
+    alignment.set_sequence(line_begin, line_end - line_begin);
     if (!is_fasta) {
-        if (0!=gzgets(fp,buffer,len)) {
-        } else {
-            cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl; exit(1);
-        }
+        // handle "+" sep
+        next_line(line_begin, line_end);
         // handle quality
-        if (0!=gzgets(fp,buffer,len)) {
-            buffer[strlen(buffer)-1] = '\0';
-            string quality = string_quality_char_to_short(buffer);
-            //cerr << string_quality_short_to_char(quality) << endl;
-            alignment.set_quality(quality);
-        } else {
-            cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl; exit(1);
-        }
+        next_line(line_begin, line_end);
+        alignment.set_quality(string_quality_char_to_short(string(line_begin, line_end)));
     }
+}
 
+bool get_next_alignment_from_fastq(gzFile fp, char* buffer, size_t len, Alignment& alignment) {
+
+    // collect the lines of the record, skipping blank lines before it
+    string record;
+    size_t lines = 0;
+    size_t record_lines = 4;
+    while (lines < record_lines && 0 != gzgets(fp, buffer, len)) {
+        if (lines == 0 && (buffer[0] == '\n' || buffer[0] == '\r')) {
+            continue;
+        }
+        if (lines == 0 && buffer[0] != '@') {
+            // fasta records are only two lines
+            record_lines = 2;
+        }
+        record += buffer;
+        lines++;
+    }
+    if (record.empty()) {
+        return false;
+    }
+    parse_fastq_record(record.data(), record.data() + record.size(), alignment);
     return true;
 
 }
@@ -158,324 +200,447 @@ bool get_next_alignment_pair_from_fastqs(gzFile fp1, gzFile fp2, char* buffer, s
     return get_next_alignment_from_fastq(fp1, buffer, len, mate1) && get_next_alignment_from_fastq(fp2, buffer, len, mate2);
 }
 
-size_t unpaired_for_each_parallel(function<bool(Alignment&)> get_read_if_available, function<void(Alignment&)> lambda) {
+void FastqBlock::get(size_t i, Alignment& alignment) const {
+    parse_fastq_record(text.data() + bounds[i], text.data() + bounds[i + 1], alignment);
+}
 
-    size_t nLines = 0;
-    vector<Alignment> *batch = nullptr;
+FastqBlockReader::FastqBlockReader(const string& filename, size_t decompression_threads, size_t chunk_bytes) :
+    chunk_bytes(max(chunk_bytes, (size_t) 1)) {
+
+    fp = (filename != "-") ? bgzf_open(filename.c_str(), "r") : bgzf_dopen(fileno(stdin), "r");
+    if (!fp) {
+        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
+    }
+    if (decompression_threads > 0 && bgzf_compression(fp) == 2) {
+        // BGZF blocks can be decompressed independently
+        bgzf_mt(fp, decompression_threads, 256);
+    }
+}
+
+FastqBlockReader::~FastqBlockReader(void) {
+    bgzf_close(fp);
+}
+
+bool FastqBlockReader::fill(void) {
+    if (at_end) {
+        return false;
+    }
+    size_t old_size = buffer.size();
+    buffer.resize(old_size + chunk_bytes);
+    ssize_t got = bgzf_read(fp, &buffer[old_size], chunk_bytes);
+    if (got < 0) {
+        cerr << "[vg::alignment.cpp] error: could not read fastq input" << endl; exit(1);
+    }
+    buffer.resize(old_size + got);
+    at_end = (got == 0);
+    return !at_end;
+}
+
+size_t FastqBlockReader::record_end(size_t start) const {
+    // fasta records are only two lines
+    size_t lines = buffer[start] == '@' ? 4 : 2;
+    for (size_t i = 0; i < lines; i++) {
+        const char* newline = (const char*) memchr(buffer.data() + start, '\n', buffer.size() - start);
+        if (newline == nullptr) {
+            return string::npos;
+        }
+        start = newline - buffer.data() + 1;
+    }
+    return start;
+}
+
+bool FastqBlockReader::read(FastqBlock& block, size_t count) {
+    block.bounds.assign(1, 0);
+
+    // only look for where the records end here; they are parsed later
+    size_t start = 0;
+    while (block.size() < count) {
+        size_t first = start;
+        while (first < buffer.size() && (buffer[first] == '\n' || buffer[first] == '\r')) {
+            first++;
+        }
+        if (first < buffer.size() && buffer[first] != '@' && buffer[first] != '>') {
+            throw runtime_error("Found unexpected delimiter " + string(1, buffer[first]) + " in fastq/fasta input");
+        }
+        size_t end = first < buffer.size() ? record_end(first) : string::npos;
+        if (end == string::npos) {
+            if (fill()) {
+                continue;
+            }
+            if (first == buffer.size()) {
+                // only blank lines were left
+                start = buffer.size();
+                break;
+            }
+            if (buffer.back() != '\n') {
+                // finish off the last line
+                buffer.push_back('\n');
+                continue;
+            }
+            cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl; exit(1);
+        }
+        start = end;
+        block.bounds.push_back(end);
+    }
+
+    // hand over the complete records and keep the rest for next time
+    block.text.swap(buffer);
+    buffer.assign(block.text, start, string::npos);
+    block.text.resize(start);
+    return block.size() > 0;
+}
+
+/// Use a few threads to decompress BGZF input when there are enough workers
+/// to outrun a single decompressor.
+static size_t fastq_decompression_threads(void) {
+    size_t threads = omp_get_max_threads();
+    return threads >= 8 ? min(threads / 8, (size_t) 4) : 0;
+}
+
+/// Run process on each batch that fill produces, in OpenMP tasks, while fill
+/// reads ahead on its own thread. Batches are processed on the calling thread
+/// until single_threaded_until_true returns true.
+template<typename Batch>
+static void for_each_batch_parallel(const function<bool(Batch&)>& fill,
+                                    const function<bool(const Batch&)>& is_empty,
+                                    const function<void(Batch&)>& process,
+                                    const function<bool(void)>& single_threaded_until_true) {
+
+    Batch* batch = nullptr;
     // number of batches currently being processed
     uint64_t batches_outstanding = 0;
-#pragma omp parallel default(none) shared(batches_outstanding, batch, nLines, get_read_if_available, lambda)
+
+#pragma omp parallel default(none) shared(batches_outstanding, batch, fill, is_empty, process, single_threaded_until_true)
 #pragma omp single
     {
-        
-        // number of reads in each batch
-        const uint64_t batch_size = 1 << 9; // 512
+
         // max # of such batches to be holding in memory
         uint64_t max_batches_outstanding = 1 << 9; // 512
         // max # we will ever increase the batch buffer to
         const uint64_t max_max_batches_outstanding = 1 << 13; // 8192
-        
-        // alignments to hold the incoming data
-        Alignment aln;
-        // did we find the end of the file yet?
-        bool more_data = true;
-        
-        while (more_data) {
-            // init a new batch
-            batch = new std::vector<Alignment>();
-            batch->reserve(batch_size);
-            
-            // load up to the batch-size number of reads
-            for (int i = 0; i < batch_size; i++) {
-                
-                more_data = get_read_if_available(aln);
-                
-                if (more_data) {
-                    batch->emplace_back(std::move(aln));
-                    nLines++;
-                }
-                else {
-                    break;
-                }
+
+        BatchReader<Batch> reader(fill, is_empty);
+
+        while (true) {
+            // get the next batch
+            batch = new Batch();
+            if (!reader.next(*batch)) {
+                delete batch;
+                break;
             }
-            
-            // did we get a batch?
-            if (batch->size()) {
-                
-                // how many batch tasks are outstanding currently, including this one?
-                uint64_t current_batches_outstanding;
+
+            // how many batch tasks are outstanding currently, including this one?
+            uint64_t current_batches_outstanding;
 #pragma omp atomic capture
-                current_batches_outstanding = ++batches_outstanding;
-                
-                if (current_batches_outstanding >= max_batches_outstanding) {
-                    // do this batch in the current thread because we've spawned the maximum number of
-                    // concurrent batch tasks
-                    for (auto& aln : *batch) {
-                        lambda(aln);
-                    }
-                    delete batch;
+            current_batches_outstanding = ++batches_outstanding;
+
+            bool do_single_threaded = !single_threaded_until_true();
+            if (current_batches_outstanding >= max_batches_outstanding || do_single_threaded) {
+                // do this batch in the current thread because we've spawned the maximum number of
+                // concurrent batch tasks or because we are directed to work in a single thread
+                process(*batch);
+                delete batch;
 #pragma omp atomic capture
-                    current_batches_outstanding = --batches_outstanding;
-                    
-                    if (4 * current_batches_outstanding / 3 < max_batches_outstanding
-                        && max_batches_outstanding < max_max_batches_outstanding) {
-                        // we went through at least 1/4 of the batch buffer while we were doing this thread's batch
-                        // this looks risky, since we want the batch buffer to stay populated the entire time we're
-                        // occupying this thread on compute, so let's increase the batch buffer size
-                        
-                        max_batches_outstanding *= 2;
-                    }
+                current_batches_outstanding = --batches_outstanding;
+
+                if (4 * current_batches_outstanding / 3 < max_batches_outstanding
+                    && max_batches_outstanding < max_max_batches_outstanding
+                    && !do_single_threaded) {
+                    // we went through at least 1/4 of the batch buffer while we were doing this thread's batch
+                    // this looks risky, since we want the batch buffer to stay populated the entire time we're
+                    // occupying this thread on compute, so let's increase the batch buffer size
+                    // (skip this adjustment if you're in single-threaded mode and thus expect the buffer to be
+                    // empty)
+
+                    max_batches_outstanding *= 2;
                 }
-                else {
-                    // spawn a new task to take care of this batch
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda)
-                    {
-                        for (auto& aln : *batch) {
-                            lambda(aln);
-                        }
-                        delete batch;
+            }
+            else {
+                // spawn a new task to take care of this batch
+#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, process)
+                {
+                    process(*batch);
+                    delete batch;
 #pragma omp atomic update
-                        batches_outstanding--;
-                    }
+                    batches_outstanding--;
                 }
             }
         }
+
+        // let the tasks finish before the reader goes away
+#pragma omp taskwait
     }
+}
+
+// number of reads or pairs in each batch
+static const size_t READ_BATCH_SIZE = 1 << 9; // 512
+
+size_t unpaired_for_each_parallel(function<bool(Alignment&)> get_read_if_available, function<void(Alignment&)> lambda) {
+
+    size_t nLines = 0;
+    // a batch of reads, with the input sequence number of its first read
+    typedef pair<size_t, vector<Alignment>> read_batch_t;
+
+    // parse the input on its own thread, so that it keeps going while this
+    // thread is busy with a batch
+    function<bool(read_batch_t&)> fill = [&](read_batch_t& b) {
+        b.first = nLines;
+        b.second.reserve(READ_BATCH_SIZE);
+        Alignment aln;
+        while (b.second.size() < READ_BATCH_SIZE) {
+            if (!get_read_if_available(aln)) {
+                return false;
+            }
+            b.second.emplace_back(std::move(aln));
+            nLines++;
+        }
+        return true;
+    };
+    function<bool(const read_batch_t&)> is_empty = [](const read_batch_t& b) {
+        return b.second.empty();
+    };
+
+    // run the lambda on each read in a batch, with its sequence number set
+    function<void(read_batch_t&)> process = [&lambda](read_batch_t& b) {
+        for (size_t i = 0; i < b.second.size(); i++) {
+            InputSequenceScope sequence(b.first + i);
+            lambda(b.second[i]);
+        }
+    };
+
+    for_each_batch_parallel<read_batch_t>(fill, is_empty, process, [](void) {return true;});
     return nLines;
 }
 
 size_t paired_for_each_parallel_after_wait(function<bool(Alignment&, Alignment&)> get_pair_if_available,
                                            function<void(Alignment&, Alignment&)> lambda,
                                            function<bool(void)> single_threaded_until_true) {
-    
-    
+
+
     size_t nLines = 0;
-    vector<pair<Alignment, Alignment> > *batch = nullptr;
-    // number of batches currently being processed
-    uint64_t batches_outstanding = 0;
-    
-#pragma omp parallel default(none) shared(batches_outstanding, batch, nLines, get_pair_if_available, single_threaded_until_true, lambda)
-#pragma omp single
-    {
-        
-        // number of pairs in each batch
-        const uint64_t batch_size = 1 << 9; // 512
-        // max # of such batches to be holding in memory
-        uint64_t max_batches_outstanding = 1 << 9; // 512
-        // max # we will ever increase the batch buffer to
-        const uint64_t max_max_batches_outstanding = 1 << 13; // 8192
-        
-        // alignments to hold the incoming data
+    // a batch of pairs, with the input sequence number of its first pair
+    typedef pair<size_t, vector<pair<Alignment, Alignment>>> pair_batch_t;
+
+    // parse the input on its own thread, so that it keeps going while this
+    // thread is busy with a batch
+    function<bool(pair_batch_t&)> fill = [&](pair_batch_t& b) {
+        b.first = nLines;
+        b.second.reserve(READ_BATCH_SIZE);
         Alignment mate1, mate2;
-        // did we find the end of the file yet?
-        bool more_data = true;
-        
-        while (more_data) {
-            // init a new batch
-            batch = new std::vector<pair<Alignment, Alignment>>();
-            batch->reserve(batch_size);
-            
-            // load up to the batch-size number of pairs
-            for (int i = 0; i < batch_size; i++) {
-                
-                more_data = get_pair_if_available(mate1, mate2);
-                
-                if (more_data) {
-                    batch->emplace_back(std::move(mate1), std::move(mate2));
-                    nLines++;
-                }
-                else {
-                    break;
-                }
-            }
-            
-            // did we get a batch?
-            if (batch->size()) {
-                // how many batch tasks are outstanding currently, including this one?
-                uint64_t current_batches_outstanding;
-#pragma omp atomic capture
-                current_batches_outstanding = ++batches_outstanding;
-                
-                bool do_single_threaded = !single_threaded_until_true();
-                if (current_batches_outstanding >= max_batches_outstanding || do_single_threaded) {
-                    // do this batch in the current thread because we've spawned the maximum number of
-                    // concurrent batch tasks or because we are directed to work in a single thread
-                    for (auto& p : *batch) {
-                        lambda(p.first, p.second);
-                    }
-                    delete batch;
-#pragma omp atomic capture
-                    current_batches_outstanding = --batches_outstanding;
-                    
-                    if (4 * current_batches_outstanding / 3 < max_batches_outstanding
-                        && max_batches_outstanding < max_max_batches_outstanding
-                        && !do_single_threaded) {
-                        // we went through at least 1/4 of the batch buffer while we were doing this thread's batch
-                        // this looks risky, since we want the batch buffer to stay populated the entire time we're
-                        // occupying this thread on compute, so let's increase the batch buffer size
-                        // (skip this adjustment if you're in single-threaded mode and thus expect the buffer to be
-                        // empty)
-                        
-                        max_batches_outstanding *= 2;
-                    }
-                }
-                else {
-                    // spawn a new task to take care of this batch
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda)
-                    {
-                        for (auto& p : *batch) {
-                            lambda(p.first, p.second);
-                        }
-                        delete batch;
-#pragma omp atomic update
-                        batches_outstanding--;
-                    }
-                }
+        while (b.second.size() < READ_BATCH_SIZE) {
+            if (!get_pair_if_available(mate1, mate2)) {
+                return false;
             }
+            b.second.emplace_back(std::move(mate1), std::move(mate2));
+            nLines++;
         }
-    }
-    
+        return true;
+    };
+    function<bool(const pair_batch_t&)> is_empty = [](const pair_batch_t& b) {
+        return b.second.empty();
+    };
+
+    // run the lambda on each pair in a batch, with its sequence number set
+    function<void(pair_batch_t&)> process = [&lambda](pair_batch_t& b) {
+        for (size_t i = 0; i < b.second.size(); i++) {
+            InputSequenceScope sequence(b.first + i);
+            lambda(b.second[i].first, b.second[i].second);
+        }
+    };
+
+    for_each_batch_parallel<pair_batch_t>(fill, is_empty, process, single_threaded_until_true);
     return nLines;
 }
 
 size_t fastq_unpaired_for_each_parallel(const string& filename, function<void(Alignment&)> lambda) {
-    
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
-    }
-    
-    size_t len = 2 << 22; // 4M
-    char* buf = new char[len];
-    
-    function<bool(Alignment&)> get_read = [&](Alignment& aln) {
-        return get_next_alignment_from_fastq(fp, buf, len, aln);;
+
+    FastqBlockReader reader(filename, fastq_decompression_threads());
+
+    size_t nLines = 0;
+    // a block of reads, with the input sequence number of its first read
+    typedef pair<size_t, FastqBlock> read_batch_t;
+
+    // the reader thread only finds where the records are; the workers parse them
+    function<bool(read_batch_t&)> fill = [&](read_batch_t& b) {
+        b.first = nLines;
+        reader.read(b.second, READ_BATCH_SIZE);
+        nLines += b.second.size();
+        return b.second.size() == READ_BATCH_SIZE;
     };
-    
-    
-    size_t nLines = unpaired_for_each_parallel(get_read, lambda);
-    
-    delete[] buf;
-    gzclose(fp);
+    function<bool(const read_batch_t&)> is_empty = [](const read_batch_t& b) {
+        return b.second.size() == 0;
+    };
+    function<void(read_batch_t&)> process = [&lambda](read_batch_t& b) {
+        Alignment aln;
+        for (size_t i = 0; i < b.second.size(); i++) {
+            b.second.get(i, aln);
+            InputSequenceScope sequence(b.first + i);
+            lambda(aln);
+        }
+    };
+
+    for_each_batch_parallel<read_batch_t>(fill, is_empty, process, [](void) {return true;});
     return nLines;
-    
+
 }
 
 size_t fastq_paired_interleaved_for_each_parallel(const string& filename, function<void(Alignment&, Alignment&)> lambda) {
     return fastq_paired_interleaved_for_each_parallel_after_wait(filename, lambda, [](void) {return true;});
 }
-    
+
 size_t fastq_paired_two_files_for_each_parallel(const string& file1, const string& file2, function<void(Alignment&, Alignment&)> lambda) {
     return fastq_paired_two_files_for_each_parallel_after_wait(file1, file2, lambda, [](void) {return true;});
 }
-    
+
 size_t fastq_paired_interleaved_for_each_parallel_after_wait(const string& filename,
                                                              function<void(Alignment&, Alignment&)> lambda,
                                                              function<bool(void)> single_threaded_until_true) {
-    
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
-    }
-    
-    size_t len = 1 << 18; // 256k
-    char* buf = new char[len];
-    
-    function<bool(Alignment&, Alignment&)> get_pair = [&](Alignment& mate1, Alignment& mate2) {
-        return get_next_interleaved_alignment_pair_from_fastq(fp, buf, len, mate1, mate2);
+
+    FastqBlockReader reader(filename, fastq_decompression_threads());
+
+    size_t nLines = 0;
+    // a block of pairs, with the input sequence number of its first pair
+    typedef pair<size_t, FastqBlock> pair_batch_t;
+
+    function<bool(pair_batch_t&)> fill = [&](pair_batch_t& b) {
+        b.first = nLines;
+        reader.read(b.second, 2 * READ_BATCH_SIZE);
+        nLines += b.second.size() / 2;
+        return b.second.size() == 2 * READ_BATCH_SIZE;
     };
-    
-    size_t nLines = paired_for_each_parallel_after_wait(get_pair, lambda, single_threaded_until_true);
-    
-    delete[] buf;
-    gzclose(fp);
+    function<bool(const pair_batch_t&)> is_empty = [](const pair_batch_t& b) {
+        return b.second.size() < 2;
+    };
+    function<void(pair_batch_t&)> process = [&lambda](pair_batch_t& b) {
+        Alignment mate1, mate2;
+        // an unpaired read at the end is dropped
+        for (size_t i = 0; i + 1 < b.second.size(); i += 2) {
+            b.second.get(i, mate1);
+            b.second.get(i + 1, mate2);
+            InputSequenceScope sequence(b.first + i / 2);
+            lambda(mate1, mate2);
+        }
+    };
+
+    for_each_batch_parallel<pair_batch_t>(fill, is_empty, process, single_threaded_until_true);
     return nLines;
 }
-    
+
 size_t fastq_paired_two_files_for_each_parallel_after_wait(const string& file1, const string& file2,
                                                            function<void(Alignment&, Alignment&)> lambda,
                                                            function<bool(void)> single_threaded_until_true) {
-    
-    gzFile fp1 = (file1 != "-") ? gzopen(file1.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp1) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file1 << endl; exit(1);
-    }
-    gzFile fp2 = (file2 != "-") ? gzopen(file2.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp2) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file2 << endl; exit(1);
-    }
-    
-    size_t len = 1 << 18; // 256k
-    char* buf = new char[len];
-    
-    function<bool(Alignment&, Alignment&)> get_pair = [&](Alignment& mate1, Alignment& mate2) {
-        return get_next_alignment_pair_from_fastqs(fp1, fp2, buf, len, mate1, mate2);
+
+    FastqBlockReader reader1(file1, fastq_decompression_threads());
+    FastqBlockReader reader2(file2, fastq_decompression_threads());
+
+    size_t nLines = 0;
+    // blocks of first and second mates, with the input sequence number of the first pair
+    struct pair_batch_t {
+        size_t first;
+        FastqBlock mates1;
+        FastqBlock mates2;
     };
-    
-    size_t nLines = paired_for_each_parallel_after_wait(get_pair, lambda, single_threaded_until_true);
-    
-    delete[] buf;
-    gzclose(fp1);
-    gzclose(fp2);
+
+    function<bool(pair_batch_t&)> fill = [&](pair_batch_t& b) {
+        b.first = nLines;
+        reader1.read(b.mates1, READ_BATCH_SIZE);
+        reader2.read(b.mates2, READ_BATCH_SIZE);
+        nLines += min(b.mates1.size(), b.mates2.size());
+        return b.mates1.size() == READ_BATCH_SIZE && b.mates2.size() == READ_BATCH_SIZE;
+    };
+    function<bool(const pair_batch_t&)> is_empty = [](const pair_batch_t& b) {
+        return b.mates1.size() == 0 || b.mates2.size() == 0;
+    };
+    function<void(pair_batch_t&)> process = [&lambda](pair_batch_t& b) {
+        Alignment mate1, mate2;
+        // reads past the end of the shorter file are dropped
+        for (size_t i = 0; i < b.mates1.size() && i < b.mates2.size(); i++) {
+            b.mates1.get(i, mate1);
+            b.mates2.get(i, mate2);
+            InputSequenceScope sequence(b.first + i);
+            lambda(mate1, mate2);
+        }
+    };
+
+    for_each_batch_parallel<pair_batch_t>(fill, is_empty, process, single_threaded_until_true);
     return nLines;
 }
 
 size_t fastq_unpaired_for_each(const string& filename, function<void(Alignment&)> lambda) {
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
-    }
-    size_t len = 2 << 22; // 4M
+    FastqBlockReader reader(filename);
+
+    // decompress and split up the input on its own thread, and parse here
+    function<bool(FastqBlock&)> fill = [&](FastqBlock& block) {
+        return reader.read(block, READ_BATCH_SIZE);
+    };
+    function<bool(const FastqBlock&)> is_empty = [](const FastqBlock& block) {
+        return block.size() == 0;
+    };
+    BatchReader<FastqBlock> batches(fill, is_empty);
+
     size_t nLines = 0;
-    char *buffer = new char[len];
+    FastqBlock block;
     Alignment alignment;
-    while(get_next_alignment_from_fastq(fp, buffer, len, alignment)) {
-        lambda(alignment);
-        nLines++;
+    while (batches.next(block)) {
+        for (size_t i = 0; i < block.size(); i++) {
+            block.get(i, alignment);
+            lambda(alignment);
+            nLines++;
+        }
     }
-    gzclose(fp);
-    delete[] buffer;
     return nLines;
 }
 
 size_t fastq_paired_interleaved_for_each(const string& filename, function<void(Alignment&, Alignment&)> lambda) {
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
-    }
-    size_t len = 2 << 18; // 256k
+    FastqBlockReader reader(filename);
+
+    function<bool(FastqBlock&)> fill = [&](FastqBlock& block) {
+        return reader.read(block, 2 * READ_BATCH_SIZE);
+    };
+    function<bool(const FastqBlock&)> is_empty = [](const FastqBlock& block) {
+        return block.size() < 2;
+    };
+    BatchReader<FastqBlock> batches(fill, is_empty);
+
     size_t nLines = 0;
-    char *buffer = new char[len];
+    FastqBlock block;
     Alignment mate1, mate2;
-    while(get_next_interleaved_alignment_pair_from_fastq(fp, buffer, len, mate1, mate2)) {
-        lambda(mate1, mate2);
-        nLines++;
+    while (batches.next(block)) {
+        for (size_t i = 0; i + 1 < block.size(); i += 2) {
+            block.get(i, mate1);
+            block.get(i + 1, mate2);
+            lambda(mate1, mate2);
+            nLines++;
+        }
     }
-    gzclose(fp);
-    delete[] buffer;
     return nLines;
 }
 
 size_t fastq_paired_two_files_for_each(const string& file1, const string& file2, function<void(Alignment&, Alignment&)> lambda) {
-    gzFile fp1 = (file1 != "-") ? gzopen(file1.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp1) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file1 << endl; exit(1);
-    }
-    gzFile fp2 = (file2 != "-") ? gzopen(file2.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp2) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file2 << endl; exit(1);
-    }
-    size_t len = 2 << 18; // 256k
+    FastqBlockReader reader1(file1);
+    FastqBlockReader reader2(file2);
+
+    function<bool(pair<FastqBlock, FastqBlock>&)> fill = [&](pair<FastqBlock, FastqBlock>& blocks) {
+        bool more1 = reader1.read(blocks.first, READ_BATCH_SIZE);
+        bool more2 = reader2.read(blocks.second, READ_BATCH_SIZE);
+        return more1 && more2;
+    };
+    function<bool(const pair<FastqBlock, FastqBlock>&)> is_empty = [](const pair<FastqBlock, FastqBlock>& blocks) {
+        return blocks.first.size() == 0 || blocks.second.size() == 0;
+    };
+    BatchReader<pair<FastqBlock, FastqBlock>> batches(fill, is_empty);
+
     size_t nLines = 0;
-    char *buffer = new char[len];
+    pair<FastqBlock, FastqBlock> blocks;
     Alignment mate1, mate2;
-    while(get_next_alignment_pair_from_fastqs(fp1, fp2, buffer, len, mate1, mate2)) {
-        lambda(mate1, mate2);
-        nLines++;
+    while (batches.next(blocks)) {
+        for (size_t i = 0; i < blocks.first.size() && i < blocks.second.size(); i++) {
+            blocks.first.get(i, mate1);
+            blocks.second.get(i, mate2);
+            lambda(mate1, mate2);
+            nLines++;
+        }
     }
-    gzclose(fp1);
-    gzclose(fp2);
-    delete[] buffer;
     return nLines;
 
 }
@@ -10,6 +10,7 @@
 #include "vg.pb.h"
 #include "xg.hpp"
 #include "edit.hpp"
+#include "htslib/bgzf.h"
 #include "htslib/hfile.h"
 #include "htslib/hts.h"
 #include "htslib/sam.h"
@@ -28,10 +29,70 @@ bool get_next_alignment_from_fastq(gzFile fp, char* buffer, size_t len, Alignmen
 bool get_next_interleaved_alignment_pair_from_fastq(gzFile fp, char* buffer, size_t len, Alignment& mate1, Alignment& mate2);
 bool get_next_alignment_pair_from_fastqs(gzFile fp1, gzFile fp2, char* buffer, size_t len, Alignment& mate1, Alignment& mate2);
 
+/**
+ * A run of whole FASTQ (or FASTA) records, kept as text, so that building the
+ * Alignments can be left to whichever thread gets the block.
+ */
+struct FastqBlock {
+    /// The records, one after the other
+    string text;
+    /// Where each record starts in the text, and where the last one ends
+    vector<size_t> bounds;
+    /// Get the number of records
+    inline size_t size(void) const {
+        return bounds.empty() ? 0 : bounds.size() - 1;
+    }
+    /// Parse the record with the given index
+    void get(size_t i, Alignment& alignment) const;
+};
+
+/**
+ * Reads FASTQ (or FASTA) input in large chunks and splits it into blocks of
+ * whole records, without parsing them. Plain, gzipped and BGZF input are all
+ * read; BGZF input can be decompressed on several threads of its own.
+ */
+class FastqBlockReader {
+public:
+    /// Open the given file, or "-" for standard input.
+    FastqBlockReader(const string& filename, size_t decompression_threads = 0,
+                     size_t chunk_bytes = 1 << 20);
+    ~FastqBlockReader(void);
+
+    FastqBlockReader(const FastqBlockReader& other) = delete;
+    FastqBlockReader& operator=(const FastqBlockReader& other) = delete;
+
+    /// Fill the block with up to count records. Returns false if there were
+    /// none left.
+    bool read(FastqBlock& block, size_t count);
+
+private:
+    /// Read another chunk onto the buffer. Returns false at the end of the input.
+    bool fill(void);
+    /// Find where the record starting at the given buffer position ends, or
+    /// string::npos if it is not all in the buffer.
+    size_t record_end(size_t start) const;
+
+    BGZF* fp;
+    size_t chunk_bytes;
+    /// Input read but not yet handed out
+    string buffer;
+    bool at_end = false;
+};
+
 size_t fastq_unpaired_for_each(const string& filename, function<void(Alignment&)> lambda);
 size_t fastq_paired_interleaved_for_each(const string& filename, function<void(Alignment&, Alignment&)> lambda);
 size_t fastq_paired_two_files_for_each(const string& file1, const string& file2, function<void(Alignment&, Alignment&)> lambda);
 // parallel versions of above
+// reads are fetched on their own thread and handed out in batches; while the lambda
+// runs, current_input_sequence() (threaded_io.hpp) is the read's or pair's index in the input
+// the fastq_ versions only split the input into records on that thread, and parse them on the workers
+size_t unpaired_for_each_parallel(function<bool(Alignment&)> get_read_if_available,
+                                  function<void(Alignment&)> lambda);
+
+size_t paired_for_each_parallel_after_wait(function<bool(Alignment&, Alignment&)> get_pair_if_available,
+                                           function<void(Alignment&, Alignment&)> lambda,
+                                           function<bool(void)> single_threaded_until_true);
+
 size_t fastq_unpaired_for_each_parallel(const string& filename,
                                         function<void(Alignment&)> lambda);
     
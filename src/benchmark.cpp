@@ -5,6 +5,7 @@
 #include <numeric>
 #include <cmath>
 #include <iomanip>
+#include <sstream>
 
 /**
  * \file benchmark.hpp: implementations of benchmarking functions
@@ -42,6 +43,28 @@ double BenchmarkResult::score_error() const {
     return err * 1000;
 }
 
+string BenchmarkResult::to_json() const {
+    using frac_secs = chrono::duration<double, std::micro>;
+    
+    stringstream out;
+    out << "{\"name\": \"";
+    for (char c : name) {
+        // Names are our own, but keep the JSON valid whatever they are
+        if (c == '"' || c == '\\') {
+            out << '\\';
+        }
+        out << c;
+    }
+    out << "\", \"runs\": " << runs
+        << ", \"test_mean_us\": " << chrono::duration_cast<frac_secs>(test_mean).count()
+        << ", \"test_stddev_us\": " << chrono::duration_cast<frac_secs>(test_stddev).count()
+        << ", \"control_mean_us\": " << chrono::duration_cast<frac_secs>(control_mean).count()
+        << ", \"control_stddev_us\": " << chrono::duration_cast<frac_secs>(control_stddev).count()
+        << ", \"score\": " << score()
+        << ", \"score_error\": " << score_error() << "}";
+    return out.str();
+}
+
 ostream& operator<<(ostream& out, const BenchmarkResult& result) {
     // Dump it as a partial TSV line
     
@@ -40,6 +40,8 @@ struct BenchmarkResult {
     double score() const;
     /// What is the uncertainty on the score?
     double score_error() const;
+    /// Describe the result as a JSON object, with times in microseconds.
+    string to_json() const;
 };
 
 /**
@@ -17,11 +17,11 @@ using namespace std;
 // Cactus
 
 
-// Step 1) Get undirected adjacency connected components of VG *sides*
+// Step 1) Get undirected adjacency connected components of graph *sides*
 // (note we can't put NodeSides in header, so leave this function static)
 typedef set<NodeSide> SideSet;
 typedef map<NodeSide, int> Side2Component;
-static void compute_side_components(VG& graph, 
+static void compute_side_components(const HandleGraph& graph, 
                                     vector<SideSet>& components,
                                     Side2Component& side_to_component) {
 
@@ -48,21 +48,96 @@ static void compute_side_components(VG& graph,
             q.pop();
             if (side_to_component.find(cur_side) == side_to_component.end()) {
                 update_component(cur_side, cur_side == side ? -1 : components.size() - 1);
-                // visit all adjacent sides
-                set<NodeSide> adj_sides = graph.sides_of(cur_side);
-                for (auto adj_side : adj_sides) {
-                    q.push(adj_side);
-                }
+                // visit all adjacent sides, by reading out of this one
+                graph.follow_edges(graph.get_handle(cur_side.node, !cur_side.is_end), false, [&](const handle_t& next) {
+                    // We come in on the start of a forward node or the end of a reverse one
+                    q.push(NodeSide(graph.get_id(next), graph.get_is_reverse(next)));
+                });
             }
         }
     };
 
-    graph.for_each_node([&](Node* n) {
-            add_node_side(NodeSide(n->id(), false));
-            add_node_side(NodeSide(n->id(), true));
+    graph.for_each_handle([&](const handle_t& handle) {
+            add_node_side(NodeSide(graph.get_id(handle), false));
+            add_node_side(NodeSide(graph.get_id(handle), true));
         });
 }
 
+/// Find the strongly connected components of the graph, as sets of node IDs,
+/// using an iterative Tarjan's algorithm over oriented handles. Both
+/// orientations of a node that are not in a cycle together yield separate
+/// components, which are deduplicated like in VG::strongly_connected_components.
+static set<set<id_t>> strongly_connected_components(const HandleGraph& graph) {
+
+    // When each handle was discovered, and the earliest discovery it can reach
+    unordered_map<handle_t, size_t> discover_idx;
+    unordered_map<handle_t, size_t> low_idx;
+    // Handles waiting to be assigned to components
+    vector<handle_t> stack;
+    unordered_set<handle_t> on_stack;
+    // The DFS frames, each with the successors left to explore
+    vector<pair<handle_t, vector<handle_t>>> frames;
+    
+    set<set<id_t>> components;
+    
+    auto discover = [&](const handle_t& handle) {
+        size_t index = discover_idx.size();
+        discover_idx[handle] = index;
+        low_idx[handle] = index;
+        stack.push_back(handle);
+        on_stack.insert(handle);
+        frames.emplace_back(handle, vector<handle_t>());
+        graph.follow_edges(handle, false, [&](const handle_t& next) {
+            frames.back().second.push_back(next);
+        });
+    };
+    
+    graph.for_each_handle([&](const handle_t& node) {
+        for (handle_t root : {node, graph.flip(node)}) {
+            if (discover_idx.count(root)) {
+                continue;
+            }
+            discover(root);
+            while (!frames.empty()) {
+                if (!frames.back().second.empty()) {
+                    // Go on to the next successor
+                    handle_t here = frames.back().first;
+                    handle_t next = frames.back().second.back();
+                    frames.back().second.pop_back();
+                    if (!discover_idx.count(next)) {
+                        discover(next);
+                    } else if (on_stack.count(next)) {
+                        low_idx[here] = min(low_idx[here], discover_idx[next]);
+                    }
+                    continue;
+                }
+                
+                // We are done with this handle
+                handle_t here = frames.back().first;
+                frames.pop_back();
+                if (!frames.empty()) {
+                    auto& parent_low = low_idx[frames.back().first];
+                    parent_low = min(parent_low, low_idx[here]);
+                }
+                if (low_idx[here] == discover_idx[here]) {
+                    // Everything above us on the stack is in our component
+                    set<id_t> component;
+                    handle_t other;
+                    do {
+                        other = stack.back();
+                        stack.pop_back();
+                        on_stack.erase(other);
+                        component.insert(graph.get_id(other));
+                    } while (other != here);
+                    components.insert(component);
+                }
+            }
+        }
+    });
+    
+    return components;
+}
+
 void* mergeNodeObjects(void* a, void* b) {
     // One of the objects is going to get returned, and the other one is going
     // to get freed (since the graph is supposed to own them all).
@@ -179,7 +254,8 @@ void addArbitraryTelomerePair(vector<stCactusEdgeEnd*> ends, stList *telomeres)
 // Step 2) Make a Cactus Graph. Returns the graph and a list of paired
 // cactusEdgeEnd telomeres, one after the other. Both members of the return
 // value must be destroyed.
-pair<stCactusGraph*, stList*> vg_to_cactus(VG& graph, const unordered_set<string>& hint_paths) {
+pair<stCactusGraph*, stList*> handle_graph_to_cactus(const HandleGraph& graph, const for_each_path_t& for_each_path,
+                                                     const unordered_set<string>& hint_paths) {
 
     // in a cactus graph, every node is an adjacency component.
     // every edge is a *vg* node connecting the component
@@ -296,53 +372,52 @@ pair<stCactusGraph*, stList*> vg_to_cactus(VG& graph, const unordered_set<string
     
     // Assign path names to components
     vector<vector<string>> component_paths(weak_components.size());
-    // Also get the path length.
+    // Also get the path length, and the inward-facing handles at its ends. We
+    // don't keep the whole path.
     unordered_map<string, size_t> path_length;
+    unordered_map<string, pair<handle_t, handle_t>> path_ends;
     
-    graph.paths.for_each_name([&](const std::string& name) {
-        // For every path
-        auto& path_mappings = graph.paths.get_path(name);
-        
-        if (path_mappings.empty()) {
-            // Not a real useful path, so skip it. Some alt paths used for
-            // haplotype generation are empty.
-            return;
-        }
-        
-        // Save the path under the component
-        auto component = node_to_component[path_mappings.front().node_id()];
-        component_paths[component].push_back(name);
-        
+    if (for_each_path) {
+        for_each_path([&](const string& name, const vector<handle_t>& steps) {
+            // For every path
+            
+            if (steps.empty()) {
+                // Not a real useful path, so skip it. Some alt paths used for
+                // haplotype generation are empty.
+                return;
+            }
+            
+            // Save the path under the component
+            auto component = node_to_component[graph.get_id(steps.front())];
+            component_paths[component].push_back(name);
+            path_ends[name] = make_pair(steps.front(), graph.flip(steps.back()));
+            
 #ifdef debug
-        cerr << "Path " << name << " belongs to component " << component << endl;
+            cerr << "Path " << name << " belongs to component " << component << endl;
 #endif
-        
-        for (auto& mapping : graph.paths.get_path(name)) {
-            // Total up the length. We could use from length on the mapping, but
-            // sometimes (like in the tests) the mapping edits haven't been
-            // populated.
-            path_length[name] += graph.get_length(graph.get_handle(mapping.node_id(), false));
             
-            if (node_to_component[mapping.node_id()] != component) {
-                // If we use a path like this to pick telomeres we will segfault Cactus.
-                throw runtime_error("Path " + name + " spans multiple connected components!");
+            for (auto& step : steps) {
+                // Total up the length. We could use from length on the mapping, but
+                // sometimes (like in the tests) the mapping edits haven't been
+                // populated.
+                path_length[name] += graph.get_length(step);
+                
+                if (node_to_component[graph.get_id(step)] != component) {
+                    // If we use a path like this to pick telomeres we will segfault Cactus.
+                    throw runtime_error("Path " + name + " spans multiple connected components!");
+                }
             }
-        }
-        
+            
 #ifdef debug
-        cerr << "\tPath " << name << " has length " << path_length[name] << endl;
+            cerr << "\tPath " << name << " has length " << path_length[name] << endl;
 #endif
-    });
+        });
+    }
     
     // We'll also need the strongly connected components, in case the graph is cyclic.
     // This holds all the strongly connected components that live in each weakly connected component.
-    vector<vector<set<id_t>>> component_strong_components(weak_components.size());
-    for (auto& strong_component : graph.strongly_connected_components()) {
-        // For each strongly connected component
-        assert(!strong_component.empty());
-        // Assign it to the weak comnponent that some node in it belongs to
-        component_strong_components[node_to_component[*strong_component.begin()]].push_back(strong_component);
-    }
+    // We only find them if some component has no tips to use.
+    vector<vector<set<id_t>>> component_strong_components;
     
     
     // OK, now we need to fill in the telomeres list with two telomeres per
@@ -390,18 +465,10 @@ pair<stCactusGraph*, stList*> vg_to_cactus(VG& graph, const unordered_set<string
                         continue;
                     }
                     
-                    auto& path_mappings = graph.paths.get_path(path_name);
-                    
-#ifdef debug
-                    cerr << "\tPath " << path_name << " has " << path_mappings.size() << " mappings" << endl;
-#endif
-                    
                     // See if I can get two tips on its ends.
                     // Get the inward-facing start and end handles.
-                    handle_t path_start = graph.get_handle(path_mappings.front().node_id(),
-                        path_mappings.front().is_reverse());
-                    handle_t path_end = graph.get_handle(path_mappings.back().node_id(),
-                        !path_mappings.back().is_reverse());
+                    handle_t path_start = path_ends.at(path_name).first;
+                    handle_t path_end = path_ends.at(path_name).second;
                     
                     if (component_tips[i].count(path_start) && component_tips[i].count(path_end)) {
                         // This path ends in two tips so we can consider it
@@ -744,6 +811,16 @@ pair<stCactusGraph*, stList*> vg_to_cactus(VG& graph, const unordered_set<string
         // the outward-facing ends of the node.
         
         {
+            if (component_strong_components.empty()) {
+                component_strong_components.resize(weak_components.size());
+                for (auto& strong_component : strongly_connected_components(graph)) {
+                    // For each strongly connected component
+                    assert(!strong_component.empty());
+                    // Assign it to the weak comnponent that some node in it belongs to
+                    component_strong_components[node_to_component[*strong_component.begin()]].push_back(strong_component);
+                }
+            }
+        
             // What strongly connected components do we have?
             auto& strong_components = component_strong_components[i];
             
@@ -812,6 +889,23 @@ pair<stCactusGraph*, stList*> vg_to_cactus(VG& graph, const unordered_set<string
     return make_pair(cactus_graph, telomeres);
 }
 
+pair<stCactusGraph*, stList*> vg_to_cactus(VG& graph, const unordered_set<string>& hint_paths) {
+    return handle_graph_to_cactus(graph, for_each_vg_path(graph), hint_paths);
+}
+
+for_each_path_t for_each_vg_path(VG& graph) {
+    return [&graph](const path_iteratee_t& iteratee) {
+        vector<handle_t> steps;
+        graph.paths.for_each_name([&](const string& name) {
+            steps.clear();
+            for (auto& mapping : graph.paths.get_path(name)) {
+                steps.push_back(graph.get_handle(mapping.node_id(), mapping.is_reverse()));
+            }
+            iteratee(name, steps);
+        });
+    };
+}
+
 VG cactus_to_vg(stCactusGraph* cactus_graph) {
     VG vg_graph;
     unordered_map<stCactusNode*, Node*> node_map;
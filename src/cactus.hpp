@@ -8,6 +8,7 @@
 
 #include <vector>
 #include <map>
+#include <functional>
 
 #include "types.hpp"
 #include "utility.hpp"
@@ -29,13 +30,28 @@ struct CactusSide {
     bool is_end;
 };
 
-// Convert VG to Cactus Graph. Takes a list of path names to use to find
-// telomeres if present in a connected component.
+// Takes the name of a path and the handles it visits, in order.
+using path_iteratee_t = function<void(const string&, const vector<handle_t>&)>;
+// Calls its argument on each path that can be used to pick telomeres.
+using for_each_path_t = function<void(const path_iteratee_t&)>;
+
+// Convert a HandleGraph to Cactus Graph. Paths, which may be omitted, are used
+// to find telomeres, preferring the named hint paths, if present in a
+// connected component.
 // Notes:
 //  - returned cactus graph needs to be freed by stCactusGraph_destruct
 //  - returns a Cactus graph, and a list of stCactusEdgeEnd* telomeres, in pairs of adjacent items.
+pair<stCactusGraph*, stList*> handle_graph_to_cactus(const HandleGraph& graph, const for_each_path_t& for_each_path,
+                                                     const unordered_set<string>& hint_paths);
+
+// Convert VG to Cactus Graph, using its embedded paths. Takes a list of path
+// names to use to find telomeres if present in a connected component.
 pair<stCactusGraph*, stList*> vg_to_cactus(VG& graph, const unordered_set<string>& hint_paths);
 
+// Get a for_each_path_t that visits the paths embedded in a VG, which must
+// outlive it.
+for_each_path_t for_each_vg_path(VG& graph);
+
 // Convert back from Cactus to VG
 // (to, for example, display using vg view)
 // todo: also provide mapping info to get nodes embedded in cactus components
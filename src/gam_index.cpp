@@ -0,0 +1,395 @@
+#include "gam_index.hpp"
+#include "stream.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <zlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//#define debug
+
+namespace vg {
+
+using namespace std;
+
+static const char GAM_INDEX_MAGIC[8] = {'V', 'G', 'G', 'A', 'M', 'I', 'X', '1'};
+
+// Append a protobuf-style base-128 varint to a buffer
+static void append_varint(string& buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back((char) ((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((char) value);
+}
+
+// Read a varint starting at cursor, advancing it. Returns false if it runs off the end.
+static bool read_varint(const char*& cursor, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; cursor < end && shift < 64; shift += 7) {
+        uint8_t byte = (uint8_t) *cursor++;
+        value |= ((uint64_t) (byte & 0x7f)) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The node ID range visited by an alignment, or (0, 0) if it has no mappings
+static pair<int64_t, int64_t> node_range(const Alignment& alignment) {
+    if (alignment.path().mapping_size() == 0) {
+        return make_pair(0, 0);
+    }
+    int64_t min_id = numeric_limits<int64_t>::max();
+    int64_t max_id = numeric_limits<int64_t>::min();
+    for (auto& mapping : alignment.path().mapping()) {
+        int64_t id = mapping.position().node_id();
+        min_id = min(min_id, id);
+        max_id = max(max_id, id);
+    }
+    return make_pair(min_id, max_id);
+}
+
+GAMIndex::Writer::Writer(const string& filename, size_t block_alignments, int compression_level) :
+    filename(filename), block_alignments(max<size_t>(block_alignments, 1)), compression_level(compression_level) {
+    out.open(filename, ios::binary | ios::trunc);
+    if (!out) {
+        throw runtime_error("[GAMIndex] could not open " + filename + " for writing");
+    }
+    out.write(GAM_INDEX_MAGIC, sizeof(GAM_INDEX_MAGIC));
+    offset = sizeof(GAM_INDEX_MAGIC);
+}
+
+GAMIndex::Writer::~Writer(void) {
+    if (!finished) {
+        // Don't throw from a destructor; an unfinished store just has no table
+        // and will be rejected by open().
+        out.close();
+    }
+}
+
+void GAMIndex::Writer::add(const Alignment& alignment) {
+    auto range = node_range(alignment);
+    bool mapped = alignment.path().mapping_size() > 0;
+
+    PendingBlock& block = mapped ? mapped_block : unmapped_block;
+    string serialized;
+    if (!alignment.SerializeToString(&serialized)) {
+        throw runtime_error("[GAMIndex] could not serialize alignment " + alignment.name());
+    }
+    append_varint(block.data, serialized.size());
+    block.data.append(serialized);
+
+    if (mapped) {
+        if (block.count == 0) {
+            block.min_id = range.first;
+            block.max_id = range.second;
+        } else {
+            block.min_id = min(block.min_id, range.first);
+            block.max_id = max(block.max_id, range.second);
+        }
+    }
+    block.count++;
+
+    if (block.count >= block_alignments) {
+        flush_block(block, mapped);
+    }
+}
+
+void GAMIndex::Writer::flush_block(PendingBlock& block, bool mapped) {
+    if (block.count == 0) {
+        return;
+    }
+
+    uLongf compressed_size = compressBound(block.data.size());
+    string compressed(compressed_size, '\0');
+    if (compress2((Bytef*) &compressed[0], &compressed_size,
+                  (const Bytef*) block.data.data(), block.data.size(), compression_level) != Z_OK) {
+        throw runtime_error("[GAMIndex] compression failed writing " + filename);
+    }
+
+    out.write(compressed.data(), compressed_size);
+    if (!out) {
+        throw runtime_error("[GAMIndex] I/O error writing " + filename);
+    }
+
+    BlockRecord record;
+    record.offset = offset;
+    record.compressed_size = compressed_size;
+    record.uncompressed_size = block.data.size();
+    record.count = block.count;
+    record.min_id = mapped ? block.min_id : 0;
+    record.max_id = mapped ? block.max_id : 0;
+    blocks.push_back(record);
+
+#ifdef debug
+    cerr << "[GAMIndex] block of " << record.count << " alignments over nodes "
+         << record.min_id << "-" << record.max_id << " at " << record.offset << endl;
+#endif
+
+    offset += compressed_size;
+    block = PendingBlock();
+}
+
+void GAMIndex::Writer::finish(void) {
+    if (finished) {
+        return;
+    }
+    flush_block(mapped_block, true);
+    flush_block(unmapped_block, false);
+
+    uint64_t table_offset = offset;
+    for (auto& record : blocks) {
+        out.write((const char*) &record, sizeof(BlockRecord));
+    }
+    uint64_t block_count = blocks.size();
+    out.write((const char*) &block_count, sizeof(block_count));
+    out.write((const char*) &table_offset, sizeof(table_offset));
+    out.write(GAM_INDEX_MAGIC, sizeof(GAM_INDEX_MAGIC));
+    out.close();
+    if (!out) {
+        throw runtime_error("[GAMIndex] I/O error finishing " + filename);
+    }
+    finished = true;
+}
+
+GAMIndex::GAMIndex(const string& filename) {
+    open(filename);
+}
+
+GAMIndex::~GAMIndex(void) {
+    close();
+}
+
+void GAMIndex::build(istream& sorted_gam, const string& filename,
+                     size_t block_alignments, int compression_level) {
+    Writer writer(filename, block_alignments, compression_level);
+    function<void(Alignment&)> lambda = [&writer](Alignment& aln) {
+        writer.add(aln);
+    };
+    stream::for_each(sorted_gam, lambda);
+    writer.finish();
+}
+
+void GAMIndex::open(const string& filename) {
+    close();
+
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("[GAMIndex] could not open " + filename);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close();
+        throw runtime_error("[GAMIndex] could not stat " + filename);
+    }
+    data_size = file_stat.st_size;
+
+    const size_t trailer_size = 2 * sizeof(uint64_t) + sizeof(GAM_INDEX_MAGIC);
+    if (data_size < sizeof(GAM_INDEX_MAGIC) + trailer_size) {
+        close();
+        throw runtime_error("[GAMIndex] " + filename + " is too short to be a GAM index");
+    }
+
+    void* mapping = mmap(nullptr, data_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        throw runtime_error("[GAMIndex] could not map " + filename);
+    }
+    data = (const char*) mapping;
+    // Queries jump from block to block, but read each block start to finish.
+    madvise(mapping, data_size, MADV_RANDOM);
+
+    const char* trailer = data + data_size - trailer_size;
+    uint64_t block_count, table_offset;
+    memcpy(&block_count, trailer, sizeof(block_count));
+    memcpy(&table_offset, trailer + sizeof(block_count), sizeof(table_offset));
+    if (memcmp(data, GAM_INDEX_MAGIC, sizeof(GAM_INDEX_MAGIC)) != 0
+        || memcmp(trailer + 2 * sizeof(uint64_t), GAM_INDEX_MAGIC, sizeof(GAM_INDEX_MAGIC)) != 0
+        || table_offset + block_count * sizeof(BlockRecord) != data_size - trailer_size) {
+        close();
+        throw runtime_error("[GAMIndex] " + filename + " is not a complete GAM index");
+    }
+
+    for (uint64_t i = 0; i < block_count; ++i) {
+        BlockRecord record;
+        memcpy(&record, data + table_offset + i * sizeof(BlockRecord), sizeof(BlockRecord));
+        if (record.offset + record.compressed_size > table_offset) {
+            close();
+            throw runtime_error("[GAMIndex] corrupt block table in " + filename);
+        }
+        total_alignments += record.count;
+        if (record.min_id == 0 && record.max_id == 0) {
+            unmapped_blocks.push_back(record);
+        } else {
+            mapped_blocks.push_back(record);
+        }
+    }
+
+    // Sorted input gives sorted blocks already, but a GAM sorted by path
+    // endpoints can put a read that loops back to a lower node slightly out
+    // of order, so don't rely on it.
+    stable_sort(mapped_blocks.begin(), mapped_blocks.end(), [](const BlockRecord& a, const BlockRecord& b) {
+            return a.min_id < b.min_id;
+        });
+    for (auto& record : mapped_blocks) {
+        prefix_max_id.push_back(prefix_max_id.empty() ? record.max_id
+                                : max(prefix_max_id.back(), record.max_id));
+    }
+}
+
+void GAMIndex::close(void) {
+    if (data != nullptr) {
+        munmap((void*) data, data_size);
+        data = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    data_size = 0;
+    mapped_blocks.clear();
+    prefix_max_id.clear();
+    unmapped_blocks.clear();
+    total_alignments = 0;
+}
+
+bool GAMIndex::is_open(void) const {
+    return data != nullptr;
+}
+
+size_t GAMIndex::size(void) const {
+    return total_alignments;
+}
+
+size_t GAMIndex::block_count(void) const {
+    return mapped_blocks.size() + unmapped_blocks.size();
+}
+
+void GAMIndex::for_each_in_block(const BlockRecord& block, const function<bool(const Alignment&)>& lambda) const {
+    string buffer(block.uncompressed_size, '\0');
+    uLongf uncompressed_size = block.uncompressed_size;
+    if (uncompress((Bytef*) &buffer[0], &uncompressed_size,
+                   (const Bytef*) (data + block.offset), block.compressed_size) != Z_OK
+        || uncompressed_size != block.uncompressed_size) {
+        throw runtime_error("[GAMIndex] corrupt block at offset " + to_string(block.offset));
+    }
+
+    const char* cursor = buffer.data();
+    const char* end = cursor + buffer.size();
+    Alignment alignment;
+    while (cursor < end) {
+        uint64_t length;
+        if (!read_varint(cursor, end, length) || cursor + length > end
+            || !alignment.ParseFromArray(cursor, length)) {
+            throw runtime_error("[GAMIndex] corrupt alignment in block at offset " + to_string(block.offset));
+        }
+        cursor += length;
+        if (!lambda(alignment)) {
+            return;
+        }
+    }
+}
+
+pair<size_t, size_t> GAMIndex::candidate_blocks(int64_t id1, int64_t id2) const {
+    // Blocks are sorted by min_id, so anything past the first block starting
+    // after id2 is out. The running max of max_id is nondecreasing, so
+    // anything before the first block whose prefix reaches id1 ends too early.
+    auto last = upper_bound(mapped_blocks.begin(), mapped_blocks.end(), id2,
+                            [](int64_t id, const BlockRecord& block) { return id < block.min_id; });
+    auto first = lower_bound(prefix_max_id.begin(), prefix_max_id.end(), id1);
+    size_t first_index = first - prefix_max_id.begin();
+    size_t last_index = last - mapped_blocks.begin();
+    return make_pair(first_index, max(first_index, last_index));
+}
+
+void GAMIndex::get_alignments(int64_t node_id, vector<Alignment>& alignments) const {
+    get_alignments(node_id, node_id, alignments);
+}
+
+void GAMIndex::get_alignments(int64_t id1, int64_t id2, vector<Alignment>& alignments) const {
+    for_alignment_in_range(id1, id2, [&alignments](const Alignment& alignment) {
+            alignments.push_back(alignment);
+        });
+}
+
+void GAMIndex::for_alignment_in_range(int64_t id1, int64_t id2,
+                                      const function<void(const Alignment&)>& lambda) const {
+    // Alignments are keyed by their lowest node, so a block can only hold
+    // matches if its key range starts by id2 and its node range reaches id1.
+    auto range = candidate_blocks(id1, id2);
+    for (size_t i = range.first; i < range.second; ++i) {
+        if (mapped_blocks[i].max_id < id1) {
+            continue;
+        }
+        for_each_in_block(mapped_blocks[i], [&](const Alignment& alignment) {
+                int64_t key = node_range(alignment).first;
+                if (key >= id1 && key <= id2) {
+                    lambda(alignment);
+                }
+                return true;
+            });
+    }
+}
+
+void GAMIndex::for_alignment_to_node(int64_t node_id, const function<void(const Alignment&)>& lambda) const {
+    for_alignment_to_nodes(vector<int64_t>{node_id}, lambda);
+}
+
+void GAMIndex::for_alignment_to_nodes(const vector<int64_t>& ids,
+                                      const function<void(const Alignment&)>& lambda) const {
+    if (ids.empty()) {
+        return;
+    }
+    vector<int64_t> sorted_ids(ids);
+    std::sort(sorted_ids.begin(), sorted_ids.end());
+    sorted_ids.erase(unique(sorted_ids.begin(), sorted_ids.end()), sorted_ids.end());
+
+    // Collect each candidate block once, even if several query nodes land in it
+    vector<size_t> blocks;
+    for (auto id : sorted_ids) {
+        auto range = candidate_blocks(id, id);
+        for (size_t i = range.first; i < range.second; ++i) {
+            if (mapped_blocks[i].min_id <= id && mapped_blocks[i].max_id >= id) {
+                blocks.push_back(i);
+            }
+        }
+    }
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(unique(blocks.begin(), blocks.end()), blocks.end());
+
+    for (auto i : blocks) {
+        for_each_in_block(mapped_blocks[i], [&](const Alignment& alignment) {
+                for (auto& mapping : alignment.path().mapping()) {
+                    if (binary_search(sorted_ids.begin(), sorted_ids.end(), mapping.position().node_id())) {
+                        lambda(alignment);
+                        break;
+                    }
+                }
+                return true;
+            });
+    }
+}
+
+void GAMIndex::for_each_alignment(const function<void(const Alignment&)>& lambda) const {
+    auto each = [&lambda](const Alignment& alignment) {
+        lambda(alignment);
+        return true;
+    };
+    for (auto& block : mapped_blocks) {
+        for_each_in_block(block, each);
+    }
+    for (auto& block : unmapped_blocks) {
+        for_each_in_block(block, each);
+    }
+}
+
+}
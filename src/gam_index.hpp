@@ -0,0 +1,149 @@
+#ifndef VG_GAM_INDEX_HPP_INCLUDED
+#define VG_GAM_INDEX_HPP_INCLUDED
+
+#include <iostream>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "vg.pb.h"
+
+/** \file
+ * gam_index.hpp: an immutable, block-compressed store of alignments with a
+ * node-range interval index over its blocks. It is built in one pass over a
+ * GAM sorted by vg gamsort and answers the same alignment queries as the
+ * RocksDB Index, without a write-ahead log, compaction, or per-read keys.
+ */
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * On-disk layout (all integers little-endian, as written by the host):
+ *
+ *   magic                            "VGGAMIX1"
+ *   block 0 .. block n-1             zlib-compressed runs of length-prefixed Alignment protobufs
+ *   block table                      n x BlockRecord
+ *   n                                uint64_t
+ *   offset of block table            uint64_t
+ *   magic                            "VGGAMIX1"
+ *
+ * Mapped alignments are keyed by the lowest node ID they touch. Any order
+ * gives correct answers, but queries only touch few blocks when the input is
+ * sorted, as vg gamsort output is. Unmapped alignments may arrive at any point
+ * (vg gamsort puts them at the end); they are kept in their own blocks and
+ * only come back from for_each_alignment().
+ */
+class GAMIndex {
+public:
+
+    /// Summary of one compressed block. Mapped blocks are sorted by min_id.
+    struct BlockRecord {
+        uint64_t offset;
+        uint64_t compressed_size;
+        uint64_t uncompressed_size;
+        uint64_t count;
+        /// Lowest node ID touched by any alignment in the block, or 0 if unmapped
+        int64_t min_id;
+        /// Highest node ID touched by any alignment in the block, or 0 if unmapped
+        int64_t max_id;
+    };
+
+    /**
+     * Streams alignments into a new store. Call add() for every alignment,
+     * in sorted order for best query performance, and then finish(), which
+     * writes the block table. Throws std::runtime_error on I/O failure.
+     */
+    class Writer {
+    public:
+        Writer(const string& filename, size_t block_alignments = 1024, int compression_level = 6);
+        ~Writer(void);
+
+        void add(const Alignment& alignment);
+        void finish(void);
+
+    private:
+        /// Accumulating, uncompressed contents of a block
+        struct PendingBlock {
+            string data;
+            uint64_t count = 0;
+            int64_t min_id = 0;
+            int64_t max_id = 0;
+        };
+
+        void flush_block(PendingBlock& block, bool mapped);
+
+        ofstream out;
+        string filename;
+        size_t block_alignments;
+        int compression_level;
+        PendingBlock mapped_block;
+        PendingBlock unmapped_block;
+        uint64_t offset = 0;
+        vector<BlockRecord> blocks;
+        bool finished = false;
+    };
+
+    GAMIndex(void) = default;
+    GAMIndex(const string& filename);
+    ~GAMIndex(void);
+
+    // Owns a mapping; not copyable
+    GAMIndex(const GAMIndex& other) = delete;
+    GAMIndex& operator=(const GAMIndex& other) = delete;
+
+    /// Build a store from a sorted GAM stream.
+    static void build(istream& sorted_gam, const string& filename,
+                      size_t block_alignments = 1024, int compression_level = 6);
+
+    /// Memory-map a store for reading. Throws std::runtime_error if it is not a valid store.
+    void open(const string& filename);
+    void close(void);
+    bool is_open(void) const;
+
+    /// Number of alignments stored, mapped and unmapped.
+    size_t size(void) const;
+    size_t block_count(void) const;
+
+    // Queries, with the same meaning as the Index methods of the same name.
+    // All of them are const and safe to call from several threads at once.
+
+    /// Alignments whose lowest node ID is node_id
+    void get_alignments(int64_t node_id, vector<Alignment>& alignments) const;
+    /// Alignments whose lowest node ID is in [id1, id2]
+    void get_alignments(int64_t id1, int64_t id2, vector<Alignment>& alignments) const;
+    /// Call lambda on alignments whose lowest node ID is in [id1, id2], in block order
+    void for_alignment_in_range(int64_t id1, int64_t id2, const function<void(const Alignment&)>& lambda) const;
+    /// Call lambda on each alignment that visits the given node
+    void for_alignment_to_node(int64_t node_id, const function<void(const Alignment&)>& lambda) const;
+    /// Call lambda once on each alignment that visits any of the given nodes
+    void for_alignment_to_nodes(const vector<int64_t>& ids, const function<void(const Alignment&)>& lambda) const;
+    /// Call lambda on every stored alignment, mapped ones first
+    void for_each_alignment(const function<void(const Alignment&)>& lambda) const;
+
+private:
+
+    /// Decompress a block and call lambda on each of its alignments, stopping if it returns false
+    void for_each_in_block(const BlockRecord& block, const function<bool(const Alignment&)>& lambda) const;
+    /// Indexes into mapped_blocks of the blocks whose node range may overlap [id1, id2]
+    pair<size_t, size_t> candidate_blocks(int64_t id1, int64_t id2) const;
+
+    const char* data = nullptr;
+    size_t data_size = 0;
+    int fd = -1;
+
+    /// Blocks holding mapped alignments, sorted by min_id
+    vector<BlockRecord> mapped_blocks;
+    /// Running maximum of max_id over mapped_blocks, for interval lookups
+    vector<int64_t> prefix_max_id;
+    /// Blocks holding unmapped alignments
+    vector<BlockRecord> unmapped_blocks;
+    size_t total_alignments = 0;
+};
+
+}
+
+#endif
@@ -368,22 +368,34 @@ void GAMSorter::stream_sort(string gamfile){
 
 void GAMSorter::write_index(string gamfile, string outfile, bool isSorted)
 {
+    ifstream gammy;
+    gammy.open(gamfile);
+    if (!gammy)
+    {
+        throw runtime_error("[vg gamsort] could not open " + gamfile);
+    }
 
-    map<int64_t, vector<string>> node_to_alns;
+    if (isSorted)
+    {
+        // Stream straight into the block-compressed index
+        GAMIndex::build(gammy, outfile);
+        return;
+    }
 
-    std::function<void(Alignment &)> node_grabber = [&](Alignment &aln) {
-        vector<int64_t> ret;
-        Path p = aln.path();
-        for (int i = 0; i < p.mapping_size(); i++)
-        {
-            Mapping m = p.mapping(i);
-            ret.push_back(m.position().node_id());
-        }
-        for (auto x : ret)
-        {
-            node_to_alns[x].push_back(aln.name());
-        }
+    // Otherwise sort in memory first, as in dumb_sort
+    std::vector<Alignment> buf;
+    std::function<void(Alignment&)> presort = [&](Alignment &aln) {
+        buf.push_back(aln);
     };
+    stream::for_each(gammy, presort);
+    std::stable_sort(buf.begin(), buf.end(), alnsortkey);
+
+    GAMIndex::Writer writer(outfile);
+    for (auto& aln : buf)
+    {
+        writer.add(aln);
+    }
+    writer.finish();
 }
 
 bool GAMSorter::min_aln_first(Alignment &a, Alignment &b)
@@ -3,6 +3,7 @@
 
 #include "vg.pb.h"
 #include "stream.hpp"
+#include "gam_index.hpp"
 #include <string>
 #include <queue>
 #include <sstream>
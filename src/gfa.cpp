@@ -0,0 +1,491 @@
+#include "gfa.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <omp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace vg {
+
+using namespace std;
+
+const char* GFA_HEADER = "H\tVN:Z:1.0\n";
+
+GFAText::GFAText(const string& filename) {
+    if (filename == "-") {
+        read_stream(cin);
+        return;
+    }
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("[GFAText] could not open " + filename);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        void* mapped = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            mapping = mapped;
+            text = (const char*) mapped;
+            length = file_stat.st_size;
+            // Both passes go through the file front to back.
+            madvise(mapped, length, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd);
+
+    if (mapping == nullptr) {
+        // Pipes, process substitutions, and anything else we can't map
+        ifstream in(filename);
+        if (!in) {
+            throw runtime_error("[GFAText] could not read " + filename);
+        }
+        read_stream(in);
+    }
+}
+
+GFAText::GFAText(istream& in) {
+    read_stream(in);
+}
+
+GFAText::~GFAText() {
+    if (mapping != nullptr) {
+        munmap(mapping, length);
+    }
+}
+
+void GFAText::read_stream(istream& in) {
+    char chunk[1 << 16];
+    while (in) {
+        in.read(chunk, sizeof(chunk));
+        buffer.append(chunk, in.gcount());
+    }
+    text = buffer.data();
+    length = buffer.size();
+}
+
+namespace {
+
+/// A field of a line, pointing into the text
+struct field_t {
+    const char* start;
+    size_t length;
+
+    inline string str(void) const {
+        return string(start, length);
+    }
+
+    inline bool operator==(const char* other) const {
+        return strlen(other) == length && strncmp(start, other, length) == 0;
+    }
+};
+
+/// Split a line into tab-separated fields, or space-separated ones if there
+/// are no tabs at all
+void split_fields(const char* line, size_t line_length, vector<field_t>& fields) {
+    fields.clear();
+    char separator = memchr(line, '\t', line_length) != nullptr ? '\t' : ' ';
+    const char* end = line + line_length;
+    const char* start = line;
+    while (start <= end) {
+        const char* stop = (const char*) memchr(start, separator, end - start);
+        if (stop == nullptr) {
+            stop = end;
+        }
+        if (stop > start || separator == '\t') {
+            // Runs of spaces count as one separator
+            fields.push_back(field_t{start, (size_t) (stop - start)});
+        }
+        start = stop + 1;
+    }
+}
+
+/// Call lambda with each line in [start, end), without its line ending
+void for_each_line(const char* start, const char* end, const function<void(const char*, size_t)>& lambda) {
+    while (start < end) {
+        const char* stop = (const char*) memchr(start, '\n', end - start);
+        const char* next = stop == nullptr ? end : stop + 1;
+        if (stop == nullptr) {
+            stop = end;
+        }
+        if (stop > start && *(stop - 1) == '\r') {
+            stop--;
+        }
+        if (stop > start) {
+            lambda(start, stop - start);
+        }
+        start = next;
+    }
+}
+
+/// Whether the field is a nonempty string of digits
+bool is_numeric(const field_t& field) {
+    if (field.length == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < field.length; i++) {
+        if (field.start[i] < '0' || field.start[i] > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+id_t parse_id(const field_t& field) {
+    id_t id = 0;
+    for (size_t i = 0; i < field.length; i++) {
+        id = id * 10 + (field.start[i] - '0');
+    }
+    return id;
+}
+
+/// Parse a "+" or "-" field into whether it means reverse
+bool parse_orientation(const field_t& field, const char* line, size_t line_length) {
+    if (field == "+") {
+        return false;
+    } else if (field == "-") {
+        return true;
+    }
+    throw runtime_error("[GFAReader] bad orientation in line: " + string(line, line_length));
+}
+
+/// Get the overlap length of a link's CIGAR, if it is a single match
+size_t parse_overlap(const field_t& field) {
+    if (field.length < 2 || field.start[field.length - 1] != 'M') {
+        return 0;
+    }
+    field_t length{field.start, field.length - 1};
+    return is_numeric(length) ? parse_id(length) : 0;
+}
+
+}
+
+GFAReader::GFAReader(const GFAText& text, size_t block_bytes) : text(text) {
+
+    // Cut the text into blocks at line boundaries
+    const char* data = text.data();
+    size_t start = 0;
+    while (start < text.size()) {
+        block_starts.push_back(start);
+        size_t end = min(start + max(block_bytes, (size_t) 1), text.size());
+        const char* newline = (const char*) memchr(data + end - 1, '\n', text.size() - end + 1);
+        start = newline == nullptr ? text.size() : newline - data + 1;
+    }
+    block_starts.push_back(text.size());
+    size_t block_count = block_starts.size() - 1;
+
+    // Find the segment names in parallel, keeping the non-numeric ones in
+    // file order so we can number them
+    vector<vector<field_t>> block_names(block_count);
+    vector<id_t> block_max_ids(block_count, 0);
+    vector<size_t> block_segments(block_count, 0);
+    exception_ptr error;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < block_count; i++) {
+        try {
+            vector<field_t> fields;
+            for_each_line(data + block_starts[i], data + block_starts[i + 1], [&](const char* line, size_t line_length) {
+                if (line[0] != 'S') {
+                    return;
+                }
+                split_fields(line, line_length, fields);
+                if (fields.size() < 3 || !(fields[0] == "S")) {
+                    throw runtime_error("[GFAReader] bad segment line: " + string(line, line_length));
+                }
+                block_segments[i]++;
+                if (is_numeric(fields[1])) {
+                    block_max_ids[i] = max(block_max_ids[i], parse_id(fields[1]));
+                } else {
+                    block_names[i].push_back(fields[1]);
+                }
+            });
+        } catch (...) {
+            #pragma omp critical (gfa_reader_error)
+            error = current_exception();
+        }
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+
+    id_t next_id = 1;
+    for (auto& max_id : block_max_ids) {
+        next_id = max(next_id, max_id + 1);
+    }
+    for (size_t i = 0; i < block_count; i++) {
+        segments += block_segments[i];
+        for (auto& name : block_names[i]) {
+            if (name_to_id.emplace(name.str(), next_id).second) {
+                next_id++;
+            }
+        }
+    }
+}
+
+id_t GFAReader::lookup(const char* name, size_t name_length) const {
+    field_t field{name, name_length};
+    if (is_numeric(field)) {
+        return parse_id(field);
+    }
+    auto found = name_to_id.find(field.str());
+    if (found == name_to_id.end()) {
+        throw runtime_error("[GFAReader] no segment named " + field.str());
+    }
+    return found->second;
+}
+
+id_t GFAReader::get_id(const string& name) const {
+    return lookup(name.c_str(), name.size());
+}
+
+size_t GFAReader::segment_count(void) const {
+    return segments;
+}
+
+bool GFAReader::has_overlaps(void) const {
+    return overlaps;
+}
+
+void GFAReader::parse_block(size_t block, Graph& graph, bool& saw_overlap) const {
+    // Where each path in this block is in the graph's paths
+    unordered_map<string, size_t> path_at;
+    auto get_path = [&](const field_t& name) -> Path& {
+        auto inserted = path_at.emplace(name.str(), graph.path_size());
+        if (inserted.second) {
+            graph.add_path()->set_name(inserted.first->first);
+        }
+        return *graph.mutable_path(inserted.first->second);
+    };
+    auto add_visit = [&](Path& path, id_t id, bool is_reverse) {
+        Position* position = path.add_mapping()->mutable_position();
+        position->set_node_id(id);
+        position->set_is_reverse(is_reverse);
+    };
+
+    vector<field_t> fields;
+    const char* data = text.data();
+    for_each_line(data + block_starts[block], data + block_starts[block + 1], [&](const char* line, size_t line_length) {
+        if (line[0] != 'S' && line[0] != 'L' && line[0] != 'P') {
+            // Headers, comments, containments and anything newer
+            return;
+        }
+        split_fields(line, line_length, fields);
+        if (fields[0].length != 1) {
+            return;
+        }
+        switch (line[0]) {
+        case 'S':
+        {
+            Node* node = graph.add_node();
+            node->set_id(lookup(fields[1].start, fields[1].length));
+            node->set_sequence(fields[2].start, fields[2].length);
+            node->set_name(fields[1].start, fields[1].length);
+            break;
+        }
+        case 'L':
+        {
+            if (fields.size() < 6) {
+                throw runtime_error("[GFAReader] bad link line: " + string(line, line_length));
+            }
+            Edge* edge = graph.add_edge();
+            edge->set_from(lookup(fields[1].start, fields[1].length));
+            edge->set_from_start(parse_orientation(fields[2], line, line_length));
+            edge->set_to(lookup(fields[3].start, fields[3].length));
+            edge->set_to_end(parse_orientation(fields[4], line, line_length));
+            size_t overlap = parse_overlap(fields[5]);
+            if (overlap > 0) {
+                edge->set_overlap(overlap);
+                saw_overlap = true;
+            }
+            break;
+        }
+        case 'P':
+        {
+            if (fields.size() >= 4 && (fields[3] == "+" || fields[3] == "-")) {
+                // One step per line: segment, path, orientation
+                add_visit(get_path(fields[2]), lookup(fields[1].start, fields[1].length),
+                          parse_orientation(fields[3], line, line_length));
+            } else if (fields.size() >= 3) {
+                // A whole path, as comma-separated oriented segments
+                Path& path = get_path(fields[1]);
+                const char* step = fields[2].start;
+                const char* end = step + fields[2].length;
+                while (step < end) {
+                    const char* stop = (const char*) memchr(step, ',', end - step);
+                    if (stop == nullptr) {
+                        stop = end;
+                    }
+                    if (stop - step < 2 || (*(stop - 1) != '+' && *(stop - 1) != '-')) {
+                        throw runtime_error("[GFAReader] bad path step in line: " + string(line, line_length));
+                    }
+                    add_visit(path, lookup(step, stop - step - 1), *(stop - 1) == '-');
+                    step = stop + 1;
+                }
+            } else {
+                throw runtime_error("[GFAReader] bad path line: " + string(line, line_length));
+            }
+            break;
+        }
+        }
+    });
+}
+
+void GFAReader::for_each_chunk(const function<void(Graph&)>& lambda) {
+
+    size_t block_count = block_starts.size() - 1;
+    // blocks to parse at a time; enough to keep all the threads busy
+    const size_t batch_size = 4 * omp_get_max_threads();
+
+    // The rank of the last mapping handed over on each path
+    unordered_map<string, size_t> path_ranks;
+
+    // Parse a batch of blocks while the calling thread hands over the last one
+    vector<Graph> ready;
+    for (size_t batch_start = 0; batch_start < block_count + batch_size; batch_start += batch_size) {
+        size_t batch_end = min(batch_start + batch_size, block_count);
+        vector<Graph> parsed(batch_start < batch_end ? batch_end - batch_start : 0);
+
+        bool saw_overlap = false;
+        exception_ptr error;
+        #pragma omp parallel
+        {
+            #pragma omp single nowait
+            {
+                try {
+                    for (auto& graph : ready) {
+                        for (int i = 0; i < graph.path_size(); i++) {
+                            Path* path = graph.mutable_path(i);
+                            size_t& rank = path_ranks[path->name()];
+                            for (int j = 0; j < path->mapping_size(); j++) {
+                                path->mutable_mapping(j)->set_rank(++rank);
+                            }
+                        }
+                        lambda(graph);
+                        // don't hold on to graphs we've handed over
+                        Graph().Swap(&graph);
+                    }
+                } catch (...) {
+                    #pragma omp critical (gfa_reader_error)
+                    error = current_exception();
+                }
+            }
+
+            #pragma omp for schedule(dynamic, 1) nowait
+            for (size_t i = 0; i < parsed.size(); i++) {
+                try {
+                    bool block_overlap = false;
+                    parse_block(batch_start + i, parsed[i], block_overlap);
+                    if (block_overlap) {
+                        #pragma omp atomic write
+                        saw_overlap = true;
+                    }
+                } catch (...) {
+                    #pragma omp critical (gfa_reader_error)
+                    error = current_exception();
+                }
+            }
+        }
+        if (error) {
+            rethrow_exception(error);
+        }
+        overlaps = overlaps || saw_overlap;
+        ready = std::move(parsed);
+    }
+}
+
+void write_gfa_lines(ostream& out, size_t count, const function<void(size_t, string&)>& format,
+                     size_t items_per_block) {
+
+    items_per_block = max(items_per_block, (size_t) 1);
+    size_t block_count = (count + items_per_block - 1) / items_per_block;
+    // blocks to format at a time; enough to keep all the threads busy
+    const size_t batch_size = 4 * omp_get_max_threads();
+
+    // Format a batch of blocks while the calling thread writes the last one
+    vector<string> ready;
+    for (size_t batch_start = 0; batch_start < block_count + batch_size; batch_start += batch_size) {
+        size_t batch_end = min(batch_start + batch_size, block_count);
+        vector<string> formatted(batch_start < batch_end ? batch_end - batch_start : 0);
+
+        exception_ptr error;
+        #pragma omp parallel
+        {
+            #pragma omp single nowait
+            {
+                for (auto& text : ready) {
+                    out.write(text.data(), text.size());
+                }
+            }
+
+            #pragma omp for schedule(dynamic, 1) nowait
+            for (size_t i = 0; i < formatted.size(); i++) {
+                try {
+                    size_t first = (batch_start + i) * items_per_block;
+                    size_t last = min(first + items_per_block, count);
+                    for (size_t j = first; j < last; j++) {
+                        format(j, formatted[i]);
+                    }
+                } catch (...) {
+                    #pragma omp critical (gfa_writer_error)
+                    error = current_exception();
+                }
+            }
+        }
+        if (error) {
+            rethrow_exception(error);
+        }
+        ready = std::move(formatted);
+    }
+}
+
+void append_gfa_segment(string& buffer, const Node& node) {
+    buffer += "S\t";
+    buffer += to_string(node.id());
+    buffer += '\t';
+    buffer += node.sequence();
+    buffer += '\n';
+}
+
+void append_gfa_link(string& buffer, const Edge& edge) {
+    buffer += "L\t";
+    buffer += to_string(edge.from());
+    buffer += edge.from_start() ? "\t-\t" : "\t+\t";
+    buffer += to_string(edge.to());
+    buffer += edge.to_end() ? "\t-\t" : "\t+\t";
+    buffer += to_string(edge.overlap());
+    buffer += "M\n";
+}
+
+void append_gfa_path(string& buffer, const string& name,
+                     const vector<tuple<id_t, bool, size_t>>& visits) {
+    buffer += "P\t";
+    buffer += name;
+    buffer += '\t';
+    for (size_t i = 0; i < visits.size(); i++) {
+        if (i > 0) {
+            buffer += ',';
+        }
+        buffer += to_string(get<0>(visits[i]));
+        buffer += get<1>(visits[i]) ? '-' : '+';
+    }
+    if (!visits.empty()) {
+        buffer += '\t';
+        for (size_t i = 0; i < visits.size(); i++) {
+            if (i > 0) {
+                buffer += ',';
+            }
+            buffer += to_string(get<2>(visits[i]));
+            buffer += 'M';
+        }
+    }
+    buffer += '\n';
+}
+
+}
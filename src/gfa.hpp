@@ -0,0 +1,128 @@
+#ifndef VG_GFA_HPP_INCLUDED
+#define VG_GFA_HPP_INCLUDED
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "types.hpp"
+#include "vg.pb.h"
+
+/** \file
+ * gfa.hpp: streaming GFA 1 reading and writing that works straight from the
+ * text, without building an in-memory model of the whole file first.
+ */
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * The text of a GFA file. Regular files are mapped into memory; anything else
+ * (standard input, pipes) is read into a buffer, since the reader needs to
+ * make two passes.
+ */
+class GFAText {
+public:
+    /// Map the named file, or read standard input if the name is "-". Throws
+    /// runtime_error if the file can't be opened.
+    explicit GFAText(const string& filename);
+    /// Read the whole stream
+    explicit GFAText(istream& in);
+    ~GFAText();
+
+    GFAText(const GFAText& other) = delete;
+    GFAText& operator=(const GFAText& other) = delete;
+
+    inline const char* data(void) const { return text; }
+    inline size_t size(void) const { return length; }
+
+private:
+    void read_stream(istream& in);
+
+    const char* text = nullptr;
+    size_t length = 0;
+    /// The mapping, if the text is mapped
+    void* mapping = nullptr;
+    /// The text, if it was read
+    string buffer;
+};
+
+/**
+ * Reads the segments (S), links (L) and paths (P) of a GFA 1 file in two
+ * passes over blocks of lines, parsing the blocks in parallel.
+ *
+ * The first pass assigns node IDs. Numeric segment names are used as IDs, and
+ * other names are numbered after the largest numeric one, in file order. The
+ * second pass turns each block of lines into a Graph, which is handed over in
+ * file order, so memory use is the text plus the name table plus the blocks
+ * in flight.
+ *
+ * Paths may be given either as GFA 1 P lines or as the older one-step-per-line
+ * form ("P segment path orientation overlap"). Path mappings carry ranks that
+ * continue across chunks, so the chunks can be appended to a graph or written
+ * out one after another.
+ */
+class GFAReader {
+public:
+    /// Prepare to read the text, which must outlive the reader. Runs the first
+    /// pass. Throws runtime_error on malformed segment lines.
+    GFAReader(const GFAText& text, size_t block_bytes = 4 << 20);
+
+    /// Run the second pass, calling lambda on the Graph made from each block
+    /// of lines, in file order. Throws runtime_error on malformed lines or
+    /// references to segments that don't exist.
+    void for_each_chunk(const function<void(Graph&)>& lambda);
+
+    /// Get the ID assigned to a segment name
+    id_t get_id(const string& name) const;
+
+    /// Number of segment lines seen
+    size_t segment_count(void) const;
+
+    /// Whether any link read so far had a nonzero overlap, in which case the
+    /// graph needs to be bluntified before use
+    bool has_overlaps(void) const;
+
+private:
+    /// Look up a segment name in a field; throws if it's not numeric and has
+    /// no segment
+    id_t lookup(const char* name, size_t name_length) const;
+
+    /// Parse a block of lines into a Graph
+    void parse_block(size_t block, Graph& graph, bool& saw_overlap) const;
+
+    const GFAText& text;
+    /// Where each block of lines starts, followed by the end of the text
+    vector<size_t> block_starts;
+    /// IDs for segments without numeric names
+    unordered_map<string, id_t> name_to_id;
+    size_t segments = 0;
+    bool overlaps = false;
+};
+
+/// Write count items to out, in order, with format(i, buffer) appending the
+/// text for item i to buffer. Runs format in parallel over blocks of items.
+void write_gfa_lines(ostream& out, size_t count, const function<void(size_t, string&)>& format,
+                     size_t items_per_block = 1024);
+
+/// Append an S line for a node
+void append_gfa_segment(string& buffer, const Node& node);
+
+/// Append an L line for an edge
+void append_gfa_link(string& buffer, const Edge& edge);
+
+/// Append a P line for a path, given as (node ID, is reverse, node length)
+/// visits
+void append_gfa_path(string& buffer, const string& name,
+                     const vector<tuple<id_t, bool, size_t>>& visits);
+
+/// The header line written before everything else
+extern const char* GFA_HEADER;
+
+}
+
+#endif
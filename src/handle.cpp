@@ -21,6 +21,14 @@ handle_t HandleGraph::forward(const handle_t& handle) const {
     return this->get_is_reverse(handle) ? this->flip(handle) : handle;
 }
 
+void HandleGraph::get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& neighbors) const {
+    neighbors.clear();
+    follow_edges(handle, go_left, [&](const handle_t& other) {
+        neighbors.push_back(other);
+        return true;
+    });
+}
+
 pair<handle_t, handle_t> HandleGraph::edge_handle(const handle_t& left, const handle_t& right) const {
     // The degeneracy is between any pair and a pair of the same nodes but reversed in order and orientation.
     // We compare those two pairs and construct the smaller one.
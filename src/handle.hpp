@@ -13,6 +13,7 @@
 #include "hash_map.hpp"
 
 #include <functional>
+#include <type_traits>
 #include <cstdint>
 #include <vector>
 
@@ -65,6 +66,23 @@ inline bool operator!=(const handle_t& a, const handle_t& b) {
     return as_integer(a) != as_integer(b);
 }
 
+/// Call an iteratee that returns either bool or void on a handle, and say
+/// whether to keep iterating. Lets templated loops take either kind.
+template<typename Iteratee>
+inline auto call_iteratee(Iteratee& iteratee, const handle_t& handle)
+-> typename std::enable_if<std::is_void<decltype(iteratee(handle))>::value, bool>::type {
+    iteratee(handle);
+    return true;
+}
+
+/// Call an iteratee that returns either bool or void on a handle, and say
+/// whether to keep iterating. Lets templated loops take either kind.
+template<typename Iteratee>
+inline auto call_iteratee(Iteratee& iteratee, const handle_t& handle)
+-> typename std::enable_if<!std::is_void<decltype(iteratee(handle))>::value, bool>::type {
+    return iteratee(handle);
+}
+
 /**
  * Define hashes for handles.
  */
@@ -208,6 +226,13 @@ public:
     /// Get the locally forward version of a handle
     handle_t forward(const handle_t& handle) const;
     
+    /// Replace the contents of the buffer with the handles to next/previous
+    /// (right/left) nodes, in follow_edges order. Lets callers that want all
+    /// the neighbors pay for one virtual call instead of one per edge;
+    /// implementations should override it with a loop that does not go
+    /// through a std::function.
+    virtual void get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& neighbors) const;
+    
     // A pair of handles can be used as an edge. When so used, the handles have a
     // cannonical order and orientation.
     edge_t edge_handle(const handle_t& left, const handle_t& right) const;
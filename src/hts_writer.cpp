@@ -0,0 +1,95 @@
+#include "hts_writer.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+namespace vg {
+
+using namespace std;
+
+HTSWriter::HTSWriter(const string& format, int compression_level, int compression_threads,
+                     bool ordered, size_t reorder_window) :
+    mode(output_mode(format, compression_level)), compression_threads(compression_threads),
+    header_written(false),
+    writer([this](vector<bam1_t*>& records) { write_records(records); }, ordered, reorder_window) {
+    // Nothing to do
+}
+
+HTSWriter::~HTSWriter(void) {
+    close();
+}
+
+string HTSWriter::output_mode(const string& format, int compression_level) {
+    string mode = "w";
+    if (format == "bam") {
+        mode += "b";
+    } else if (format == "cram") {
+        mode += "c";
+    } else if (format != "sam") {
+        throw runtime_error("[HTSWriter] unknown output format " + format);
+    }
+    if (format != "sam" && compression_level >= 0) {
+        if (compression_level > 9) {
+            throw runtime_error("[HTSWriter] compression level must be between 0 and 9");
+        }
+        mode += (char) ('0' + compression_level);
+    }
+    return mode;
+}
+
+void HTSWriter::ensure_header(const function<bam_hdr_t*(void)>& make_header) {
+    if (header_written.load(memory_order_acquire)) {
+        return;
+    }
+    lock_guard<mutex> guard(header_lock);
+    if (header_written.load(memory_order_relaxed)) {
+        return;
+    }
+    hdr = make_header();
+    if ((out = sam_open("-", mode.c_str())) == 0) {
+        cerr << "[vg] error: failed to open stdout for writing HTS output" << endl;
+        exit(1);
+    }
+    if (compression_threads > 0 && mode != "w") {
+        // Let htslib compress blocks in parallel; it keeps them in order
+        if (hts_set_threads(out, compression_threads) != 0) {
+            cerr << "[vg] warning: could not start HTS compression threads" << endl;
+        }
+    }
+    if (sam_hdr_write(out, hdr) != 0) {
+        cerr << "[vg] error: failed to write the SAM header" << endl;
+    }
+    header_written.store(true, memory_order_release);
+}
+
+bool HTSWriter::has_header(void) const {
+    return header_written.load(memory_order_acquire);
+}
+
+void HTSWriter::emit(vector<bam1_t*>&& records) {
+    writer.emit(std::move(records));
+}
+
+void HTSWriter::write_records(vector<bam1_t*>& records) {
+    for (bam1_t* b : records) {
+        if (sam_write1(out, hdr, b) < 0) {
+            cerr << "[vg] error: writing to stdout failed" << endl;
+            exit(1);
+        }
+        bam_destroy1(b);
+    }
+}
+
+void HTSWriter::close(void) {
+    writer.finish();
+    if (out != nullptr) {
+        sam_close(out);
+        out = nullptr;
+    }
+    if (hdr != nullptr) {
+        bam_hdr_destroy(hdr);
+        hdr = nullptr;
+    }
+}
+
+}
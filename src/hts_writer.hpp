@@ -0,0 +1,76 @@
+#ifndef VG_HTS_WRITER_HPP_INCLUDED
+#define VG_HTS_WRITER_HPP_INCLUDED
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "htslib/hts.h"
+#include "htslib/sam.h"
+#include "threaded_io.hpp"
+
+/** \file
+ * hts_writer.hpp: SAM/BAM/CRAM output to stdout for the surjecting
+ * subcommands. Worker threads make the records and hand them over; one writer
+ * thread feeds them to htslib, which compresses BGZF blocks or CRAM
+ * containers on its own pool of threads.
+ */
+
+namespace vg {
+
+using namespace std;
+
+class HTSWriter {
+public:
+
+    /// Make a writer for the given format ("sam", "bam" or "cram"). A
+    /// compression level of -1 uses htslib's default, and compression threads
+    /// are in addition to the calling and writer threads; neither applies to
+    /// SAM. The ordering options are as for OrderedWriter. Nothing is written
+    /// until ensure_header() is called.
+    HTSWriter(const string& format, int compression_level = -1, int compression_threads = 0,
+              bool ordered = false, size_t reorder_window = OrderedWriter<bam1_t*>::DEFAULT_REORDER_WINDOW);
+    ~HTSWriter(void);
+
+    HTSWriter(const HTSWriter& other) = delete;
+    HTSWriter& operator=(const HTSWriter& other) = delete;
+
+    /// Open stdout and write the header, unless that has already happened.
+    /// make_header is called at most once, and the writer takes ownership of
+    /// the header it returns. Safe to call from several threads at once.
+    void ensure_header(const function<bam_hdr_t*(void)>& make_header);
+
+    /// True once the header has been written.
+    bool has_header(void) const;
+
+    /// Queue records to be written, after the header, under the calling
+    /// thread's current input sequence number. Takes ownership of the records.
+    void emit(vector<bam1_t*>&& records);
+
+    /// Write everything queued and close the output. Must not race with
+    /// emit(). Safe to call more than once.
+    void close(void);
+
+    /// Get the htslib mode string for the given format and compression level.
+    static string output_mode(const string& format, int compression_level);
+
+private:
+
+    void write_records(vector<bam1_t*>& records);
+
+    string mode;
+    int compression_threads;
+
+    mutex header_lock;
+    atomic<bool> header_written;
+    samFile* out = nullptr;
+    bam_hdr_t* hdr = nullptr;
+
+    OrderedWriter<bam1_t*> writer;
+};
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "index.hpp"
+#include "kmer.hpp"
 
 namespace vg {
 
@@ -939,6 +940,43 @@ void Index::cross_alignment(int64_t aln_id, const Alignment& alignment) {
 }
 
 void Index::load_graph(VG& graph) {
+    if (bulk_load) {
+        // Build the node and edge entries on all threads and ingest them as
+        // SST files, rather than pushing them through the memtable.
+        vector<vector<pair<string, string>>> thread_items(omp_get_max_threads());
+        graph.preload_progress("indexing nodes of " + graph.name);
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < graph.graph.node_size(); ++i) {
+            const Node& node = graph.graph.node(i);
+            auto& items = thread_items[omp_get_thread_num()];
+            items.emplace_back(key_for_node(node.id()), string());
+            node.SerializeToString(&items.back().second);
+        }
+        graph.preload_progress("indexing edges of " + graph.name);
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < graph.graph.edge_size(); ++i) {
+            const Edge& edge = graph.graph.edge(i);
+            auto& items = thread_items[omp_get_thread_num()];
+            // Same layout as batch_edge: the data lives on the smaller node's key
+            string data;
+            edge.SerializeToString(&data);
+            bool backward = (edge.from_start() != edge.to_end());
+            items.emplace_back(edge.from_start() ? key_for_edge_on_start(edge.from(), edge.to(), backward)
+                                                 : key_for_edge_on_end(edge.from(), edge.to(), backward),
+                               edge.from() <= edge.to() ? data : string());
+            items.emplace_back(edge.to_end() ? key_for_edge_on_end(edge.to(), edge.from(), backward)
+                                             : key_for_edge_on_start(edge.to(), edge.from(), backward),
+                               edge.to() <= edge.from() ? data : string());
+        }
+        vector<pair<string, string>> items;
+        for (auto& thread : thread_items) {
+            move(thread.begin(), thread.end(), back_inserter(items));
+            thread.clear();
+        }
+        ingest_sharded(items);
+        return;
+    }
+
     // a bit of a hack--- the logging only works with for_each_*parallel
     // also the high parallelism may be causing issues
     int thread_count = 1;
@@ -1043,6 +1081,50 @@ int64_t Index::get_path_id(const string& name) {
 }
 
 void Index::store_paths(VG& graph) {
+    if (bulk_load) {
+        // Assign path ids up front, then build each path's entries in parallel
+        // Paths hands out temporaries, so keep copies
+        vector<Path> paths;
+        vector<int64_t> path_ids;
+        graph.paths.for_each([&](const Path& path) {
+                if (path.name().empty()) {
+                    cerr << "[vg::Index] error, path has no name" << endl;
+                    exit(1);
+                }
+                int64_t path_id = get_path_id(path.name());
+                if (!path_id) {
+                    path_id = new_path_id(path.name());
+                }
+                paths.push_back(path);
+                path_ids.push_back(path_id);
+            });
+        vector<vector<pair<string, string>>> thread_items(omp_get_max_threads());
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < paths.size(); ++i) {
+            auto& items = thread_items[omp_get_thread_num()];
+            const Path& path = paths[i];
+            int64_t path_pos = 0;
+            for (int64_t j = 0; j < path.mapping_size(); ++j) {
+                const Mapping& mapping = path.mapping(j);
+                int64_t node_id = mapping.position().node_id();
+                bool backward = mapping.position().is_reverse();
+                string data;
+                mapping.SerializeToString(&data);
+                items.emplace_back(key_for_path_position(path_ids[i], path_pos, backward, node_id), data);
+                items.emplace_back(key_for_node_path_position(node_id, path_ids[i], path_pos, backward), data);
+                // The graph is in memory, so we needn't read the node back out of the index
+                path_pos += graph.get_node(node_id)->sequence().size();
+            }
+        }
+        vector<pair<string, string>> items;
+        for (auto& thread : thread_items) {
+            move(thread.begin(), thread.end(), back_inserter(items));
+            thread.clear();
+        }
+        ingest_sharded(items);
+        return;
+    }
+
     function<void(const Path&)> lambda = [this, &graph](const Path& path) {
         store_path(graph, path);
     };
@@ -1140,7 +1222,15 @@ void Index::get_mappings(int64_t node_id, vector<Mapping>& mappings) {
         });
 }
 
+void Index::open_gam_index(const string& filename) {
+    gam_index.open(filename);
+}
+
 void Index::get_alignments(int64_t node_id, vector<Alignment>& alignments) {
+    if (gam_index.is_open()) {
+        gam_index.get_alignments(node_id, alignments);
+        return;
+    }
     string start = key_for_alignment_prefix(node_id);
     string end = start + end_sep;
     for_range(start, end, [this, &alignments](string& key, string& value) {
@@ -1151,6 +1241,10 @@ void Index::get_alignments(int64_t node_id, vector<Alignment>& alignments) {
 }
 
 void Index::get_alignments(int64_t id1, int64_t id2, vector<Alignment>& alignments) {
+    if (gam_index.is_open()) {
+        gam_index.get_alignments(id1, id2, alignments);
+        return;
+    }
     string start = key_for_alignment_prefix(id1);
     string end = key_for_alignment_prefix(id2) + end_sep;
     for_range(start, end, [this, &alignments](string& key, string& value) {
@@ -1161,6 +1255,10 @@ void Index::get_alignments(int64_t id1, int64_t id2, vector<Alignment>& alignmen
 }
 
 void Index::for_alignment_in_range(int64_t id1, int64_t id2, std::function<void(const Alignment&)> lambda) {
+    if (gam_index.is_open()) {
+        gam_index.for_alignment_in_range(id1, id2, lambda);
+        return;
+    }
     string start = key_for_alignment_prefix(id1);
     string end = key_for_alignment_prefix(id2) + end_sep;
     for_range(start, end, [this, &lambda](string& key, string& value) {
@@ -1170,7 +1268,15 @@ void Index::for_alignment_in_range(int64_t id1, int64_t id2, std::function<void(
         });
 }
 
+void Index::for_alignment_to_node(int64_t node_id, std::function<void(const Alignment&)> lambda) {
+    for_alignment_to_nodes(vector<int64_t>{node_id}, lambda);
+}
+
 void Index::for_alignment_to_nodes(const vector<int64_t>& ids, std::function<void(const Alignment&)> lambda) {
+    if (gam_index.is_open()) {
+        gam_index.for_alignment_to_nodes(ids, lambda);
+        return;
+    }
     set<int64_t> aln_ids;
     for (auto id : ids) {
         string start = key_prefix_for_traversal(id);
@@ -1575,6 +1681,10 @@ void Index::path_layout(map<string, pair<pair<int64_t, bool>, pair<int64_t, bool
 }
 
 void Index::for_each_alignment(function<void(const Alignment&)> lambda) {
+    if (gam_index.is_open()) {
+        gam_index.for_each_alignment(lambda);
+        return;
+    }
     string key;
     key.resize(2*sizeof(char));
     char* k = (char*) key.c_str();
@@ -2041,6 +2151,11 @@ void Index::batch_kmer(const string& kmer,
 }
 
 void Index::store_batch(map<string, string>& items) {
+    if (bulk_load) {
+        vector<pair<string, string>> sorted_items(items.begin(), items.end());
+        ingest_batch(sorted_items);
+        return;
+    }
     rocksdb::WriteBatch batch;
     for (auto& i : items) {
         const string& k = i.first;
@@ -2051,6 +2166,181 @@ void Index::store_batch(map<string, string>& items) {
     if (!s.ok()) cerr << "an error occurred while inserting items" << endl;
 }
 
+void Index::load_kmers(VG& graph, int kmer_size) {
+    // The index only keeps kmers at their forward-strand start positions.
+    // Kmers are found on all threads, and each thread writes out its own
+    // kmers whenever it has collected enough of them, as one SST file when
+    // open for bulk load, so memory use doesn't grow with the graph. A thread
+    // only writes between nodes, so no key is split between two writes and
+    // the last value for each key wins, as with Put.
+    size_t buffer_limit = 1 << 20;
+    vector<vector<pair<string, string>>> thread_items(omp_get_max_threads());
+    vector<int64_t> thread_node(thread_items.size(), 0);
+    exception_ptr error;
+    auto write_items = [&](vector<pair<string, string>>& items) {
+        try {
+            if (bulk_load) {
+                ingest_batch(items);
+            } else {
+                rocksdb::WriteBatch batch;
+                for (auto& item : items) {
+                    batch.Put(item.first, item.second);
+                }
+                S(db->Write(write_options, &batch));
+            }
+        } catch (...) {
+            // We can't throw out of the worker threads
+#pragma omp critical (load_kmers_error)
+            if (!error) {
+                error = current_exception();
+            }
+        }
+        items.clear();
+    };
+    for_each_kmer(graph, kmer_size, [&](const kmer_t& kmer) {
+            if (kmer.seq.size() != (size_t) kmer_size || is_rev(kmer.begin)) {
+                return;
+            }
+            size_t thread = omp_get_thread_num();
+            auto& items = thread_items[thread];
+            if (items.size() >= buffer_limit && thread_node[thread] != id(kmer.begin)) {
+                write_items(items);
+            }
+            thread_node[thread] = id(kmer.begin);
+            int32_t pos = offset(kmer.begin);
+            string data(sizeof(int32_t), '\0');
+            memcpy((char*) data.c_str(), &pos, sizeof(int32_t));
+            items.emplace_back(key_for_kmer(kmer.seq, id(kmer.begin)), data);
+        });
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < thread_items.size(); ++i) {
+        if (!thread_items[i].empty()) {
+            write_items(thread_items[i]);
+        }
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    remember_kmer_size(kmer_size);
+}
+
+// Distinguishes the SST files written by concurrent ingestions in one process
+static std::atomic<uint64_t> ingest_file_counter(0);
+
+void Index::ingest_batch(vector<pair<string, string>>& items) {
+    vector<vector<pair<string, string>>> shards(1);
+    shards.front().swap(items);
+    ingest_shards(shards);
+}
+
+void Index::ingest_sharded(vector<pair<string, string>>& items) {
+    size_t shard_count = max(1, min(threads, (int) (items.size() / (1 << 16)) + 1));
+    vector<vector<pair<string, string>>> shards(shard_count);
+    if (shard_count == 1) {
+        shards.front().swap(items);
+    } else {
+        // Pick evenly spaced splitters from a sorted sample of the keys, so
+        // that the shards get disjoint key ranges of roughly equal size.
+        // Equal keys always land in the same shard.
+        vector<string> sample;
+        size_t sample_size = shard_count * 32;
+        for (size_t i = 0; i < sample_size; ++i) {
+            sample.push_back(items[(i * items.size()) / sample_size].first);
+        }
+        std::sort(sample.begin(), sample.end());
+        vector<string> splitters;
+        for (size_t i = 1; i < shard_count; ++i) {
+            splitters.push_back(sample[i * 32]);
+        }
+        for (auto& item : items) {
+            size_t shard = upper_bound(splitters.begin(), splitters.end(), item.first) - splitters.begin();
+            shards[shard].push_back(move(item));
+        }
+        items.clear();
+    }
+    ingest_shards(shards);
+}
+
+void Index::ingest_shards(vector<vector<pair<string, string>>>& shards) {
+
+    // Write each shard to its own SST file in parallel
+    vector<string> files(shards.size());
+    vector<rocksdb::Status> statuses(shards.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < shards.size(); ++i) {
+        auto& shard = shards[i];
+        if (shard.empty()) {
+            continue;
+        }
+        // Stable, so that later values for the same key win, as with Put
+        stable_sort(shard.begin(), shard.end(), [](const pair<string, string>& a, const pair<string, string>& b) {
+                return a.first < b.first;
+            });
+
+        string file = name + "/vg-ingest-" + to_string(getpid()) + "-" + to_string(ingest_file_counter++) + ".sst";
+        rocksdb::SstFileWriter writer(rocksdb::EnvOptions(), db_options);
+        rocksdb::Status s = writer.Open(file);
+        for (size_t j = 0; s.ok() && j < shard.size(); ++j) {
+            if (j + 1 < shard.size() && shard[j + 1].first == shard[j].first) {
+                continue;
+            }
+            s = writer.Add(shard[j].first, shard[j].second);
+        }
+        if (s.ok()) {
+            s = writer.Finish();
+        }
+        statuses[i] = s;
+        files[i] = file;
+    }
+    for (auto& s : statuses) {
+        S(s);
+    }
+
+    // Order the files by key range and see whether any of them overlap
+    vector<size_t> order;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (!shards[i].empty()) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return shards[a].front().first < shards[b].front().first;
+        });
+    bool disjoint = true;
+    for (size_t i = 1; i < order.size(); ++i) {
+        if (shards[order[i - 1]].back().first >= shards[order[i]].front().first) {
+            disjoint = false;
+        }
+    }
+
+    rocksdb::IngestExternalFileOptions ingest_options;
+    // Hard link the files into the database instead of copying them
+    ingest_options.move_files = true;
+    ingest_options.allow_blocking_flush = true;
+    if (disjoint) {
+        vector<string> ordered_files;
+        for (auto i : order) {
+            ordered_files.push_back(files[i]);
+        }
+        if (!ordered_files.empty()) {
+            S(db->IngestExternalFile(ordered_files, ingest_options));
+        }
+    } else {
+        // Ingest in the order given, so values in later shards win
+        for (size_t i = 0; i < shards.size(); ++i) {
+            if (!shards[i].empty()) {
+                S(db->IngestExternalFile({files[i]}, ingest_options));
+            }
+        }
+    }
+
+    for (auto i : order) {
+        // Harmless if the file was moved
+        std::remove(files[i].c_str());
+        shards[i].clear();
+    }
+}
+
 void Index::for_all(std::function<void(string&, string&)> lambda) {
     string start(1, start_sep);
     string end(1, end_sep);
@@ -16,10 +16,12 @@
 #include "rocksdb/slice_transform.h"
 #include "rocksdb/table.h"
 #include "rocksdb/filter_policy.h"
+#include "rocksdb/sst_file_writer.h"
 
 #include "json2pb.h"
 #include "vg.hpp"
 #include "hash_map.hpp"
+#include "gam_index.hpp"
 
 namespace vg {
 
@@ -80,6 +82,10 @@ namespace vg {
   +a+node_id+offset                     align_id // for sorting
   +b+align_id                           alignment [vg::Alignment] // stores base alignments
   +t+node_id+strand+align_id            alignment traversal // allows us to quickly go from node traversal to alignments
+
+  Alignments can instead be served from a GAMIndex built from a sorted GAM
+  (see open_gam_index), in which case the alignment queries below read from it
+  rather than from the +a, +b and +t tables.
  */
 
 class Index {
@@ -114,6 +120,10 @@ public:
     bool bulk_load;
     std::atomic<uint64_t> next_nonce;
 
+    // Serve alignment queries from this block-compressed store when it is open
+    GAMIndex gam_index;
+    void open_gam_index(const string& filename);
+
     void load_graph(VG& graph);
     void dump(std::ostream& out);
     void for_all(std::function<void(string&, string&)> lambda);
@@ -296,7 +306,23 @@ public:
 
     void remember_kmer_size(int size);
     set<int> stored_kmer_sizes(void);
+    // Index the forward-strand kmers of the graph, found in parallel and
+    // written in bounded batches per thread, each ingested as its own SST
+    // file when open for bulk load
+    void load_kmers(VG& graph, int kmer_size);
     void store_batch(map<string, string>& items);
+
+    // SST ingestion, used by the bulk load paths. Items are sorted and
+    // deduplicated (the last value for a key wins), written to SST files in
+    // the database directory, and moved into the database, bypassing the
+    // memtable, write-ahead log and compaction.
+    void ingest_batch(vector<pair<string, string>>& items);
+    // Ingest several batches at once, writing one SST file per shard in
+    // parallel. Shards should cover disjoint key ranges; overlapping ones are
+    // ingested one at a time, in order, so later shards win as with Put.
+    void ingest_shards(vector<vector<pair<string, string>>>& shards);
+    // Split items into one sorted shard per thread with disjoint key ranges and ingest them
+    void ingest_sharded(vector<pair<string, string>>& items);
     //void store_positions(VG& graph, std::map<long, Node*>& node_path, std::map<long, Edge*>& edge_path);
 
     // once we have indexed the kmers, we can get the nodes and edges matching
@@ -2,168 +2,192 @@
 
 namespace vg {
 
+/// Buffers that one thread reuses for all the handles it processes, so that
+/// kmer enumeration doesn't allocate once they have grown
+struct kmer_pool_t {
+    kmer_pool_t(void) : kmer("", pos_t(), pos_t(), handle_t()) { };
+    /// The kmer handed to the callback
+    kmer_t kmer;
+    /// Depth-first walk out of the current node, as (handle, bases walked
+    /// before it) pairs
+    vector<pair<handle_t, size_t>> stack;
+    /// Sequence along the walk, after the current node
+    string path_seq;
+    /// Previous context of the first base of the current node
+    vector<pos_t> start_prev_pos;
+    vector<char> start_prev_char;
+    vector<handle_t> nexts;
+};
+
+/// Fill in the next context of a complete kmer, fix up the head and tail
+/// markers, and pass it to the callback. end_seq is the sequence of the handle
+/// the kmer ends on.
+static void finish_kmer(const HandleGraph& graph, kmer_t& kmer, const string& end_seq,
+                        const function<void(const kmer_t&)>& lambda,
+                        id_t head_id, id_t tail_id) {
+    bool using_head_tail = head_id + tail_id > 0;
+    kmer.next_pos.clear();
+    kmer.next_char.clear();
+    // establish the context
+    if (offset(kmer.end) == end_seq.size()) {
+        // have to check which nodes are next
+        graph.follow_edges(kmer.curr, false, [&](const handle_t& next) {
+                kmer.next_pos.emplace_back(graph.get_id(next), graph.get_is_reverse(next), 0);
+                kmer.next_char.emplace_back(graph.get_sequence(next)[0]);
+            });
+        if (kmer.next_pos.empty() && using_head_tail) {
+            if (id(kmer.begin) == head_id) {
+                kmer.next_pos.emplace_back(tail_id, true, 0);
+                kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, true))[0]);
+            } else if (id(kmer.begin) == tail_id) {
+                kmer.next_pos.emplace_back(head_id, false, 0);
+                kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, false))[0]);
+            }
+        }
+    } else {
+        // on node
+        kmer.next_pos.push_back(kmer.end);
+        kmer.next_char.push_back(end_seq[offset(kmer.end)]);
+    }
+    if (!using_head_tail) {
+        // now pass the kmer and its context to our callback
+        lambda(kmer);
+        return;
+    }
+    // if we have head and tail ids set, iterate through our positions and do the flip
+    // flip the beginning
+    if (id(kmer.begin) == head_id && is_rev(kmer.begin)) {
+        get_id(kmer.begin) = tail_id;
+        get_is_rev(kmer.begin) = false;
+    } else if (id(kmer.begin) == tail_id && is_rev(kmer.begin)) {
+        get_id(kmer.begin) = head_id;
+        get_is_rev(kmer.begin) = false;
+    }
+    // flip the nexts
+    for (auto& pos : kmer.next_pos) {
+        if (id(pos) == head_id && is_rev(pos)) {
+            get_id(pos) = tail_id;
+            get_is_rev(pos) = false;
+        } else if (id(pos) == tail_id && is_rev(pos)) {
+            get_id(pos) = head_id;
+            get_is_rev(pos) = false;
+        }
+    }
+    // if we aren't both from and to a head/tail node, emit
+    if (kmer.prev_pos.size() == 1 && kmer.next_pos.size() == 1
+        && (offset(kmer.begin) == 0)
+        && (id(kmer.begin) == head_id || id(kmer.begin) == tail_id)
+        && (id(kmer.prev_pos.front()) == head_id || id(kmer.prev_pos.front()) == tail_id)
+        && (id(kmer.next_pos.front()) == head_id || id(kmer.next_pos.front()) == tail_id)) {
+        // skip
+    } else {
+        lambda(kmer);
+    }
+}
+
 void for_each_kmer(const HandleGraph& graph, size_t k,
                    const function<void(const kmer_t&)>& lambda,
                    id_t head_id, id_t tail_id) {
-    // for each position on the forward and reverse of the graph
-    // TODO -- add parallel interface in handlegraph
+    if (k == 0) {
+        return;
+    }
     bool using_head_tail = head_id + tail_id > 0;
+    vector<kmer_pool_t> pools(get_thread_count());
+    // for each position on the forward and reverse of the graph
     graph.for_each_handle([&](const handle_t& h) {
+            kmer_pool_t& pool = pools[omp_get_thread_num()];
+            kmer_t& kmer = pool.kmer;
+            // Queue up the handles after the given one, so that they come off
+            // the stack in edge order
+            auto push_nexts = [&](const handle_t& from, size_t walked) {
+                pool.nexts.clear();
+                graph.follow_edges(from, false, [&](const handle_t& next) {
+                        pool.nexts.push_back(next);
+                    });
+                for (auto next = pool.nexts.rbegin(); next != pool.nexts.rend(); ++next) {
+                    pool.stack.emplace_back(*next, walked);
+                }
+            };
             // for the forward and reverse of this handle
-            // walk k bases from the end, so that any kmer starting on the node will be represented in the tree we build
             for (auto handle_is_rev : { false, true }) {
-                //cerr << "###########################################" << endl;
                 handle_t handle = handle_is_rev ? graph.flip(h) : h;
-                list<kmer_t> kmers;
-                // for each position in the node, set up a kmer with that start position and the node end or kmer length as the end position
-                // determine next positions
                 id_t handle_id = graph.get_id(handle);
-                size_t handle_length = graph.get_length(handle);
                 string handle_seq = graph.get_sequence(handle);
-                for (size_t i = 0; i < handle_length;  ++i) {
-                    pos_t begin = make_pos_t(handle_id, handle_is_rev, i);
-                    pos_t end = make_pos_t(handle_id, handle_is_rev, min(handle_length, i+k));
-                    kmer_t kmer = kmer_t(handle_seq.substr(offset(begin), offset(end)-offset(begin)), begin, end, handle);
-                    // determine previous context
-                    // if we are running with head/tail nodes, we'll need to do some trickery to eliminate the reverse complement versions of both
+                size_t handle_length = handle_seq.size();
+                if (handle_length == 0) {
+                    continue;
+                }
+
+                // determine the previous context of the node start
+                // if we are running with head/tail nodes, we'll need to do some trickery to eliminate the reverse complement versions of both
+                pool.start_prev_pos.clear();
+                pool.start_prev_char.clear();
+                graph.follow_edges(handle, true, [&](const handle_t& prev) {
+                        string prev_seq = graph.get_sequence(prev);
+                        pool.start_prev_pos.emplace_back(graph.get_id(prev), graph.get_is_reverse(prev), prev_seq.size()-1);
+                        pool.start_prev_char.emplace_back(prev_seq.back());
+                    });
+                // if we're on the forward head or reverse tail, we need to point to the end of the opposite node
+                if (pool.start_prev_pos.empty() && using_head_tail) {
+                    if (handle_id == head_id) {
+                        pool.start_prev_pos.emplace_back(tail_id, false, 0);
+                        pool.start_prev_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, false))[0]);
+                    } else if (handle_id == tail_id) {
+                        pool.start_prev_pos.emplace_back(head_id, true, 0);
+                        pool.start_prev_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, true))[0]);
+                    }
+                }
+                auto start_at = [&](size_t i) {
+                    kmer.begin = make_pos_t(handle_id, handle_is_rev, i);
                     if (i == 0) {
-                        // look at the previous nodes
-                        graph.follow_edges(handle, true, [&](const handle_t& prev) {
-                                size_t prev_length = graph.get_length(prev);
-                                kmer.prev_pos.emplace_back(graph.get_id(prev), graph.get_is_reverse(prev), prev_length-1);
-                                kmer.prev_char.emplace_back(graph.get_sequence(prev).substr(prev_length-1, 1)[0]);
-                            });
-                        // if we're on the forward head or reverse tail, we need to point to the end of the opposite node
-                        if (kmer.prev_pos.empty() && using_head_tail) {
-                            if (id(begin) == head_id) {
-                                kmer.prev_pos.emplace_back(tail_id, false, 0);
-                                kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, false))[0]);
-                            } else if (id(begin) == tail_id) {
-                                kmer.prev_pos.emplace_back(head_id, true, 0);
-                                kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, true))[0]);
-                            }
-                        }
+                        kmer.prev_pos = pool.start_prev_pos;
+                        kmer.prev_char = pool.start_prev_char;
                     } else {
                         // the previous is in this node
-                        kmer.prev_pos.emplace_back(handle_id, handle_is_rev, i-1);
-                        kmer.prev_char.emplace_back(handle_seq[i-1]);
-                    }
-                    if (kmer.seq.size() < k) {
-                        kmer.seq.reserve(k); // may reduce allocation costs
-                        // follow edges if we haven't completed the kmer here
-                        graph.follow_edges(kmer.curr, false, [&](const handle_t& next) {
-                                kmers.push_back(kmer);
-                                auto& todo = kmers.back();
-                                todo.curr = next;
-                            });
-                    } else {
-                        kmers.push_back(kmer);
+                        kmer.prev_pos.assign(1, make_pos_t(handle_id, handle_is_rev, i-1));
+                        kmer.prev_char.assign(1, handle_seq[i-1]);
                     }
+                };
+
+                // kmers that fit in the node
+                for (size_t i = 0; i + k <= handle_length; ++i) {
+                    start_at(i);
+                    kmer.seq.assign(handle_seq, i, k);
+                    kmer.end = make_pos_t(handle_id, handle_is_rev, i + k);
+                    kmer.curr = handle;
+                    finish_kmer(graph, kmer, handle_seq, lambda, head_id, tail_id);
                 }
 
-                // now expand the kmers until they reach k
-                while (!kmers.empty()) {
-                    // first we check which ones have reached length k in the current handle; for each of these we run lambda and remove them from our list
-                    auto kmers_end = kmers.end();
-                    for (list<kmer_t>::iterator q = kmers.begin(); q != kmers_end; ++q) {
-                        auto& kmer = *q;
-                        // did we reach our target length?
-                        if (kmer.seq.size() == k) {
-                            // TODO here check if we are at the beginning of the reverse head or the beginning of the forward tail and would need special handling
-                            // establish the context
-                            handle_t end_handle = graph.get_handle(id(kmer.end), is_rev(kmer.end));
-                            size_t end_length = graph.get_length(end_handle);
-                            if (offset(kmer.end) == end_length) {
-                                // have to check which nodes are next
-                                graph.follow_edges(kmer.curr, false, [&](const handle_t& next) {
-                                        kmer.next_pos.emplace_back(graph.get_id(next), graph.get_is_reverse(next), 0);
-                                        kmer.next_char.emplace_back(graph.get_sequence(next)[0]);
-                                    });
-                                if (kmer.next_pos.empty() && using_head_tail) {
-                                    if (id(kmer.begin) == head_id) {
-                                        kmer.next_pos.emplace_back(tail_id, true, 0);
-                                        kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, true))[0]);
-                                    } else if (id(kmer.begin) == tail_id) {
-                                        kmer.next_pos.emplace_back(head_id, false, 0);
-                                        kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, false))[0]);
-                                    }
-                                    //cerr << "done head or tail" << endl;
-                                }
-                            } else {
-                                // on node
-                                kmer.next_pos.push_back(kmer.end);
-                                kmer.next_char.push_back(graph.get_sequence(end_handle)[offset(kmer.end)]);
-                            }
-                            // if we have head and tail ids set, iterate through our positions and do the flip
-                            if (using_head_tail) {
-                                // flip the beginning
-                                if (id(kmer.begin) == head_id && is_rev(kmer.begin)) {
-                                    get_id(kmer.begin) = tail_id;
-                                    get_is_rev(kmer.begin) = false;
-                                } else if (id(kmer.begin) == tail_id && is_rev(kmer.begin)) {
-                                    get_id(kmer.begin) = head_id;
-                                    get_is_rev(kmer.begin) = false;
-                                }
-                                // flip the nexts
-                                for (auto& pos : kmer.next_pos) {
-                                    if (id(pos) == head_id && is_rev(pos)) {
-                                        get_id(pos) = tail_id;
-                                        get_is_rev(pos) = false;
-                                    } else if (id(pos) == tail_id && is_rev(pos)) {
-                                        get_id(pos) = head_id;
-                                        get_is_rev(pos) = false;
-                                    }
-                                }
-                                // if we aren't both from and to a head/tail node, emit
-                                /*
-                                if (!((offset(kmer.begin) == 0
-                                       && id(kmer.begin) == head_id
-                                       && kmer.next_pos.size() == 1
-                                       && id(kmer.next_pos.front()) == tail_id)
-                                      || (offset(kmer.begin) == 0
-                                          && id(kmer.begin) == tail_id
-                                          && kmer.next_pos.size() == 1
-                                          && id(kmer.next_pos.front()) == head_id))) {
-                                    lambda(kmer);
-                                }
-                                */
-                                if (kmer.prev_pos.size() == 1 && kmer.next_pos.size() == 1
-                                    && (offset(kmer.begin) == 0)
-                                    && (id(kmer.begin) == head_id || id(kmer.begin) == tail_id)
-                                    && (id(kmer.prev_pos.front()) == head_id || id(kmer.prev_pos.front()) == tail_id)
-                                    && (id(kmer.next_pos.front()) == head_id || id(kmer.next_pos.front()) == tail_id)) {
-                                    // skip
-                                } else {
-                                    lambda(kmer);
-                                }
-                            } else {
-                                // now pass the kmer and its context to our callback
-                                lambda(kmer);
-                            }
-                            q = kmers.erase(q);
-                        } else {
-                            // do we finish in the current node?
-                            id_t curr_id = graph.get_id(kmer.curr);
-                            size_t curr_length = graph.get_length(kmer.curr);
-                            bool curr_is_rev = graph.get_is_reverse(kmer.curr);
-                            string curr_seq = graph.get_sequence(kmer.curr);
-                            size_t take = min(curr_length, k-kmer.seq.size());
-                            kmer.end = make_pos_t(curr_id, curr_is_rev, take);
-                            kmer.seq.append(curr_seq.substr(0,take));
-                            if (kmer.seq.size() < k) {
-                                // if not, we need to expand through the node then follow on
-                                graph.follow_edges(kmer.curr, false, [&](const handle_t& next) {
-                                        kmers.push_back(kmer);
-                                        auto& todo = kmers.back();
-                                        todo.curr = next;
-                                    });
-                                q = kmers.erase(q);
-                            } else {
-                                if (kmer.seq.size() > k) {
-                                    assert(kmer.seq.size() <= k);
-                                }
-                            }
-                        }
+                // The kmer starting at offset i needs k - (handle_length - i)
+                // bases past the end of the node. Walk out depth first, so
+                // each distinct walk of up to k - 1 bases is visited once, and
+                // finish the kmers whose ends fall in each handle we reach.
+                size_t first_start = handle_length >= k ? handle_length - k + 1 : 0;
+                size_t min_needed = k - (handle_length - first_start);
+                pool.stack.clear();
+                if (k > 1) {
+                    push_nexts(handle, 0);
+                }
+                while (!pool.stack.empty()) {
+                    handle_t curr = pool.stack.back().first;
+                    size_t walked = pool.stack.back().second;
+                    pool.stack.pop_back();
+                    string curr_seq = graph.get_sequence(curr);
+                    size_t take = min(curr_seq.size(), k - 1 - walked);
+                    pool.path_seq.resize(walked);
+                    pool.path_seq.append(curr_seq, 0, take);
+                    for (size_t needed = max(min_needed, walked + 1); needed <= walked + take; ++needed) {
+                        size_t i = handle_length + needed - k;
+                        start_at(i);
+                        kmer.seq.assign(handle_seq, i, handle_length - i);
+                        kmer.seq.append(pool.path_seq, 0, needed);
+                        kmer.end = make_pos_t(graph.get_id(curr), graph.get_is_reverse(curr), needed - walked);
+                        kmer.curr = curr;
+                        finish_kmer(graph, kmer, curr_seq, lambda, head_id, tail_id);
+                    }
+                    if (walked + curr_seq.size() < k - 1) {
+                        // if not, we need to expand through the node then follow on
+                        push_nexts(curr, walked + curr_seq.size());
                     }
                 }
             }
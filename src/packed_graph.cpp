@@ -0,0 +1,1023 @@
+#include "packed_graph.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+#include <omp.h>
+
+#include "stream.hpp"
+#include "utility.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/// Don't bother compacting storage smaller than this
+const size_t MIN_COMPACTION_SIZE = 1024;
+
+PackedGraph::PackedGraph(void) {
+    // Nothing to do
+}
+
+PackedGraph::PackedGraph(istream& in, bool keep_paths) {
+    // Edges and path visits may refer to nodes in later chunks
+    vector<pair<int64_t, int64_t>> pending_edges;
+    // Visits are kept as (rank, handle, bases matched, or -1 for no edits)
+    unordered_map<string, vector<tuple<int64_t, int64_t, int64_t>>> pending_steps;
+    vector<string> path_order;
+
+    function<void(Graph&)> lambda = [&](Graph& g) {
+        for (size_t i = 0; i < g.node_size(); i++) {
+            const Node& node = g.node(i);
+            if (!has_node(node.id())) {
+                create_handle(node.sequence(), node.id());
+            }
+        }
+        for (size_t i = 0; i < g.edge_size(); i++) {
+            const Edge& edge = g.edge(i);
+            pending_edges.emplace_back(as_integer(get_handle(edge.from(), edge.from_start())),
+                                       as_integer(get_handle(edge.to(), edge.to_end())));
+        }
+        for (size_t i = 0; keep_paths && i < g.path_size(); i++) {
+            const Path& path = g.path(i);
+            auto found = pending_steps.find(path.name());
+            if (found == pending_steps.end()) {
+                path_order.push_back(path.name());
+                found = pending_steps.emplace(path.name(), vector<tuple<int64_t, int64_t, int64_t>>()).first;
+                if (path.is_circular()) {
+                    create_path(path.name(), true);
+                }
+            }
+            for (size_t j = 0; j < path.mapping_size(); j++) {
+                const Mapping& mapping = path.mapping(j);
+                if (mapping.position().offset() != 0) {
+                    throw UnsupportedPathError("[PackedGraph] path " + path.name() + " has a mapping with an offset");
+                }
+                int64_t matched = mapping.edit_size() == 0 ? -1 : 0;
+                for (size_t k = 0; k < mapping.edit_size(); k++) {
+                    const Edit& edit = mapping.edit(k);
+                    if (edit.from_length() != edit.to_length() || !edit.sequence().empty()) {
+                        throw UnsupportedPathError("[PackedGraph] path " + path.name() + " has a mapping that is not a match");
+                    }
+                    matched += edit.from_length();
+                }
+                // Ranks are 1-based; unranked mappings keep their stream order
+                found->second.emplace_back(mapping.rank(),
+                                           as_integer(get_handle(mapping.position().node_id(),
+                                                                 mapping.position().is_reverse())),
+                                           matched);
+            }
+        }
+    };
+    stream::for_each(in, lambda);
+
+    for (auto& edge : pending_edges) {
+        if (!has_node(get_id(as_handle(edge.first))) || !has_node(get_id(as_handle(edge.second)))) {
+            throw runtime_error("[PackedGraph] edge refers to a missing node");
+        }
+        create_edge(as_handle(edge.first), as_handle(edge.second));
+    }
+    pending_edges.clear();
+
+    for (auto& name : path_order) {
+        auto& visits = pending_steps[name];
+        stable_sort(visits.begin(), visits.end(), [](const tuple<int64_t, int64_t, int64_t>& a,
+                                                     const tuple<int64_t, int64_t, int64_t>& b) {
+            return get<0>(a) < get<0>(b);
+        });
+        create_path(name);
+        for (auto& visit : visits) {
+            handle_t handle = as_handle(get<1>(visit));
+            if (!has_node(get_id(handle))) {
+                throw runtime_error("[PackedGraph] path " + name + " visits a missing node");
+            }
+            if (get<2>(visit) != -1 && (size_t) get<2>(visit) != get_length(handle)) {
+                throw UnsupportedPathError("[PackedGraph] path " + name + " has a mapping that covers part of a node");
+            }
+            append_step(name, handle);
+        }
+        // Free as we go
+        vector<tuple<int64_t, int64_t, int64_t>>().swap(visits);
+    }
+}
+
+void PackedGraph::serialize_to_ostream(ostream& out, size_t chunk_size) const {
+    // Elements are node slots followed by path steps in path order
+    size_t slot_count = node_ids.size();
+    size_t total_steps = 0;
+    for (size_t i = 0; i < path_names.size(); i++) {
+        total_steps += path_lengths[i];
+    }
+
+    // Where each chunk we have reached starts in the paths, as path, step and
+    // rank, so we can resume there, or retry a chunk that was too big
+    struct cursor_t {
+        size_t path;
+        uint64_t step;
+        size_t rank;
+    };
+    unordered_map<uint64_t, cursor_t> cursors;
+    {
+        size_t path = 0;
+        while (path < path_names.size() && path_heads[path] == 0) {
+            path++;
+        }
+        cursors[slot_count] = cursor_t{path, path < path_names.size() ? path_heads[path] : 0, 1};
+    }
+
+    function<Graph(uint64_t, uint64_t)> lambda = [&](uint64_t element_start, uint64_t element_length) -> Graph {
+        Graph g;
+        uint64_t element_end = element_start + element_length;
+
+        for (size_t slot = element_start; slot < element_end && slot < slot_count; slot++) {
+            id_t node_id = node_ids.get(slot);
+            if (node_id == 0) {
+                continue;
+            }
+            handle_t handle = get_handle(node_id);
+            Node* node = g.add_node();
+            node->set_id(node_id);
+            node->set_sequence(get_sequence(handle));
+
+            // Write each edge once, from the node with the smaller ID, or from
+            // the right side list for self loops that appear in both lists
+            for (size_t side : {LEFT, RIGHT}) {
+                for (uint64_t record = edge_heads.get(2 * slot + side); record != 0;
+                     record = edge_lists.get(2 * (record - 1) + 1)) {
+                    handle_t other = unpack(edge_lists.get(2 * (record - 1)));
+                    id_t other_id = get_id(other);
+                    if (other_id < node_id || (other_id == node_id && side == LEFT && !get_is_reverse(other))) {
+                        continue;
+                    }
+                    edge_t edge = side == RIGHT ? make_pair(handle, other) : make_pair(other, handle);
+                    Edge* e = g.add_edge();
+                    e->set_from(get_id(edge.first));
+                    e->set_from_start(get_is_reverse(edge.first));
+                    e->set_to(get_id(edge.second));
+                    e->set_to_end(get_is_reverse(edge.second));
+                }
+            }
+        }
+
+        if (element_start == 0) {
+            // Empty paths go in the first chunk
+            for (size_t path = 0; path < path_names.size(); path++) {
+                if (path_lengths[path] == 0) {
+                    Path* p = g.add_path();
+                    p->set_name(path_names[path]);
+                    p->set_is_circular(path_circular[path]);
+                }
+            }
+        }
+
+        if (element_end > slot_count) {
+            uint64_t element = max<uint64_t>(element_start, slot_count);
+            cursor_t cursor = cursors.at(element);
+            size_t path = cursor.path;
+            uint64_t step = cursor.step;
+            // Ranks count from 1 along each path
+            size_t rank = cursor.rank;
+            Path* p = nullptr;
+            for (; element < element_end && path < path_names.size(); element++) {
+                if (p == nullptr) {
+                    p = g.add_path();
+                    p->set_name(path_names[path]);
+                    p->set_is_circular(path_circular[path]);
+                }
+                handle_t handle = unpack(steps.get((step - 1) * STEP_RECORD_SIZE + STEP_HANDLE));
+                Mapping* mapping = p->add_mapping();
+                mapping->mutable_position()->set_node_id(get_id(handle));
+                mapping->mutable_position()->set_is_reverse(get_is_reverse(handle));
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(get_length(handle));
+                edit->set_to_length(get_length(handle));
+                mapping->set_rank(rank++);
+
+                step = steps.get((step - 1) * STEP_RECORD_SIZE + STEP_NEXT);
+                if (step == 0) {
+                    // On to the next nonempty path
+                    p = nullptr;
+                    do {
+                        path++;
+                    } while (path < path_names.size() && path_heads[path] == 0);
+                    step = path < path_names.size() ? path_heads[path] : 0;
+                    rank = 1;
+                }
+            }
+            cursors[element_end] = cursor_t{path, step, rank};
+        }
+
+        return g;
+    };
+
+    stream::write(out, slot_count + total_steps, chunk_size, lambda);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// HandleGraph interface
+////////////////////////////////////////////////////////////////////////////
+
+handle_t PackedGraph::get_handle(const id_t& node_id, bool is_reverse) const {
+    return as_handle(((int64_t) node_id << 1) | (int64_t) is_reverse);
+}
+
+id_t PackedGraph::get_id(const handle_t& handle) const {
+    return as_integer(handle) >> 1;
+}
+
+bool PackedGraph::get_is_reverse(const handle_t& handle) const {
+    return as_integer(handle) & 1;
+}
+
+handle_t PackedGraph::flip(const handle_t& handle) const {
+    return as_handle(as_integer(handle) ^ 1);
+}
+
+size_t PackedGraph::get_length(const handle_t& handle) const {
+    return seq_lengths.get(slot_of(get_id(handle)));
+}
+
+string PackedGraph::get_sequence(const handle_t& handle) const {
+    static const char BASES[] = "ACGT";
+    size_t slot = slot_of(get_id(handle));
+    size_t start = seq_starts.get(slot);
+    size_t length = seq_lengths.get(slot);
+    string seq(length, 'N');
+    for (size_t i = 0; i < length; i++) {
+        seq[i] = BASES[sequence.get(start + i)];
+    }
+    if (!sequence_exceptions.empty()) {
+        for (size_t i = 0; i < length; i++) {
+            auto found = sequence_exceptions.find(start + i);
+            if (found != sequence_exceptions.end()) {
+                seq[i] = found->second;
+            }
+        }
+    }
+    return get_is_reverse(handle) ? reverse_complement(seq) : seq;
+}
+
+bool PackedGraph::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
+    size_t slot = slot_of(get_id(handle));
+    bool is_reverse = get_is_reverse(handle);
+    // Going left on the reverse strand is going right on the forward strand
+    size_t side = (go_left != is_reverse) ? LEFT : RIGHT;
+    for (uint64_t record = edge_heads.get(2 * slot + side); record != 0;
+         record = edge_lists.get(2 * (record - 1) + 1)) {
+        handle_t next = unpack(edge_lists.get(2 * (record - 1)));
+        if (!iteratee(is_reverse ? flip(next) : next)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PackedGraph::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    size_t slot_count = node_ids.size();
+    if (parallel) {
+#pragma omp parallel for schedule(dynamic,1)
+        for (size_t slot = 0; slot < slot_count; slot++) {
+            id_t node_id = node_ids.get(slot);
+            if (node_id != 0) {
+                // We can't stop early in parallel
+                iteratee(get_handle(node_id, false));
+            }
+        }
+    } else {
+        for (size_t slot = 0; slot < node_ids.size(); slot++) {
+            id_t node_id = node_ids.get(slot);
+            if (node_id != 0 && !iteratee(get_handle(node_id, false))) {
+                return;
+            }
+        }
+    }
+}
+
+size_t PackedGraph::node_size() const {
+    return live_nodes;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// MutableHandleGraph interface
+////////////////////////////////////////////////////////////////////////////
+
+handle_t PackedGraph::create_handle(const string& sequence) {
+    return create_handle(sequence, max_id + 1);
+}
+
+handle_t PackedGraph::create_handle(const string& sequence, const id_t& id) {
+    if (id <= 0) {
+        throw runtime_error("[PackedGraph] node IDs must be positive");
+    }
+    if (has_node(id)) {
+        throw runtime_error("[PackedGraph] node ID " + to_string(id) + " is already in use");
+    }
+    size_t start = append_sequence(sequence);
+    return add_slot(id, start, sequence.size());
+}
+
+void PackedGraph::destroy_handle(const handle_t& handle) {
+    handle_t forward = get_is_reverse(handle) ? flip(handle) : handle;
+    for (auto& edge : edges_of(forward)) {
+        destroy_edge(edge.first, edge.second);
+    }
+    size_t slot = slot_of(get_id(forward));
+    for (uint64_t step : steps_on(slot)) {
+        remove_step(step);
+    }
+
+    size_t length = seq_lengths.get(slot);
+    live_bases -= length;
+    dead_bases += length;
+
+    id_to_slot.set(get_id(forward) - id_offset, 0);
+    node_ids.set(slot, 0);
+    seq_starts.set(slot, 0);
+    seq_lengths.set(slot, 0);
+    live_nodes--;
+
+    maybe_compact_sequence();
+    maybe_compact_steps();
+    maybe_compact_slots();
+}
+
+void PackedGraph::create_edge(const handle_t& left, const handle_t& right) {
+    if (has_edge(left, right)) {
+        return;
+    }
+    size_t slot1, side1, slot2, side2;
+    uint64_t value1, value2;
+    bool has_second;
+    edge_records(left, right, slot1, side1, value1, has_second, slot2, side2, value2);
+    add_edge_record(slot1, side1, value1);
+    if (has_second) {
+        add_edge_record(slot2, side2, value2);
+    }
+    live_edges++;
+}
+
+void PackedGraph::destroy_edge(const handle_t& left, const handle_t& right) {
+    size_t slot1, side1, slot2, side2;
+    uint64_t value1, value2;
+    bool has_second;
+    edge_records(left, right, slot1, side1, value1, has_second, slot2, side2, value2);
+    if (!remove_edge_record(slot1, side1, value1)) {
+        // No such edge
+        return;
+    }
+    if (has_second) {
+        remove_edge_record(slot2, side2, value2);
+    }
+    live_edges--;
+    maybe_compact_edges();
+}
+
+void PackedGraph::swap_handles(const handle_t& a, const handle_t& b) {
+    size_t slot_a = slot_of(get_id(a));
+    size_t slot_b = slot_of(get_id(b));
+    if (slot_a == slot_b) {
+        return;
+    }
+    auto swap_entries = [](PagedVector& v, size_t i, size_t j) {
+        uint64_t tmp = v.get(i);
+        v.set(i, v.get(j));
+        v.set(j, tmp);
+    };
+    swap_entries(node_ids, slot_a, slot_b);
+    swap_entries(seq_starts, slot_a, slot_b);
+    swap_entries(occurrence_heads, slot_a, slot_b);
+    swap_entries(edge_heads, 2 * slot_a + LEFT, 2 * slot_b + LEFT);
+    swap_entries(edge_heads, 2 * slot_a + RIGHT, 2 * slot_b + RIGHT);
+    uint64_t length = seq_lengths.get(slot_a);
+    seq_lengths.set(slot_a, seq_lengths.get(slot_b));
+    seq_lengths.set(slot_b, length);
+
+    id_to_slot.set(get_id(a) - id_offset, slot_b + 1);
+    id_to_slot.set(get_id(b) - id_offset, slot_a + 1);
+}
+
+handle_t PackedGraph::apply_orientation(const handle_t& handle) {
+    if (!get_is_reverse(handle)) {
+        return handle;
+    }
+    id_t node_id = get_id(handle);
+    size_t slot = slot_of(node_id);
+
+    // Store the reverse complement as the new forward sequence
+    string flipped = get_sequence(handle);
+    seq_starts.set(slot, append_sequence(flipped));
+    dead_bases += flipped.size();
+
+    // Everything that referred to one strand now refers to the other
+    auto reorient = [&](const handle_t& h) {
+        return get_id(h) == node_id ? flip(h) : h;
+    };
+    vector<edge_t> edges = edges_of(handle);
+    for (auto& edge : edges) {
+        destroy_edge(edge.first, edge.second);
+    }
+    for (auto& edge : edges) {
+        create_edge(reorient(edge.first), reorient(edge.second));
+    }
+    for (uint64_t step : steps_on(slot)) {
+        size_t field = (step - 1) * STEP_RECORD_SIZE + STEP_HANDLE;
+        steps.set(field, pack(flip(unpack(steps.get(field)))));
+    }
+
+    maybe_compact_sequence();
+    return get_handle(node_id, false);
+}
+
+vector<handle_t> PackedGraph::divide_handle(const handle_t& handle, const vector<size_t>& offsets) {
+    id_t node_id = get_id(handle);
+    bool is_reverse = get_is_reverse(handle);
+    size_t slot = slot_of(node_id);
+    size_t start = seq_starts.get(slot);
+    size_t length = seq_lengths.get(slot);
+
+    // Work out the break points on the forward strand
+    vector<size_t> breaks;
+    for (size_t offset : offsets) {
+        size_t forward_offset = is_reverse ? length - offset : offset;
+        if (forward_offset > 0 && forward_offset < length) {
+            breaks.push_back(forward_offset);
+        }
+    }
+    sort(breaks.begin(), breaks.end());
+    breaks.erase(unique(breaks.begin(), breaks.end()), breaks.end());
+    breaks.push_back(length);
+
+    vector<edge_t> edges = edges_of(handle);
+    for (auto& edge : edges) {
+        destroy_edge(edge.first, edge.second);
+    }
+
+    // The original node keeps the first piece; the others share the rest of
+    // its sequence range
+    vector<handle_t> pieces { get_handle(node_id, false) };
+    seq_lengths.set(slot, breaks.front());
+    for (size_t i = 1; i < breaks.size(); i++) {
+        pieces.push_back(add_slot(max_id + 1, start + breaks[i - 1], breaks[i] - breaks[i - 1]));
+    }
+    // add_slot counted the split off bases again
+    live_bases -= length - breaks.front();
+
+    // The left side stays on the first piece and the right side moves to the last
+    auto leaving = [&](const handle_t& h) {
+        if (get_id(h) != node_id) {
+            return h;
+        }
+        return get_is_reverse(h) ? flip(pieces.front()) : pieces.back();
+    };
+    auto entering = [&](const handle_t& h) {
+        if (get_id(h) != node_id) {
+            return h;
+        }
+        return get_is_reverse(h) ? flip(pieces.back()) : pieces.front();
+    };
+    for (auto& edge : edges) {
+        create_edge(leaving(edge.first), entering(edge.second));
+    }
+    for (size_t i = 0; i + 1 < pieces.size(); i++) {
+        create_edge(pieces[i], pieces[i + 1]);
+    }
+
+    // Expand each path visit into visits to all the pieces
+    for (uint64_t step : steps_on(slot)) {
+        size_t path = steps.get((step - 1) * STEP_RECORD_SIZE + STEP_PATH);
+        bool visit_reverse = get_is_reverse(unpack(steps.get((step - 1) * STEP_RECORD_SIZE + STEP_HANDLE)));
+        if (visit_reverse) {
+            // The existing visit becomes the last piece on the reverse strand
+            size_t old_occurrence = occurrence_heads.get(slot);
+            // Unlink it from the first piece's occurrences and give it to the last
+            if (old_occurrence == step) {
+                occurrence_heads.set(slot, steps.get((step - 1) * STEP_RECORD_SIZE + STEP_NEXT_OCCURRENCE));
+            } else {
+                uint64_t prev = old_occurrence;
+                while (steps.get((prev - 1) * STEP_RECORD_SIZE + STEP_NEXT_OCCURRENCE) != step) {
+                    prev = steps.get((prev - 1) * STEP_RECORD_SIZE + STEP_NEXT_OCCURRENCE);
+                }
+                steps.set((prev - 1) * STEP_RECORD_SIZE + STEP_NEXT_OCCURRENCE,
+                          steps.get((step - 1) * STEP_RECORD_SIZE + STEP_NEXT_OCCURRENCE));
+            }
+            size_t last_slot = slot_of(get_id(pieces.back()));
+            steps.set((step - 1) * STEP_RECORD_SIZE + STEP_HANDLE, pack(flip(pieces.back())));
+            steps.set((step - 1) * STEP_RECORD_SIZE + STEP_NEXT_OCCURRENCE, occurrence_heads.get(last_slot));
+            occurrence_heads.set(last_slot, step);
+
+            uint64_t after = step;
+            for (size_t i = pieces.size() - 1; i-- > 0;) {
+                after = insert_step(path, after, flip(pieces[i]));
+            }
+        } else {
+            uint64_t after = step;
+            for (size_t i = 1; i < pieces.size(); i++) {
+                after = insert_step(path, after, pieces[i]);
+            }
+        }
+    }
+
+    if (is_reverse) {
+        reverse(pieces.begin(), pieces.end());
+        for (auto& piece : pieces) {
+            piece = flip(piece);
+        }
+    }
+    return pieces;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Whole-graph operations
+////////////////////////////////////////////////////////////////////////////
+
+bool PackedGraph::has_node(id_t node_id) const {
+    if (node_id < id_offset || node_id - id_offset >= (id_t) id_to_slot.size()) {
+        return false;
+    }
+    return id_to_slot.get(node_id - id_offset) != 0;
+}
+
+bool PackedGraph::has_edge(const handle_t& left, const handle_t& right) const {
+    size_t slot1, side1, slot2, side2;
+    uint64_t value1, value2;
+    bool has_second;
+    edge_records(left, right, slot1, side1, value1, has_second, slot2, side2, value2);
+    for (uint64_t record = edge_heads.get(2 * slot1 + side1); record != 0;
+         record = edge_lists.get(2 * (record - 1) + 1)) {
+        if (edge_lists.get(2 * (record - 1)) == value1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t PackedGraph::edge_size(void) const {
+    return live_edges;
+}
+
+id_t PackedGraph::max_node_id(void) const {
+    for (size_t i = id_to_slot.size(); i > 0; i--) {
+        if (id_to_slot.get(i - 1) != 0) {
+            return id_offset + i - 1;
+        }
+    }
+    return 0;
+}
+
+id_t PackedGraph::min_node_id(void) const {
+    for (size_t i = 0; i < id_to_slot.size(); i++) {
+        if (id_to_slot.get(i) != 0) {
+            return id_offset + i;
+        }
+    }
+    return 0;
+}
+
+void PackedGraph::increment_node_ids(id_t increment) {
+    reassign_ids([&](id_t node_id) { return node_id + increment; });
+}
+
+void PackedGraph::decrement_node_ids(id_t decrement) {
+    increment_node_ids(-decrement);
+}
+
+void PackedGraph::compact_ids(void) {
+    unordered_map<id_t, id_t> renumbered;
+    renumbered.reserve(live_nodes);
+    id_t next_id = 1;
+    for_each_handle([&](const handle_t& handle) {
+        renumbered[get_id(handle)] = next_id++;
+    });
+    reassign_ids([&](id_t node_id) { return renumbered.at(node_id); });
+}
+
+size_t PackedGraph::memory_usage(void) const {
+    size_t total = sizeof(*this);
+    total += node_ids.memory_usage() + seq_starts.memory_usage() + seq_lengths.memory_usage();
+    total += edge_heads.memory_usage() + occurrence_heads.memory_usage() + id_to_slot.memory_usage();
+    total += sequence.memory_usage() + sequence_exceptions.size() * (sizeof(size_t) + sizeof(char));
+    total += edge_lists.memory_usage() + steps.memory_usage();
+    for (auto& name : path_names) {
+        total += name.capacity();
+    }
+    return total;
+}
+
+void PackedGraph::reassign_ids(const function<id_t(id_t)>& new_id) {
+    auto reassign = [&](uint64_t packed) {
+        handle_t handle = unpack(packed);
+        return pack(get_handle(new_id(get_id(handle)), get_is_reverse(handle)));
+    };
+
+    id_t new_min = numeric_limits<id_t>::max();
+    max_id = 0;
+    for (size_t slot = 0; slot < node_ids.size(); slot++) {
+        id_t node_id = node_ids.get(slot);
+        if (node_id == 0) {
+            continue;
+        }
+        id_t renumbered = new_id(node_id);
+        if (renumbered <= 0) {
+            throw runtime_error("[PackedGraph] node IDs must be positive");
+        }
+        node_ids.set(slot, renumbered);
+        new_min = min(new_min, renumbered);
+        max_id = max(max_id, renumbered);
+    }
+    for (size_t i = 0; i < edge_lists.size(); i += 2) {
+        uint64_t value = edge_lists.get(i);
+        if (value != 0) {
+            edge_lists.set(i, reassign(value));
+        }
+    }
+    for (size_t i = STEP_HANDLE; i < steps.size(); i += STEP_RECORD_SIZE) {
+        uint64_t value = steps.get(i);
+        if (value != 0) {
+            steps.set(i, reassign(value));
+        }
+    }
+
+    id_to_slot.clear();
+    id_offset = live_nodes > 0 ? new_min : 0;
+    for (size_t slot = 0; slot < node_ids.size(); slot++) {
+        id_t node_id = node_ids.get(slot);
+        if (node_id != 0) {
+            reserve_id(node_id);
+            id_to_slot.set(node_id - id_offset, slot + 1);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Paths
+////////////////////////////////////////////////////////////////////////////
+
+bool PackedGraph::has_path(const string& name) const {
+    return path_index.count(name);
+}
+
+void PackedGraph::create_path(const string& name, bool is_circular) {
+    if (has_path(name)) {
+        return;
+    }
+    path_index[name] = path_names.size();
+    path_names.push_back(name);
+    path_circular.push_back(is_circular);
+    path_heads.push_back(0);
+    path_tails.push_back(0);
+    path_lengths.push_back(0);
+}
+
+void PackedGraph::append_step(const string& name, const handle_t& handle) {
+    create_path(name);
+    size_t path = path_index.at(name);
+    insert_step(path, path_tails[path], handle);
+}
+
+size_t PackedGraph::path_count(void) const {
+    return path_names.size();
+}
+
+size_t PackedGraph::path_step_count(const string& name) const {
+    return path_lengths[path_index.at(name)];
+}
+
+void PackedGraph::for_each_path_name(const function<void(const string&)>& iteratee) const {
+    for (auto& name : path_names) {
+        iteratee(name);
+    }
+}
+
+void PackedGraph::for_each_step(const string& name, const function<void(const handle_t&)>& iteratee) const {
+    for (uint64_t step = path_heads[path_index.at(name)]; step != 0;
+         step = steps.get((step - 1) * STEP_RECORD_SIZE + STEP_NEXT)) {
+        iteratee(unpack(steps.get((step - 1) * STEP_RECORD_SIZE + STEP_HANDLE)));
+    }
+}
+
+void PackedGraph::clear_paths(void) {
+    steps.clear();
+    dead_step_records = 0;
+    path_names.clear();
+    path_circular.clear();
+    path_heads.clear();
+    path_tails.clear();
+    path_lengths.clear();
+    path_index.clear();
+    for (size_t slot = 0; slot < occurrence_heads.size(); slot++) {
+        occurrence_heads.set(slot, 0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Internals
+////////////////////////////////////////////////////////////////////////////
+
+size_t PackedGraph::slot_of(id_t node_id) const {
+    return id_to_slot.get(node_id - id_offset) - 1;
+}
+
+void PackedGraph::reserve_id(id_t node_id) {
+    if (id_to_slot.empty()) {
+        id_offset = node_id;
+    } else if (node_id < id_offset) {
+        // Shift the table up to start at the new ID
+        PagedVector shifted;
+        shifted.resize(id_to_slot.size() + (id_offset - node_id));
+        for (size_t i = 0; i < id_to_slot.size(); i++) {
+            shifted.set(i + (id_offset - node_id), id_to_slot.get(i));
+        }
+        id_to_slot = std::move(shifted);
+        id_offset = node_id;
+    }
+    if (node_id - id_offset >= (id_t) id_to_slot.size()) {
+        id_to_slot.resize(node_id - id_offset + 1);
+    }
+}
+
+void PackedGraph::maybe_compact_slots(void) {
+    size_t dead_slots = node_ids.size() - live_nodes;
+    if (dead_slots < MIN_COMPACTION_SIZE || dead_slots < live_nodes) {
+        return;
+    }
+    PagedVector compacted_ids;
+    PagedVector compacted_starts;
+    PackedVector compacted_lengths;
+    PagedVector compacted_edge_heads;
+    PagedVector compacted_occurrence_heads;
+    // Keep the live slots in order, so iteration order doesn't change
+    for (size_t slot = 0; slot < node_ids.size(); slot++) {
+        id_t node_id = node_ids.get(slot);
+        if (node_id == 0) {
+            continue;
+        }
+        compacted_ids.append(node_id);
+        compacted_starts.append(seq_starts.get(slot));
+        compacted_lengths.append(seq_lengths.get(slot));
+        compacted_edge_heads.append(edge_heads.get(2 * slot + LEFT));
+        compacted_edge_heads.append(edge_heads.get(2 * slot + RIGHT));
+        compacted_occurrence_heads.append(occurrence_heads.get(slot));
+        id_to_slot.set(node_id - id_offset, compacted_ids.size());
+    }
+    node_ids = std::move(compacted_ids);
+    seq_starts = std::move(compacted_starts);
+    seq_lengths = std::move(compacted_lengths);
+    edge_heads = std::move(compacted_edge_heads);
+    occurrence_heads = std::move(compacted_occurrence_heads);
+}
+
+handle_t PackedGraph::add_slot(id_t node_id, size_t seq_start, size_t seq_length) {
+    reserve_id(node_id);
+    size_t slot = node_ids.size();
+    node_ids.append(node_id);
+    seq_starts.append(seq_start);
+    seq_lengths.append(seq_length);
+    edge_heads.append(0);
+    edge_heads.append(0);
+    occurrence_heads.append(0);
+    id_to_slot.set(node_id - id_offset, slot + 1);
+    max_id = max(max_id, node_id);
+    live_nodes++;
+    live_bases += seq_length;
+    return get_handle(node_id, false);
+}
+
+size_t PackedGraph::append_sequence(const string& seq) {
+    size_t start = sequence.size();
+    sequence.resize(start + seq.size());
+    for (size_t i = 0; i < seq.size(); i++) {
+        switch (seq[i]) {
+        case 'A': break;
+        case 'C': sequence.set(start + i, 1); break;
+        case 'G': sequence.set(start + i, 2); break;
+        case 'T': sequence.set(start + i, 3); break;
+        default: sequence_exceptions[start + i] = seq[i]; break;
+        }
+    }
+    return start;
+}
+
+void PackedGraph::maybe_compact_sequence(void) {
+    if (dead_bases < MIN_COMPACTION_SIZE || dead_bases < live_bases) {
+        return;
+    }
+    PackedVector compacted;
+    unordered_map<size_t, char> compacted_exceptions;
+    // Pieces of divided nodes share ranges; they each get their own copy here
+    for (size_t slot = 0; slot < node_ids.size(); slot++) {
+        if (node_ids.get(slot) == 0) {
+            continue;
+        }
+        size_t start = seq_starts.get(slot);
+        size_t length = seq_lengths.get(slot);
+        size_t new_start = compacted.size();
+        compacted.resize(new_start + length);
+        for (size_t i = 0; i < length; i++) {
+            compacted.set(new_start + i, sequence.get(start + i));
+            auto found = sequence_exceptions.find(start + i);
+            if (found != sequence_exceptions.end()) {
+                compacted_exceptions[new_start + i] = found->second;
+            }
+        }
+        seq_starts.set(slot, new_start);
+    }
+    sequence = std::move(compacted);
+    sequence_exceptions = std::move(compacted_exceptions);
+    dead_bases = 0;
+}
+
+void PackedGraph::edge_records(const handle_t& left, const handle_t& right,
+                               size_t& slot1, size_t& side1, uint64_t& value1,
+                               bool& has_second, size_t& slot2, size_t& side2, uint64_t& value2) const {
+    // Each side list holds what you reach from that side of the forward strand
+    slot1 = slot_of(get_id(left));
+    side1 = get_is_reverse(left) ? LEFT : RIGHT;
+    value1 = pack(get_is_reverse(left) ? flip(right) : right);
+    slot2 = slot_of(get_id(right));
+    side2 = get_is_reverse(right) ? RIGHT : LEFT;
+    value2 = pack(get_is_reverse(right) ? flip(left) : left);
+    has_second = !(slot1 == slot2 && side1 == side2 && value1 == value2);
+}
+
+void PackedGraph::add_edge_record(size_t slot, size_t side, uint64_t value) {
+    edge_lists.append(value);
+    edge_lists.append(edge_heads.get(2 * slot + side));
+    edge_heads.set(2 * slot + side, edge_lists.size() / 2);
+}
+
+bool PackedGraph::remove_edge_record(size_t slot, size_t side, uint64_t value) {
+    uint64_t prev = 0;
+    for (uint64_t record = edge_heads.get(2 * slot + side); record != 0;
+         prev = record, record = edge_lists.get(2 * (record - 1) + 1)) {
+        if (edge_lists.get(2 * (record - 1)) == value) {
+            uint64_t next = edge_lists.get(2 * (record - 1) + 1);
+            if (prev == 0) {
+                edge_heads.set(2 * slot + side, next);
+            } else {
+                edge_lists.set(2 * (prev - 1) + 1, next);
+            }
+            edge_lists.set(2 * (record - 1), 0);
+            edge_lists.set(2 * (record - 1) + 1, 0);
+            dead_edge_records++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PackedGraph::maybe_compact_edges(void) {
+    size_t records = edge_lists.size() / 2;
+    if (dead_edge_records < MIN_COMPACTION_SIZE || dead_edge_records < records - dead_edge_records) {
+        return;
+    }
+    PagedVector compacted;
+    for (size_t i = 0; i < edge_heads.size(); i++) {
+        // Copy each list in order
+        uint64_t previous = 0;
+        for (uint64_t record = edge_heads.get(i); record != 0; record = edge_lists.get(2 * (record - 1) + 1)) {
+            compacted.append(edge_lists.get(2 * (record - 1)));
+            compacted.append(0);
+            uint64_t copied = compacted.size() / 2;
+            if (previous == 0) {
+                edge_heads.set(i, copied);
+            } else {
+                compacted.set(2 * (previous - 1) + 1, copied);
+            }
+            previous = copied;
+        }
+    }
+    edge_lists = std::move(compacted);
+    dead_edge_records = 0;
+}
+
+vector<edge_t> PackedGraph::edges_of(const handle_t& handle) const {
+    vector<edge_t> edges;
+    follow_edges(handle, false, [&](const handle_t& next) {
+        edges.push_back(edge_handle(handle, next));
+    });
+    follow_edges(handle, true, [&](const handle_t& prev) {
+        edges.push_back(edge_handle(prev, handle));
+    });
+    // Self loops can show up more than once
+    sort(edges.begin(), edges.end(), [](const edge_t& a, const edge_t& b) {
+        return make_pair(as_integer(a.first), as_integer(a.second)) < make_pair(as_integer(b.first), as_integer(b.second));
+    });
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    return edges;
+}
+
+uint64_t PackedGraph::insert_step(size_t path, uint64_t after, const handle_t& handle) {
+    uint64_t step = steps.size() / STEP_RECORD_SIZE + 1;
+    uint64_t next = after == 0 ? path_heads[path] : steps.get((after - 1) * STEP_RECORD_SIZE + STEP_NEXT);
+    size_t slot = slot_of(get_id(handle));
+
+    steps.resize(steps.size() + STEP_RECORD_SIZE);
+    size_t base = (step - 1) * STEP_RECORD_SIZE;
+    steps.set(base + STEP_HANDLE, pack(handle));
+    steps.set(base + STEP_PREV, after);
+    steps.set(base + STEP_NEXT, next);
+    steps.set(base + STEP_NEXT_OCCURRENCE, occurrence_heads.get(slot));
+    steps.set(base + STEP_PATH, path);
+    occurrence_heads.set(slot, step);
+
+    if (after == 0) {
+        path_heads[path] = step;
+    } else {
+        steps.set((after - 1) * STEP_RECORD_SIZE + STEP_NEXT, step);
+    }
+    if (next == 0) {
+        path_tails[path] = step;
+    } else {
+        steps.set((next - 1) * STEP_RECORD_SIZE + STEP_PREV, step);
+    }
+    path_lengths[path]++;
+    return step;
+}
+
+vector<uint64_t> PackedGraph::steps_on(size_t slot) const {
+    vector<uint64_t> found;
+    for (uint64_t step = occurrence_heads.get(slot); step != 0;
+         step = steps.get((step - 1) * STEP_RECORD_SIZE + STEP_NEXT_OCCURRENCE)) {
+        found.push_back(step);
+    }
+    return found;
+}
+
+void PackedGraph::remove_step(uint64_t step) {
+    size_t base = (step - 1) * STEP_RECORD_SIZE;
+    size_t path = steps.get(base + STEP_PATH);
+    uint64_t prev = steps.get(base + STEP_PREV);
+    uint64_t next = steps.get(base + STEP_NEXT);
+    if (prev == 0) {
+        path_heads[path] = next;
+    } else {
+        steps.set((prev - 1) * STEP_RECORD_SIZE + STEP_NEXT, next);
+    }
+    if (next == 0) {
+        path_tails[path] = prev;
+    } else {
+        steps.set((next - 1) * STEP_RECORD_SIZE + STEP_PREV, prev);
+    }
+    path_lengths[path]--;
+
+    size_t slot = slot_of(get_id(unpack(steps.get(base + STEP_HANDLE))));
+    uint64_t occurrence = occurrence_heads.get(slot);
+    if (occurrence == step) {
+        occurrence_heads.set(slot, steps.get(base + STEP_NEXT_OCCURRENCE));
+    } else {
+        while (steps.get((occurrence - 1) * STEP_RECORD_SIZE + STEP_NEXT_OCCURRENCE) != step) {
+            occurrence = steps.get((occurrence - 1) * STEP_RECORD_SIZE + STEP_NEXT_OCCURRENCE);
+        }
+        steps.set((occurrence - 1) * STEP_RECORD_SIZE + STEP_NEXT_OCCURRENCE, steps.get(base + STEP_NEXT_OCCURRENCE));
+    }
+
+    for (size_t field = 0; field < STEP_RECORD_SIZE; field++) {
+        steps.set(base + field, 0);
+    }
+    dead_step_records++;
+}
+
+void PackedGraph::maybe_compact_steps(void) {
+    size_t records = steps.size() / STEP_RECORD_SIZE;
+    if (dead_step_records < MIN_COMPACTION_SIZE || dead_step_records < records - dead_step_records) {
+        return;
+    }
+    // Number the live steps in path order, so each path's records end up together
+    PackedVector renumbered(records + 1);
+    uint64_t next_step = 1;
+    for (size_t path = 0; path < path_heads.size(); path++) {
+        for (uint64_t step = path_heads[path]; step != 0;
+             step = steps.get((step - 1) * STEP_RECORD_SIZE + STEP_NEXT)) {
+            renumbered.set(step, next_step++);
+        }
+    }
+    // Dead records and the null pointer both map to 0
+    PagedVector compacted;
+    compacted.resize((next_step - 1) * STEP_RECORD_SIZE);
+    for (uint64_t step = 1; step <= records; step++) {
+        uint64_t copied = renumbered.get(step);
+        if (copied == 0) {
+            continue;
+        }
+        size_t base = (step - 1) * STEP_RECORD_SIZE;
+        size_t new_base = (copied - 1) * STEP_RECORD_SIZE;
+        compacted.set(new_base + STEP_HANDLE, steps.get(base + STEP_HANDLE));
+        compacted.set(new_base + STEP_PREV, renumbered.get(steps.get(base + STEP_PREV)));
+        compacted.set(new_base + STEP_NEXT, renumbered.get(steps.get(base + STEP_NEXT)));
+        compacted.set(new_base + STEP_NEXT_OCCURRENCE, renumbered.get(steps.get(base + STEP_NEXT_OCCURRENCE)));
+        compacted.set(new_base + STEP_PATH, steps.get(base + STEP_PATH));
+    }
+    for (size_t path = 0; path < path_heads.size(); path++) {
+        path_heads[path] = renumbered.get(path_heads[path]);
+        path_tails[path] = renumbered.get(path_tails[path]);
+    }
+    for (size_t slot = 0; slot < occurrence_heads.size(); slot++) {
+        occurrence_heads.set(slot, renumbered.get(occurrence_heads.get(slot)));
+    }
+    steps = std::move(compacted);
+    dead_step_records = 0;
+}
+
+}
@@ -0,0 +1,233 @@
+#ifndef VG_PACKED_GRAPH_HPP_INCLUDED
+#define VG_PACKED_GRAPH_HPP_INCLUDED
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "handle.hpp"
+#include "packed_structs.hpp"
+#include "vg.pb.h"
+
+/** \file
+ * packed_graph.hpp: a compact, mutable graph for tools that edit whole graphs
+ * without needing the Protobuf objects that VG keeps.
+ */
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Thrown when loading a path that PackedGraph can't represent, because it has
+ * mappings that are not full length matches.
+ */
+class UnsupportedPathError : public runtime_error {
+    // Use the runtime_error constructor
+    using runtime_error::runtime_error;
+};
+
+/**
+ * A MutableHandleGraph kept in bit-packed vectors instead of Protobuf
+ * objects. Sequences are stored at 2 bits per base (with a side table for
+ * anything other than ACGT), adjacencies are linked lists of packed edge
+ * records, and node columns and edge lists live in paged vectors that store
+ * each page relative to an anchor value.
+ *
+ * Handles encode node IDs, like VG's, so they stay valid across everything
+ * except destroying the node and renumbering. The ID lookup table is dense
+ * over the range of IDs in use, so graphs should have reasonably compact IDs.
+ *
+ * Paths are stored as lists of oriented node visits. Each visit is a full
+ * length match, which is what graph construction produces; paths with partial
+ * or edited mappings are rejected at load time. Unlike VG, destroy_handle()
+ * removes the node's visits from paths, and apply_orientation() flips them.
+ */
+class PackedGraph : public MutableHandleGraph {
+public:
+
+    PackedGraph(void);
+
+    /// Load a graph from a stream of Graph messages, as written by VG. Paths
+    /// are skipped unless keep_paths is set. Throws UnsupportedPathError on
+    /// kept paths that are not made of full length matches, and runtime_error
+    /// on edges or paths that refer to missing nodes.
+    PackedGraph(istream& in, bool keep_paths = true);
+
+    /// Write the graph as a stream of Graph messages that VG can read.
+    void serialize_to_ostream(ostream& out, size_t chunk_size = 1000) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // HandleGraph interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    // Pull in the templated overloads
+    using HandleGraph::follow_edges;
+    using HandleGraph::for_each_handle;
+    using HandleGraph::get_handle;
+
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse = false) const;
+    virtual id_t get_id(const handle_t& handle) const;
+    virtual bool get_is_reverse(const handle_t& handle) const;
+    virtual handle_t flip(const handle_t& handle) const;
+    virtual size_t get_length(const handle_t& handle) const;
+    virtual string get_sequence(const handle_t& handle) const;
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+    virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+    virtual size_t node_size() const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // MutableHandleGraph interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    virtual handle_t create_handle(const string& sequence);
+    virtual handle_t create_handle(const string& sequence, const id_t& id);
+    virtual void destroy_handle(const handle_t& handle);
+    virtual void create_edge(const handle_t& left, const handle_t& right);
+    virtual void destroy_edge(const handle_t& left, const handle_t& right);
+    virtual void swap_handles(const handle_t& a, const handle_t& b);
+    virtual handle_t apply_orientation(const handle_t& handle);
+    virtual vector<handle_t> divide_handle(const handle_t& handle, const vector<size_t>& offsets);
+    using MutableHandleGraph::divide_handle;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Whole-graph operations
+    ////////////////////////////////////////////////////////////////////////////
+
+    bool has_node(id_t node_id) const;
+    bool has_edge(const handle_t& left, const handle_t& right) const;
+    /// Number of edges in the graph
+    size_t edge_size(void) const;
+    /// Largest node ID in use, or 0 for an empty graph
+    id_t max_node_id(void) const;
+    /// Smallest node ID in use, or 0 for an empty graph
+    id_t min_node_id(void) const;
+
+    /// Add the given value to all node IDs. Invalidates all handles.
+    void increment_node_ids(id_t increment);
+    /// Subtract the given value from all node IDs. Invalidates all handles.
+    void decrement_node_ids(id_t decrement);
+    /// Renumber the nodes 1 to n in the order for_each_handle() visits them.
+    /// Invalidates all handles.
+    void compact_ids(void);
+
+    /// Approximate bytes of memory used
+    size_t memory_usage(void) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Paths
+    ////////////////////////////////////////////////////////////////////////////
+
+    bool has_path(const string& name) const;
+    /// Make an empty path, if it doesn't exist already
+    void create_path(const string& name, bool is_circular = false);
+    /// Add a visit to the end of a path, creating the path if needed
+    void append_step(const string& name, const handle_t& handle);
+    /// Number of paths, including empty ones
+    size_t path_count(void) const;
+    /// Number of node visits on a path
+    size_t path_step_count(const string& name) const;
+    /// Loop over the path names in the order the paths were created
+    void for_each_path_name(const function<void(const string&)>& iteratee) const;
+    /// Loop over the node visits on a path, in order
+    void for_each_step(const string& name, const function<void(const handle_t&)>& iteratee) const;
+    /// Remove all paths
+    void clear_paths(void);
+
+private:
+
+    /// Adjacency list sides in edge_heads
+    enum : size_t { LEFT = 0, RIGHT = 1 };
+
+    /// Fields of step records in steps
+    enum : size_t { STEP_HANDLE = 0, STEP_PREV, STEP_NEXT, STEP_NEXT_OCCURRENCE, STEP_PATH, STEP_RECORD_SIZE };
+
+    /// Encode a handle as a nonzero integer for storage
+    static inline uint64_t pack(const handle_t& handle) { return (uint64_t) as_integer(handle); }
+    static inline handle_t unpack(uint64_t value) { int64_t i = (int64_t) value; return as_handle(i); }
+
+    /// Get the storage slot of a node
+    size_t slot_of(id_t node_id) const;
+    /// Add a node backed by an existing range of the sequence vector
+    handle_t add_slot(id_t node_id, size_t seq_start, size_t seq_length);
+    /// Make room in the ID lookup table for the given ID
+    void reserve_id(id_t node_id);
+    /// Rewrite the node columns without deleted nodes' slots if there are too
+    /// many. Invalidates slot numbers.
+    void maybe_compact_slots(void);
+
+    /// Append a sequence to the sequence vector and return where it starts
+    size_t append_sequence(const string& sequence);
+    /// Rewrite the sequence vector without dead bases if it has too many
+    void maybe_compact_sequence(void);
+
+    /// The list entries that record an edge, as (slot, side, value). The second
+    /// is empty when it would duplicate the first, as for some self loops.
+    void edge_records(const handle_t& left, const handle_t& right,
+                      size_t& slot1, size_t& side1, uint64_t& value1,
+                      bool& has_second, size_t& slot2, size_t& side2, uint64_t& value2) const;
+    void add_edge_record(size_t slot, size_t side, uint64_t value);
+    bool remove_edge_record(size_t slot, size_t side, uint64_t value);
+    /// Rewrite the edge records without dead ones if there are too many
+    void maybe_compact_edges(void);
+    /// All the distinct edges touching a node
+    vector<edge_t> edges_of(const handle_t& handle) const;
+
+    /// Add a step with the given handle to the path after the given step (0
+    /// for the start), and return it
+    uint64_t insert_step(size_t path, uint64_t after, const handle_t& handle);
+    /// All the steps that visit the node in the given slot
+    vector<uint64_t> steps_on(size_t slot) const;
+    /// Remove a step from its path and from its node's occurrence list
+    void remove_step(uint64_t step);
+    /// Rewrite the step records without dead ones if there are too many.
+    /// Invalidates step pointers.
+    void maybe_compact_steps(void);
+
+    /// Renumber every node, rewriting everything that refers to them
+    void reassign_ids(const function<id_t(id_t)>& new_id);
+
+    /// Node columns, indexed by slot. Deleted nodes keep their slot with ID 0
+    /// until maybe_compact_slots() drops them.
+    PagedVector node_ids;
+    PagedVector seq_starts;
+    PackedVector seq_lengths;
+    /// Two list heads per slot, for the left and right sides
+    PagedVector edge_heads;
+    /// First step visiting each slot
+    PagedVector occurrence_heads;
+
+    /// Slot + 1 for each ID from id_offset, or 0 if unused
+    PagedVector id_to_slot;
+    id_t id_offset = 0;
+    id_t max_id = 0;
+
+    /// 2-bit packed bases, and the bases that aren't ACGT by position
+    PackedVector sequence;
+    unordered_map<size_t, char> sequence_exceptions;
+    size_t live_bases = 0;
+    size_t dead_bases = 0;
+
+    /// Pairs of (handle reached, next record + 1)
+    PagedVector edge_lists;
+    size_t dead_edge_records = 0;
+
+    size_t live_nodes = 0;
+    size_t live_edges = 0;
+
+    /// Records of STEP_RECORD_SIZE fields; step pointers are 1-based
+    PagedVector steps;
+    size_t dead_step_records = 0;
+    vector<string> path_names;
+    vector<bool> path_circular;
+    vector<uint64_t> path_heads;
+    vector<uint64_t> path_tails;
+    vector<size_t> path_lengths;
+    unordered_map<string, size_t> path_index;
+};
+
+}
+
+#endif
@@ -0,0 +1,141 @@
+#include "packed_structs.hpp"
+
+#include <algorithm>
+
+namespace vg {
+
+using namespace std;
+
+PackedVector::PackedVector(size_t size) {
+    resize(size);
+}
+
+size_t PackedVector::bit_width(uint64_t value) {
+    size_t width = 1;
+    while (width < 64 && (value >> width) != 0) {
+        width++;
+    }
+    return width;
+}
+
+void PackedVector::repack(size_t new_width) {
+    PackedVector repacked;
+    repacked.bits = new_width;
+    repacked.words.resize((filled * new_width + 63) / 64 + 1, 0);
+    repacked.filled = filled;
+    for (size_t i = 0; i < filled; i++) {
+        repacked.set(i, get(i));
+    }
+    *this = std::move(repacked);
+}
+
+void PackedVector::set(size_t i, uint64_t value) {
+    if (bits < 64 && (value >> bits) != 0) {
+        // Doesn't fit; widen everything
+        repack(bit_width(value));
+    }
+    size_t bit = i * bits;
+    size_t word = bit / 64;
+    size_t offset = bit % 64;
+    uint64_t mask = bits == 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << bits) - 1);
+    words[word] = (words[word] & ~(mask << offset)) | (value << offset);
+    if (offset + bits > 64) {
+        // Straddles two words
+        size_t spill = offset + bits - 64;
+        uint64_t high_mask = ((uint64_t) 1 << spill) - 1;
+        words[word + 1] = (words[word + 1] & ~high_mask) | (value >> (64 - offset));
+    }
+}
+
+void PackedVector::append(uint64_t value) {
+    resize(filled + 1);
+    set(filled - 1, value);
+}
+
+void PackedVector::pop_back(void) {
+    resize(filled - 1);
+}
+
+void PackedVector::resize(size_t new_size) {
+    if (new_size < filled) {
+        // Zero what we drop so that growing again gives zeros
+        for (size_t i = new_size; i < filled; i++) {
+            set(i, 0);
+        }
+    }
+    // One extra word lets get() and set() read past a straddling entry without checks
+    size_t needed = (new_size * bits + 63) / 64 + 1;
+    if (needed > words.size()) {
+        // Grow geometrically
+        words.resize(max(needed, words.size() + words.size() / 2), 0);
+    }
+    filled = new_size;
+}
+
+void PackedVector::clear(void) {
+    words.clear();
+    filled = 0;
+    bits = 1;
+}
+
+size_t PackedVector::memory_usage(void) const {
+    return words.capacity() * sizeof(uint64_t) + sizeof(*this);
+}
+
+PagedVector::PagedVector(size_t page_size) : page_size(max(page_size, (size_t) 1)) {
+    // Nothing to do
+}
+
+void PagedVector::set(size_t i, uint64_t value) {
+    size_t page = i / page_size;
+    uint64_t anchor = anchors.get(page);
+    if (anchor == 0 && value != 0) {
+        // First nonzero value in the page; everything else there is 0
+        anchor = value;
+        anchors.set(page, anchor);
+    }
+    pages[page].set(i % page_size, to_diff(value, anchor));
+}
+
+void PagedVector::append(uint64_t value) {
+    resize(filled + 1);
+    set(filled - 1, value);
+}
+
+void PagedVector::pop_back(void) {
+    resize(filled - 1);
+}
+
+void PagedVector::resize(size_t new_size) {
+    if (new_size < filled) {
+        for (size_t i = new_size; i < filled; i++) {
+            set(i, 0);
+        }
+    }
+    size_t page_count = (new_size + page_size - 1) / page_size;
+    while (pages.size() < page_count) {
+        pages.emplace_back(page_size);
+        anchors.append(0);
+    }
+    while (pages.size() > page_count) {
+        pages.pop_back();
+        anchors.pop_back();
+    }
+    filled = new_size;
+}
+
+void PagedVector::clear(void) {
+    pages.clear();
+    anchors.clear();
+    filled = 0;
+}
+
+size_t PagedVector::memory_usage(void) const {
+    size_t total = sizeof(*this) + anchors.memory_usage();
+    for (auto& page : pages) {
+        total += page.memory_usage();
+    }
+    return total;
+}
+
+}
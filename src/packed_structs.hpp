@@ -0,0 +1,146 @@
+#ifndef VG_PACKED_STRUCTS_HPP_INCLUDED
+#define VG_PACKED_STRUCTS_HPP_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+/** \file
+ * packed_structs.hpp: growable vectors of unsigned integers that use only as
+ * many bits per entry as their contents need.
+ */
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A vector of unsigned integers packed at a common bit width, which grows to
+ * fit the largest value ever stored.
+ */
+class PackedVector {
+public:
+    PackedVector(void) = default;
+    /// Make a vector of the given number of zeros
+    PackedVector(size_t size);
+
+    inline uint64_t get(size_t i) const;
+    void set(size_t i, uint64_t value);
+
+    void append(uint64_t value);
+    void pop_back(void);
+    void resize(size_t new_size);
+    void clear(void);
+
+    inline size_t size(void) const;
+    inline bool empty(void) const;
+    /// Bits used per entry
+    inline size_t width(void) const;
+    /// Approximate bytes of memory used
+    size_t memory_usage(void) const;
+
+private:
+    /// Rewrite the contents at a new width
+    void repack(size_t new_width);
+    /// Bits needed to store the value
+    static size_t bit_width(uint64_t value);
+
+    vector<uint64_t> words;
+    size_t filled = 0;
+    size_t bits = 1;
+};
+
+/**
+ * A vector of unsigned integers stored in fixed-size pages, each packed
+ * relative to an anchor value taken from the page's first nonzero entry. Runs
+ * of similar large values, like node IDs or sequence offsets in a graph, take
+ * only a few bits each. Zero is always stored exactly.
+ */
+class PagedVector {
+public:
+    PagedVector(size_t page_size = 64);
+
+    inline uint64_t get(size_t i) const;
+    void set(size_t i, uint64_t value);
+
+    void append(uint64_t value);
+    void pop_back(void);
+    void resize(size_t new_size);
+    void clear(void);
+
+    inline size_t size(void) const;
+    inline bool empty(void) const;
+    /// Approximate bytes of memory used
+    size_t memory_usage(void) const;
+
+private:
+    inline static uint64_t to_diff(uint64_t value, uint64_t anchor);
+    inline static uint64_t from_diff(uint64_t diff, uint64_t anchor);
+
+    size_t page_size;
+    size_t filled = 0;
+    /// First nonzero value set in each page, or 0 if none yet
+    PackedVector anchors;
+    vector<PackedVector> pages;
+};
+
+////////////////////////////////////////////////////////////////////////////
+// Inline implementations
+////////////////////////////////////////////////////////////////////////////
+
+inline uint64_t PackedVector::get(size_t i) const {
+    size_t bit = i * bits;
+    size_t word = bit / 64;
+    size_t offset = bit % 64;
+    uint64_t mask = bits == 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << bits) - 1);
+    uint64_t value = words[word] >> offset;
+    if (offset + bits > 64) {
+        // Straddles two words
+        value |= words[word + 1] << (64 - offset);
+    }
+    return value & mask;
+}
+
+inline size_t PackedVector::size(void) const {
+    return filled;
+}
+
+inline bool PackedVector::empty(void) const {
+    return filled == 0;
+}
+
+inline size_t PackedVector::width(void) const {
+    return bits;
+}
+
+inline uint64_t PagedVector::to_diff(uint64_t value, uint64_t anchor) {
+    if (value == 0) {
+        return 0;
+    }
+    // Zigzag the signed difference, shifted up by one to keep 0 for 0
+    int64_t diff = (int64_t) (value - anchor);
+    return (diff >= 0 ? ((uint64_t) diff << 1) : (((uint64_t) -diff << 1) - 1)) + 1;
+}
+
+inline uint64_t PagedVector::from_diff(uint64_t diff, uint64_t anchor) {
+    if (diff == 0) {
+        return 0;
+    }
+    diff -= 1;
+    return (diff & 1) ? anchor - ((diff + 1) >> 1) : anchor + (diff >> 1);
+}
+
+inline uint64_t PagedVector::get(size_t i) const {
+    return from_diff(pages[i / page_size].get(i % page_size), anchors.get(i / page_size));
+}
+
+inline size_t PagedVector::size(void) const {
+    return filled;
+}
+
+inline bool PagedVector::empty(void) const {
+    return filled == 0;
+}
+
+}
+
+#endif
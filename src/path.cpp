@@ -133,6 +133,8 @@ void Paths::for_each_name(const function<void(const string&)>& lambda) {
 }
 
 void Paths::for_each_mapping(const function<void(mapping_t&)>& lambda) {
+    // the lambda may change ranks
+    all_paths_dirty = true;
     for (auto& p : _paths) {
         auto& path = p.second;
         for (auto& m : path) {
@@ -165,9 +167,12 @@ void Paths::extend(const Path& p) {
     if (p.is_circular()) {
         make_circular(name);
     }
-    // re-sort?
-    sort_by_mapping_rank();
-    rebuild_mapping_aux();
+    // only this path needs to be re-sorted
+    if (batch_depth) {
+        batch_rebuild = true;
+    } else {
+        rebuild_path(name);
+    }
 }
 
 // one of these should go away
@@ -184,8 +189,13 @@ void Paths::extend(Paths& p) {
             make_circular(name);
         }
     }
-    sort_by_mapping_rank();
-    rebuild_mapping_aux();
+    if (batch_depth) {
+        batch_rebuild = true;
+    } else {
+        for (auto& l : p._paths) {
+            rebuild_path(l.first);
+        }
+    }
 }
 
 void Paths::append(Paths& paths) {
@@ -201,8 +211,13 @@ void Paths::append(Paths& paths) {
             make_circular(name);
         }
     }
-    sort_by_mapping_rank();
-    rebuild_mapping_aux();
+    if (batch_depth) {
+        batch_rebuild = true;
+    } else {
+        for (auto& p : paths._paths) {
+            rebuild_path(p.first);
+        }
+    }
 }
 
 void Paths::append(Graph& g) {
@@ -282,6 +297,7 @@ void Paths::append_mapping(const string& name, const mapping_t& m) {
         // add it to the node mappings
         auto& ms = get_node_mapping(mp->node_id());
         ms[get_path_id(name)].insert(mp);
+        mark_dirty(get_path_id(name));
         // and record its position in this list
         list<mapping_t>::iterator mi = pt.end(); --mi;
         auto& mitr = mapping_itr[mp];
@@ -340,6 +356,7 @@ void Paths::prepend_mapping(const string& name, const Mapping& m) {
         // add it to the node mappings
         auto& ms = get_node_mapping(m.position().node_id());
         ms[get_path_id(name)].insert(mp);
+        mark_dirty(get_path_id(name));
         // and record its position in this list
         list<mapping_t>::iterator mi = pt.begin();
         auto& mitr = mapping_itr[mp];
@@ -428,7 +445,12 @@ void Paths::increment_node_ids(id_t inc) {
             m.set_node_id(m.node_id()+inc);
         }
     }
-    rebuild_node_mapping();
+    // Move the node records over to their new IDs rather than rebuilding them
+    hash_map<id_t, map<int64_t, set<mapping_t*>>> renumbered;
+    for (auto& entry : node_mapping) {
+        renumbered[entry.first + inc] = std::move(entry.second);
+    }
+    std::swap(node_mapping, renumbered);
 }
 
 void Paths::swap_node_ids(hash_map<id_t, id_t>& id_mapping) {
@@ -444,7 +466,22 @@ void Paths::swap_node_ids(hash_map<id_t, id_t>& id_mapping) {
             }
         }
     }
-    rebuild_node_mapping();
+    // Move the node records over to their new IDs rather than rebuilding them
+    hash_map<id_t, map<int64_t, set<mapping_t*>>> renumbered;
+    for (auto& entry : node_mapping) {
+        auto replacement = id_mapping.find(entry.first);
+        id_t id = replacement == id_mapping.end() ? entry.first : replacement->second;
+        auto& records = renumbered[id];
+        if (records.empty()) {
+            records = std::move(entry.second);
+        } else {
+            // Two nodes were given the same ID
+            for (auto& p : entry.second) {
+                records[p.first].insert(p.second.begin(), p.second.end());
+            }
+        }
+    }
+    std::swap(node_mapping, renumbered);
 }
 
 void Paths::reassign_node(id_t new_id, mapping_t* m) {
@@ -470,9 +507,15 @@ void Paths::rebuild_node_mapping(void) {
 
 // attempt to sort the paths based on the recorded ranks of the mappings
 void Paths::sort_by_mapping_rank(void) {
+    // Paths are independent, so sort them in parallel
+    vector<list<mapping_t>*> to_sort;
+    to_sort.reserve(_paths.size());
     for (auto p = _paths.begin(); p != _paths.end(); ++p) {
-        list<mapping_t>& path = p->second;
-        path.sort([](const mapping_t& m1, const mapping_t& m2) {
+        to_sort.push_back(&p->second);
+    }
+#pragma omp parallel for schedule(dynamic, 1) if (to_sort.size() > 1)
+    for (size_t i = 0; i < to_sort.size(); ++i) {
+        to_sort[i]->sort([](const mapping_t& m1, const mapping_t& m2) {
                 return m1.rank < m2.rank;
             });
     }
@@ -480,48 +523,137 @@ void Paths::sort_by_mapping_rank(void) {
 
 // compact the ranks preserving the relative rank order
 void Paths::compact_ranks(void) {
-    // first ensure the storage order of the mappings is correct
-    sort_by_mapping_rank();
-    // clear the ranks
-    clear_mapping_ranks();
-    // and rebuild them and other aux data structures
-    rebuild_node_mapping();
-    rebuild_mapping_aux();
+    if (batch_depth) {
+        batch_compact = true;
+        return;
+    }
+    if (all_paths_dirty) {
+        // first ensure the storage order of the mappings is correct
+        sort_by_mapping_rank();
+        // clear the ranks
+        clear_mapping_ranks();
+        // and rebuild them and other aux data structures
+        rebuild_node_mapping();
+        rebuild_mapping_aux();
+    } else {
+        // Every other path is already sorted and numbered from 1, and the
+        // node and iterator indexes are kept up to date as mappings come and
+        // go, so only the changed paths need to be sorted and renumbered.
+        vector<pair<const string*, list<mapping_t>*>> to_compact;
+        to_compact.reserve(dirty_paths.size());
+        for (auto path_id : dirty_paths) {
+            auto p = _paths.find(get_path_name(path_id));
+            if (p != _paths.end()) {
+                to_compact.emplace_back(&p->first, &p->second);
+            }
+        }
+#pragma omp parallel for schedule(dynamic, 1) if (to_compact.size() > 1)
+        for (size_t i = 0; i < to_compact.size(); ++i) {
+            list<mapping_t>& path = *to_compact[i].second;
+            path.sort([](const mapping_t& m1, const mapping_t& m2) {
+                    return m1.rank < m2.rank;
+                });
+            for (auto& m : path) {
+                m.rank = 0;
+            }
+        }
+        for (auto& p : to_compact) {
+            rebuild_mapping_aux(*p.first);
+        }
+    }
+    dirty_paths.clear();
+    all_paths_dirty = false;
+}
+
+void Paths::mark_dirty(int64_t path_id) {
+    if (!all_paths_dirty) {
+        dirty_paths.insert(path_id);
+    }
+}
+
+void Paths::rebuild_path(const string& name) {
+    auto p = _paths.find(name);
+    if (p == _paths.end()) {
+        return;
+    }
+    p->second.sort([](const mapping_t& m1, const mapping_t& m2) {
+            return m1.rank < m2.rank;
+        });
+    rebuild_mapping_aux(name);
+}
+
+void Paths::rebuild_dirty_paths(void) {
+    if (all_paths_dirty) {
+        sort_by_mapping_rank();
+        rebuild_mapping_aux();
+    } else {
+        for (auto path_id : dirty_paths) {
+            rebuild_path(get_path_name(path_id));
+        }
+    }
+}
+
+Paths::Batch::Batch(Paths& paths) : paths(paths) {
+    ++paths.batch_depth;
+}
+
+Paths::Batch::~Batch(void) {
+    if (--paths.batch_depth == 0) {
+        if (paths.batch_compact) {
+            paths.compact_ranks();
+        } else if (paths.batch_rebuild) {
+            paths.rebuild_dirty_paths();
+        }
+        paths.batch_compact = false;
+        paths.batch_rebuild = false;
+    }
 }
 
 void Paths::rebuild_mapping_aux(void) {
     mapping_itr.clear();
     mappings_by_rank.clear();
     for (auto& p : _paths) {
-        const string& path_name = p.first;
-        list<mapping_t>& path = p.second;
-        size_t order_in_path = 0;
-        for (list<mapping_t>::iterator i = path.begin(); i != path.end(); ++i) {
-            auto& mitr = mapping_itr[&*i];
-            mitr.first = i;
-            mitr.second = get_path_id(path_name);
+        rebuild_mapping_aux(p.first);
+    }
+    // ranks that were out of order are fixed up, but not compacted
+    all_paths_dirty = true;
+}
+
+void Paths::rebuild_mapping_aux(const string& name) {
+    auto p = _paths.find(name);
+    if (p == _paths.end()) {
+        return;
+    }
+    const string& path_name = p->first;
+    list<mapping_t>& path = p->second;
+    int64_t path_id = get_path_id(path_name);
+    mappings_by_rank.erase(path_name);
+    size_t order_in_path = 0;
+    for (list<mapping_t>::iterator i = path.begin(); i != path.end(); ++i) {
+        auto& mitr = mapping_itr[&*i];
+        mitr.first = i;
+        mitr.second = path_id;
             
-            if(i->rank > order_in_path + 1) {
-                // Make sure that if we have to assign a rank to a node after
-                // this one, it is greater than this node's rank. TODO: should
-                // we just uniformly re-rank all the nodes starting at 0? Or
-                // will we ever want to cut and paste things back together using
-                // the old preserved ranks?
-                order_in_path = i->rank - 1;
-            }
+        if(i->rank > order_in_path + 1) {
+            // Make sure that if we have to assign a rank to a node after
+            // this one, it is greater than this node's rank. TODO: should
+            // we just uniformly re-rank all the nodes starting at 0? Or
+            // will we ever want to cut and paste things back together using
+            // the old preserved ranks?
+            order_in_path = i->rank - 1;
+        }
             
-            if (i->rank == 0 || i->rank < order_in_path + 1) {
-                // If we don't already have a rank, or if we see a rank that
-                // can't be correct given the ranks we have already seen, we set
-                // the rank based on what we've built
-                i->rank = order_in_path+1;
-            }
+        if (i->rank == 0 || i->rank < order_in_path + 1) {
+            // If we don't already have a rank, or if we see a rank that
+            // can't be correct given the ranks we have already seen, we set
+            // the rank based on what we've built
+            i->rank = order_in_path+1;
+        }
             
-            // Save the mapping as being at the given rank in its path.
-            mappings_by_rank[path_name][i->rank] = &*i;
+        // Save the mapping as being at the given rank in its path.
+        mappings_by_rank[path_name][i->rank] = &*i;
             
-            ++order_in_path;
-        }
+        ++order_in_path;
     }
 }
 
@@ -551,6 +683,7 @@ list<mapping_t>::iterator Paths::remove_mapping(mapping_t* m) {
     
     // Actually deallocate the mapping
     list<mapping_t>::iterator p = _paths[path_name].erase(mitr.first);
+    mark_dirty(mitr.second);
     if (has_node_mapping(id)) {
         auto& node_path_mapping = get_node_mapping(id);
         node_path_mapping[mitr.second].erase(m);
@@ -576,6 +709,7 @@ list<mapping_t>::iterator Paths::insert_mapping(list<mapping_t>::iterator w, con
     auto& mitr = mapping_itr[&*p];
     mitr.first = p;
     mitr.second = get_path_id(path_name);
+    mark_dirty(mitr.second);
     return p;
 }
 
@@ -598,6 +732,7 @@ void Paths::clear(void) {
     _paths.clear();
     node_mapping.clear();
     mappings_by_rank.clear();
+    dirty_paths.clear();
 }
 
 void Paths::clear_mapping_ranks(void) {
@@ -609,9 +744,12 @@ void Paths::clear_mapping_ranks(void) {
         }
     }
     mappings_by_rank.clear();
+    all_paths_dirty = true;
 }
 
 list<mapping_t>& Paths::get_path(const string& name) {
+    // the caller may reorder the mappings or change their ranks
+    mark_dirty(get_path_id(name));
     return _paths[name];
 }
 
@@ -654,6 +792,7 @@ void Paths::keep_paths(const set<string>& names) {
 }
 
 list<mapping_t>& Paths::create_path(const string& name) {
+    mark_dirty(get_path_id(name));
     return _paths[name];
 }
 
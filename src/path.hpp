@@ -50,6 +50,7 @@ public:
         if (this != &other) {
             _paths = other._paths;
             rebuild_node_mapping();
+            all_paths_dirty = true;
         }
     }
     // move constructor
@@ -57,6 +58,7 @@ public:
         _paths = other._paths;
         other.clear();
         rebuild_node_mapping();
+        all_paths_dirty = true;
     }
 
     // copy assignment operator
@@ -70,9 +72,28 @@ public:
     Paths& operator=(Paths&& other) noexcept {
         std::swap(_paths, other._paths);
         rebuild_node_mapping();
+        all_paths_dirty = true;
+        other.all_paths_dirty = true;
         return *this;
     }
 
+    /**
+     * While a Batch is alive, the rank sorting and reindexing that extend(),
+     * append(Paths&) and compact_ranks() would do is put off until the
+     * outermost Batch is destroyed, and then done once, for the paths that
+     * changed. Ranks and mappings_by_rank may be stale inside a batch, so
+     * nothing that reads them should run there.
+     */
+    class Batch {
+    public:
+        Batch(Paths& paths);
+        ~Batch(void);
+        Batch(const Batch& other) = delete;
+        Batch& operator=(const Batch& other) = delete;
+    private:
+        Paths& paths;
+    };
+
     // This maps from path name to the list of Mappings for that path.
     map<string, list<mapping_t> > _paths;
     int64_t max_path_id;
@@ -90,6 +111,8 @@ public:
     void sort_by_mapping_rank(void);
     /// Reassign ranks and rebuild indexes, treating the mapping lists in _paths as the truth.
     void rebuild_mapping_aux(void);
+    /// Do the same for one path only.
+    void rebuild_mapping_aux(const string& name);
     // We need this in order to make sure we aren't adding duplicate mappings
     // with the same rank in the same path. Maps from path name and rank to
     // Mapping pointer.
@@ -184,6 +207,9 @@ public:
     // clear the internal data structures tracking mappings and storing the paths
     void clear(void);
     void clear_mapping_ranks(void);
+    // Sort each path by rank and renumber it from 1. Only the paths that have
+    // had mappings added or removed since they were last compacted are
+    // touched.
     void compact_ranks(void);
     //void add_node_mapping(Node* n);
     void load(istream& in);
@@ -219,6 +245,24 @@ public:
     // erases current (old index information)
     void reassign_node(id_t new_id, mapping_t* m);
     void for_each_mapping(const function<void(mapping_t&)>& lambda);
+
+private:
+    // Note that the path has changed since its ranks were last compacted
+    void mark_dirty(int64_t path_id);
+    // Sort one path by rank and rebuild its indexes
+    void rebuild_path(const string& name);
+    // Sort the dirty paths by rank and rebuild their indexes, leaving them
+    // dirty
+    void rebuild_dirty_paths(void);
+
+    // IDs of the paths changed since their ranks were last compacted
+    hash_set<int64_t> dirty_paths;
+    // Set when every path has to be treated as changed, e.g. after a copy
+    bool all_paths_dirty = true;
+    // Number of open batches, and the work they have put off
+    size_t batch_depth = 0;
+    bool batch_rebuild = false;
+    bool batch_compact = false;
 };
 
 string  path_to_string(Path p);
@@ -8,34 +8,25 @@ PathIndex::PathIndex(const Path& path) {
     // What base are we at in the path?
     size_t path_base = 0;
     
-    // What was the last rank? Ranks must always go up.
-    int64_t last_rank = -1;
+    // Where does each node occurrence start?
+    vector<pair<size_t, NodeSide>> occurrences;
+    occurrences.reserve(path.mapping_size());
     
     for (size_t i = 0; i < path.mapping_size(); i++) {
         // For every mapping
         auto& mapping = path.mapping(i);
     
-        if (!by_id.count(mapping.position().node_id())) {
-            // This is the first time we have visited this node in the path.
-            
-            // Add in a mapping.
-            by_id[mapping.position().node_id()] = 
-                std::make_pair(path_base, mapping.position().is_reverse());
-        }
-        
         // Say that this node appears here along the reference in this
         // orientation.
-        by_start[path_base] = NodeSide(mapping.position().node_id(), mapping.position().is_reverse());
-        
-        // Remember that occurrence by node ID.
-        node_occurrences[mapping.position().node_id()].push_back(by_start.find(path_base));
+        occurrences.emplace_back(path_base, NodeSide(mapping.position().node_id(), mapping.position().is_reverse()));
         
         // Just advance and don't grab sequence.
         path_base += mapping_from_length(mapping);
     }
     
     // Record the length of the last mapping, since there's no next mapping to work it out from
-    last_node_length = path.mapping_size() > 0 ? mapping_from_length(path.mapping(path.mapping_size() - 1)) : 0;
+    index_occurrences(std::move(occurrences),
+                      path.mapping_size() > 0 ? mapping_from_length(path.mapping(path.mapping_size() - 1)) : 0);
 
 #ifdef debug    
     // Announce progress.
@@ -57,36 +48,30 @@ PathIndex::PathIndex(const list<mapping_t>& mappings, VG& vg) {
     // What was the last rank? Ranks must always go up.
     int64_t last_rank = -1;
     
+    // Where does each node occurrence, and each Mapping, start?
+    vector<pair<size_t, NodeSide>> occurrences;
+    vector<pair<const mapping_t*, size_t>> positions;
+    
     for (auto& mapping : mappings) {
     
-        if (!by_id.count(mapping.node_id())) {
-            // This is the first time we have visited this node in the path.
-            
-            // Add in a mapping.
-            by_id[mapping.node_id()] = 
-                std::make_pair(path_base, mapping.is_reverse());
 #ifdef debug
-            #pragma omp critical (cerr)
-            std::cerr << "Node " << mapping.node_id() << " rank " << mapping.rank()
-                << " starts at base " << path_base << " with "
-                << vg.get_node(mapping.node_id())->sequence() << std::endl;
+        #pragma omp critical (cerr)
+        std::cerr << "Node " << mapping.node_id() << " rank " << mapping.rank
+            << " starts at base " << path_base << " with "
+            << vg.get_node(mapping.node_id())->sequence() << std::endl;
 #endif
-            
-            // Make sure ranks are monotonically increasing along the path, or
-            // unset.
-            assert(mapping.rank > last_rank || (mapping.rank == 0 && last_rank == 0));
-            last_rank = mapping.rank;
-        }
+        
+        // Make sure ranks are monotonically increasing along the path, or
+        // unset.
+        assert(mapping.rank > last_rank || (mapping.rank == 0 && last_rank == 0));
+        last_rank = mapping.rank;
         
         // Say that this node appears here along the reference in this
         // orientation.
-        by_start[path_base] = NodeSide(mapping.node_id(), mapping.is_reverse());
-    
-        // Remember that occurrence by node ID.
-        node_occurrences[mapping.node_id()].push_back(by_start.find(path_base));
+        occurrences.emplace_back(path_base, NodeSide(mapping.node_id(), mapping.is_reverse()));
     
         // Say this Mapping happens at this base along the path
-        mapping_positions[&mapping] = path_base;
+        positions.emplace_back(&mapping, path_base);
     
         // Find the node's sequence
         std::string node_sequence = vg.get_node(mapping.node_id())->sequence();
@@ -127,9 +112,9 @@ PathIndex::PathIndex(const list<mapping_t>& mappings, VG& vg) {
     }
     
     // Record the length of the last mapping's node, since there's no next mapping to work it out from
-    last_node_length = mappings.empty() ?
-        0 : 
-        vg.get_node(mappings.back().node_id())->sequence().size();
+    index_occurrences(std::move(occurrences), mappings.empty() ?
+                      0 : vg.get_node(mappings.back().node_id())->sequence().size());
+    mapping_positions.assign(std::move(positions));
     
     // Create the actual reference sequence we will use
     sequence = seq_stream.str();
@@ -144,8 +129,6 @@ PathIndex::PathIndex(const list<mapping_t>& mappings, VG& vg) {
         std::cerr << "Sequence: " << sequence << std::endl;
     }
 #endif
-
-    // Follow the path (again) and place all its Mappings
     
 }
 
@@ -161,34 +144,28 @@ PathIndex::PathIndex(const Path& path, const xg::XG& index) {
     // What was the last rank? Ranks must always go up.
     int64_t last_rank = -1;
     
+    // Where does each node occurrence start?
+    vector<pair<size_t, NodeSide>> occurrences;
+    occurrences.reserve(path.mapping_size());
+    
     for (size_t i = 0; i < path.mapping_size(); i++) {
         auto& mapping = path.mapping(i);
     
-        if (!by_id.count(mapping.position().node_id())) {
-            // This is the first time we have visited this node in the path.
-            
-            // Add in a mapping.
-            by_id[mapping.position().node_id()] = 
-                std::make_pair(path_base, mapping.position().is_reverse());
 #ifdef debug
-            #pragma omp critical (cerr)
-            std::cerr << "Node " << mapping.position().node_id() << " rank " << mapping.rank()
-                << " starts at base " << path_base << " with "
-                << index.node_sequence(mapping.position().node_id()) << std::endl;
+        #pragma omp critical (cerr)
+        std::cerr << "Node " << mapping.position().node_id() << " rank " << mapping.rank()
+            << " starts at base " << path_base << " with "
+            << index.node_sequence(mapping.position().node_id()) << std::endl;
 #endif
-            
-            // Make sure ranks are monotonically increasing along the path, or
-            // unset.
-            assert(mapping.rank() > last_rank || (mapping.rank() == 0 && last_rank == 0));
-            last_rank = mapping.rank();
-        }
+        
+        // Make sure ranks are monotonically increasing along the path, or
+        // unset.
+        assert(mapping.rank() > last_rank || (mapping.rank() == 0 && last_rank == 0));
+        last_rank = mapping.rank();
         
         // Say that this node appears here along the reference in this
         // orientation.
-        by_start[path_base] = NodeSide(mapping.position().node_id(), mapping.position().is_reverse());
-    
-        // Remember that occurrence by node ID.
-        node_occurrences[mapping.position().node_id()].push_back(by_start.find(path_base));
+        occurrences.emplace_back(path_base, NodeSide(mapping.position().node_id(), mapping.position().is_reverse()));
     
         // Find the node's sequence
         std::string node_sequence = index.node_sequence(mapping.position().node_id());
@@ -229,9 +206,8 @@ PathIndex::PathIndex(const Path& path, const xg::XG& index) {
     }
     
     // Record the length of the last mapping's node, since there's no next mapping to work it out from
-    last_node_length = path.mapping_size() > 0 ?
-        index.node_length(path.mapping(path.mapping_size() - 1).position().node_id()) :
-        0;
+    index_occurrences(std::move(occurrences), path.mapping_size() > 0 ?
+                      index.node_length(path.mapping(path.mapping_size() - 1).position().node_id()) : 0);
     
     // Create the actual reference sequence we will use
     sequence = seq_stream.str();
@@ -269,9 +245,63 @@ PathIndex::PathIndex(const xg::XG& index, const string& path_name, bool extract_
     if (extract_sequence) {
         // Constructor dispatch hack
         *this = PathIndex(index.path(path_name), index);
-    } else {
-        *this = PathIndex(index.path(path_name));
+        return;
     }
+    
+    // Otherwise we can read the node occurrences and their positions right
+    // out of the XG path, without making Mappings.
+    const xg::XGPath& xgpath = index.get_path(path_name);
+    size_t occurrence_count = xgpath.ids.size();
+    vector<pair<size_t, NodeSide>> occurrences(occurrence_count);
+#pragma omp parallel for schedule(static, 4096)
+    for (size_t i = 0; i < occurrence_count; i++) {
+        occurrences[i] = make_pair((size_t) xgpath.positions[i], NodeSide(xgpath.node(i), xgpath.is_reverse(i)));
+    }
+    
+    index_occurrences(std::move(occurrences),
+                      occurrence_count > 0 ? index.node_length(xgpath.node(occurrence_count - 1)) : 0);
+}
+
+void PathIndex::index_occurrences(vector<pair<size_t, NodeSide>>&& occurrences, size_t last_length) {
+    
+    // Each node's first occurrence is the one that comes first along the path
+    vector<pair<int64_t, pair<size_t, bool>>> first_occurrences(occurrences.size());
+#pragma omp parallel for schedule(static, 4096)
+    for (size_t i = 0; i < occurrences.size(); i++) {
+        auto& occurrence = occurrences[i];
+        first_occurrences[i] = make_pair(occurrence.second.node, make_pair(occurrence.first, occurrence.second.is_end));
+    }
+    by_id.assign(std::move(first_occurrences));
+    
+    // A later occurrence at the same base replaces an earlier one
+    by_start.assign(std::move(occurrences), true);
+    
+    last_node_length = last_length;
+    
+    // Mark where each occurrence starts, and count the marks
+    size_t path_length = by_start.empty() ? 0 : (by_start.end() - 1)->first + last_node_length;
+    start_bits.assign(path_length / 64 + 1, 0);
+    for (auto& occurrence : by_start) {
+        start_bits[occurrence.first / 64] |= (uint64_t) 1 << (occurrence.first % 64);
+    }
+    start_bits_ranks.resize(start_bits.size() / 8 + 1);
+    size_t rank = 0;
+    for (size_t i = 0; i < start_bits.size(); i++) {
+        if (i % 8 == 0) {
+            start_bits_ranks[i / 8] = rank;
+        }
+        rank += __builtin_popcountll(start_bits[i]);
+    }
+}
+
+size_t PathIndex::starts_before(size_t position) const {
+    size_t word = position / 64;
+    size_t rank = start_bits_ranks[word / 8];
+    for (size_t i = word - word % 8; i < word; i++) {
+        rank += __builtin_popcountll(start_bits[i]);
+    }
+    uint64_t mask = ((uint64_t) 1 << (position % 64)) - 1;
+    return rank + __builtin_popcountll(start_bits[word] & mask);
 }
 
 void PathIndex::update_mapping_positions(VG& vg, const string& path_name) {
@@ -281,7 +311,7 @@ void PathIndex::update_mapping_positions(VG& vg, const string& path_name) {
     // TODO: Don't make this brute force. Integrate into Paths or keep our own
     // original-rank-based index or something.
     
-    mapping_positions.clear();
+    vector<pair<const mapping_t*, size_t>> positions;
     
     // Where are we in the path?
     size_t path_base = 0;
@@ -289,11 +319,13 @@ void PathIndex::update_mapping_positions(VG& vg, const string& path_name) {
     for (auto& mapping : vg.paths.get_path(path_name)) {
         // For each mapping currently in the path, remember its start position
         // along the path.
-        mapping_positions[&mapping] = path_base;
+        positions.emplace_back(&mapping, path_base);
         
         // Go right by its length
         path_base += mapping.length;
     }
+    
+    mapping_positions.assign(std::move(positions));
 }
 
 bool PathIndex::path_contains_node(int64_t node_id){
@@ -318,14 +350,14 @@ PathIndex::iterator PathIndex::end() const {
 PathIndex::iterator PathIndex::find_position(size_t position) const {
     assert(!by_start.empty());
     
-    // Look up the iterator to whatever starts after here
-    auto starts_next = by_start.upper_bound(position);
+    // Count the occurrences that start at or before here, which gets us one
+    // past the occurrence that has to own the position we asked about.
+    size_t starting = (position + 1) / 64 < start_bits.size() ? starts_before(position + 1) : by_start.size();
     
     // This can't work if we try to look before the first node.
-    assert(starts_next != by_start.begin());
+    assert(starting > 0);
     
-    // Walk one back, to the node that has to own the position we asked about.
-    starts_next--;
+    auto starts_next = by_start.begin() + (starting - 1);
     
 #ifdef debug
     cerr << "At " << position << " we have " << starts_next->second << endl;
@@ -451,37 +483,8 @@ map<id_t, vector<Mapping>> PathIndex::parse_translation(const Translation& trans
 void PathIndex::apply_translation(const Translation& translation) {
     
     // Parse the translation, to get a map form old node ID to vector of
-    // replacement mappings.
-    auto old_node_to_new_nodes = parse_translation(translation);
-    
-    
-    // TODO: we would like to update mapping_positions efficiently, but we
-    // can't, because it's full of potentially invalidated pointers.
-    mapping_positions.clear();
-    
-    for (auto kv : old_node_to_new_nodes) {
-        // For every node that needs to be replaced with other nodes
-        auto& old_id = kv.first;
-        auto& replacements = kv.second;
-        
-        // Pull out all the occurrences of the old node.
-        vector<iterator> occurrences{std::move(node_occurrences[old_id])};
-        node_occurrences.erase(old_id);
-        
-        for (auto& occurrence : occurrences) {
-            // Each time the old node appeared, replace it (and log occurrences
-            // of the new nodes that partition it, one of which may re-use the
-            // ID)
-            replace_occurrence(occurrence, replacements);
-        }
-        
-#ifdef debug
-        cerr << "by_start is now: " << endl;
-        for (auto kv2 : by_start) {
-            cerr << "\t" << kv2.first << ": " << kv2.second << endl;
-        }
-#endif
-    }
+    // replacement mappings, and apply it.
+    replace_nodes(parse_translation(translation));
 }
 
 void PathIndex::apply_translations(const vector<Translation>& translations) {
@@ -514,6 +517,9 @@ void PathIndex::apply_translations(const vector<Translation>& translations) {
         collated[t.from().mapping(0).position().node_id()].push_back(make_pair(t.from().mapping(0), t.to().mapping(0)));
     }
     
+    // We collect the replacements for all the nodes and rebuild the index once
+    map<id_t, vector<Mapping>> old_node_to_new_nodes;
+    
     for (auto& kv : collated) {
         // For every original node and its replacement nodes
         
@@ -539,69 +545,73 @@ void PathIndex::apply_translations(const vector<Translation>& translations) {
         from_edit->set_from_length(path_from_length(covering.to()));
         from_edit->set_to_length(from_edit->from_length());
         
-        // Apply this (single node) translation.
-        // TODO: batch up a bit?
-        apply_translation(covering);
+        // Parse this (single node) translation.
+        for (auto& replacement : parse_translation(covering)) {
+            old_node_to_new_nodes[replacement.first] = std::move(replacement.second);
+        }
     }
+    
+    replace_nodes(old_node_to_new_nodes);
 }
 
-void PathIndex::replace_occurrence(iterator to_replace, const vector<Mapping>& replacements) {
-    // Grab the node ID
-    auto node_id = to_replace->second.node;
-    
-    // Grab it's start
-    auto start = to_replace->first;
+void PathIndex::replace_nodes(const map<id_t, vector<Mapping>>& old_node_to_new_nodes) {
     
-    // Determine if we want to insert replacement nodes forward or backward
-    bool reverse = to_replace->second.is_end;
-    
-    // Peek ahead at whatever's next (so we know if we're replacing the last
-    // node in the path).
-    auto comes_next = to_replace;
-    comes_next++;
+    // TODO: we would like to update mapping_positions efficiently, but we
+    // can't, because it's full of potentially invalidated pointers.
+    mapping_positions.clear();
     
-    if (by_id.count(node_id) && by_id.at(node_id).first == start) {
-        // We're removing the first occurrence of this node, so we need to
-        // clean up by_id. But since we're removing all occurreences of this
-        // node we don't have to point it at the second occurrence.
-        by_id.erase(node_id);
+    if (old_node_to_new_nodes.empty()) {
+        return;
     }
     
-    for (int64_t i = reverse ? (replacements.size() - 1) : 0;
-        i != (reverse ? -1 : replacements.size());
-        i += (reverse ? -1 : 1)) {
-        
-        // For each replacement mapping in the appropriate order
-        auto& mapping = replacements.at(i);
-        
-        // What ID do we put?
-        auto new_id = mapping.position().node_id();
-        
-        // What orientation doies it go in?
-        auto new_orientation = mapping.position().is_reverse() != reverse;
-        
-        // Stick the replacements in the map
-        by_start[start] = NodeSide(new_id, new_orientation);
-        
-        // Remember that occurrence by node ID.
-        node_occurrences[new_id].push_back(by_start.find(start));
-        
-        if (!by_id.count(new_id) || by_id.at(new_id).first > start) {
-            // We've created a new first mapping to this new node.
-            // Record it.
-            by_id[new_id] = make_pair(start, new_orientation);
+    // Trace out the new node occurrences along the path
+    vector<pair<size_t, NodeSide>> occurrences;
+    occurrences.reserve(by_start.size());
+    size_t last_length = last_node_length;
+    
+    for (auto here = by_start.begin(); here != by_start.end(); ++here) {
+        auto found = old_node_to_new_nodes.find(here->second.node);
+        if (found == old_node_to_new_nodes.end()) {
+            // This occurrence stays as it is
+            occurrences.push_back(*here);
+            continue;
         }
+        auto& replacements = found->second;
+        
+        // Determine if we want to insert replacement nodes forward or backward
+        bool reverse = here->second.is_end;
         
-        // Budge start up so the next mapping gets inserted after this one.
-        start += mapping_from_length(mapping);
+        // Where does the next replacement go?
+        size_t start = here->first;
         
-        if (comes_next == by_start.end() && i == (reverse ? 0 : replacements.size() - 1)) {
-            // We just added the last mapping replacing what the old last
-            // mapping was. So update the length of the last node to reflect
-            // this new last node.
-            last_node_length = mapping_from_length(mapping);
+        for (size_t j = 0; j < replacements.size(); j++) {
+            // For each replacement mapping in the appropriate order
+            auto& mapping = replacements.at(reverse ? replacements.size() - 1 - j : j);
+            
+            // What orientation does it go in?
+            bool new_orientation = mapping.position().is_reverse() != reverse;
+            
+            occurrences.emplace_back(start, NodeSide(mapping.position().node_id(), new_orientation));
+            
+            // Budge start up so the next mapping gets inserted after this one.
+            start += mapping_from_length(mapping);
+            
+            if (here + 1 == by_start.end()) {
+                // We're replacing the last node in the path, so the length of
+                // the last node becomes that of its last replacement.
+                last_length = mapping_from_length(mapping);
+            }
         }
     }
+    
+    index_occurrences(std::move(occurrences), last_length);
+    
+#ifdef debug
+    cerr << "by_start is now: " << endl;
+    for (auto kv : by_start) {
+        cerr << "\t" << kv.first << ": " << kv.second << endl;
+    }
+#endif
 }
 
 }
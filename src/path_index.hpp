@@ -4,7 +4,7 @@
 /** \file
  *
  * Provides an index for indexing an individual path for fast random access.
- * Stores all the mappings uncompressed in memory.
+ * Stores all the mappings uncompressed in memory, in sorted arrays.
  *
  * Used for the reference path during VCF creation and interpretation.
  */
@@ -12,6 +12,9 @@
 #include <map>
 #include <utility>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
 
 #include "vg.hpp"
 #include "xg.hpp"
@@ -20,6 +23,53 @@ namespace vg {
 
 using namespace std;
 
+/**
+ * A map from keys to values stored as an array of pairs sorted by key, for
+ * indexes that are built all at once and then only read. Offers the read-only
+ * parts of the std::map interface. Iterators are invalidated when the map is
+ * rebuilt.
+ */
+template<typename Key, typename Value>
+class SortedArrayMap {
+public:
+    using value_type = pair<Key, Value>;
+    using const_iterator = typename vector<value_type>::const_iterator;
+    using iterator = const_iterator;
+    
+    /// Replace the contents with the given entries. If a key appears more
+    /// than once, keep the entry for it that comes first, or last if
+    /// keep_last is set.
+    void assign(vector<value_type>&& entries, bool keep_last = false);
+    
+    /// Remove all the entries.
+    void clear();
+    
+    iterator begin() const;
+    iterator end() const;
+    size_t size() const;
+    bool empty() const;
+    
+    iterator find(const Key& key) const;
+    size_t count(const Key& key) const;
+    
+    /// Get the value for a key. Throws std::out_of_range if it is absent.
+    const Value& at(const Key& key) const;
+    
+    /// Get the value for a key, or a default-constructed value if it is
+    /// absent. Unlike std::map, never inserts anything.
+    Value operator[](const Key& key) const;
+    
+    /// Get the first entry with a key not less than the given key.
+    iterator lower_bound(const Key& key) const;
+    /// Get the first entry with a key greater than the given key.
+    iterator upper_bound(const Key& key) const;
+    
+private:
+    static bool key_less(const value_type& a, const value_type& b);
+    
+    vector<value_type> entries;
+};
+
 /**
  * Holds indexes of the reference in a graph: position to node, node to position
  * and orientation, and the full reference string. Also knows about the lengths
@@ -28,12 +78,13 @@ using namespace std;
 struct PathIndex {
     /// Index from node ID to first position on the reference string and
     /// orientation it occurs there.
-    map<int64_t, pair<size_t, bool>> by_id;
+    SortedArrayMap<int64_t, pair<size_t, bool>> by_id;
     
     /// Index from start position on the reference to the side of the node that
     /// begins there. If it is a right side, the node occurs on the path in a
-    /// reverse orientation.
-    map<size_t, NodeSide> by_start;
+    /// reverse orientation. The i-th entry is the i-th node occurrence on the
+    /// path.
+    SortedArrayMap<size_t, NodeSide> by_start;
     
     /// The actual sequence of the path, if desired.
     std::string sequence;
@@ -41,7 +92,7 @@ struct PathIndex {
     /// Index from Mapping pointers in a VG Paths object to their actual
     /// positions along their paths. Pointers may dangle if the vg graph
     /// changes the path.
-    map<const mapping_t*, size_t> mapping_positions;
+    SortedArrayMap<const mapping_t*, size_t> mapping_positions;
     
     /// Index just a path
     PathIndex(const Path& path);
@@ -59,12 +110,12 @@ struct PathIndex {
     /// Make a PathIndex from a path in a graph
     PathIndex(VG& vg, const string& path_name, bool extract_sequence = false);
     
-    /// Make a PathIndex from a path in an indexed graph
+    /// Make a PathIndex from a path in an indexed graph. Without the sequence,
+    /// the index is read straight out of the XG path's arrays, in parallel.
     PathIndex(const xg::XG& index, const string& path_name, bool extract_sequence = false);
     
     /// Rebuild the mapping positions map by tracing all the paths in the given
-    /// graph. TODO: We ought to move this functionality to the Paths object and
-    /// make it use a good datastructure instead of brute force.
+    /// graph. TODO: We ought to move this functionality to the Paths object.
     void update_mapping_positions(VG& vg, const string& path_name);
     
     /// Find what node and orientation covers a position. The position must not
@@ -74,8 +125,9 @@ struct PathIndex {
     // Check whether a node is on the reference path.
     bool path_contains_node(int64_t node_id);
     
-    /// We keep iterators to node occurrences along the ref path.
-    using iterator = map<size_t, vg::NodeSide>::const_iterator;
+    /// We keep iterators to node occurrences along the ref path. They are
+    /// invalidated by applying translations.
+    using iterator = SortedArrayMap<size_t, vg::NodeSide>::const_iterator;
     
     /// Get the iterator to the first node occurrence on the indexed path.
     iterator begin() const;
@@ -83,7 +135,7 @@ struct PathIndex {
     iterator end() const;
     
     /// Find the iterator at the given position along the ref path. The position
-    /// must not be greater than the path length.
+    /// must not be greater than the path length. Takes constant time.
     iterator find_position(size_t position) const;
     
     /// Get the length of the node occurrence on the path represented by this
@@ -123,23 +175,127 @@ protected:
     /// indexed path.
     size_t last_node_length;
     
-    /// This holds all the places that a particular node occurs, in order.
-    /// TODO: use this to replace by_id
-    map<id_t, vector<iterator>> node_occurrences;
+    /// Bit vector with a 1 at each position along the path where a node
+    /// occurrence starts, and rank support to count the 1s before a position.
+    /// Every 8 words we store the count of 1s in all the words before.
+    vector<uint64_t> start_bits;
+    vector<size_t> start_bits_ranks;
+    
+    /// Fill in by_id, by_start, the start bits and last_node_length from the
+    /// node occurrences along the path, in order. If several occurrences start
+    /// at the same place, the last one is kept.
+    void index_occurrences(vector<pair<size_t, NodeSide>>&& occurrences, size_t last_length);
+    
+    /// Count the node occurrences that start before the given position, which
+    /// must be in the path.
+    size_t starts_before(size_t position) const;
     
     /// Convert a Translation that partitions old nodes into a map from old node
     /// ID to the Mappings that replace it in its forward orientation.
     map<id_t, vector<Mapping>> parse_translation(const Translation& translation);
     
-    /// Given an iterator into by_start, replace the occurrence of the node
-    /// there with occurrences of the nodes given in the vector of mappings,
-    /// which partition the forward strand of the node being replaced.
-    void replace_occurrence(iterator to_replace, const vector<Mapping>& replacements);
-    
-    
+    /// Replace every occurrence of each old node in the map with occurrences
+    /// of the nodes given in its vector of mappings, which partition the
+    /// forward strand of the node being replaced, and reindex.
+    void replace_nodes(const map<id_t, vector<Mapping>>& old_node_to_new_nodes);
     
 };
 
+template<typename Key, typename Value>
+bool SortedArrayMap<Key, Value>::key_less(const value_type& a, const value_type& b) {
+    return a.first < b.first;
+}
+
+template<typename Key, typename Value>
+void SortedArrayMap<Key, Value>::assign(vector<value_type>&& new_entries, bool keep_last) {
+    entries = std::move(new_entries);
+    if (!std::is_sorted(entries.begin(), entries.end(), key_less)) {
+        std::stable_sort(entries.begin(), entries.end(), key_less);
+    }
+    
+    // Squeeze out the duplicate keys
+    size_t kept = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (kept > 0 && entries[kept - 1].first == entries[i].first) {
+            if (keep_last) {
+                entries[kept - 1] = std::move(entries[i]);
+            }
+        } else {
+            if (kept != i) {
+                entries[kept] = std::move(entries[i]);
+            }
+            kept++;
+        }
+    }
+    entries.resize(kept);
+    entries.shrink_to_fit();
+}
+
+template<typename Key, typename Value>
+void SortedArrayMap<Key, Value>::clear() {
+    vector<value_type>().swap(entries);
+}
+
+template<typename Key, typename Value>
+auto SortedArrayMap<Key, Value>::begin() const -> iterator {
+    return entries.begin();
+}
+
+template<typename Key, typename Value>
+auto SortedArrayMap<Key, Value>::end() const -> iterator {
+    return entries.end();
+}
+
+template<typename Key, typename Value>
+size_t SortedArrayMap<Key, Value>::size() const {
+    return entries.size();
+}
+
+template<typename Key, typename Value>
+bool SortedArrayMap<Key, Value>::empty() const {
+    return entries.empty();
+}
+
+template<typename Key, typename Value>
+auto SortedArrayMap<Key, Value>::lower_bound(const Key& key) const -> iterator {
+    return std::lower_bound(entries.begin(), entries.end(), key, [](const value_type& entry, const Key& k) {
+        return entry.first < k;
+    });
+}
+
+template<typename Key, typename Value>
+auto SortedArrayMap<Key, Value>::upper_bound(const Key& key) const -> iterator {
+    return std::upper_bound(entries.begin(), entries.end(), key, [](const Key& k, const value_type& entry) {
+        return k < entry.first;
+    });
+}
+
+template<typename Key, typename Value>
+auto SortedArrayMap<Key, Value>::find(const Key& key) const -> iterator {
+    auto found = lower_bound(key);
+    return (found != entries.end() && found->first == key) ? found : entries.end();
+}
+
+template<typename Key, typename Value>
+size_t SortedArrayMap<Key, Value>::count(const Key& key) const {
+    return find(key) != entries.end();
+}
+
+template<typename Key, typename Value>
+const Value& SortedArrayMap<Key, Value>::at(const Key& key) const {
+    auto found = find(key);
+    if (found == entries.end()) {
+        throw std::out_of_range("SortedArrayMap::at");
+    }
+    return found->second;
+}
+
+template<typename Key, typename Value>
+Value SortedArrayMap<Key, Value>::operator[](const Key& key) const {
+    auto found = find(key);
+    return found == entries.end() ? Value() : found->second;
+}
+
 }
  
 #endif
@@ -0,0 +1,101 @@
+#include "path_offset_cache.hpp"
+#include "xg_position.hpp"
+
+#include <algorithm>
+
+namespace vg {
+
+using namespace std;
+
+PathOffsetCache::PathOffsetCache(xg::XG* xgidx, size_t max_nodes) :
+    xgidx(xgidx), max_nodes_per_shard(max(max_nodes / SHARD_COUNT, (size_t) 1)), shards(SHARD_COUNT) {
+    // Nothing to do
+}
+
+PathOffsetCache::Shard& PathOffsetCache::shard_for(id_t node_id) {
+    // Neighboring nodes go to different shards, so threads walking sorted IDs don't collide
+    return shards[((uint64_t) node_id) % SHARD_COUNT];
+}
+
+vector<PathOffsetCache::node_visit_t> PathOffsetCache::node_visits(id_t node_id) {
+    Shard& shard = shard_for(node_id);
+    {
+        lock_guard<mutex> guard(shard.lock);
+        auto found = shard.visits.find(node_id);
+        if (found != shard.visits.end()) {
+            return found->second;
+        }
+    }
+
+    // Look the node up without holding the lock; if two threads race, they
+    // compute the same answer.
+    vector<node_visit_t> visits;
+    for (auto& path_offsets : xgidx->offsets_in_paths(make_pos_t(node_id, false, 0))) {
+        for (auto& offset_and_dir : path_offsets.second) {
+            visits.emplace_back(path_offsets.first, offset_and_dir.first, offset_and_dir.second);
+        }
+    }
+
+    lock_guard<mutex> guard(shard.lock);
+    if (shard.visits.size() >= max_nodes_per_shard) {
+        // Crude but bounded; annotation walks the graph roughly in order, so
+        // old entries are unlikely to be needed again.
+        shard.visits.clear();
+    }
+    shard.visits[node_id] = visits;
+    return visits;
+}
+
+void PathOffsetCache::prefetch(vector<id_t>& node_ids) {
+    std::sort(node_ids.begin(), node_ids.end());
+    node_ids.erase(unique(node_ids.begin(), node_ids.end()), node_ids.end());
+    // Contiguous runs of sorted IDs per thread keep each thread's XG accesses local
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < node_ids.size(); ++i) {
+        node_visits(node_ids[i]);
+    }
+}
+
+map<string, vector<pair<size_t, bool> > > PathOffsetCache::alignment_path_offsets(const Alignment& aln, bool just_min) {
+    map<string, vector<pair<size_t, bool> > > offsets;
+    for (auto& mapping : aln.path().mapping()) {
+        auto& pos = mapping.position();
+        // Shift each visit to the mapped strand and offset, as XG::offsets_in_paths does
+        for (auto& visit : node_visits(pos.node_id())) {
+            offsets[get<0>(visit)].emplace_back(get<1>(visit) + pos.offset(),
+                                                get<2>(visit) != pos.is_reverse());
+        }
+    }
+    if (offsets.empty()) {
+        // Nothing on a path; search nearby, which we don't cache
+        return xg_alignment_path_offsets(aln, just_min, true, xgidx);
+    }
+    if (just_min) {
+        // take the min offset in each path
+        for (auto& p : offsets) {
+            auto& v = p.second;
+            auto m = *min_element(v.begin(), v.end(),
+                                  [](const pair<size_t, bool>& a,
+                                     const pair<size_t, bool>& b)
+                                  { return a.first < b.first; });
+            v.clear();
+            v.push_back(m);
+        }
+    }
+    return offsets;
+}
+
+void PathOffsetCache::annotate_with_initial_path_positions(Alignment& aln, bool just_min) {
+    if (!aln.refpos_size()) {
+        for (auto& pos_record : alignment_path_offsets(aln, just_min)) {
+            for (auto& pos : pos_record.second) {
+                Position* refpos = aln.add_refpos();
+                refpos->set_name(pos_record.first);
+                refpos->set_offset(pos.first);
+                refpos->set_is_reverse(pos.second);
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef VG_PATH_OFFSET_CACHE_HPP_INCLUDED
+#define VG_PATH_OFFSET_CACHE_HPP_INCLUDED
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "vg.pb.h"
+#include "types.hpp"
+#include "xg.hpp"
+
+/** \file
+ * path_offset_cache.hpp: a cache of where nodes fall on the embedded paths of
+ * an xg::XG index, shared by threads that annotate alignments with reference
+ * positions.
+ */
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Caches, per node, the start offset and orientation of each of the node's
+ * visits to each path in an XG index. The cache is split into independently
+ * locked shards so that many threads can read and fill it at once.
+ *
+ * alignment_path_offsets() gives the same answers as
+ * xg_alignment_path_offsets(aln, just_min, false, xgidx), including its
+ * fallback to nearby path positions for alignments touching no path.
+ */
+class PathOffsetCache {
+public:
+
+    /// One visit of a node to a path, relative to the node's forward strand at offset 0
+    typedef tuple<string, size_t, bool> node_visit_t;
+
+    PathOffsetCache(xg::XG* xgidx, size_t max_nodes = 1 << 22);
+
+    /// Make sure the given nodes are cached. The IDs are sorted and
+    /// deduplicated in place and then looked up in order, on all threads, so
+    /// that XG is walked sequentially.
+    void prefetch(vector<id_t>& node_ids);
+
+    /// Get the offsets along each path of the alignment's mappings.
+    map<string, vector<pair<size_t, bool> > > alignment_path_offsets(const Alignment& aln, bool just_min = true);
+
+    /// Replace the alignment's refpos annotations, if it has none, with its initial path positions
+    void annotate_with_initial_path_positions(Alignment& aln, bool just_min = true);
+
+    /// Get the cached visits of a node to the paths, looking them up if needed.
+    vector<node_visit_t> node_visits(id_t node_id);
+
+private:
+
+    struct Shard {
+        mutex lock;
+        unordered_map<id_t, vector<node_visit_t> > visits;
+    };
+
+    static const size_t SHARD_COUNT = 64;
+
+    Shard& shard_for(id_t node_id);
+
+    xg::XG* xgidx;
+    size_t max_nodes_per_shard;
+    vector<Shard> shards;
+};
+
+}
+
+#endif
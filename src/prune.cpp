@@ -1,100 +1,251 @@
 #include "prune.hpp"
 
+#include <algorithm>
+#include <stack>
+#include <unordered_set>
+
 namespace vg {
 
+/// Hash for walk states, so each one is expanded once per start
+struct walk_hash_t {
+    size_t operator()(const walk_t& walk) const {
+        size_t hash = std::hash<handle_t>()(walk.curr);
+        hash ^= ((size_t) walk.length << 16 | walk.forks) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+};
+
 vector<edge_t> find_edges_to_prune(const HandleGraph& graph, size_t k, size_t edge_max) {
-    // for each position on the forward and reverse of the graph
-    //unordered_set<edge_t> edges_to_prune;
-    vector<vector<edge_t> > edges_to_prune;
-    edges_to_prune.resize(get_thread_count());
+    if (k == 0) {
+        // No walk needs to leave its node
+        return vector<edge_t>();
+    }
+
+    // Per-thread buffers, reused across handles so that the search itself
+    // doesn't allocate
+    size_t thread_count = get_thread_count();
+    vector<vector<edge_t>> edges_to_prune(thread_count);
+    vector<vector<walk_t>> frontiers(thread_count);
+    vector<vector<handle_t>> successors(thread_count);
+    vector<unordered_set<walk_t, walk_hash_t>> expanded(thread_count);
+
     graph.for_each_handle([&](const handle_t& h) {
-            // for the forward and reverse of this handle
-            // walk k bases from the end, so that any kmer starting on the node will be represented in the tree we build
-            for (auto handle_is_rev : { false, true }) {
-                //cerr << "###########################################" << endl;
-                handle_t handle = handle_is_rev ? graph.flip(h) : h;
-                list<walk_t> walks;
-                // for each position in the node, set up a kmer with that start position and the node end or kmer length as the end position
-                // determine next positions
-                id_t handle_id = graph.get_id(handle);
-                size_t handle_length = graph.get_length(handle);
-                string handle_seq = graph.get_sequence(handle);
-                for (size_t i = 0; i < handle_length;  ++i) {
-                    pos_t begin = make_pos_t(handle_id, handle_is_rev, handle_length);
-                    pos_t end = make_pos_t(handle_id, handle_is_rev, min(handle_length, i+k));
-                    walk_t walk = walk_t(offset(end)-offset(begin), begin, end, handle, 0);
-                    if (walk.length < k) {
-                        // are we branching over more than one edge?
-                        size_t next_count = 0;
-                        graph.follow_edges(walk.curr, false, [&](const handle_t& next) { ++next_count; });
-                        graph.follow_edges(walk.curr, false, [&](const handle_t& next) {
-                                if (next_count > 1 && edge_max == walk.forks) { // our next step takes us over the max
-                                    int tid = omp_get_thread_num();
-                                    edges_to_prune[tid].push_back(graph.edge_handle(walk.curr, next));
-                                } else {
-                                    walks.push_back(walk);
-                                    auto& todo = walks.back();
-                                    todo.curr = next;
-                                    if (next_count > 1) {
-                                        ++todo.forks;
-                                    }
-                                }
-                            });
+            if (graph.get_length(h) == 0) {
+                // No kmers start here
+                return;
+            }
+            int tid = omp_get_thread_num();
+            auto& found = edges_to_prune[tid];
+            auto& frontier = frontiers[tid];
+            auto& nexts = successors[tid];
+            auto& seen = expanded[tid];
+
+            // Queue up the walks continuing past the end of from, or record
+            // the edges they would take over the fork limit
+            auto extend = [&](const handle_t& from, uint32_t length, uint32_t forks) {
+                nexts.clear();
+                graph.follow_edges(from, false, [&](const handle_t& next) {
+                        nexts.push_back(next);
+                    });
+                bool branching = nexts.size() > 1;
+                for (auto& next : nexts) {
+                    if (branching && forks == edge_max) {
+                        // our next step takes us over the max
+                        found.push_back(graph.edge_handle(from, next));
                     } else {
-                        walks.push_back(walk);
+                        frontier.emplace_back(next, length, forks + branching);
                     }
                 }
-                // now expand the kmers until they reach k
-                while (!walks.empty()) {
-                    // first we check which ones have reached length k in the current handle; for each of these we run lambda and remove them from our list
-                    auto walks_end = walks.end();
-                    for (list<walk_t>::iterator q = walks.begin(); q != walks_end; ++q) {
-                        auto& walk = *q;
-                        // did we reach our target length?
-                        if (walk.length >= k) {
-                            q = walks.erase(q);
-                        } else {
-                            id_t curr_id = graph.get_id(walk.curr);
-                            size_t curr_length = graph.get_length(walk.curr);
-                            bool curr_is_rev = graph.get_is_reverse(walk.curr);
-                            size_t take = min(curr_length, k-walk.length);
-                            walk.end = make_pos_t(curr_id, curr_is_rev, take);
-                            walk.length += take;
-                            if (walk.length < k) {
-                                // if not, we need to expand through the node then follow on
-                                size_t next_count = 0;
-                                graph.follow_edges(walk.curr, false, [&](const handle_t& next) { ++next_count; });
-                                graph.follow_edges(walk.curr, false, [&](const handle_t& next) {
-                                        if (next_count > 1 && edge_max == walk.forks) { // our next step takes us over the max
-                                            int tid = omp_get_thread_num();
-                                            edges_to_prune[tid].push_back(graph.edge_handle(walk.curr, next));
-                                        } else {
-                                            walks.push_back(walk);
-                                            auto& todo = walks.back();
-                                            todo.curr = next;
-                                            if (next_count > 1) {
-                                                ++todo.forks;
-                                            }
-                                        }
-                                    });
-                                q = walks.erase(q);
-                            } else {
-                                // nothing, we'll remove it next time around
-                            }
-                        }
+            };
+
+            // Walk up to k bases out from each end of the node, so that any
+            // kmer starting on the node is covered
+            for (auto handle_is_rev : { false, true }) {
+                frontier.clear();
+                seen.clear();
+                extend(handle_is_rev ? graph.flip(h) : h, 0, 0);
+                while (!frontier.empty()) {
+                    walk_t walk = frontier.back();
+                    frontier.pop_back();
+                    if (!seen.insert(walk).second) {
+                        // Another walk got to the same place with the same
+                        // length and forks, so it finds the same edges
+                        continue;
+                    }
+                    size_t length = walk.length + min(graph.get_length(walk.curr), k - walk.length);
+                    if (length < k) {
+                        extend(walk.curr, length, walk.forks);
                     }
                 }
             }
         }, true);
+
     uint64_t total_edges = 0;
     for (auto& v : edges_to_prune) total_edges += v.size();
     vector<edge_t> merged; merged.reserve(total_edges);
     for (auto& v : edges_to_prune) {
         merged.insert(merged.end(), v.begin(), v.end());
+        vector<edge_t>().swap(v);
     }
-    // duplicates are assumed to be dealt with externally
+
+    // The same edge is usually found from many starting handles
+    auto edge_less = [](const edge_t& a, const edge_t& b) {
+        return make_pair(as_integer(a.first), as_integer(a.second)) < make_pair(as_integer(b.first), as_integer(b.second));
+    };
+    sort(merged.begin(), merged.end(), edge_less);
+    merged.erase(unique(merged.begin(), merged.end()), merged.end());
     return merged;
 }
 
 
+/// Visit each node in the component of the given one, ignoring edge
+/// directions and never passing through the nodes in the skip set
+static void for_each_connected_node(const HandleGraph& graph, const handle_t& start,
+                                    const unordered_set<id_t>& skip,
+                                    const function<void(const handle_t&)>& lambda) {
+    unordered_set<id_t> seen { graph.get_id(start) };
+    stack<handle_t> to_visit;
+    to_visit.push(graph.forward(start));
+    while (!to_visit.empty()) {
+        handle_t curr = to_visit.top(); to_visit.pop();
+        lambda(curr);
+        for (bool go_left : { false, true }) {
+            graph.follow_edges(curr, go_left, [&](const handle_t& next) {
+                    id_t next_id = graph.get_id(next);
+                    if (!skip.count(next_id) && !seen.count(next_id)) {
+                        seen.insert(next_id);
+                        to_visit.push(graph.forward(next));
+                    }
+                });
+        }
+    }
+}
+
+/// Is the handle's node without edges on the given side?
+static bool is_end(const HandleGraph& graph, const handle_t& handle, bool go_left) {
+    return graph.follow_edges(handle, go_left, [](const handle_t& next) { return false; });
+}
+
+void prune_complex_with_head_tail(MutableHandleGraph& graph, size_t k, size_t edge_max) {
+
+    id_t max_id = 0;
+    vector<handle_t> heads, tails;
+    unordered_set<id_t> unattached;
+    graph.for_each_handle([&](const handle_t& h) {
+            max_id = max(max_id, graph.get_id(h));
+            unattached.insert(graph.get_id(h));
+            if (is_end(graph, h, true)) {
+                heads.push_back(h);
+            }
+            if (is_end(graph, h, false)) {
+                tails.push_back(h);
+            }
+        });
+
+    handle_t head_node = graph.create_handle(string(k, '#'), max_id + 1);
+    handle_t tail_node = graph.create_handle(string(k, '$'), max_id + 2);
+    unordered_set<id_t> markers { max_id + 1, max_id + 2 };
+    auto attach = [&](const handle_t& h) {
+        if (unattached.count(graph.get_id(h))) {
+            for_each_connected_node(graph, h, markers, [&](const handle_t& node) {
+                    unattached.erase(graph.get_id(node));
+                });
+        }
+    };
+
+    for (auto& h : heads) {
+        attach(h);
+        graph.create_edge(head_node, h);
+    }
+    for (auto& h : tails) {
+        attach(h);
+        graph.create_edge(h, tail_node);
+    }
+    while (!unattached.empty()) {
+        // Break into each component with no heads or tails at an arbitrary node
+        handle_t h = graph.get_handle(*unattached.begin(), false);
+        attach(h);
+        vector<handle_t> prev;
+        graph.follow_edges(h, true, [&](const handle_t& p) {
+                if (graph.get_id(p) != graph.get_id(head_node)) {
+                    prev.push_back(p);
+                }
+            });
+        graph.create_edge(head_node, h);
+        for (auto& p : prev) {
+            graph.create_edge(p, tail_node);
+        }
+    }
+
+    for (auto& e : find_edges_to_prune(graph, k, edge_max)) {
+        graph.destroy_edge(e.first, e.second);
+    }
+
+    // Fix up the new heads and tails
+    heads.clear();
+    tails.clear();
+    graph.for_each_handle([&](const handle_t& h) {
+            if (markers.count(graph.get_id(h))) {
+                return;
+            }
+            if (is_end(graph, h, true)) {
+                heads.push_back(h);
+            }
+            if (is_end(graph, h, false)) {
+                tails.push_back(h);
+            }
+        });
+    for (auto& h : heads) {
+        graph.create_edge(head_node, h);
+    }
+    for (auto& h : tails) {
+        graph.create_edge(h, tail_node);
+    }
+
+    graph.destroy_handle(head_node);
+    graph.destroy_handle(tail_node);
+}
+
+void prune_short_subgraphs(MutableHandleGraph& graph, size_t min_size) {
+
+    vector<handle_t> heads;
+    graph.for_each_handle([&](const handle_t& h) {
+            if (is_end(graph, h, true)) {
+                heads.push_back(h);
+            }
+        });
+
+    unordered_set<id_t> destroyed;
+    for (auto& head : heads) {
+        if (destroyed.count(graph.get_id(head))) {
+            continue;   // Already pruned.
+        }
+
+        // Explore the neighborhood until the component is too large.
+        size_t subgraph_size = graph.get_length(head);
+        stack<handle_t> to_check; to_check.push(head);
+        unordered_set<id_t> subgraph { graph.get_id(head) };
+        while (subgraph_size < min_size && !to_check.empty()) {
+            handle_t curr = to_check.top(); to_check.pop();
+            for (bool go_left : { false, true }) {
+                graph.follow_edges(curr, go_left, [&](const handle_t& next) {
+                        if (!subgraph.count(graph.get_id(next))) {
+                            subgraph_size += graph.get_length(next);
+                            subgraph.insert(graph.get_id(next));
+                            to_check.push(graph.forward(next));
+                        }
+                    });
+            }
+        }
+
+        // Destroy the component if it was small enough.
+        if (subgraph_size < min_size) {
+            for (id_t node : subgraph) {
+                graph.destroy_handle(graph.get_handle(node, false));
+                destroyed.insert(node);
+            }
+        }
+    }
+}
+
 }
@@ -15,25 +15,36 @@ namespace vg {
 
 using namespace std;
 
-/// Record a <=k-length walk in the context of a graph.
+/// A walk of less than k bases that has reached a handle, as kept on the
+/// frontier of find_edges_to_prune().
 struct walk_t {
-    walk_t(uint16_t l,
-           const pos_t& b,
-           const pos_t& e,
-           const handle_t& c,
-           uint16_t f)
-        : length(l), begin(b), end(e), curr(c), forks(f) { };
-    /// our start position
-    pos_t begin;
-    pos_t end; /// one past the (current) end of the kmer
+    walk_t(const handle_t& c, uint32_t l, uint32_t f)
+        : curr(c), length(l), forks(f) { };
     handle_t curr; /// the next handle we extend into
-    uint16_t forks; /// how many branching edge crossings we took to get here
-    uint16_t length; /// how far we've been
+    uint32_t length; /// how many bases we've walked before curr
+    uint32_t forks; /// how many branching edge crossings we took to get here
+
+    inline bool operator==(const walk_t& other) const {
+        return curr == other.curr && length == other.length && forks == other.forks;
+    }
 };
 
-/// Iterate over all the walks up to length k, adding edges which 
+/// Find the edges to remove so that no walk of up to k bases crosses more than
+/// edge_max branching edges. Handles are searched in parallel, walks that
+/// reach the same handle with the same length and forks are only followed
+/// once, and each edge is reported once.
 vector<edge_t> find_edges_to_prune(const HandleGraph& graph, size_t k, size_t edge_max);
 
+/// Remove the edges that find_edges_to_prune() finds, with temporary head and
+/// tail marker nodes of length k attached to the graph's ends (and to one node
+/// of each headless component) so that walks from the ends are also limited.
+/// Works like VG::prune_complex_with_head_tail().
+void prune_complex_with_head_tail(MutableHandleGraph& graph, size_t k, size_t edge_max);
+
+/// Remove the connected components reachable from head nodes that have less
+/// than min_size bases in total. Works like VG::prune_short_subgraphs().
+void prune_short_subgraphs(MutableHandleGraph& graph, size_t min_size);
+
 }
 
 #endif
@@ -577,7 +577,7 @@ NGSSimulator::NGSSimulator(xg::XG& xg_index,
     , insert_sampler(insert_length_mean, insert_length_stdev)
     , seed(seed)
     , source_paths(source_paths)
-    , joint_initial_distr(seed - 1)
+    , quality_model(make_shared<QualityModel>())
 {
     if (source_paths.empty()) {
         start_pos_samplers.emplace_back(1, xg_index.seq_length);
@@ -667,6 +667,8 @@ NGSSimulator::NGSSimulator(xg::XG& xg_index,
         cerr << "warning:[NGSSimulator] Auto-detected read length of " << modal_length << " is long compared to mean insert length " << insert_length_mean << " and standard deviation " << insert_length_stdev << ", sampling may take additional time and statistical properties of insert length distribution may not reflect input parameters" << endl;
     }
     
+    auto& transition_distrs_1 = quality_model->transition_distrs_1;
+    auto& transition_distrs_2 = quality_model->transition_distrs_2;
     while (transition_distrs_1.size() > modal_length) {
         transition_distrs_1.pop_back();
     }
@@ -686,6 +688,34 @@ NGSSimulator::NGSSimulator(xg::XG& xg_index,
 #endif
 }
 
+NGSSimulator::NGSSimulator(const NGSSimulator& trained, size_t stream_seed, size_t first_fragment) :
+      mutation_alphabets(trained.mutation_alphabets)
+    , phred_prob(trained.phred_prob)
+    , quality_model(trained.quality_model)
+    , xg_index(trained.xg_index)
+    , node_cache(100)
+    , edge_cache(100)
+    , prng(stream_seed)
+    , path_sampler(trained.path_sampler.param())
+    , start_pos_samplers(trained.start_pos_samplers)
+    , strand_sampler(trained.strand_sampler.param())
+    , background_sampler(trained.background_sampler.param())
+    , mut_sampler(trained.mut_sampler.param())
+    , prob_sampler(trained.prob_sampler.param())
+    , insert_sampler(trained.insert_sampler.param())
+    , sub_poly_rate(trained.sub_poly_rate)
+    , indel_poly_rate(trained.indel_poly_rate)
+    , indel_error_prop(trained.indel_error_prop)
+    , insert_mean(trained.insert_mean)
+    , insert_sd(trained.insert_sd)
+    , sample_counter(first_fragment)
+    , seed(trained.seed)
+    , retry_on_Ns(trained.retry_on_Ns)
+    , source_paths(trained.source_paths)
+{
+    // the trained distributions are only read from here on
+}
+
 Alignment NGSSimulator::sample_read() {
     
     Alignment aln;
@@ -740,7 +770,7 @@ pair<Alignment, Alignment> NGSSimulator::sample_read_pair() {
     
     while (!aln_pair.first.has_path() || !aln_pair.second.has_path()) {
         int64_t insert_length = (int64_t) round(insert_sampler(prng));
-        if (insert_length < (int64_t) transition_distrs_1.size()) {
+        if (insert_length < (int64_t) quality_model->transition_distrs_1.size()) {
             // don't make reads where the insert length is shorter than one end of the read
             continue;
         }
@@ -770,7 +800,7 @@ pair<Alignment, Alignment> NGSSimulator::sample_read_pair() {
         }
         
         // walk out the unsequenced part of the insert in the graph
-        int64_t remaining_length = insert_length - 2 * transition_distrs_1.size();
+        int64_t remaining_length = insert_length - 2 * quality_model->transition_distrs_1.size();
         if (remaining_length >= 0) {
             // we need to move forward from the end of the first read
             if (advance_by_distance(offset, is_reverse, pos, remaining_length, source_path)) {
@@ -821,7 +851,7 @@ void NGSSimulator::sample_read_internal(Alignment& aln, size_t& offset, bool& is
     aln.clear_path();
     aln.clear_sequence();
     
-    char graph_char = xg_cached_pos_char(curr_pos, &xg_index, node_cache);
+    char graph_char = walk_char(curr_pos);
     bool hit_end = false;
     
     // walk a path and generate a read sequence at the same time
@@ -932,6 +962,13 @@ bool NGSSimulator::advance(size_t& offset, bool& is_reverse, pos_t& pos, char& g
 
 bool NGSSimulator::advance_on_graph(pos_t& pos, char& graph_char) {
     
+    if (id(pos) == walk_node_id && offset(pos) + 1 < walk_node_sequence.size()) {
+        // there is only one way to go inside the node
+        get_offset(pos)++;
+        graph_char = walk_char(pos);
+        return false;
+    }
+    
     // choose a next position at random
     map<pos_t, char> next_pos_chars = xg_cached_next_pos_chars(pos,
                                                                &xg_index,
@@ -948,7 +985,7 @@ bool NGSSimulator::advance_on_graph(pos_t& pos, char& graph_char) {
         iter++;
     }
     pos = iter->first;
-    graph_char = iter->second;
+    graph_char = walk_char(pos);
     
     return false;
 }
@@ -975,7 +1012,7 @@ bool NGSSimulator::advance_on_path(size_t& offset, bool& is_reverse, pos_t& pos,
     pos = position_at(&xg_index, source_path, offset, is_reverse);
     
     // And look up the character
-    graph_char = xg_cached_pos_char(pos, &xg_index, node_cache);
+    graph_char = walk_char(pos);
     
     return false;
 }
@@ -1043,6 +1080,18 @@ bool NGSSimulator::advance_on_path_by_distance(size_t& offset, bool& is_reverse,
     return false;
 }
 
+char NGSSimulator::walk_char(const pos_t& pos) {
+    if (id(pos) != walk_node_id) {
+        walk_node_id = id(pos);
+        walk_node_sequence = xg_index.node_sequence(id(pos));
+    }
+    if (is_rev(pos)) {
+        return reverse_complement(walk_node_sequence[walk_node_sequence.size() - offset(pos) - 1]);
+    } else {
+        return walk_node_sequence[offset(pos)];
+    }
+}
+
 pos_t NGSSimulator::walk_backwards(const Path& path, size_t distance) {
     // Starting at the past-the-end of the path, walk back to the given nonzero distance.
     // Walking back the whole path length puts you at the start of the path.
@@ -1307,12 +1356,12 @@ string NGSSimulator::get_read_name() {
 
 void NGSSimulator::record_read_quality(const Alignment& aln, bool read_2) {
     const string& quality = aln.quality();
-    auto& transition_distrs = read_2 ? transition_distrs_2 : transition_distrs_1;
+    auto& transition_distrs = read_2 ? quality_model->transition_distrs_2 : quality_model->transition_distrs_1;
     if (quality.empty()) {
         return;
     }
     while (transition_distrs.size() < quality.size()) {
-        transition_distrs.emplace_back(seed ? seed + transition_distrs.size() + 1 : random_device()());
+        transition_distrs.emplace_back();
     }
     transition_distrs[0].record_transition(0, quality[0]);
     for (size_t i = 1; i < transition_distrs.size(); i++) {
@@ -1324,55 +1373,51 @@ void NGSSimulator::record_read_pair_quality(const Alignment& aln_1, const Alignm
     record_read_quality(aln_1, false);
     record_read_quality(aln_2, true);
     if (!aln_1.quality().empty() && !aln_2.quality().empty()) {
-        joint_initial_distr.record_transition(0, make_pair<uint8_t, uint8_t>(aln_1.quality()[0], aln_2.quality()[0]));
+        quality_model->joint_initial_distr.record_transition(0, make_pair<uint8_t, uint8_t>(aln_1.quality()[0], aln_2.quality()[0]));
     }
 }
 
 void NGSSimulator::finalize() {
-    for (MarkovDistribution<uint8_t, uint8_t>& markov_distr : transition_distrs_1) {
+    for (MarkovDistribution<uint8_t, uint8_t>& markov_distr : quality_model->transition_distrs_1) {
         markov_distr.finalize();
     }
-    for (MarkovDistribution<uint8_t, uint8_t>& markov_distr : transition_distrs_2) {
+    for (MarkovDistribution<uint8_t, uint8_t>& markov_distr : quality_model->transition_distrs_2) {
         markov_distr.finalize();
     }
-    joint_initial_distr.finalize();
+    quality_model->joint_initial_distr.finalize();
 }
 
 string NGSSimulator::sample_read_quality() {
     // only use the first trained distribution (on the assumption that it better reflects the properties of
     // single-ended sequencing)
-    return sample_read_quality_internal(transition_distrs_1[0].sample_transition(0),  transition_distrs_1);
+    const auto& transition_distrs_1 = quality_model->transition_distrs_1;
+    return sample_read_quality_internal(transition_distrs_1[0].sample_transition(0, prng), transition_distrs_1);
 }
     
 pair<string, string> NGSSimulator::sample_read_quality_pair() {
-    if (transition_distrs_2.empty()) {
+    if (quality_model->transition_distrs_2.empty()) {
         // no paired training data, sample qual strings independently
         return make_pair(sample_read_quality(), sample_read_quality());
     }
     else {
         // paired training data, sample the start quality jointly
-        pair<uint8_t, uint8_t> first_quals = joint_initial_distr.sample_transition(0);
-        return make_pair(sample_read_quality_internal(first_quals.first, transition_distrs_1),
-                         sample_read_quality_internal(first_quals.second, transition_distrs_2));
+        pair<uint8_t, uint8_t> first_quals = quality_model->joint_initial_distr.sample_transition(0, prng);
+        return make_pair(sample_read_quality_internal(first_quals.first, quality_model->transition_distrs_1),
+                         sample_read_quality_internal(first_quals.second, quality_model->transition_distrs_2));
     }
 }
     
 string NGSSimulator::sample_read_quality_internal(uint8_t first,
-                                                  vector<MarkovDistribution<uint8_t, uint8_t>>& transition_distrs) {
+                                                  const vector<MarkovDistribution<uint8_t, uint8_t>>& transition_distrs) {
     string quality(transition_distrs.size(), first);
     uint8_t at = first;
     for (size_t i = 1; i < transition_distrs.size(); i++) {
-        at = transition_distrs[i].sample_transition(at);
+        at = transition_distrs[i].sample_transition(at, prng);
         quality[i] = at;
     }
     return quality;
 }
     
-template<class From, class To>
-NGSSimulator::MarkovDistribution<From, To>::MarkovDistribution(size_t seed) : prng(seed) {
-    // nothing to do
-}
-
 template<class From, class To>
 void NGSSimulator::MarkovDistribution<From, To>::record_transition(From from, To to) {
     if (!cond_distrs.count(from)) {
@@ -1396,21 +1441,20 @@ void NGSSimulator::MarkovDistribution<From, To>::finalize() {
         for (size_t i = 1; i < cond_distr.second.size(); i++) {
             cond_distr.second[i] += cond_distr.second[i - 1];
         }
-        
-        samplers[cond_distr.first] = uniform_int_distribution<size_t>(0, cond_distr.second.back() - 1);
     }
 }
 
 template<class From, class To>
-To NGSSimulator::MarkovDistribution<From, To>::sample_transition(From from) {
+To NGSSimulator::MarkovDistribution<From, To>::sample_transition(From from, default_random_engine& prng) const {
     // return randomly if a transition has never been observed
-    if (!cond_distrs.count(from)) {
+    auto found = cond_distrs.find(from);
+    if (found == cond_distrs.end()) {
         return value_at[uniform_int_distribution<size_t>(0, value_at.size() - 1)(prng)];
     }
     
-    size_t sample_val = samplers[from](prng);
+    const vector<size_t>& cdf = found->second;
     
-    vector<size_t>& cdf = cond_distrs[from];
+    size_t sample_val = uniform_int_distribution<size_t>(0, cdf.back() - 1)(prng);
     
     if (sample_val <= cdf[0]) {
         return value_at[0];
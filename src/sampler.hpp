@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 #include <sstream>
@@ -149,6 +150,12 @@ public:
                  bool retry_on_Ns = true,
                  size_t seed = 0);
     
+    /// Make a simulator that shares the trained error distribution of another
+    /// one, but draws from its own random stream seeded with stream_seed, so
+    /// several can sample at once. The fragments it names are numbered from
+    /// first_fragment.
+    NGSSimulator(const NGSSimulator& trained, size_t stream_seed, size_t first_fragment);
+    
     /// Sample an individual read and alignment
     Alignment sample_read();
     
@@ -159,20 +166,15 @@ private:
     template<class From, class To>
     class MarkovDistribution {
     public:
-        MarkovDistribution(size_t seed);
-        
         /// record a transition from the input data
         void record_transition(From from, To to);
         /// indicate that there is no more data and prepare for sampling
         void finalize();
-        /// sample according to the training data
-        To sample_transition(From from);
+        /// sample according to the training data, using randomness from prng
+        To sample_transition(From from, default_random_engine& prng) const;
         
     private:
         
-        default_random_engine prng;
-        unordered_map<From, uniform_int_distribution<size_t>> samplers;
-        
         unordered_map<To, size_t> column_of;
         vector<To> value_at;
         unordered_map<From, vector<size_t>> cond_distrs;
@@ -198,7 +200,7 @@ private:
     pair<string, string> sample_read_quality_pair();
     /// Wrapped internal function for quality sampling
     string sample_read_quality_internal(uint8_t first,
-                                        vector<MarkovDistribution<uint8_t, uint8_t>>& transition_distrs);
+                                        const vector<MarkovDistribution<uint8_t, uint8_t>>& transition_distrs);
     
     /// Internal method called by paired and unpaired samplers for both whole-
     /// graph and path sources. Offset and is_reverse are only used (and drive
@@ -246,6 +248,10 @@ private:
     bool advance_on_graph_by_distance(pos_t& pos, size_t distance);
     
     
+    /// Get the character at a position, keeping the sequence of its node for the
+    /// next call so that walking along a node doesn't go back to the index
+    char walk_char(const pos_t& pos);
+    
     /// Returns the position a given distance from the end of the path, walking backwards
     pos_t walk_backwards(const Path& path, size_t distance);
     /// Add a deletion to the alignment
@@ -258,18 +264,27 @@ private:
     /// Memo for Phred -> probability conversion
     vector<double> phred_prob;
     
-    /// A Markov distribution for each read position
-    vector<MarkovDistribution<uint8_t, uint8_t>> transition_distrs_1;
-    /// A second set of Markov distributions for the second read in a pair
-    vector<MarkovDistribution<uint8_t, uint8_t>> transition_distrs_2;
-    /// A distribution for the joint initial qualities of a read pair
-    MarkovDistribution<uint8_t, pair<uint8_t, uint8_t>> joint_initial_distr;
+    /// The distributions trained on the FASTQ, which are shared read-only
+    /// between simulators made from one another
+    struct QualityModel {
+        /// A Markov distribution for each read position
+        vector<MarkovDistribution<uint8_t, uint8_t>> transition_distrs_1;
+        /// A second set of Markov distributions for the second read in a pair
+        vector<MarkovDistribution<uint8_t, uint8_t>> transition_distrs_2;
+        /// A distribution for the joint initial qualities of a read pair
+        MarkovDistribution<uint8_t, pair<uint8_t, uint8_t>> joint_initial_distr;
+    };
+    shared_ptr<QualityModel> quality_model;
     
     xg::XG& xg_index;
     
     LRUCache<id_t, Node> node_cache;
     LRUCache<id_t, vector<Edge> > edge_cache;
     
+    /// The node that walk_char last looked at and its forward sequence
+    id_t walk_node_id = 0;
+    string walk_node_sequence;
+    
     default_random_engine prng;
     discrete_distribution<> path_sampler;
     vector<uniform_int_distribution<size_t> > start_pos_samplers;
@@ -12,6 +12,48 @@
 
 namespace vg {
 
+/// Create a snarl in the given SnarlManager with the given start and end,
+/// containing the given child snarls in the list of chains of children and
+/// the given list of unary children. Recursively creates snarls in the
+/// SnarlManager for the children. Returns a pointer to the finished snarl
+/// in the SnarlManager. Start and end may be empty visits, in which case no
+/// snarl is created, all the child chains are added as root chains, and
+/// null is returned. If parent_start and parent_end are empty Visits, no
+/// parent() is added to the produced snarl. Connectivity is worked out in
+/// the given graph.
+static const Snarl* recursively_emit_snarls(const HandleGraph* graph, const Visit& start, const Visit& end,
+                                            const Visit& parent_start, const Visit& parent_end,
+                                            stList* chains_list, stList* unary_snarls_list, SnarlManager& destination);
+
+/// Decompose the graph, with the given telomeres, and put the snarls in the
+/// destination. Takes ownership of and frees the Cactus graph and telomeres.
+static void emit_cactus_snarls(const HandleGraph* graph, pair<stCactusGraph*, stList*> cac_pair,
+                               SnarlManager& destination) {
+    stCactusGraph* cactus_graph = cac_pair.first;
+    stList* telomeres = cac_pair.second;
+
+    // get the snarl decomposition as a C struct
+    stSnarlDecomposition *snarls = stCactusGraph_getSnarlDecomposition(cactus_graph, telomeres);
+    
+    // Get a non-owning pointer to the list of chains (which are themselves lists of snarls).
+    stList* cactus_chains_list = snarls->topLevelChains;
+    
+    // And one to the list of top-level unary snarls
+    stList* cactus_unary_snarls_list = snarls->topLevelUnarySnarls;
+    
+    // Fill the manager with all of the snarls, recursively.
+    recursively_emit_snarls(graph, Visit(), Visit(), Visit(), Visit(), cactus_chains_list, cactus_unary_snarls_list, destination);
+    
+    // Free the decomposition
+    stSnarlDecomposition_destruct(snarls);
+    
+    // Free the telomeres
+    stList_destruct(telomeres);
+
+    // free the cactus graph
+    stCactusGraph_destruct(cactus_graph);
+}
+
 CactusSnarlFinder::CactusSnarlFinder(VG& graph) :
     graph(graph) {
     // Make sure the graph is sorted.
@@ -33,44 +75,202 @@ SnarlManager CactusSnarlFinder::find_snarls() {
         // No snarls here!
         return SnarlManager();
     }
-    // convert to cactus
-    pair<stCactusGraph*, stList*> cac_pair = vg_to_cactus(graph, hint_paths);
-    stCactusGraph* cactus_graph = cac_pair.first;
-    stList* telomeres = cac_pair.second;
+    // We'll fill this with all the snarls
+    SnarlManager snarl_manager;
+    
+    // convert to cactus and decompose
+    emit_cactus_snarls(&graph, vg_to_cactus(graph, hint_paths), snarl_manager);
+    
+    // Return the completed SnarlManager
+    return snarl_manager;
+    
+}
 
-    // get the snarl decomposition as a C struct
-    stSnarlDecomposition *snarls = stCactusGraph_getSnarlDecomposition(cactus_graph, telomeres);
+namespace {
+
+/**
+ * A view of one weakly connected component of a backing graph, so that it can
+ * be decomposed on its own. Nodes are visited in the order they were given.
+ */
+class ComponentGraph : public HandleGraph {
+public:
+    ComponentGraph(const HandleGraph* backing, const vector<handle_t>& nodes) : backing(backing), nodes(nodes) {
+        // Nothing to do
+    }
     
-    // Get a non-owning pointer to the list of chains (which are themselves lists of snarls).
-    stList* cactus_chains_list = snarls->topLevelChains;
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse = false) const {
+        return backing->get_handle(node_id, is_reverse);
+    }
+    using HandleGraph::get_handle;
     
-    // And one to the list of top-level unary snarls
-    stList* cactus_unary_snarls_list = snarls->topLevelUnarySnarls;
+    virtual id_t get_id(const handle_t& handle) const {
+        return backing->get_id(handle);
+    }
     
+    virtual bool get_is_reverse(const handle_t& handle) const {
+        return backing->get_is_reverse(handle);
+    }
     
-    // We'll fill this with all the snarls
-    SnarlManager snarl_manager;
+    virtual handle_t flip(const handle_t& handle) const {
+        return backing->flip(handle);
+    }
     
-    // Fill the manager with all of the snarls, recursively.
-    recursively_emit_snarls(Visit(), Visit(), Visit(), Visit(), cactus_chains_list, cactus_unary_snarls_list, snarl_manager);
+    virtual size_t get_length(const handle_t& handle) const {
+        return backing->get_length(handle);
+    }
     
-    // Free the decomposition
-    stSnarlDecomposition_destruct(snarls);
+    virtual string get_sequence(const handle_t& handle) const {
+        return backing->get_sequence(handle);
+    }
     
-    // Free the telomeres
-    stList_destruct(telomeres);
+    // All the edges of a component's nodes stay in the component
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
+        return backing->follow_edges(handle, go_left, iteratee);
+    }
+    using HandleGraph::follow_edges;
+    
+    virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const {
+        for (auto& handle : nodes) {
+            if (!iteratee(handle)) {
+                break;
+            }
+        }
+    }
+    using HandleGraph::for_each_handle;
+    
+    virtual size_t node_size() const {
+        return nodes.size();
+    }
+    
+private:
+    const HandleGraph* backing;
+    const vector<handle_t>& nodes;
+};
 
-    // free the cactus graph
-    stCactusGraph_destruct(cactus_graph);
+}
+
+HandleGraphSnarlFinder::HandleGraphSnarlFinder(const HandleGraph* graph, const for_each_path_t& for_each_path,
+                                               const unordered_set<string>& hint_paths) :
+    graph(graph), for_each_path(for_each_path), hint_paths(hint_paths) {
+    // Nothing to do
+}
+
+void HandleGraphSnarlFinder::for_each_component(const function<void(SnarlManager&)>& lambda) {
+    
+    // Find the weakly connected components, numbered in order of their first
+    // nodes, and keep each one's nodes in the backing graph's order.
+    vector<handle_t> nodes;
+    nodes.reserve(graph->node_size());
+    graph->for_each_handle([&](const handle_t& handle) {
+        nodes.push_back(handle);
+    });
+    unordered_map<id_t, size_t> component_of;
+    component_of.reserve(nodes.size());
+    size_t component_count = 0;
+    vector<handle_t> stack;
+    for (auto& node : nodes) {
+        if (component_of.count(graph->get_id(node))) {
+            continue;
+        }
+        component_of[graph->get_id(node)] = component_count;
+        stack.push_back(node);
+        while (!stack.empty()) {
+            handle_t here = stack.back();
+            stack.pop_back();
+            auto handle_other = [&](const handle_t& other) {
+                if (!component_of.count(graph->get_id(other))) {
+                    component_of[graph->get_id(other)] = component_count;
+                    stack.push_back(graph->forward(other));
+                }
+            };
+            graph->follow_edges(here, false, handle_other);
+            graph->follow_edges(here, true, handle_other);
+        }
+        component_count++;
+    }
+    vector<vector<handle_t>> components(component_count);
+    for (auto& node : nodes) {
+        components[component_of.at(graph->get_id(node))].push_back(node);
+    }
+    vector<handle_t>().swap(nodes);
+    
+    // Sort the paths into components too, checking that none of them cross
+    // between components
+    vector<vector<pair<string, vector<handle_t>>>> component_paths(component_count);
+    if (for_each_path) {
+        for_each_path([&](const string& name, const vector<handle_t>& steps) {
+            if (steps.empty()) {
+                return;
+            }
+            size_t component = component_of.at(graph->get_id(steps.front()));
+            for (auto& step : steps) {
+                if (component_of.at(graph->get_id(step)) != component) {
+                    throw runtime_error("Path " + name + " spans multiple connected components!");
+                }
+            }
+            component_paths[component].emplace_back(name, steps);
+        });
+    }
+    unordered_map<id_t, size_t>().swap(component_of);
+    
+    // Decompose the components in parallel, but hand them out in order. At
+    // most one component per thread is waiting its turn at a time.
+#pragma omp parallel for schedule(dynamic, 1) ordered
+    for (size_t i = 0; i < component_count; i++) {
+        SnarlManager snarl_manager;
+        
+        // A single node can't go through Cactus, but has no snarls anyway
+        if (components[i].size() > 1) {
+            ComponentGraph component(graph, components[i]);
+            auto& paths = component_paths[i];
+            for_each_path_t for_each_component_path = [&](const path_iteratee_t& iteratee) {
+                for (auto& path : paths) {
+                    iteratee(path.first, path.second);
+                }
+            };
+            emit_cactus_snarls(&component, handle_graph_to_cactus(component, for_each_component_path, hint_paths),
+                               snarl_manager);
+        }
+        vector<handle_t>().swap(components[i]);
+        vector<pair<string, vector<handle_t>>>().swap(component_paths[i]);
+        
+#pragma omp ordered
+        lambda(snarl_manager);
+    }
+}
+
+SnarlManager HandleGraphSnarlFinder::find_snarls() {
+    SnarlManager snarl_manager;
     
-    // Return the completed SnarlManager
-    return snarl_manager;
+    for_each_component([&](SnarlManager& component_snarls) {
+        // Copy each snarl and then its child chains, so everything in a chain
+        // is added before the chain is.
+        function<const Snarl*(const Snarl*)> copy_snarl = [&](const Snarl* snarl) {
+            const Snarl* copied = snarl_manager.add_snarl(*snarl);
+            for (auto& chain : component_snarls.chains_of(snarl)) {
+                Chain copied_chain;
+                for (const Snarl* child : chain) {
+                    copied_chain.push_back(copy_snarl(child));
+                }
+                snarl_manager.add_chain(copied_chain, copied);
+            }
+            return copied;
+        };
+        for (auto& chain : component_snarls.chains_of(nullptr)) {
+            Chain copied_chain;
+            for (const Snarl* snarl : chain) {
+                copied_chain.push_back(copy_snarl(snarl));
+            }
+            snarl_manager.add_chain(copied_chain, nullptr);
+        }
+    });
     
+    return snarl_manager;
 }
 
-const Snarl* CactusSnarlFinder::recursively_emit_snarls(const Visit& start, const Visit& end,
-                                                        const Visit& parent_start, const Visit& parent_end,
-                                                        stList* chains_list, stList* unary_snarls_list, SnarlManager& destination) {
+static const Snarl* recursively_emit_snarls(const HandleGraph* graph, const Visit& start, const Visit& end,
+                                            const Visit& parent_start, const Visit& parent_end,
+                                            stList* chains_list, stList* unary_snarls_list, SnarlManager& destination) {
         
 #ifdef debug    
     cerr << "Explore snarl " << start << " -> " << end << endl;
@@ -142,7 +342,7 @@ const Snarl* CactusSnarlFinder::recursively_emit_snarls(const Visit& start, cons
             child_end.set_backward(cac_child_side2->is_end);
                 
             // Recursively create a snarl for the child, and then add it to this chain in us.
-            chain.push_back(recursively_emit_snarls(child_start, child_end, start, end,
+            chain.push_back(recursively_emit_snarls(graph, child_start, child_end, start, end,
                                                     child_snarl->chains, child_snarl->unarySnarls, destination));
         }
     }
@@ -177,7 +377,7 @@ const Snarl* CactusSnarlFinder::recursively_emit_snarls(const Visit& start, cons
         auto& chain = child_chains.back();
         
         // Recursively create a snarl for the child, and then add it to the trivial chain
-        chain.push_back(recursively_emit_snarls(child_start, child_end, start, end,
+        chain.push_back(recursively_emit_snarls(graph, child_start, child_end, start, end,
                                                 child_snarl->chains, child_snarl->unarySnarls, destination));
     }
 
@@ -188,7 +388,7 @@ const Snarl* CactusSnarlFinder::recursively_emit_snarls(const Visit& start, cons
         {
 
             // Make a net graph for the snarl that uses internal connectivity
-            NetGraph connectivity_net_graph(start, end, child_chains, &graph, true);
+            NetGraph connectivity_net_graph(start, end, child_chains, graph, true);
             
             // Evaluate connectivity
             // A snarl is minimal, so we know out start and end will be normal nodes.
@@ -292,7 +492,7 @@ const Snarl* CactusSnarlFinder::recursively_emit_snarls(const Visit& start, cons
             // Determine cyclicity/acyclicity
         
             // Make a net graph that just pretends child snarls/chains are ordinary nodes
-            NetGraph flat_net_graph(start, end, child_chains, &graph);
+            NetGraph flat_net_graph(start, end, child_chains, graph);
             
             // This definitely should be calculated based on the internal-connectivity-ignoring net graph.
             snarl.set_directed_acyclic_net_graph(algorithms::is_directed_acyclic(&flat_net_graph));
@@ -570,24 +770,79 @@ ChainIterator chain_end_from(const Chain& chain, const Snarl* start_snarl, bool
 // a deserialization iterator to match its signature because its internal file streams
 // disallow copy constructors
 SnarlManager::SnarlManager(istream& in) {
-    // add snarls to master list
-    for (stream::ProtobufIterator<Snarl> iter(in); iter.has_next(); iter.get_next()) {
-        snarls.push_back(*iter);
-    }
+    // add snarls to master list, moving each one in as it is parsed
+    stream::for_each<Snarl>(in, [&](Snarl& snarl) {
+        new_record().snarl.Swap(&snarl);
+    });
     // record the tree structure and build the other indexes
     build_indexes();
 }
     
+size_t SnarlManager::snarl_count() const {
+    return record_blocks.empty() ? 0 : (record_blocks.size() - 1) * RECORD_BLOCK_SIZE + record_blocks.back().size();
+}
+    
+SnarlManager::SnarlRecord& SnarlManager::record_at(size_t index) {
+    return record_blocks[index / RECORD_BLOCK_SIZE][index % RECORD_BLOCK_SIZE];
+}
+    
+const SnarlManager::SnarlRecord& SnarlManager::record_at(size_t index) const {
+    return record_blocks[index / RECORD_BLOCK_SIZE][index % RECORD_BLOCK_SIZE];
+}
+    
+SnarlManager::SnarlRecord& SnarlManager::new_record() {
+    if (record_blocks.empty() || record_blocks.back().size() == RECORD_BLOCK_SIZE) {
+        // Start a new block, which will never be reallocated
+        record_blocks.emplace_back();
+        record_blocks.back().reserve(RECORD_BLOCK_SIZE);
+        
+        // Remember where it is
+        pair<const SnarlRecord*, size_t> entry(record_blocks.back().data(), record_blocks.size() - 1);
+        auto less = [](const pair<const SnarlRecord*, size_t>& a, const pair<const SnarlRecord*, size_t>& b) {
+            return std::less<const SnarlRecord*>()(a.first, b.first);
+        };
+        blocks_by_address.insert(upper_bound(blocks_by_address.begin(), blocks_by_address.end(), entry, less), entry);
+    }
+    record_blocks.back().emplace_back();
+    return record_blocks.back().back();
+}
+    
+const SnarlManager::SnarlRecord* SnarlManager::record(const Snarl* snarl) const {
+    // Find the last block that starts at or before the snarl
+    const SnarlRecord* as_record = (const SnarlRecord*) snarl;
+    auto it = upper_bound(blocks_by_address.begin(), blocks_by_address.end(), as_record,
+                          [](const SnarlRecord* a, const pair<const SnarlRecord*, size_t>& b) {
+        return std::less<const SnarlRecord*>()(a, b.first);
+    });
+    if (it != blocks_by_address.begin()) {
+        --it;
+        auto& block = record_blocks[it->second];
+        if (!std::less<const SnarlRecord*>()(as_record, block.data()) &&
+            std::less<const SnarlRecord*>()(as_record, block.data() + block.size()) &&
+            &block[as_record - block.data()].snarl == snarl) {
+            // The snarl is the start of one of our records
+            return as_record;
+        }
+    }
+    
+    // Otherwise it's a copy, so go find the real one
+    return (const SnarlRecord*) manage(*snarl);
+}
+    
+SnarlManager::SnarlRecord* SnarlManager::record(const Snarl* snarl) {
+    return const_cast<SnarlRecord*>(((const SnarlManager*) this)->record(snarl));
+}
+    
 const vector<const Snarl*>& SnarlManager::children_of(const Snarl* snarl) const {
     if (snarl == nullptr) {
         // Looking for top level snarls
         return roots;
     }
-    return children.at(key_form(snarl));
+    return record(snarl)->children;
 }
     
 const Snarl* SnarlManager::parent_of(const Snarl* snarl) const {
-    return parent.at(key_form(snarl));
+    return record(snarl)->parent;
 }
     
 const Snarl* SnarlManager::snarl_sharing_start(const Snarl* here) const {
@@ -608,7 +863,7 @@ const Snarl* SnarlManager::snarl_sharing_end(const Snarl* here) const {
 }
     
 const Chain* SnarlManager::chain_of(const Snarl* snarl) const {
-    return parent_chain.at(key_form(snarl));
+    return record(snarl)->parent_chain;
 }
     
 bool SnarlManager::in_nontrivial_chain(const Snarl* here) const {
@@ -657,7 +912,7 @@ const deque<Chain>& SnarlManager::chains_of(const Snarl* snarl) const {
     }
         
     // Otherwise, go look up the child chains of this snarl.
-    return child_chains.at(key_form(snarl));
+    return record(snarl)->child_chains;
 }
     
 NetGraph SnarlManager::net_graph_of(const Snarl* snarl, const HandleGraph* graph, bool use_internal_connectivity) const {
@@ -667,11 +922,11 @@ NetGraph SnarlManager::net_graph_of(const Snarl* snarl, const HandleGraph* graph
 }
     
 bool SnarlManager::is_leaf(const Snarl* snarl) const {
-    return children.at(key_form(snarl)).size() == 0;
+    return record(snarl)->children.size() == 0;
 }
     
 bool SnarlManager::is_root(const Snarl* snarl) const {
-    return parent.at(key_form(snarl)) == nullptr;
+    return record(snarl)->parent == nullptr;
 }
     
 const vector<const Snarl*>& SnarlManager::top_level_snarls() const {
@@ -726,12 +981,9 @@ void SnarlManager::for_each_snarl_parallel(const function<void(const Snarl*)>& l
     
 void SnarlManager::flip(const Snarl* snarl) {
         
-    // save the key used in the indices before editing the snarl
-    auto old_key = key_form(snarl);
-        
-    // Get a non-const reference to the cannonical snarl.
-    // TODO: Can't we use a const cast and save a lookup?
-    Snarl& to_flip = *self[key_form(snarl)];
+    // Get a non-const reference to the cannonical snarl. Everything we know
+    // about it is stored with it, so nothing needs to be re-indexed.
+    Snarl& to_flip = record(snarl)->snarl;
         
     // swap and reverse the start and end Visits
     int64_t start_id = to_flip.start().node_id();
@@ -743,46 +995,20 @@ void SnarlManager::flip(const Snarl* snarl) {
     to_flip.mutable_end()->set_node_id(start_id);
     to_flip.mutable_end()->set_backward(!start_orientation);
         
-    // update parent index
-    parent[key_form(snarl)] = parent[old_key];
-    parent.erase(old_key);
-        
-    // update children index
-    children[key_form(snarl)] = std::move(children[old_key]);
-    children.erase(old_key);
-        
-    // And the child chain index
-    child_chains[key_form(snarl)] = std::move(child_chains[old_key]);
-    child_chains.erase(old_key);
-        
-    // And the parent chain index
-    parent_chain[key_form(snarl)] = std::move(parent_chain[old_key]);
-    parent_chain.erase(old_key);
-        
-    // Update self index
-    self[key_form(snarl)] = std::move(self[old_key]);
-    self.erase(old_key);
-        
     // note: snarl_into index is invariant to flipping
 }
     
 const Snarl* SnarlManager::add_snarl(const Snarl& new_snarl) {
     // Store the snarl
-    snarls.push_back(new_snarl);
-    Snarl* snarl = &snarls.back();
+    Snarl* snarl = &new_record().snarl;
+    *snarl = new_snarl;
         
 #ifdef debug
     cerr << "Adding snarl " << new_snarl.start().node_id() << " " << new_snarl.start().backward() << " -> "
          << new_snarl.end().node_id() << " " << new_snarl.end().backward() << endl;
 #endif
         
-    // Remember where each snarl is
-    self[key_form(snarl)] = snarl;
-        
-    // It has an empty vector of children
-    children[key_form(snarl)] = vector<const Snarl*>();
-    // It has an empty list of child chains.
-    child_chains[key_form(snarl)] = deque<Chain>();
+    // It starts with no children or child chains.
         
     // We will set the parent later when we add the snarl's chain.
     // Every snarl has to be in a chain. Even the unary ones, in trivial chains.
@@ -810,11 +1036,11 @@ void SnarlManager::add_chain(const Chain& new_chain, const Snarl* chain_parent)
             roots.push_back(child);
                 
             // Save its parent, which is null
-            parent.emplace(key_form(child), nullptr);
+            record(child)->parent = nullptr;
                 
             // Save its chain. Relies on the Chain in root_chains never
             // moving.
-            parent_chain.emplace(key_form(child), &root_chains.back());
+            record(child)->parent_chain = &root_chains.back();
                 
 #ifdef debug
             cerr << "Stored parent of " << child << endl;
@@ -831,18 +1057,19 @@ void SnarlManager::add_chain(const Chain& new_chain, const Snarl* chain_parent)
 #endif
         
         // Save a copy of the chain as a child chain
-        child_chains[key_form(chain_parent)].push_back(new_chain);
+        SnarlRecord* parent_record = record(chain_parent);
+        parent_record->child_chains.push_back(new_chain);
             
         for (const Snarl* child : new_chain) {
             // Save it as a child of the parent
-            children[key_form(chain_parent)].push_back(child);
+            parent_record->children.push_back(child);
                 
             // Save its parent
-            parent.emplace(key_form(child), chain_parent);
+            record(child)->parent = chain_parent;
                 
             // Save its chain. Relies on the Chain in child_chains never
             // moving.
-            parent_chain.emplace(key_form(child), &child_chains[key_form(chain_parent)].back());
+            record(child)->parent_chain = &parent_record->child_chains.back();
                 
 #ifdef debug
             cerr << "Stored parent of " << child << endl;
@@ -852,7 +1079,7 @@ void SnarlManager::add_chain(const Chain& new_chain, const Snarl* chain_parent)
     }
         
 #ifdef debug
-    cerr << "Now have " << parent_chain.size() << " chain index entries for " << snarls.size() << " snarls" << endl;
+    cerr << "Now have " << snarl_count() << " snarls" << endl;
 #endif
 }
     
@@ -866,7 +1093,8 @@ const Snarl* SnarlManager::into_which_snarl(const Visit& visit) const {
     
 unordered_map<pair<int64_t, bool>, const Snarl*> SnarlManager::snarl_boundary_index() const {
     unordered_map<pair<int64_t, bool>, const Snarl*> index;
-    for (const Snarl& snarl : snarls) {
+    for (size_t i = 0; i < snarl_count(); i++) {
+        const Snarl& snarl = record_at(i).snarl;
         index[make_pair(snarl.start().node_id(), snarl.start().backward())] = &snarl;
         index[make_pair(snarl.end().node_id(), !snarl.end().backward())] = &snarl;
     }
@@ -875,7 +1103,8 @@ unordered_map<pair<int64_t, bool>, const Snarl*> SnarlManager::snarl_boundary_in
     
 unordered_map<pair<int64_t, bool>, const Snarl*> SnarlManager::snarl_end_index() const {
     unordered_map<pair<int64_t, bool>, const Snarl*> index;
-    for (const Snarl& snarl : snarls) {
+    for (size_t i = 0; i < snarl_count(); i++) {
+        const Snarl& snarl = record_at(i).snarl;
         index[make_pair(snarl.end().node_id(), !snarl.end().backward())] = &snarl;
     }
     return index;
@@ -883,105 +1112,78 @@ unordered_map<pair<int64_t, bool>, const Snarl*> SnarlManager::snarl_end_index()
     
 unordered_map<pair<int64_t, bool>, const Snarl*> SnarlManager::snarl_start_index() const {
     unordered_map<pair<int64_t, bool>, const Snarl*> index;
-    for (const Snarl& snarl : snarls) {
+    for (size_t i = 0; i < snarl_count(); i++) {
+        const Snarl& snarl = record_at(i).snarl;
         index[make_pair(snarl.start().node_id(), snarl.start().backward())] = &snarl;
     }
     return index;
 }
     
-// can include definition of inline function apart from forward declaration b/c only used in this file
-inline SnarlManager::key_t SnarlManager::key_form(const Snarl* snarl) const {
-    return make_pair(make_pair(snarl->start().node_id(), snarl->start().backward()),
-                     make_pair(snarl->end().node_id(), snarl->end().backward()));
-}
-    
-
 void SnarlManager::build_indexes() {
         
 #ifdef debug
-    cerr << "Building SnarlManager index of " << snarls.size() << " snarls" << endl;
+    cerr << "Building SnarlManager index of " << snarl_count() << " snarls" << endl;
 #endif
         
-    for (Snarl& snarl : snarls) {
+    for (size_t i = 0; i < snarl_count(); i++) {
+        const Snarl& snarl = record_at(i).snarl;
             
 #ifdef debug
         cerr << pb2json(snarl) << endl;
 #endif
             
-        // Remember where each snarl is
-        self[key_form(&snarl)] = &snarl;
+        // add the boundaries into the indices
+        snarl_into[make_pair(snarl.start().node_id(), snarl.start().backward())] = &snarl;
+        snarl_into[make_pair(snarl.end().node_id(), !snarl.end().backward())] = &snarl;
+    }
+        
+    for (size_t i = 0; i < snarl_count(); i++) {
+        SnarlRecord& here = record_at(i);
         
-        // is this a top-level snarl?
-        if (snarl.has_parent()) {
+        // is this a top-level snarl? Snarls whose parents we don't have count
+        // as top-level too.
+        const Snarl* parent = here.snarl.has_parent() ? find_managed(here.snarl.parent()) : nullptr;
+        if (parent != nullptr) {
             // add this snarl to the parent-to-children index
 #ifdef debug
             cerr << "\tSnarl is a child" << endl;
 #endif
-            if (!children.count(key_form(&(snarl.parent()))) ) {
-                children.insert(make_pair(key_form(&snarl.parent()), vector<const Snarl*>(1, &snarl)));
-            }
-            else {
-                children[key_form(&(snarl.parent()))].push_back(&snarl);
-            }
+            record(parent)->children.push_back(&here.snarl);
+            here.parent = parent;
         }
         else {
             // record top level status
 #ifdef debug
             cerr << "\tSnarl is top-level" << endl;
 #endif
-            roots.push_back(&snarl);
-            parent[key_form(&snarl)] = nullptr;
-        }
-            
-        // add the boundaries into the indices
-        snarl_into[make_pair(snarl.start().node_id(), snarl.start().backward())] = &snarl;
-        snarl_into[make_pair(snarl.end().node_id(), !snarl.end().backward())] = &snarl;
-    }
-        
-    for (Snarl& snarl : snarls) {
-        if (children.count(key_form(&snarl))) {
-            // mark this snarl as the parent in child-to-parent map
-            for (const Snarl* child : children[key_form(&snarl)]) {
-                parent[key_form(child)] = &snarl;
-            }
-        }
-        else {
-            // ensure that all snarls are in the parent-to-children map
-            children.insert(make_pair(key_form(&snarl), vector<const Snarl*>()));
+            roots.push_back(&here.snarl);
         }
     }
         
-    if (root_chains.empty() || child_chains.empty()) {
-        // Chains were not provided already.
-        // Now compute the chains using the into and out-of indexes.
+    // Now compute the chains using the into and out-of indexes.
         
-        // Compute the chains for the root level snarls
-        root_chains = compute_chains(roots);
+    // Compute the chains for the root level snarls
+    root_chains = compute_chains(roots);
             
-        // Build the back index from root snarl to containing chain
-        for (auto& chain : root_chains) {
-            for (const Snarl* snarl : chain) {
-                parent_chain.emplace(key_form(snarl), &chain);
-            }
+    // Build the back index from root snarl to containing chain
+    for (auto& chain : root_chains) {
+        for (const Snarl* snarl : chain) {
+            record(snarl)->parent_chain = &chain;
         }
+    }
         
-        for (auto& kv : children) {
-            // For each parent snarl
-            const key_t& parent_key = kv.first;
-            // And its children
-            vector<const Snarl*>& snarl_children = kv.second;
+    for (size_t i = 0; i < snarl_count(); i++) {
+        // For each parent snarl
+        SnarlRecord& here = record_at(i);
                 
-            // Compute chains of the children and store it under the parent.
-            // Keep the iterator.
-            auto inserted = child_chains.emplace(make_pair(parent_key, compute_chains(snarl_children))).first;
+        // Compute chains of the children and store it under the parent.
+        here.child_chains = compute_chains(here.children);
                 
-            // Build the back index from child snarl to containing chain
-            for (auto& chain : inserted->second) {
-                for (const Snarl* snarl : chain) {
-                    parent_chain.emplace(key_form(snarl), &chain);
-                }
+        // Build the back index from child snarl to containing chain
+        for (auto& chain : here.child_chains) {
+            for (const Snarl* snarl : chain) {
+                record(snarl)->parent_chain = &chain;
             }
-                
         }
     }
 }
@@ -1322,25 +1524,28 @@ pair<unordered_set<Node*>, unordered_set<Edge*> > SnarlManager::deep_contents(co
     return to_return;
 }
     
+const Snarl* SnarlManager::find_managed(const Snarl& snarl) const {
+    // Every snarl is indexed under both of its inward-facing boundaries, so
+    // the one we want has to be the one the start reads into.
+    const Snarl* found = into_which_snarl(snarl.start().node_id(), snarl.start().backward());
+    if (found != nullptr && found->start() == snarl.start() && found->end() == snarl.end()) {
+        return found;
+    }
+    return nullptr;
+}
+    
 const Snarl* SnarlManager::manage(const Snarl& not_owned) const {
-    // TODO: keep the Snarls in some kind of sorted order to make lookup
-    // efficient. We could also have a map<Snarl, Snarl*> but that would be
-    // a tremendous waste of space.
-        
-    // Work out the key for the snarl
-    key_t key = key_form(&not_owned);
-        
-    // Get the cannonical pointer to the snarl with that key.
-    auto it = self.find(key);
+    // Get the cannonical pointer to the snarl with these boundaries.
+    const Snarl* found = find_managed(not_owned);
         
-    if (it == self.end()) {
+    if (found == nullptr) {
         // It's not there. Someone is trying to manage a snarl we don't
         // really own. Complain.
         throw runtime_error("Unable to find snarl " +  pb2json(not_owned) + " in SnarlManager");
     }
         
     // Return the official copy of that snarl
-    return it->second;
+    return found;
 }
     
 vector<Visit> SnarlManager::visits_right(const Visit& visit, VG& graph, const Snarl* in_snarl) const {
@@ -55,18 +55,6 @@ class CactusSnarlFinder : public SnarlFinder {
     /// Holds the names of reference path hints
     unordered_set<string> hint_paths;
     
-    /// Create a snarl in the given SnarlManager with the given start and end,
-    /// containing the given child snarls in the list of chains of children and
-    /// the given list of unary children. Recursively creates snarls in the
-    /// SnarlManager for the children. Returns a pointer to the finished snarl
-    /// in the SnarlManager. Start and end may be empty visits, in which case no
-    /// snarl is created, all the child chains are added as root chains, and
-    /// null is returned. If parent_start and parent_end are empty Visits, no
-    /// parent() is added to the produced snarl.
-    const Snarl* recursively_emit_snarls(const Visit& start, const Visit& end,
-        const Visit& parent_start, const Visit& parent_end,
-        stList* chains_list, stList* unary_snarls_list, SnarlManager& destination);
-    
 public:
     /**
      * Make a new CactusSnarlFinder to find snarls in the given graph.
@@ -89,6 +77,47 @@ public:
     
 };
 
+/**
+ * Class for finding all snarls in any HandleGraph, such as an XG, without
+ * copying it into a VG. Each weakly connected component gets its own Cactus
+ * graph and decomposition, and components are done in parallel, so only a few
+ * of them are ever in Cactus form at once.
+ */
+class HandleGraphSnarlFinder : public SnarlFinder {
+    
+    /// Holds the graph we are looking for sites in.
+    const HandleGraph* graph;
+    
+    /// Visits the paths we can use to pick telomeres, if any.
+    for_each_path_t for_each_path;
+    
+    /// Holds the names of reference path hints
+    unordered_set<string> hint_paths;
+    
+public:
+    /**
+     * Make a new HandleGraphSnarlFinder to find snarls in the given graph.
+     * Paths, if given, are used to root the decomposition of each component,
+     * preferring the hint paths, as in CactusSnarlFinder.
+     */
+    HandleGraphSnarlFinder(const HandleGraph* graph, const for_each_path_t& for_each_path = nullptr,
+                           const unordered_set<string>& hint_paths = unordered_set<string>());
+    
+    /**
+     * Find the snarls in each weakly connected component, and pass a
+     * SnarlManager holding just that component's snarls to the given function.
+     * Components come in the order of their first nodes in the graph, one at a
+     * time, and each SnarlManager is dropped once the function returns.
+     */
+    void for_each_component(const function<void(SnarlManager&)>& lambda);
+    
+    /**
+     * Find all the snarls, and put them into a single SnarlManager.
+     */
+    virtual SnarlManager find_snarls();
+    
+};
+
 /**
  * Snarls are defined at the Protobuf level, but here is how we define
  * chains as real objects.
@@ -519,39 +548,65 @@ public:
         
 private:
     
-    /// Define the key type
-    using key_t = pair<pair<int64_t, bool>, pair<int64_t, bool>>;
-        
-    /// Master list of the snarls in the graph.
-    /// Use a deque so pointers never get invalidated but we still have some locality.
-    deque<Snarl> snarls;
-        
+    /// A managed Snarl, stored together with its place in the snarl tree.
+    /// The Snarl comes first, so a pointer to a managed Snarl is also a
+    /// pointer to its record.
+    struct SnarlRecord {
+        /// The snarl itself
+        Snarl snarl;
+        /// Its parent snarl, or null if it is a root
+        const Snarl* parent = nullptr;
+        /// The chain it is in
+        const Chain* parent_chain = nullptr;
+        /// The snarls it contains
+        vector<const Snarl*> children;
+        /// The chains of snarls it contains. Uses a deque so Chain*
+        /// pointers don't get invalidated.
+        deque<Chain> child_chains;
+    };
+    
+    /// How many records go in each block
+    static const size_t RECORD_BLOCK_SIZE = 1024;
+    
+    /// Master list of the snarls in the graph, with their tree information.
+    /// Records are kept in blocks whose storage is reserved up front, so
+    /// pointers never get invalidated, and neighboring records are adjacent
+    /// in memory.
+    vector<vector<SnarlRecord>> record_blocks;
+    
+    /// The first record of each block and the block's number, sorted by
+    /// address, so we can tell whether a Snarl* is one of ours.
+    vector<pair<const SnarlRecord*, size_t>> blocks_by_address;
+    
     /// Roots of snarl trees
     vector<const Snarl*> roots;
     /// Chains of root-level snarls. Uses a deque so Chain* pointers don't get invalidated.
     deque<Chain> root_chains;
         
-    /// Map of snarls to the child snarls they contain
-    unordered_map<key_t, vector<const Snarl*>> children;
-    /// Map of snarls to the child chains they contain
-    /// Uses a deque so Chain* pointers don't get invalidated.
-    unordered_map<key_t, deque<Chain>> child_chains;
-    /// Map of snarls to their parent snarls
-    unordered_map<key_t, const Snarl*> parent;
-    /// Map of snarls to the chain each appears in
-    unordered_map<key_t, const Chain*> parent_chain;
-        
-    /// Map of snarl keys to the pointer to the managed copy in the snarls vector.
-    /// Is non-const so we can do flip nicely.
-    unordered_map<key_t, Snarl*> self;
-        
     /// Map of node traversals to the snarls they point into
     unordered_map<pair<int64_t, bool>, const Snarl*> snarl_into;
+    
+    /// Get the number of snarls we manage.
+    size_t snarl_count() const;
+    
+    /// Get the record at the given index in the master list.
+    SnarlRecord& record_at(size_t index);
+    const SnarlRecord& record_at(size_t index) const;
+    
+    /// Make an empty record at the end of the master list.
+    SnarlRecord& new_record();
+    
+    /// Get the record for a Snarl. The Snarl may be one of ours, in which case
+    /// no lookup is needed, or a copy of one, which is looked up by its
+    /// boundaries.
+    const SnarlRecord* record(const Snarl* snarl) const;
+    SnarlRecord* record(const Snarl* snarl);
+    
+    /// Find the managed copy of a snarl by its boundaries, or null if we
+    /// don't have it.
+    const Snarl* find_managed(const Snarl& snarl) const;
         
-    /// Converts Snarl to the form used as keys in internal data structures
-    inline key_t key_form(const Snarl* snarl) const;
-        
-    /// Builds tree indexes after Snarls have been added to the snarls vector
+    /// Builds tree indexes after Snarls have been added to the master list
     void build_indexes();
         
     /// Actually compute chains for a set of already indexed snarls, which
@@ -704,7 +759,7 @@ template <typename SnarlIterator>
 SnarlManager::SnarlManager(SnarlIterator begin, SnarlIterator end) {
     // add snarls to master list
     for (auto iter = begin; iter != end; iter++) {
-        snarls.push_back(*iter);
+        new_record().snarl = *iter;
     }
     // record the tree structure and build the other indexes
     build_indexes();
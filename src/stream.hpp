@@ -5,18 +5,23 @@
 // from http://www.mail-archive.com/protobuf@googlegroups.com/msg03417.html
 
 #include <cassert>
+#include <exception>
 #include <iostream>
 #include <istream>
 #include <fstream>
 #include <functional>
 #include <vector>
 #include <list>
+#include <string>
+#include <omp.h>
 #include "google/protobuf/stubs/common.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/coded_stream.h"
 
+#include "threaded_io.hpp"
+
 namespace stream {
 
 /// Protobuf will refuse to read messages longer than this size.
@@ -99,6 +104,105 @@ bool write(std::ostream& out, uint64_t element_count, uint64_t chunk_elements,
 
 }
 
+/// Write objects like write() above, but build and compress the chunks on
+/// all the OpenMP threads while the calling thread writes finished chunks in
+/// order. Each chunk of chunk_elements elements is its own gzip member, which
+/// readers handle as if the stream were compressed as one. lambda must be
+/// safe to call concurrently. A chunk whose message would be too big is split
+/// in half until it fits. If given, written is called on the calling thread
+/// with the number of elements written so far after each chunk.
+template <typename T>
+bool write_parallel(std::ostream& out, uint64_t element_count, uint64_t chunk_elements,
+                    const std::function<T(uint64_t, uint64_t)>& lambda,
+                    const std::function<void(uint64_t)>& written = nullptr) {
+
+    chunk_elements = std::max<uint64_t>(chunk_elements, 1);
+    uint64_t chunk_count = (element_count + chunk_elements - 1) / chunk_elements;
+    // chunks to have in flight at once
+    const uint64_t wave_size = 4 * omp_get_max_threads();
+
+    auto handle = [](bool ok) {
+        if (!ok) throw std::runtime_error("stream::write_parallel: I/O error writing protobuf");
+    };
+
+    // serialize elements [start, start + length) as one or more messages into
+    // the coded stream
+    std::function<void(::google::protobuf::io::CodedOutputStream&, uint64_t, uint64_t)> emit;
+    emit = [&](::google::protobuf::io::CodedOutputStream& coded_out, uint64_t start, uint64_t length) {
+        std::string chunk_data;
+        handle(lambda(start, length).SerializeToString(&chunk_data));
+        if (chunk_data.size() > MAX_PROTOBUF_SIZE) {
+            if (length > 1) {
+                emit(coded_out, start, length / 2);
+                emit(coded_out, start + length / 2, length - length / 2);
+                return;
+            }
+            throw std::runtime_error("stream::write_parallel: message for element " +
+                std::to_string(start) + " too large error writing protobuf");
+        }
+        // each message is a group of one, as in write()
+        coded_out.WriteVarint64(1);
+        coded_out.WriteVarint32(chunk_data.size());
+        coded_out.WriteRaw(chunk_data.data(), chunk_data.size());
+        handle(!coded_out.HadError());
+    };
+
+    // the compressed chunks of the previous wave, waiting to be written
+    std::vector<std::string> ready;
+    uint64_t ready_end = 0;
+    for (uint64_t wave_start = 0; wave_start < chunk_count || !ready.empty(); wave_start += wave_size) {
+        uint64_t wave_end = std::min(wave_start + wave_size, chunk_count);
+        std::vector<std::string> compressed(wave_end > wave_start ? wave_end - wave_start : 0);
+
+        std::exception_ptr error;
+        #pragma omp parallel
+        {
+            #pragma omp single nowait
+            {
+                // write out the previous wave in order
+                try {
+                    for (auto& data : ready) {
+                        out.write(data.data(), data.size());
+                        handle(out.good());
+                        std::string().swap(data);
+                    }
+                    if (written && !ready.empty()) {
+                        written(ready_end);
+                    }
+                } catch (...) {
+                    #pragma omp critical (stream_write_parallel_error)
+                    error = std::current_exception();
+                }
+            }
+
+            #pragma omp for schedule(dynamic, 1) nowait
+            for (uint64_t i = 0; i < compressed.size(); i++) {
+                try {
+                    uint64_t start = (wave_start + i) * chunk_elements;
+                    ::google::protobuf::io::StringOutputStream raw_out(&compressed[i]);
+                    ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
+                    {
+                        ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+                        emit(coded_out, start, std::min(chunk_elements, element_count - start));
+                    }
+                    handle(gzip_out.Close());
+                } catch (...) {
+                    #pragma omp critical (stream_write_parallel_error)
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        ready = std::move(compressed);
+        ready_end = std::min(wave_end * chunk_elements, element_count);
+    }
+
+    return true;
+}
+
 // write objects
 // count should be equal to the number of objects to write
 // count is written before the objects, but if it is 0, it is not written
@@ -222,7 +326,9 @@ void for_each(std::istream& in,
 // lambda2 is invoked on interleaved pairs of elements from the stream. The
 // elements of each pair are in order, but the overall order in which lambda2
 // is invoked on pairs is undefined (concurrent). lambda1 is invoked on an odd
-// last element of the stream, if any.
+// last element of the stream, if any. While either runs, the thread's
+// vg::current_input_sequence() is the number of pairs before it in the stream.
+// The stream is read and split into messages on a dedicated thread.
 template <typename T>
 void for_each_parallel_impl(std::istream& in,
                             const std::function<void(T&,T&)>& lambda2,
@@ -240,132 +346,142 @@ void for_each_parallel_impl(std::istream& in,
     // number of batches currently being processed
     uint64_t batches_outstanding = 0;
 
-    // this loop handles a chunked file with many pieces
-    // such as we might write in a multithreaded process
-    #pragma omp parallel default(none) shared(in, lambda1, lambda2, handle_count, batches_outstanding, max_batches_outstanding, single_threaded_until_true)
-    #pragma omp single
-    {
-        auto handle = [](bool retval) -> void {
-            if (!retval) throw std::runtime_error("obsolete, invalid, or corrupt protobuf input");
-        };
+    auto handle = [](bool retval) -> void {
+        if (!retval) throw std::runtime_error("obsolete, invalid, or corrupt protobuf input");
+    };
 
-        ::google::protobuf::io::IstreamInputStream raw_in(&in);
-        ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
-        ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+    // serialized messages, with the index in the stream of the first one
+    typedef std::pair<uint64_t, std::vector<std::string>> message_batch_t;
 
-        std::vector<std::string> *batch = nullptr;
-        
-        // process chunks prefixed by message count
-        uint64_t count;
-        while (coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
-            handle_count(count);
-            for (uint64_t i = 0; i < count; ++i) {
-                if (!batch) {
-                     batch = new std::vector<std::string>();
-                     batch->reserve(batch_size);
-                }
-                
-                // Reconstruct the CodedInputStream in place to reset its maximum-
-                // bytes-ever-read counter, because it thinks it's reading a single
-                // message.
-                coded_in.~CodedInputStream();
-                new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
-                // Allot space for size, and for reading next chunk's length
-                coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
-                
-                uint32_t msgSize = 0;
-                // the messages are prefixed by their size
-                handle(coded_in.ReadVarint32(&msgSize));
-                
-                if (msgSize > MAX_PROTOBUF_SIZE) {
-                    throw std::runtime_error("[stream::for_each] protobuf message of " +
-                        std::to_string(msgSize) + " bytes is too long");
-                }
-                
-                if (msgSize) {
-                    // pick off the message (serialized protobuf object)
-                    std::string s;
-                    handle(coded_in.ReadString(&s, msgSize));
-                    batch->push_back(std::move(s));
+    ::google::protobuf::io::IstreamInputStream raw_in(&in);
+    ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
+    ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+
+    // messages left in the current chunk
+    uint64_t count = 0;
+    // messages read so far
+    uint64_t messages = 0;
+
+    // this handles a chunked file with many pieces
+    // such as we might write in a multithreaded process
+    std::function<bool(message_batch_t&)> fill = [&](message_batch_t& batch) {
+        batch.first = messages;
+        batch.second.reserve(batch_size);
+        while (batch.second.size() < batch_size) {
+            if (count == 0) {
+                // process chunks prefixed by message count
+                if (!coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+                    return false;
                 }
+                handle_count(count);
+                continue;
+            }
+            count--;
+            
+            // Reconstruct the CodedInputStream in place to reset its maximum-
+            // bytes-ever-read counter, because it thinks it's reading a single
+            // message.
+            coded_in.~CodedInputStream();
+            new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
+            // Allot space for size, and for reading next chunk's length
+            coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
+            
+            uint32_t msgSize = 0;
+            // the messages are prefixed by their size
+            handle(coded_in.ReadVarint32(&msgSize));
+            
+            if (msgSize > MAX_PROTOBUF_SIZE) {
+                throw std::runtime_error("[stream::for_each] protobuf message of " +
+                    std::to_string(msgSize) + " bytes is too long");
+            }
+            
+            if (msgSize) {
+                // pick off the message (serialized protobuf object)
+                std::string s;
+                handle(coded_in.ReadString(&s, msgSize));
+                batch.second.push_back(std::move(s));
+                messages++;
+            }
+        }
+        return true;
+    };
+    std::function<bool(const message_batch_t&)> is_empty = [](const message_batch_t& batch) {
+        return batch.second.empty();
+    };
+
+    // parse the protobuf objects in a batch and invoke lambda2 on the pairs,
+    // and lambda1 on an odd one at the end
+    auto process = [&](message_batch_t& batch) {
+        T obj1, obj2;
+        size_t i = 0;
+        for (; i + 1 < batch.second.size(); i += 2) {
+            handle(obj1.ParseFromString(batch.second[i]));
+            handle(obj2.ParseFromString(batch.second[i+1]));
+            vg::InputSequenceScope sequence((batch.first + i) / 2);
+            lambda2(obj1, obj2);
+        }
+        if (i < batch.second.size()) { // odd last object
+            handle(obj1.ParseFromString(batch.second[i]));
+            vg::InputSequenceScope sequence((batch.first + i) / 2);
+            lambda1(obj1);
+        }
+    };
 
-                if (batch->size() == batch_size) {
-                    // time to enqueue this batch for processing. first, block if
-                    // we've hit max_batches_outstanding.
-                    uint64_t b;
+    #pragma omp parallel default(none) shared(fill, is_empty, process, batches_outstanding, max_batches_outstanding, single_threaded_until_true)
+    #pragma omp single
+    {
+        vg::BatchReader<message_batch_t> reader(fill, is_empty);
+
+        message_batch_t* batch = new message_batch_t();
+        while (reader.next(*batch)) {
+            if (batch->second.size() < batch_size) {
+                // only the final batch can be short; do it once everything
+                // before it is done
+                #pragma omp taskwait
+                process(*batch);
+                continue;
+            }
+            
+            // time to enqueue this batch for processing. first, block if
+            // we've hit max_batches_outstanding.
+            uint64_t b;
 #pragma omp atomic capture
-                    b = ++batches_outstanding;
-                    
-                    bool do_single_threaded = !single_threaded_until_true();
-                    if (b >= max_batches_outstanding || do_single_threaded) {
-                        
-                        // process this batch in the current thread
-                        {
-                            T obj1, obj2;
-                            for (int i = 0; i<batch_size; i+=2) {
-                                // parse protobuf objects and invoke lambda on the pair
-                                handle(obj1.ParseFromString(batch->at(i)));
-                                handle(obj2.ParseFromString(batch->at(i+1)));
-                                lambda2(obj1,obj2);
-                            }
-                        } // scope obj1 & obj2
-                        delete batch;
+            b = ++batches_outstanding;
+            
+            bool do_single_threaded = !single_threaded_until_true();
+            if (b >= max_batches_outstanding || do_single_threaded) {
+                
+                // process this batch in the current thread
+                process(*batch);
 #pragma omp atomic capture
-                        b = --batches_outstanding;
-                        
-                        if (4 * b / 3 < max_batches_outstanding
-                            && max_batches_outstanding < max_max_batches_outstanding
-                            && !do_single_threaded) {
-                            // we went through at least 1/4 of the batch buffer while we were doing this thread's batch
-                            // this looks risky, since we want the batch buffer to stay populated the entire time we're
-                            // occupying this thread on compute, so let's increase the batch buffer size
-                            // (skip this adjustment if you're in single-threaded mode and thus expect the buffer to be
-                            // empty)
-                            max_batches_outstanding *= 2;
-                        }
-                    }
-                    else {
-                        // spawn a task in another thread to process this batch
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda2, handle, single_threaded_until_true)
-                        {
-                            {
-                                T obj1, obj2;
-                                for (int i = 0; i<batch_size; i+=2) {
-                                    // parse protobuf objects and invoke lambda on the pair
-                                    handle(obj1.ParseFromString(batch->at(i)));
-                                    handle(obj2.ParseFromString(batch->at(i+1)));
-                                    lambda2(obj1,obj2);
-                                }
-                            } // scope obj1 & obj2
-                            delete batch;
+                b = --batches_outstanding;
+                
+                if (4 * b / 3 < max_batches_outstanding
+                    && max_batches_outstanding < max_max_batches_outstanding
+                    && !do_single_threaded) {
+                    // we went through at least 1/4 of the batch buffer while we were doing this thread's batch
+                    // this looks risky, since we want the batch buffer to stay populated the entire time we're
+                    // occupying this thread on compute, so let's increase the batch buffer size
+                    // (skip this adjustment if you're in single-threaded mode and thus expect the buffer to be
+                    // empty)
+                    max_batches_outstanding *= 2;
+                }
+            }
+            else {
+                // spawn a task in another thread to process this batch
+#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, process)
+                {
+                    process(*batch);
+                    delete batch;
 #pragma omp atomic update
-                            batches_outstanding--;
-                        }
-                    }
-
-                    batch = nullptr;
+                    batches_outstanding--;
                 }
+                batch = new message_batch_t();
             }
         }
+        delete batch;
 
         #pragma omp taskwait
-        // process final batch
-        if (batch) {
-            {
-                T obj1, obj2;
-                int i = 0;
-                for (; i < batch->size()-1; i+=2) {
-                    handle(obj1.ParseFromString(batch->at(i)));
-                    handle(obj2.ParseFromString(batch->at(i+1)));
-                    lambda2(obj1, obj2);
-                }
-                if (i == batch->size()-1) { // odd last object
-                    handle(obj1.ParseFromString(batch->at(i)));
-                    lambda1(obj1);
-                }
-            } // scope obj1 & obj2
-            delete batch;
-        }
     }
 }
 
@@ -397,9 +513,22 @@ template <typename T>
 void for_each_parallel(std::istream& in,
                        const std::function<void(T&)>& lambda1,
                        const std::function<void(uint64_t)>& handle_count) {
-    std::function<void(T&,T&)> lambda2 = [&lambda1](T& o1, T& o2) { lambda1(o1); lambda1(o2); };
+    // number the elements individually, rather than by pair
+    std::function<void(T&,T&)> lambda2 = [&lambda1](T& o1, T& o2) {
+        size_t pair_sequence = vg::current_input_sequence();
+        {
+            vg::InputSequenceScope sequence(pair_sequence * 2);
+            lambda1(o1);
+        }
+        vg::InputSequenceScope sequence(pair_sequence * 2 + 1);
+        lambda1(o2);
+    };
+    std::function<void(T&)> last = [&lambda1](T& o) {
+        vg::InputSequenceScope sequence(vg::current_input_sequence() * 2);
+        lambda1(o);
+    };
     std::function<bool(void)> no_wait = [](void) {return true;};
-    for_each_parallel_impl(in, lambda2, lambda1, handle_count, no_wait);
+    for_each_parallel_impl(in, lambda2, last, handle_count, no_wait);
 }
 
 template <typename T>
@@ -409,6 +538,125 @@ void for_each_parallel(std::istream& in,
     for_each_parallel(in, lambda, noop);
 }
 
+// Ordered parallel iteration. The stream is split into messages on a
+// dedicated thread, and each batch of messages is decoded by all the OpenMP
+// threads while the calling thread runs lambda, in stream order, on the
+// previous batch. For consumers that must see objects in order (like graph
+// loading) but shouldn't wait on serial decoding. handle_count is also called
+// on the calling thread, with each chunk's count, before the chunk's objects.
+template <typename T>
+void for_each_ordered_parallel(std::istream& in,
+                               const std::function<void(T&)>& lambda,
+                               const std::function<void(uint64_t)>& handle_count) {
+
+    // messages to decode at a time; enough to keep all the threads busy
+    const size_t batch_size = 4 * omp_get_max_threads();
+
+    auto handle = [](bool retval) -> void {
+        if (!retval) throw std::runtime_error("[stream::for_each_ordered_parallel] obsolete, invalid, or corrupt protobuf input");
+    };
+
+    struct message_batch_t {
+        // the chunk counts read, with the number of messages read before each
+        std::vector<std::pair<size_t, uint64_t>> counts;
+        std::vector<std::string> messages;
+    };
+
+    ::google::protobuf::io::IstreamInputStream raw_in(&in);
+    ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
+    ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+
+    // messages left in the current chunk
+    uint64_t count = 0;
+
+    std::function<bool(message_batch_t&)> fill = [&](message_batch_t& batch) {
+        while (batch.messages.size() < batch_size) {
+            if (count == 0) {
+                if (!coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+                    return false;
+                }
+                batch.counts.emplace_back(batch.messages.size(), count);
+                continue;
+            }
+            count--;
+
+            // Reset the byte limit for each message, as in for_each
+            coded_in.~CodedInputStream();
+            new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
+            coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
+
+            uint32_t msgSize = 0;
+            handle(coded_in.ReadVarint32(&msgSize));
+            if (msgSize > MAX_PROTOBUF_SIZE) {
+                throw std::runtime_error("[stream::for_each_ordered_parallel] protobuf message of " +
+                    std::to_string(msgSize) + " bytes is too long");
+            }
+            if (msgSize) {
+                std::string s;
+                handle(coded_in.ReadString(&s, msgSize));
+                batch.messages.push_back(std::move(s));
+            }
+        }
+        return true;
+    };
+    std::function<bool(const message_batch_t&)> is_empty = [](const message_batch_t& batch) {
+        return batch.messages.empty() && batch.counts.empty();
+    };
+
+    vg::BatchReader<message_batch_t> reader(fill, is_empty);
+
+    // the decoded batch waiting for lambda
+    message_batch_t ready_batch;
+    std::vector<T> ready;
+    bool more = true;
+    while (more) {
+        message_batch_t next_batch;
+        more = reader.next(next_batch);
+        std::vector<T> decoded(next_batch.messages.size());
+
+        bool decoded_ok = true;
+        std::exception_ptr lambda_error;
+        #pragma omp parallel
+        {
+            #pragma omp single nowait
+            {
+                // hand over the previous batch, in order
+                try {
+                    size_t next_count = 0;
+                    for (size_t i = 0; i <= ready.size(); i++) {
+                        for (; next_count < ready_batch.counts.size() && ready_batch.counts[next_count].first == i; next_count++) {
+                            handle_count(ready_batch.counts[next_count].second);
+                        }
+                        if (i < ready.size()) {
+                            lambda(ready[i]);
+                        }
+                    }
+                } catch (...) {
+                    lambda_error = std::current_exception();
+                }
+            }
+
+            #pragma omp for schedule(dynamic, 1) nowait
+            for (size_t i = 0; i < decoded.size(); i++) {
+                if (!decoded[i].ParseFromString(next_batch.messages[i])) {
+                    #pragma omp atomic write
+                    decoded_ok = false;
+                }
+                // don't hold on to both forms
+                std::string().swap(next_batch.messages[i]);
+            }
+        }
+        if (lambda_error) {
+            std::rethrow_exception(lambda_error);
+        }
+        handle(decoded_ok);
+
+        // the reader is done when there's nothing new left to hand over
+        ready = std::move(decoded);
+        ready_batch = std::move(next_batch);
+    }
+}
+
     
 /*
  * Refactored stream::for_each function that follows the unidirectional iterator interface
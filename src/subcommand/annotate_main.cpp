@@ -4,6 +4,7 @@
 #include "../mapper.hpp"
 #include "../stream.hpp"
 #include "../alignment.hpp"
+#include "../path_offset_cache.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -21,7 +22,8 @@ void help_annotate(char** argv) {
          << "    -g, --gcsa FILE        a GCSA2 index file base name" << endl
          << "    -a, --gam FILE         alignments to annotate" << endl
          << "    -p, --positions        annotate alignments with reference positions" << endl
-         << "    -n, --novelty          table for each read: name, bp not in xg, nodes not in xg" << endl;
+         << "    -n, --novelty          table for each read: name, bp not in xg, nodes not in xg" << endl
+         << "    -t, --threads N        use N threads (output order matches input order)" << endl;
 }
 
 int main_annotate(int argc, char** argv) {
@@ -40,6 +42,8 @@ int main_annotate(int argc, char** argv) {
     string gam_name;
     bool add_positions = false;
     bool novelty = false;
+    // Alignments are read and annotated in chunks of this many per thread
+    const size_t reads_per_thread = 1024;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -55,11 +59,12 @@ int main_annotate(int argc, char** argv) {
             {"gff-name", required_argument, 0, 'f'},
             {"db-name", required_argument, 0, 'd'},
             {"novelty", no_argument, 0, 'n'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:d:v:g:a:pb:f:n",
+        c = getopt_long (argc, argv, "hx:d:v:g:a:pb:f:nt:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -104,6 +109,10 @@ int main_annotate(int argc, char** argv) {
             novelty = true;
             break;
 
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
         case 'h':
         case '?':
             help_annotate(argv);
@@ -123,57 +132,96 @@ int main_annotate(int argc, char** argv) {
         return 1;
     }
     
-    Mapper mapper(xg_index, nullptr, nullptr);
-    
     if (!gam_name.empty()) {
-        vector<Alignment> buffer;
+        // Read a chunk of alignments, work on it on all threads, and write
+        // the results in input order.
+        size_t chunk_size = reads_per_thread * get_thread_count();
+        vector<Alignment> chunk;
+        chunk.reserve(chunk_size);
+        function<void(void)> process_chunk;
+
         if (add_positions) {
-            //map<string, double> Mapper::alignment_mean_path_positions(const Alignment& aln, bool first_hit_only);
+            // All threads share one cache of where nodes fall on the paths
+            PathOffsetCache path_offsets(xg_index);
+            process_chunk = [&](void) {
+                // Look up the chunk's nodes in sorted order before annotating
+                vector<id_t> node_ids;
+                for (auto& aln : chunk) {
+                    for (auto& mapping : aln.path().mapping()) {
+                        node_ids.push_back(mapping.position().node_id());
+                    }
+                }
+                path_offsets.prefetch(node_ids);
+#pragma omp parallel for schedule(dynamic, 64)
+                for (size_t i = 0; i < chunk.size(); ++i) {
+                    chunk[i].clear_refpos();
+                    path_offsets.annotate_with_initial_path_positions(chunk[i]);
+                }
+                stream::write_buffered(cout, chunk, 0);
+            };
             function<void(Alignment&)> lambda = [&](Alignment& aln) {
-                aln.clear_refpos();
-                mapper.annotate_with_initial_path_positions(aln);
-                buffer.push_back(aln);
-                stream::write_buffered(cout, buffer, 100);
+                chunk.push_back(aln);
+                if (chunk.size() >= chunk_size) {
+                    process_chunk();
+                }
             };
             get_input_file(gam_name, [&](istream& in) {
                     stream::for_each(in, lambda);
                 });
-            stream::write_buffered(cout, buffer, 0); // flush
+            process_chunk(); // flush
         } else if (novelty) {
             cout << "name\tlength.bp\tunaligned.bp\tknown.nodes\tknown.bp\tnovel.nodes\tnovel.bp" << endl;
-            function<void(Alignment&)> lambda = [&](Alignment& aln) {
-                // count the number of positions in the alignment that aren't in the graph
-                int total_bp = aln.sequence().size();
-                int unaligned_bp = 0;
-                int known_nodes = 0;
-                int known_bp = 0;
-                int novel_nodes = 0;
-                int novel_bp = 0;
-                for (auto& mapping : aln.path().mapping()) {
-                    if (mapping.has_position()) {
-                        auto& pos = mapping.position();
-                        if (xg_index->has_node(pos.node_id())) {
-                            ++known_nodes;
-                            known_bp += mapping_to_length(mapping);
+            vector<string> lines;
+            process_chunk = [&](void) {
+                lines.resize(chunk.size());
+#pragma omp parallel for schedule(dynamic, 64)
+                for (size_t i = 0; i < chunk.size(); ++i) {
+                    auto& aln = chunk[i];
+                    // count the number of positions in the alignment that aren't in the graph
+                    int total_bp = aln.sequence().size();
+                    int unaligned_bp = 0;
+                    int known_nodes = 0;
+                    int known_bp = 0;
+                    int novel_nodes = 0;
+                    int novel_bp = 0;
+                    for (auto& mapping : aln.path().mapping()) {
+                        if (mapping.has_position()) {
+                            auto& pos = mapping.position();
+                            if (xg_index->has_node(pos.node_id())) {
+                                ++known_nodes;
+                                known_bp += mapping_to_length(mapping);
+                            } else {
+                                ++novel_nodes;
+                                novel_bp += mapping_to_length(mapping);
+                            }
                         } else {
-                            ++novel_nodes;
-                            novel_bp += mapping_to_length(mapping);
+                            unaligned_bp += mapping_to_length(mapping);
                         }
-                    } else {
-                        unaligned_bp += mapping_to_length(mapping);
                     }
+                    lines[i] = aln.name() + "\t"
+                        + to_string(total_bp) + "\t"
+                        + to_string(unaligned_bp) + "\t"
+                        + to_string(known_nodes) + "\t"
+                        + to_string(known_bp) + "\t"
+                        + to_string(novel_nodes) + "\t"
+                        + to_string(novel_bp) + "\n";
+                }
+                for (auto& line : lines) {
+                    cout << line;
+                }
+                lines.clear();
+                chunk.clear();
+            };
+            function<void(Alignment&)> lambda = [&](Alignment& aln) {
+                chunk.push_back(aln);
+                if (chunk.size() >= chunk_size) {
+                    process_chunk();
                 }
-                cout << aln.name() << "\t"
-                << total_bp << "\t"
-                << unaligned_bp << "\t"
-                << known_nodes << "\t"
-                << known_bp << "\t"
-                << novel_nodes << "\t"
-                << novel_bp << endl;
             };
             get_input_file(gam_name, [&](istream& in) {
                     stream::for_each(in, lambda);
                 });
+            process_chunk(); // flush
         }
     } else if (!bed_name.empty()) {
         vector<Alignment> buffer;
@@ -8,6 +8,9 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
 
 #include "subcommand.hpp"
 
@@ -16,6 +19,14 @@
 
 #include "../vg.hpp"
 #include "../xg.hpp"
+#include "../mapper.hpp"
+#include "../cluster.hpp"
+#include "../gssw_aligner.hpp"
+#include "../gamsorter.hpp"
+#include "../packer.hpp"
+#include "../sampler.hpp"
+#include "../stream.hpp"
+#include "../build_index.hpp"
 #include "../algorithms/extract_connecting_graph.hpp"
 #include "../algorithms/topological_sort.hpp"
 #include "../algorithms/weakly_connected_components.hpp"
@@ -29,25 +40,299 @@ using namespace vg::subcommand;
 void help_benchmark(char** argv) {
     cerr << "usage: " << argv[0] << " benchmark [options] >report.tsv" << endl
          << "options:" << endl
+         << "    -s, --scales N,N,...   also time the mapping, alignment, indexing and I/O code on synthetic" << endl
+         << "                           graphs of 10 kbp times each scale (default: 1,10; 0 for none)" << endl
+         << "    -n, --reads N          simulate N reads for each synthetic graph [1000]" << endl
+         << "    -S, --seed N           seed for the synthetic graphs and reads [1]" << endl
+         << "    -j, --json             report results as JSON instead of TSV" << endl
          << "    -p, --progress         show progress" << endl;
 }
 
+/// A reproducible synthetic graph: a random reference backbone with SNP
+/// bubbles and deletions, and a path named "ref" along it.
+struct SyntheticGraph {
+    Graph graph;
+    /// The backbone nodes, which every path through the graph visits, in order
+    vector<id_t> backbone;
+    /// Where each backbone node starts in the reference
+    vector<size_t> backbone_offset;
+    /// The sequence of the ref path
+    string reference;
+};
+
+/// Make a SyntheticGraph with at least the given reference length. Node IDs
+/// increase along the backbone, so the graph is sorted.
+static SyntheticGraph make_synthetic_graph(size_t length, int seed) {
+    SyntheticGraph made;
+    mt19937 rng(seed);
+    auto random_sequence = [&](size_t bases) {
+        string sequence;
+        for (size_t i = 0; i < bases; i++) {
+            sequence.push_back("ACGT"[rng() % 4]);
+        }
+        return sequence;
+    };
+    
+    Path* ref = made.graph.add_path();
+    ref->set_name("ref");
+    id_t next_id = 1;
+    auto add_node = [&](const string& sequence, bool on_ref) {
+        Node* node = made.graph.add_node();
+        node->set_id(next_id++);
+        node->set_sequence(sequence);
+        if (on_ref) {
+            Mapping* mapping = ref->add_mapping();
+            mapping->mutable_position()->set_node_id(node->id());
+            mapping->set_rank(ref->mapping_size());
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(sequence.size());
+            edit->set_to_length(sequence.size());
+            made.reference += sequence;
+        }
+        return node->id();
+    };
+    auto add_edge = [&](id_t from, id_t to) {
+        Edge* edge = made.graph.add_edge();
+        edge->set_from(from);
+        edge->set_to(to);
+    };
+    auto add_backbone = [&]() {
+        made.backbone_offset.push_back(made.reference.size());
+        made.backbone.push_back(add_node(random_sequence(1 + rng() % 32), true));
+        return made.backbone.back();
+    };
+    
+    id_t prev = add_backbone();
+    while (made.reference.size() < length) {
+        if (rng() % 3 == 0) {
+            // A SNP, sometimes with a deletion around it
+            size_t ref_base = rng() % 4;
+            size_t alt_base = (ref_base + 1 + rng() % 3) % 4;
+            id_t ref_node = add_node(string(1, "ACGT"[ref_base]), true);
+            id_t alt_node = add_node(string(1, "ACGT"[alt_base]), false);
+            id_t next = add_backbone();
+            add_edge(prev, ref_node);
+            add_edge(prev, alt_node);
+            add_edge(ref_node, next);
+            add_edge(alt_node, next);
+            if (rng() % 2 == 0) {
+                add_edge(prev, next);
+            }
+            prev = next;
+        } else {
+            id_t next = add_backbone();
+            add_edge(prev, next);
+            prev = next;
+        }
+    }
+    
+    return made;
+}
+
+/// Get the part of a SyntheticGraph between two backbone nodes, inclusive.
+static Graph synthetic_window(const SyntheticGraph& synthetic, size_t first, size_t last) {
+    id_t min_id = synthetic.backbone[first];
+    id_t max_id = synthetic.backbone[last];
+    Graph window;
+    for (auto& node : synthetic.graph.node()) {
+        if (node.id() >= min_id && node.id() <= max_id) {
+            *window.add_node() = node;
+        }
+    }
+    for (auto& edge : synthetic.graph.edge()) {
+        if (edge.from() >= min_id && edge.to() <= max_id) {
+            *window.add_edge() = edge;
+        }
+    }
+    return window;
+}
+
+/// Time the mapping, alignment, indexing and I/O code on a synthetic graph of
+/// the given scale, and add the results to the given vector.
+static void run_synthetic_benchmarks(size_t scale, size_t read_count, int seed, bool show_progress,
+                                     vector<BenchmarkResult>& results) {
+    
+    string suffix = " (scale " + to_string(scale) + ")";
+    if (show_progress) {
+        cerr << "Building indexes" << suffix << endl;
+    }
+    
+    SyntheticGraph synthetic = make_synthetic_graph(10000 * scale, seed);
+    VG graph;
+    graph.extend(synthetic.graph);
+    xg::XG xg_index(synthetic.graph);
+    
+    gcsa::TempFile::setDirectory(temp_file::get_dir());
+    gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+    gcsa::GCSA* gcsa_index = nullptr;
+    gcsa::LCPArray* lcp_index = nullptr;
+    build_gcsa_lcp(graph, gcsa_index, lcp_index, 16, 3);
+    
+    Mapper mapper(&xg_index, gcsa_index, lcp_index);
+    Aligner aligner;
+    
+    // Simulate reads the same way every time
+    Sampler sampler(&xg_index, seed);
+    vector<Alignment> reads;
+    for (size_t i = 0; i < read_count; i++) {
+        reads.push_back(sampler.alignment_with_error(100, 0.01, 0.002));
+    }
+    
+    // Find their MEMs once, for the clusterer
+    vector<vector<MaximalExactMatch>> read_mems(reads.size());
+    auto find_mems = [&](size_t i) {
+        double lcp_avg, fraction_filtered;
+        auto& sequence = reads[i].sequence();
+        return mapper.find_mems_deep(sequence.begin(), sequence.end(), lcp_avg, fraction_filtered, 0, 8);
+    };
+    for (size_t i = 0; i < reads.size(); i++) {
+        read_mems[i] = find_mems(i);
+    }
+    
+    // Cut out short windows of the graph, and reads that run from end to end of
+    // them with one substitution, for the aligners
+    vector<Graph> windows;
+    vector<string> window_reads;
+    for (size_t first = 0; first < synthetic.backbone.size() && windows.size() < 100; ) {
+        size_t last = first;
+        while (last + 1 < synthetic.backbone.size() &&
+               synthetic.backbone_offset[last] - synthetic.backbone_offset[first] < 150) {
+            last++;
+        }
+        if (last == first) {
+            break;
+        }
+        windows.push_back(synthetic_window(synthetic, first, last));
+        // The last backbone node is the last node in the window
+        size_t end = synthetic.backbone_offset[last] + windows.back().node(windows.back().node_size() - 1).sequence().size();
+        window_reads.push_back(synthetic.reference.substr(synthetic.backbone_offset[first],
+                                                          end - synthetic.backbone_offset[first]));
+        char& mutated = window_reads.back()[window_reads.back().size() / 2];
+        mutated = mutated == 'A' ? 'C' : 'A';
+        first = last + 1;
+    }
+    
+    // And serialize the reads for decoding
+    string serialized;
+    {
+        stringstream out;
+        vector<Alignment> buffer = reads;
+        stream::write_buffered(out, buffer, 0);
+        serialized = out.str();
+    }
+    
+    if (show_progress) {
+        cerr << "Running benchmarks" << suffix << endl;
+    }
+    
+    results.push_back(run_benchmark("Mapper::find_mems_deep" + suffix, 10, [&]() {
+        for (size_t i = 0; i < reads.size(); i++) {
+            find_mems(i);
+        }
+    }));
+    
+    results.push_back(run_benchmark("OrientedDistanceClusterer::clusters" + suffix, 10, [&]() {
+        for (size_t i = 0; i < reads.size(); i++) {
+            OrientedDistanceClusterer clusterer(reads[i], read_mems[i], aligner, &xg_index);
+            clusterer.clusters();
+        }
+    }));
+    
+    results.push_back(run_benchmark("Aligner::align" + suffix, 10, [&]() {
+        for (size_t i = 0; i < windows.size(); i++) {
+            Alignment aln;
+            aln.set_sequence(window_reads[i]);
+            aligner.align(aln, windows[i], true, false);
+        }
+    }));
+    
+    results.push_back(run_benchmark("BandedGlobalAligner" + suffix, 10, [&]() {
+        for (size_t i = 0; i < windows.size(); i++) {
+            Alignment aln;
+            aln.set_sequence(window_reads[i]);
+            aligner.align_global_banded(aln, windows[i], 0, true);
+        }
+    }));
+    
+    // Check results outside the timed functions, so only the work is timed
+    size_t edges = 0;
+    results.push_back(run_benchmark("XG handle traversal" + suffix, 10, [&]() {
+        edges = 0;
+        xg_index.for_each_handle([&](const handle_t& handle) {
+            xg_index.follow_edges(handle, false, [&](const handle_t& next) {
+                edges++;
+                return true;
+            });
+        });
+    }));
+    // Every edge goes from an end to a start, so we see each one once
+    assert(edges == (size_t) synthetic.graph.edge_size());
+    
+    results.push_back(run_benchmark("XG path queries" + suffix, 10, [&]() {
+        size_t ref_length = xg_index.path_length("ref");
+        for (size_t i = 0; i < 1000; i++) {
+            int64_t id = xg_index.node_at_path_position("ref", (i * 7919) % ref_length);
+            xg_index.position_in_path(id, "ref");
+        }
+    }));
+    
+    size_t decoded = 0;
+    results.push_back(run_benchmark("stream::for_each_parallel" + suffix, 10, [&]() {
+        stringstream in(serialized);
+        decoded = 0;
+        function<void(Alignment&)> count = [&](Alignment& aln) {
+#pragma omp atomic
+            decoded++;
+        };
+        stream::for_each_parallel(in, count);
+    }));
+    assert(decoded == reads.size());
+    
+    vector<Alignment> to_sort;
+    results.push_back(run_benchmark("GAMSorter::sort" + suffix, 10, [&]() {
+        to_sort = reads;
+    }, [&]() {
+        GAMSorter sorter;
+        sorter.sort(to_sort);
+    }));
+    
+    unique_ptr<Packer> packer;
+    results.push_back(run_benchmark("Packer::add" + suffix, 10, [&]() {
+        packer.reset(new Packer(&xg_index));
+    }, [&]() {
+        for (auto& read : reads) {
+            packer->add(read);
+        }
+    }));
+    
+    delete gcsa_index;
+    delete lcp_index;
+}
+
 int main_benchmark(int argc, char** argv) {
 
     bool show_progress = false;
+    vector<size_t> scales = {1, 10};
+    size_t read_count = 1000;
+    int seed = 1;
+    bool output_json = false;
     
     int c;
     optind = 2; // force optind past command positional argument
     while (true) {
         static struct option long_options[] =
             {
+                {"scales", required_argument, 0, 's'},
+                {"reads", required_argument, 0, 'n'},
+                {"seed", required_argument, 0, 'S'},
+                {"json", no_argument, 0, 'j'},
                 {"progress",  no_argument, 0, 'p'},
                 {"help", no_argument, 0, 'h'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "ph?",
+        c = getopt_long (argc, argv, "s:n:S:jph?",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -57,6 +342,27 @@ int main_benchmark(int argc, char** argv) {
         switch (c)
         {
 
+        case 's':
+            scales.clear();
+            for (auto& scale : split_delims(optarg, ",")) {
+                if (atoi(scale.c_str()) > 0) {
+                    scales.push_back(atoi(scale.c_str()));
+                }
+            }
+            break;
+            
+        case 'n':
+            read_count = atoi(optarg);
+            break;
+            
+        case 'S':
+            seed = atoi(optarg);
+            break;
+            
+        case 'j':
+            output_json = true;
+            break;
+            
         case 'p':
             show_progress = true;
             break;
@@ -111,10 +417,12 @@ int main_benchmark(int argc, char** argv) {
     
     vector<BenchmarkResult> results;
     
+    // Check results outside the timed functions, so only the work is timed
+    vector<handle_t> order;
     results.push_back(run_benchmark("vg::algorithms topological_sort", 1000, [&]() {
-        vector<handle_t> order = algorithms::topological_sort(&vg);
-        assert(order.size() == vg.node_size());
+        order = algorithms::topological_sort(&vg);
     }));
+    assert(order.size() == vg.node_size());
     
     results.push_back(run_benchmark("vg::algorithms sort", 1000, [&]() {
         vg_mut = vg;
@@ -129,11 +437,12 @@ int main_benchmark(int argc, char** argv) {
     }));
     
     
+    vector<unordered_set<id_t>> components;
     results.push_back(run_benchmark("vg::algorithms weakly_connected_components", 1000, [&]() {
-        auto components = algorithms::weakly_connected_components(&vg);
-        assert(components.size() == 1);
-        assert(components.front().size() == vg.node_size());
+        components = algorithms::weakly_connected_components(&vg);
     }));
+    assert(components.size() == 1);
+    assert(components.front().size() == vg.node_size());
     
     results.push_back(run_benchmark("VG::get_node", 1000, [&]() {
         for (size_t rep = 0; rep < 100; rep++) {
@@ -167,13 +476,25 @@ int main_benchmark(int argc, char** argv) {
     
     }));
     
+    for (auto& scale : scales) {
+        run_synthetic_benchmarks(scale, read_count, seed, show_progress, results);
+    }
+    
     // Do the control against itself
     results.push_back(run_benchmark("control", 1000, benchmark_control));
 
-    cout << "# Benchmark results for vg " << VG_VERSION_STRING << endl;
-    cout << "# runs\ttest(us)\tstddev(us)\tcontrol(us)\tstddev(us)\tscore\terr\tname" << endl;
-    for (auto& result : results) {
-        cout << result << endl;
+    if (output_json) {
+        cout << "{\"version\": \"" << VG_VERSION_STRING << "\", \"results\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            cout << (i ? ",\n" : "\n") << "  " << results[i].to_json();
+        }
+        cout << "\n]}" << endl;
+    } else {
+        cout << "# Benchmark results for vg " << VG_VERSION_STRING << endl;
+        cout << "# runs\ttest(us)\tstddev(us)\tcontrol(us)\tstddev(us)\tscore\terr\tname" << endl;
+        for (auto& result : results) {
+            cout << result << endl;
+        }
     }
 
     return 0;
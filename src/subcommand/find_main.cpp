@@ -30,7 +30,8 @@ void help_find(char** argv) {
          << "    -X, --approx-pos ID    get the approximate position of this node" << endl
          << "    -r, --node-range N:M   get nodes from N to M" << endl
          << "    -G, --gam GAM          accumulate the graph touched by the alignments in the GAM" << endl
-         << "alignments: (rocksdb only)" << endl
+         << "alignments: (rocksdb or gam index only)" << endl
+         << "    -l, --gam-index FILE   read alignments from this index written by vg index -l" << endl
          << "    -a, --alignments       writes alignments from index, sorted by node id" << endl
          << "    -i, --alns-in N:M      writes alignments whose start nodes is between N and M (inclusive)" << endl
          << "    -o, --alns-on N:M      writes alignments which align to any of the nodes between N and M (inclusive)" << endl
@@ -66,6 +67,7 @@ int main_find(int argc, char** argv) {
     }
 
     string db_name;
+    string gam_index_name;
     string sequence;
     int kmer_size=0;
     int kmer_stride = 1;
@@ -112,6 +114,7 @@ int main_find(int argc, char** argv) {
             {
                 //{"verbose", no_argument,       &verbose_flag, 1},
                 {"db-name", required_argument, 0, 'd'},
+                {"gam-index", required_argument, 0, 'l'},
                 {"xg-name", required_argument, 0, 'x'},
                 {"gcsa", required_argument, 0, 'g'},
                 {"node", required_argument, 0, 'n'},
@@ -152,7 +155,7 @@ int main_find(int argc, char** argv) {
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:R:B:fi:DH:G:N:A:Y:Z:tq:X:IQ:",
+        c = getopt_long (argc, argv, "d:l:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:R:B:fi:DH:G:N:A:Y:Z:tq:X:IQ:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -165,6 +168,10 @@ int main_find(int argc, char** argv) {
             db_name = optarg;
             break;
 
+        case 'l':
+            gam_index_name = optarg;
+            break;
+
         case 'x':
             xg_name = optarg;
             break;
@@ -329,8 +336,8 @@ int main_find(int argc, char** argv) {
         return 1;
     }
 
-    if (db_name.empty() && gcsa_in.empty() && xg_name.empty()) {
-        cerr << "[vg find] find requires -d, -g, or -x to know where to find its database" << endl;
+    if (db_name.empty() && gam_index_name.empty() && gcsa_in.empty() && xg_name.empty()) {
+        cerr << "[vg find] find requires -d, -l, -g, or -x to know where to find its database" << endl;
         return 1;
     }
 
@@ -363,11 +370,16 @@ int main_find(int argc, char** argv) {
 
     // open index
     Index* vindex = nullptr;
-    if (db_name.empty()) {
+    if (db_name.empty() && gam_index_name.empty()) {
         assert(!gcsa_in.empty() || !xg_name.empty());
     } else {
         vindex = new Index;
-        vindex->open_read_only(db_name);
+        if (!db_name.empty()) {
+            vindex->open_read_only(db_name);
+        }
+        if (!gam_index_name.empty()) {
+            vindex->open_gam_index(gam_index_name);
+        }
     }
 
     xg::XG xindex;
@@ -377,7 +389,7 @@ int main_find(int argc, char** argv) {
     }
 
     if (get_alignments) {
-        assert(!db_name.empty());
+        assert(vindex != nullptr);
         vector<Alignment> output_buf;
         auto lambda = [&output_buf](const Alignment& aln) {
             output_buf.push_back(aln);
@@ -388,7 +400,7 @@ int main_find(int argc, char** argv) {
     }
 
     if (!node_id_range.empty()) {
-        assert(!db_name.empty());
+        assert(vindex != nullptr);
         vector<string> parts = split_delims(node_id_range, ":");
         if (parts.size() == 1) {
             convert(parts.front(), start_id);
@@ -407,7 +419,7 @@ int main_find(int argc, char** argv) {
     }
 
     if (!aln_on_id_range.empty()) {
-        assert(!db_name.empty());
+        assert(vindex != nullptr);
         vector<string> parts = split_delims(aln_on_id_range, ":");
         if (parts.size() == 1) {
             convert(parts.front(), start_id);
@@ -795,7 +807,7 @@ int main_find(int argc, char** argv) {
             }
             set<int> kmer_sizes = vindex->stored_kmer_sizes();
             if (kmer_sizes.empty()) {
-                cerr << "error:[vg find] index does not include kmers, add with vg index -k" << endl;
+                cerr << "error:[vg find] index does not include kmers, add with vg index -K" << endl;
                 return 1;
             }
             if (kmer_size == 0) {
@@ -19,7 +19,7 @@ void help_gamsort(char **argv)
          << "Options:" << endl
          << "  -p / --paired           Index a paired-end GAM." << endl
          << "  -s / --sorted           Input GAM is already sorted." << endl
-         << "  -i / --index <INDEX>    produce a node-to-alignment index" << endl
+         << "  -i / --index            produce a node-range alignment index of the sorted GAM (for vg find -l)" << endl
          << "  -d / --dumb-sort        use naive sorting algorithm (no tmp files, faster for small GAMs)" << endl
          << "  -r / --rocks            Just use the old RocksDB-style indexing scheme for sorting." << endl
          << "  -a / --aln-index        Create the old RocksDB-style node-to-alignment index." << endl
@@ -124,7 +124,11 @@ int main_gamsort(int argc, char **argv)
         index.close();
     }
 
-    if (dumb_sort)
+    if (is_sorted)
+    {
+        // Nothing to do; the input is indexed as-is.
+    }
+    else if (dumb_sort)
     {
         gs.dumb_sort(gamfile);
     }
@@ -161,9 +165,10 @@ int main_gamsort(int argc, char **argv)
     }
     
     else if (do_index){
-        // Write a super simple index file of format
-        // node_d \tab firstAlnLineNumber \tab secondAlnLineNumber ...
-        gs.write_index(gamfile, gamfile + ".gai", false);
+        // Write a block-compressed copy of the sorted GAM with an index of
+        // the node ranges its blocks cover.
+        string sorted_name = is_sorted ? gamfile : gamfile + ".sorted.gam";
+        gs.write_index(sorted_name, sorted_name + ".gai", true);
     }
 
     return 1;
@@ -9,10 +9,13 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <iterator>
+#include <sstream>
 
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
+#include "../packed_graph.hpp"
 #include "../vg_set.hpp"
 #include "../algorithms/topological_sort.hpp"
 
@@ -35,6 +38,28 @@ void help_ids(char** argv) {
         << "    -s, --sort           assign new node IDs in (generalized) topological sort order" << endl;
 }
 
+/// Sort and renumber the nodes of a graph as requested on the command line.
+template<typename GraphType>
+static void renumber(GraphType* graph, bool sort, bool compact, vg::id_t increment, vg::id_t decrement) {
+    if (sort) {
+        // Set up the nodes so we go through them in topological order
+        algorithms::sort(graph);
+    }
+
+    if (compact || sort) {
+        // Compact only, or compact to re-assign IDs after sort
+        graph->compact_ids();
+    }
+
+    if (increment != 0) {
+        graph->increment_node_ids(increment);
+    }
+
+    if (decrement != 0) {
+        graph->decrement_node_ids(decrement);
+    }
+}
+
 int main_ids(int argc, char** argv) {
 
     if (argc == 2) {
@@ -110,31 +135,36 @@ int main_ids(int argc, char** argv) {
     }
 
     if (!join && mapping_name.empty()) {
-        VG* graph;
+        // Renumbering only needs the handle graph operations, so use the
+        // compact backend if it can hold the graph's paths. Otherwise (for
+        // instance with edited or partial mappings) use VG, which keeps them.
+        // Keep the input so we can read it again if we have to switch.
+        string input;
         get_input_file(optind, argc, argv, [&](istream& in) {
-            graph = new VG(in);
+            input.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
         });
 
-        if (sort) {
-            // Set up the nodes so we go through them in topological order
-            algorithms::sort(graph);
-        }
-
-        if (compact || sort) {
-            // Compact only, or compact to re-assign IDs after sort
-            graph->compact_ids();
+        PackedGraph* packed = nullptr;
+        try {
+            istringstream in(input);
+            packed = new PackedGraph(in);
+        } catch (UnsupportedPathError& e) {
+            // Fall back on VG below
         }
 
-        if (increment != 0) {
-            graph->increment_node_ids(increment);
+        if (packed != nullptr) {
+            string().swap(input);
+            renumber(packed, sort, compact, increment, decrement);
+            packed->serialize_to_ostream(std::cout);
+            delete packed;
+        } else {
+            istringstream in(input);
+            VG* graph = new VG(in);
+            string().swap(input);
+            renumber(graph, sort, compact, increment, decrement);
+            graph->serialize_to_ostream(std::cout);
+            delete graph;
         }
-
-        if (decrement != 0) {
-            graph->decrement_node_ids(decrement);
-        }
-
-        graph->serialize_to_ostream(std::cout);
-        delete graph;
     } else {
 
         vector<string> graph_file_names;
@@ -16,6 +16,7 @@
 #include "../utility.hpp"
 #include "../region.hpp"
 #include "../path_index.hpp"
+#include "../gam_index.hpp"
 
 #include <gcsa/gcsa.h>
 #include <gcsa/algorithms.h>
@@ -58,8 +59,12 @@ void help_index(char** argv) {
          << "    -X, --doubling-steps N use this number of doubling steps for GCSA2 construction (default " << gcsa::ConstructionParameters::DOUBLING_STEPS << ")" << endl
          << "    -Z, --size-limit N     limit temporary disk space usage to N gigabytes (default " << gcsa::ConstructionParameters::SIZE_LIMIT << ")" << endl
          << "    -V, --verify-index     validate the GCSA2 index using the input kmers (important for testing)" << endl
+         << "gam index options:" << endl
+         << "    -l, --gam-index FILE   input is .gam format sorted by vg gamsort, store the alignments" << endl
+         << "                           in a compressed, node-range indexed file for vg find -l" << endl
          << "rocksdb options:" << endl
          << "    -d, --db-name  <X>     store the RocksDB index in <X>" << endl
+         << "    -K, --store-kmers      input is .vg format, store its kmers of the size given with -k" << endl
          << "    -m, --store-mappings   input is .gam format, store the mappings in alignments by node" << endl
          << "    -a, --store-alignments input is .gam format, store the alignments by node" << endl
          << "    -A, --dump-alignments  graph contains alignments, output them in sorted order" << endl
@@ -128,7 +133,7 @@ int main_index(int argc, char** argv) {
     vector<string> dbg_names;
 
     // Files we should write.
-    string xg_name, gbwt_name, threads_name, gcsa_name, rocksdb_name;
+    string xg_name, gbwt_name, threads_name, gcsa_name, rocksdb_name, gam_index_name;
 
     // General
     bool show_progress = false;
@@ -149,6 +154,7 @@ int main_index(int argc, char** argv) {
     bool verify_gcsa = false;
 
     // RocksDB
+    bool index_kmers = false;
     bool dump_index = false;
     bool store_alignments = false;
     bool store_node_alignments = false;
@@ -194,8 +200,12 @@ int main_index(int argc, char** argv) {
             {"size-limit", required_argument, 0, 'Z'},
             {"verify-index", no_argument, 0, 'V'},
 
+            // GAM index
+            {"gam-index", required_argument, 0, 'l'},
+
             // RocksDB
             {"db-name", required_argument, 0, 'd'},
+            {"store-kmers", no_argument, 0, 'K'},
             {"store-mappings", no_argument, 0, 'm'},
             {"store-alignments", no_argument, 0, 'a'},
             {"dump-alignments", no_argument, 0, 'A'},
@@ -206,7 +216,7 @@ int main_index(int argc, char** argv) {
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "b:t:px:F:v:TG:H:B:R:r:I:Eo:g:i:f:k:X:Z:Vd:maANDP:CM:h",
+        c = getopt_long (argc, argv, "b:t:px:F:v:TG:H:B:R:r:I:Eo:g:i:f:k:X:Z:Vl:d:KmaANDP:CM:h",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -337,11 +347,19 @@ int main_index(int argc, char** argv) {
             verify_gcsa = true;
             break;
 
+        // GAM index
+        case 'l':
+            gam_index_name = optarg;
+            break;
+
         // RocksDB
         case 'd':
             build_rocksdb = true;
             rocksdb_name = optarg;
             break;
+        case 'K':
+            index_kmers = true;
+            break;
         case 'm':
             store_mappings = true;
             break;
@@ -378,7 +396,8 @@ int main_index(int argc, char** argv) {
         file_names.push_back(file_name);
     }
 
-    if (xg_name.empty() && gbwt_name.empty() && threads_name.empty() && gcsa_name.empty() && rocksdb_name.empty()) {
+    if (xg_name.empty() && gbwt_name.empty() && threads_name.empty() && gcsa_name.empty() && rocksdb_name.empty()
+        && gam_index_name.empty()) {
         cerr << "error: [vg index] index type not specified" << endl;
         return 1;
     }
@@ -1179,6 +1198,26 @@ int main_index(int argc, char** argv) {
         }
     }
 
+    if (!gam_index_name.empty()) {
+        if (file_names.empty()) {
+            cerr << "error: [vg index] at least one sorted GAM is required to build a GAM index" << endl;
+            return 1;
+        }
+        if (show_progress) {
+            cerr << "Writing GAM index to " << gam_index_name << endl;
+        }
+        GAMIndex::Writer writer(gam_index_name);
+        function<void(Alignment&)> lambda = [&writer](Alignment& aln) {
+            writer.add(aln);
+        };
+        for (auto& file_name : file_names) {
+            get_input_file(file_name, [&](istream& in) {
+                stream::for_each(in, lambda);
+            });
+        }
+        writer.finish();
+    }
+
     if (build_rocksdb) {
 
         Index index;
@@ -1190,6 +1229,25 @@ int main_index(int argc, char** argv) {
             index.close();
         }
 
+        bool store_graphs = !(store_node_alignments || store_alignments || store_mappings
+                              || dump_alignments || dump_index || compact);
+        if (store_graphs && file_names.size() > 0) {
+            // Bulk loading writes SST files and ingests them, so no compaction is needed afterward
+            index.open_for_bulk_load(rocksdb_name);
+            for (auto& file_name : file_names) {
+                get_input_file(file_name, [&](istream& in) {
+                    VG graph(in, show_progress);
+                    index.load_graph(graph);
+                    index.load_paths(graph);
+                    if (index_kmers) {
+                        index.load_kmers(graph, kmer_size);
+                    }
+                });
+            }
+            index.flush();
+            index.close();
+        }
+
         if (store_node_alignments && file_names.size() > 0) {
             index.open_for_bulk_load(rocksdb_name);
             int64_t aln_idx = 0;
@@ -4,6 +4,8 @@
 #include "../mapper.hpp"
 #include "../surjector.hpp"
 #include "../stream.hpp"
+#include "../threaded_io.hpp"
+#include "../hts_writer.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -75,7 +77,11 @@ void help_map(char** argv) {
          << "output:" << endl
          << "    -j, --output-json       output JSON rather than an alignment stream (helpful for debugging)" << endl
          << "    --surject-to TYPE       surject the output into the graph's paths, writing TYPE := bam |sam | cram" << endl
+         << "    --compression INT       compression level for surjected BAM or CRAM output [9]" << endl
+         << "    --compression-threads INT  use INT extra threads to compress surjected BAM or CRAM output [threads]" << endl
          << "    --buffer-size INT       buffer this many alignments together before outputting in GAM [512]" << endl
+         << "    --ordered-output        write alignments in the same order as the input reads" << endl
+         << "    --reorder-window INT    with --ordered-output, hold up to INT reads waiting for a slow one before giving up on order [65536]" << endl
          << "    -X, --compare           realign GAM input (-G), writing alignment with \"correct\" field set to overlap with input" << endl
          << "    -v, --refpos-table      for efficient testing output a table of name, chr, pos, mq, score" << endl
          << "    -K, --keep-secondary    produce alignments for secondary input alignments in addition to primary ones" << endl
@@ -93,6 +99,10 @@ int main_map(int argc, char** argv) {
     }
 
     #define OPT_SCORE_MATRIX 1000
+    #define OPT_ORDERED_OUTPUT 1001
+    #define OPT_REORDER_WINDOW 1002
+    #define OPT_COMPRESSION 1003
+    #define OPT_COMPRESSION_THREADS 1004
     string matrix_file_name;
     string seq;
     string qual;
@@ -128,6 +138,10 @@ int main_map(int argc, char** argv) {
     float mem_reseed_factor = 1.5;
     int max_target_factor = 100;
     int buffer_size = 512;
+    bool ordered_output = false;
+    size_t reorder_window = OrderedWriter<Alignment>::DEFAULT_REORDER_WINDOW;
+    int compress_level = 9;
+    int compression_threads = -1;
     int8_t match = default_match;
     int8_t mismatch = default_mismatch;
     int8_t gap_open = default_gap_open;
@@ -212,6 +226,10 @@ int main_map(int argc, char** argv) {
                 {"match", required_argument, 0, 'q'},
                 {"mismatch", required_argument, 0, 'z'},
                 {"score-matrix", required_argument, 0, OPT_SCORE_MATRIX},
+                {"ordered-output", no_argument, 0, OPT_ORDERED_OUTPUT},
+                {"reorder-window", required_argument, 0, OPT_REORDER_WINDOW},
+                {"compression", required_argument, 0, OPT_COMPRESSION},
+                {"compression-threads", required_argument, 0, OPT_COMPRESSION_THREADS},
                 {"gap-open", required_argument, 0, 'o'},
                 {"gap-extend", required_argument, 0, 'y'},
                 {"qual-adjust", no_argument, 0, 'A'},
@@ -442,6 +460,26 @@ int main_map(int argc, char** argv) {
             }
             break;
 
+        case OPT_ORDERED_OUTPUT:
+            ordered_output = true;
+            break;
+
+        case OPT_REORDER_WINDOW:
+            reorder_window = atoll(optarg);
+            break;
+
+        case OPT_COMPRESSION:
+            compress_level = atoi(optarg);
+            if (compress_level < 0 || compress_level > 9) {
+                cerr << "error:[vg map] Compression level must be between 0 and 9." << endl;
+                exit(1);
+            }
+            break;
+
+        case OPT_COMPRESSION_THREADS:
+            compression_threads = atoi(optarg);
+            break;
+
         case 'o':
             gap_open = atoi(optarg);
             break;
@@ -656,18 +694,23 @@ int main_map(int argc, char** argv) {
 
     vector<Mapper*> mapper;
     mapper.resize(thread_count);
-    vector<vector<Alignment> > output_buffer;
-    output_buffer.resize(thread_count);
+    // GAM output waiting to be written; only touched on the writer thread
+    vector<Alignment> output_buffer;
     vector<Alignment> empty_alns;
     
     // If we need to do surjection
     Surjector surjector(xgidx);
 
     // bam/sam/cram output
-    samFile* sam_out = 0;
-    int buffer_limit = 100;
-    bam_hdr_t* hdr = nullptr;
-    int compress_level = 9; // hard coded
+    // Records are made on the worker threads and written out and compressed by the writer
+    unique_ptr<HTSWriter> hts_writer;
+    if (!surject_type.empty()) {
+        if (compression_threads < 0) {
+            compression_threads = thread_count;
+        }
+        hts_writer.reset(new HTSWriter(surject_type, compress_level, compression_threads,
+                                       ordered_output, reorder_window));
+    }
     map<string, string> rg_sample;
     string sam_header;
     
@@ -688,46 +731,32 @@ int main_map(int argc, char** argv) {
     }
 
     // for SAM header generation
-    auto setup_sam_header = [&hdr, &sam_out, &surject_type, &compress_level, &xgidx, &rg_sample, &sam_header] (void) {
-#pragma omp critical (hts_header)
-        if (!hdr) {
-            char out_mode[5];
-            string out_format = "";
-            strcpy(out_mode, "w");
-            if (surject_type == "bam") { out_format = "b"; }
-            else if (surject_type == "cram") { out_format = "c"; }
-            else { out_format = ""; }
-            strcat(out_mode, out_format.c_str());
-            if (compress_level >= 0) {
-                char tmp[2];
-                tmp[0] = compress_level + '0'; tmp[1] = '\0';
-                strcat(out_mode, tmp);
-            }
+    auto setup_sam_header = [&hts_writer, &xgidx, &rg_sample, &sam_header] (void) {
+        hts_writer->ensure_header([&]() {
             map<string, int64_t> path_length;
             int num_paths = xgidx->max_path_rank();
             for (int i = 1; i <= num_paths; ++i) {
                 auto name = xgidx->path_name(i);
                 path_length[name] = xgidx->path_length(name);
             }
+            bam_hdr_t* hdr;
+#pragma omp critical (hts_header)
             hdr = hts_string_header(sam_header, path_length, rg_sample);
-            if ((sam_out = sam_open("-", out_mode)) == 0) {
-                cerr << "[vg map] failed to open stdout for writing HTS output" << endl;
-                exit(1);
-            } else {
-                // write the header
-                if (sam_hdr_write(sam_out, hdr) != 0) {
-                    cerr << "[vg map] error: failed to write the SAM header" << endl;
-                }
-            }
-        }
+            return hdr;
+        });
     };
 
     // TODO: Refactor the surjection code out of surject_main and intto somewhere where we can just use it here!
 
-    auto surject_alignments = [&hdr, &sam_header, &mapper, &rg_sample, &setup_sam_header, &path_names, &sam_out, &xgidx, &surjectors] (const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
+    auto surject_alignments = [&hts_writer, &sam_header, &mapper, &rg_sample, &setup_sam_header, &path_names, &xgidx, &surjectors] (const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
         
-        if (alns1.empty()) return;
+        if (alns1.empty()) {
+            // Let the writer know this read has nothing to say
+            hts_writer->emit(vector<bam1_t*>());
+            return;
+        }
         setup_sam_header();
+        vector<bam1_t*> records;
         vector<tuple<string, int64_t, bool, Alignment> > surjects1, surjects2;
         int tid = omp_get_thread_num();
         for (auto& aln : alns1) {
@@ -740,7 +769,7 @@ int main_map(int argc, char** argv) {
             surjects1.push_back(make_tuple(path_name, path_pos, path_reverse, surj));
             
             // hack: if we haven't established the header, we look at the reads to guess which read groups to put in it
-            if (!hdr && !surj.read_group().empty() && !surj.sample_name().empty()) {
+            if (!hts_writer->has_header() && !surj.read_group().empty() && !surj.sample_name().empty()) {
 #pragma omp critical (hts_header)
                 rg_sample[surj.read_group()] = surj.sample_name();
             }
@@ -778,11 +807,7 @@ int main_map(int argc, char** argv) {
                                              path_pos,
                                              path_reverse,
                                              cigar);
-                int r = 0;
-#pragma omp critical (cout)
-                r = sam_write1(sam_out, hdr, b);
-                if (r == 0) { cerr << "[vg map] error: writing to stdout failed" << endl; exit(1); }
-                bam_destroy1(b);
+                records.push_back(b);
             }
         } else {
             // Write out surjected paired-end reads
@@ -841,21 +866,15 @@ int main_map(int argc, char** argv) {
                                               path_pos1,
                                               template_length);
                 
-                // Write the records
-                int r = 0;
-#pragma omp critical (cout)
-                r = sam_write1(sam_out, hdr, b1);
-                if (r == 0) { cerr << "[vg map] error: writing to stdout failed" << endl; exit(1); }
-                bam_destroy1(b1);
-                r = 0;
-#pragma omp critical (cout)
-                r = sam_write1(sam_out, hdr, b2);
-                if (r == 0) { cerr << "[vg map] error: writing to stdout failed" << endl; exit(1); }
-                bam_destroy1(b2);
+                // Keep the mates together
+                records.push_back(b1);
+                records.push_back(b2);
             }
             
             
         }
+        
+        hts_writer->emit(std::move(records));
     };
 
     auto write_json = [](const vector<Alignment>& alns) {
@@ -879,43 +898,41 @@ int main_map(int argc, char** argv) {
         }
     };
 
-    // We have one function to dump alignments into
-    // Make sure to flush the buffer at the end of the program!
-    auto output_alignments = [&output_buffer,
-                              &output_json,
-                              &surject_type,
-                              &surject_alignments,
-                              &buffer_size,
-                              &refpos_table,
-                              &write_json,
-                              &write_refpos](const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
+    // All the alignment output goes through the writer thread, which is the
+    // only thing that touches cout while we are mapping
+    OrderedWriter<Alignment> alignment_writer([&output_buffer,
+                                               &output_json,
+                                               &buffer_size,
+                                               &refpos_table,
+                                               &write_json,
+                                               &write_refpos](vector<Alignment>& alns) {
         if (output_json) {
             // If we want to convert to JSON, convert them all to JSON and dump them to cout.
-#pragma omp critical (cout)
-            {
-                write_json(alns1);
-                write_json(alns2);
-            }
+            write_json(alns);
         } else if (refpos_table) {
-            // keep multi alignments ordered appropriately
-#pragma omp critical (cout)
-            {
-                write_refpos(alns1);
-                write_refpos(alns2);
-            }
-        } else if (!surject_type.empty()) {
+            write_refpos(alns);
+        } else {
+            // Otherwise write them through the buffer
+            std::move(alns.begin(), alns.end(), back_inserter(output_buffer));
+            stream::write_buffered(cout, output_buffer, buffer_size);
+        }
+    }, ordered_output, reorder_window);
+
+    // We have one function to dump alignments into
+    // Make sure to flush the writers at the end of the program!
+    auto output_alignments = [&alignment_writer,
+                              &surject_type,
+                              &surject_alignments](const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
+        if (!surject_type.empty()) {
             // surject
             surject_alignments(alns1, alns2);
         } else {
-            // Otherwise write them through the buffer for our thread
-            int tid = omp_get_thread_num();
-            auto& output_buf = output_buffer[tid];
-
-            // Copy all the alignments over to the output buffer
-            copy(alns1.begin(), alns1.end(), back_inserter(output_buf));
-            copy(alns2.begin(), alns2.end(), back_inserter(output_buf));
-
-            stream::write_buffered(cout, output_buf, buffer_size);
+            // Keep the mates of a pair together, in order
+            vector<Alignment> alns;
+            alns.reserve(alns1.size() + alns2.size());
+            copy(alns1.begin(), alns1.end(), back_inserter(alns));
+            copy(alns2.begin(), alns2.end(), back_inserter(alns));
+            alignment_writer.emit(std::move(alns));
         }
     };
 
@@ -1007,36 +1024,32 @@ int main_map(int argc, char** argv) {
 
     if (!read_file.empty()) {
         ifstream in(read_file);
-        bool more_data = in.good();
-#pragma omp parallel shared(in)
-        {
+        // Make an alignment from each nonempty line
+        function<bool(Alignment&)> get_read = [&in](Alignment& unaligned) {
             string line;
-            int tid = omp_get_thread_num();
-            while (in.good()) {
-                line.clear();
-#pragma omp critical (readq)
-                {
-                    std::getline(in,line);
-                }
+            while (std::getline(in, line)) {
                 if (!line.empty()) {
-                    // Make an alignment
-                    Alignment unaligned;
+                    unaligned.Clear();
                     unaligned.set_sequence(line);
-
-                    vector<Alignment> alignments = mapper[tid]->align_multi(unaligned, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
-
-                    for(auto& alignment : alignments) {
-                        // Set the alignment metadata
-                        if (!sample_name.empty()) alignment.set_sample_name(sample_name);
-                        if (!read_group.empty()) alignment.set_read_group(read_group);
-                    }
-
-
-                    // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alignments, empty_alns);
+                    return true;
                 }
             }
-        }
+            return false;
+        };
+        function<void(Alignment&)> lambda = [&](Alignment& unaligned) {
+            int tid = omp_get_thread_num();
+            vector<Alignment> alignments = mapper[tid]->align_multi(unaligned, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
+
+            for(auto& alignment : alignments) {
+                // Set the alignment metadata
+                if (!sample_name.empty()) alignment.set_sample_name(sample_name);
+                if (!read_group.empty()) alignment.set_read_group(read_group);
+            }
+
+            // Output the alignments in JSON or protobuf as appropriate.
+            output_alignments(alignments, empty_alns);
+        };
+        unpaired_for_each_parallel(get_read, lambda);
     }
 
     if (!fasta_file.empty()) {
@@ -1061,6 +1074,7 @@ int main_map(int argc, char** argv) {
         };
 #pragma omp parallel for
         for (size_t i = 0; i < ref.index->sequenceNames.size(); ++i) {
+            InputSequenceScope sequence(i);
             auto& name = ref.index->sequenceNames[i];
             string seq = nonATGCNtoN(toUppercase(ref.getSequence(name)));
             align_seq(name, seq);
@@ -1082,6 +1096,7 @@ int main_map(int argc, char** argv) {
 
                     if(alignment.is_secondary() && !keep_secondary) {
                         // Skip over secondary alignments in the input; we don't want several output mappings for each input *mapping*.
+                        output_alignments(empty_alns, empty_alns);
                         return;
                     }
 
@@ -1121,6 +1136,7 @@ int main_map(int argc, char** argv) {
                  &pair_window,
                  &top_pairs_only,
                  &print_fragment_model,
+                 &empty_alns,
                  &output_func](Alignment& aln1, Alignment& aln2) {
                 auto our_mapper = mapper[omp_get_thread_num()];
                 bool queued_resolve_later = false;
@@ -1141,6 +1157,9 @@ int main_map(int argc, char** argv) {
                         }
                         our_mapper->imperfect_pairs_to_retry.clear();
                     }
+                } else {
+                    // The pair comes out later, out of order; don't hold up the ones after it
+                    output_alignments(empty_alns, empty_alns);
                 }
             };
             fastq_paired_interleaved_for_each_parallel(fastq1, lambda);
@@ -1204,6 +1223,7 @@ int main_map(int argc, char** argv) {
                  &pair_window,
                  &top_pairs_only,
                  &print_fragment_model,
+                 &empty_alns,
                  &output_func](Alignment& aln1, Alignment& aln2) {
                 auto our_mapper = mapper[omp_get_thread_num()];
                 bool queued_resolve_later = false;
@@ -1224,6 +1244,9 @@ int main_map(int argc, char** argv) {
                         }
                         our_mapper->imperfect_pairs_to_retry.clear();
                     }
+                } else {
+                    // The pair comes out later, out of order; don't hold up the ones after it
+                    output_alignments(empty_alns, empty_alns);
                 }
             };
             fastq_paired_two_files_for_each_parallel(fastq1, fastq2, lambda);
@@ -1280,6 +1303,7 @@ int main_map(int argc, char** argv) {
                  &pair_window,
                  &top_pairs_only,
                  &print_fragment_model,
+                 &empty_alns,
                  &output_func](Alignment& aln1, Alignment& aln2) {
                 auto our_mapper = mapper[omp_get_thread_num()];
                 bool queued_resolve_later = false;
@@ -1300,6 +1324,9 @@ int main_map(int argc, char** argv) {
                         }
                         our_mapper->imperfect_pairs_to_retry.clear();
                     }
+                } else {
+                    // The pair comes out later, out of order; don't hold up the ones after it
+                    output_alignments(empty_alns, empty_alns);
                 }
             };
             stream::for_each_interleaved_pair_parallel(gam_in, lambda);
@@ -1357,19 +1384,22 @@ int main_map(int argc, char** argv) {
         }
     }
 
+    // wait for the writers to catch up
+    alignment_writer.finish();
+    if (!output_json && !refpos_table && surject_type.empty()) {
+        stream::write_buffered(cout, output_buffer, 0);
+    }
+
     // clean up
     for (int i = 0; i < thread_count; ++i) {
         delete mapper[i];
-        auto& output_buf = output_buffer[i];
-        if (!output_json && !refpos_table && surject_type.empty()) {
-            stream::write_buffered(cout, output_buf, 0);
-        }
     }
 
     // special cleanup for htslib outputs
     if (!surject_type.empty()) {
-        if (hdr != nullptr) bam_hdr_destroy(hdr);
-        sam_close(sam_out);
+        // Even with no reads we want a valid file
+        setup_sam_header();
+        hts_writer->close();
         cout.flush();
     }
     
@@ -10,6 +10,7 @@
 
 #include "../multipath_mapper.hpp"
 #include "../path.hpp"
+#include "../threaded_io.hpp"
 
 //#define record_read_run_times
 
@@ -83,7 +84,10 @@ void help_mpmap(char** argv) {
     << "  -m, --remove-bonuses      remove full length alignment bonuses in reported scores" << endl
     << "computational parameters:" << endl
     << "  -t, --threads INT         number of compute threads to use" << endl
-    << "  -Z, --buffer-size INT     buffer this many alignments together (per compute thread) before outputting to stdout [100]" << endl;
+    << "  -Z, --buffer-size INT     buffer this many alignments together before outputting to stdout [100]" << endl
+    << "      --ordered-output      write alignments in the same order as the input reads (except pairs mapped before" << endl
+    << "                            the fragment length distribution is known, which come at the end)" << endl
+    << "      --reorder-window INT  with --ordered-output, hold up to INT reads waiting for a slow one before giving up on order [65536]" << endl;
     
 }
 
@@ -96,6 +100,8 @@ int main_mpmap(int argc, char** argv) {
 
     // initialize parameters with their default options
     #define OPT_SCORE_MATRIX 1000
+    #define OPT_ORDERED_OUTPUT 1001
+    #define OPT_REORDER_WINDOW 1002
     string matrix_file_name;
     string xg_name;
     string gcsa_name;
@@ -123,6 +129,8 @@ int main_mpmap(int argc, char** argv) {
     int localization_max_paths = 5;
     int max_num_mappings = 1;
     int buffer_size = 100;
+    bool ordered_output = false;
+    size_t reorder_window = OrderedWriter<Alignment>::DEFAULT_REORDER_WINDOW;
     int hit_max = 1024;
     int min_mem_length = 1;
     int min_clustering_mem_length = 0;
@@ -210,6 +218,8 @@ int main_mpmap(int argc, char** argv) {
             {"match", required_argument, 0, 'q'},
             {"mismatch", required_argument, 0, 'z'},
             {"score-matrix", required_argument, 0, OPT_SCORE_MATRIX},
+            {"ordered-output", no_argument, 0, OPT_ORDERED_OUTPUT},
+            {"reorder-window", required_argument, 0, OPT_REORDER_WINDOW},
             {"gap-open", required_argument, 0, 'o'},
             {"gap-extend", required_argument, 0, 'y'},
             {"full-l-bonus", required_argument, 0, 'L'},
@@ -489,6 +499,14 @@ int main_mpmap(int argc, char** argv) {
                 buffer_size = atoi(optarg);
                 break;
                 
+            case OPT_ORDERED_OUTPUT:
+                ordered_output = true;
+                break;
+                
+            case OPT_REORDER_WINDOW:
+                reorder_window = atoll(optarg);
+                break;
+                
             case 'h':
             case '?':
             default:
@@ -872,12 +890,23 @@ int main_mpmap(int argc, char** argv) {
     // during distribution estimation
     vector<pair<Alignment, Alignment>> ambiguous_pair_buffer;
     
-    vector<vector<Alignment> > single_path_output_buffer(thread_count);
-    vector<vector<MultipathAlignment> > multipath_output_buffer(thread_count);
+    // output waiting to be written; only touched on the writer threads
+    vector<Alignment> single_path_output_buffer;
+    vector<MultipathAlignment> multipath_output_buffer;
+    
+    // the workers hand their output to these, which write it to stdout on their own threads
+    OrderedWriter<Alignment> single_path_writer([&](vector<Alignment>& alns) {
+        std::move(alns.begin(), alns.end(), back_inserter(single_path_output_buffer));
+        stream::write_buffered(cout, single_path_output_buffer, buffer_size);
+    }, ordered_output, reorder_window);
+    OrderedWriter<MultipathAlignment> multipath_writer([&](vector<MultipathAlignment>& mp_alns) {
+        std::move(mp_alns.begin(), mp_alns.end(), back_inserter(multipath_output_buffer));
+        stream::write_buffered(cout, multipath_output_buffer, buffer_size);
+    }, ordered_output, reorder_window);
     
     // write unpaired multipath alignments to stdout buffer
     auto output_multipath_alignments = [&](vector<MultipathAlignment>& mp_alns) {
-        auto& output_buf = multipath_output_buffer[omp_get_thread_num()];
+        vector<MultipathAlignment> output_buf;
         
         // move all the alignments over to the output buffer
         for (MultipathAlignment& mp_aln : mp_alns) {
@@ -892,12 +921,12 @@ int main_mpmap(int argc, char** argv) {
             }
         }
         
-        stream::write_buffered(cout, output_buf, buffer_size);
+        multipath_writer.emit(std::move(output_buf));
     };
     
     // convert to unpaired single path alignments and write stdout buffer
     auto output_single_path_alignments = [&](vector<MultipathAlignment>& mp_alns) {
-        auto& output_buf = single_path_output_buffer[omp_get_thread_num()];
+        vector<Alignment> output_buf;
         // add optimal alignments to the output buffer
         for (MultipathAlignment& mp_aln : mp_alns) {
             // For each multipath alignment, get the greedy nonoverlapping
@@ -926,12 +955,12 @@ int main_mpmap(int argc, char** argv) {
             }
         }
         
-        stream::write_buffered(cout, output_buf, buffer_size);
+        single_path_writer.emit(std::move(output_buf));
     };
     
     // write paired multipath alignments to stdout buffer
     auto output_multipath_paired_alignments = [&](vector<pair<MultipathAlignment, MultipathAlignment>>& mp_aln_pairs) {
-        auto& output_buf = multipath_output_buffer[omp_get_thread_num()];
+        vector<MultipathAlignment> output_buf;
         
         // move all the alignments over to the output buffer
         for (pair<MultipathAlignment, MultipathAlignment>& mp_aln_pair : mp_aln_pairs) {
@@ -965,12 +994,12 @@ int main_mpmap(int argc, char** argv) {
             }
         }
         
-        stream::write_buffered(cout, output_buf, buffer_size);
+        multipath_writer.emit(std::move(output_buf));
     };
     
     // convert to paired single path alignments and write stdout buffer
     auto output_single_path_paired_alignments = [&](vector<pair<MultipathAlignment, MultipathAlignment>>& mp_aln_pairs) {
-        auto& output_buf = single_path_output_buffer[omp_get_thread_num()];
+        vector<Alignment> output_buf;
         
         // add optimal alignments to the output buffer
         for (pair<MultipathAlignment, MultipathAlignment>& mp_aln_pair : mp_aln_pairs) {
@@ -1029,7 +1058,7 @@ int main_mpmap(int argc, char** argv) {
             // arbitrarily decide that this is the "next" fragment
             output_buf.back().mutable_fragment_prev()->set_name(mp_aln_pair.first.name());
         }
-        stream::write_buffered(cout, output_buf, buffer_size);
+        single_path_writer.emit(std::move(output_buf));
     };
     
     // do unpaired multipath alignment and write to buffer
@@ -1196,13 +1225,10 @@ int main_mpmap(int argc, char** argv) {
     }
     
     // flush output buffers
-    for (int i = 0; i < thread_count; i++) {
-        vector<Alignment>& single_path_buffer = single_path_output_buffer[i];
-        stream::write_buffered(cout, single_path_buffer, 0);
-        
-        vector<MultipathAlignment>& multipath_buffer = multipath_output_buffer[i];
-        stream::write_buffered(cout, multipath_buffer, 0);
-    }
+    single_path_writer.finish();
+    multipath_writer.finish();
+    stream::write_buffered(cout, single_path_output_buffer, 0);
+    stream::write_buffered(cout, multipath_output_buffer, 0);
     cout.flush();
     
 #ifdef record_read_run_times
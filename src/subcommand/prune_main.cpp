@@ -17,7 +17,9 @@
  * can be used for building a GCSA2 index that maps to the original graph.
  */
 
+#include "../packed_graph.hpp"
 #include "../phase_unfolder.hpp"
+#include "../prune.hpp"
 #include "subcommand.hpp"
 
 #include <gbwt/gbwt.h>
@@ -299,6 +301,37 @@ int main_prune(int argc, char** argv) {
         return 0;
     }
 
+    // Plain pruning only edits the graph, so it can use the compact backend.
+    if (mode == mode_prune) {
+        PackedGraph* packed = nullptr;
+        get_input_file(optind, argc, argv, [&](std::istream& in) {
+            packed = new PackedGraph(in, false);
+        });
+        if (show_progress) {
+            std::cerr << "Original graph " << vg_name << ": " << packed->node_size() << " nodes, " << packed->edge_size() << " edges" << std::endl;
+        }
+        if (show_progress) {
+            std::cerr << "Removed all paths" << std::endl;
+        }
+        prune_complex_with_head_tail(*packed, kmer_length, edge_max);
+        if (show_progress) {
+            std::cerr << "Pruned complex regions: "
+                      << packed->node_size() << " nodes, " << packed->edge_size() << " edges" << std::endl;
+        }
+        prune_short_subgraphs(*packed, subgraph_min);
+        if (show_progress) {
+            std::cerr << "Removed small subgraphs: "
+                      << packed->node_size() << " nodes, " << packed->edge_size() << " edges" << std::endl;
+        }
+        packed->serialize_to_ostream(std::cout);
+        if (show_progress) {
+            std::cerr << "Serialized the graph: "
+                      << packed->node_size() << " nodes, " << packed->edge_size() << " edges" << std::endl;
+        }
+        delete packed; packed = nullptr;
+        return 0;
+    }
+
     // Handle the input.
     VG* graph;
     xg::XG xg_index;
@@ -10,6 +10,9 @@
 
 #include <list>
 #include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
 
 #include "subcommand.hpp"
 
@@ -42,7 +45,60 @@ void help_sim(char** argv) {
          << "    -v, --frag-std-dev FLOAT    use this standard deviation for fragment length estimation" << endl
          << "    -N, --allow-Ns              allow reads to be sampled from the graph with Ns in them" << endl
          << "    -a, --align-out             generate true alignments on stdout rather than reads" << endl
-         << "    -J, --json-out              write alignments in json" << endl;
+         << "    -J, --json-out              write alignments in json" << endl
+         << "    -t, --threads N             number of threads to use" << endl;
+}
+
+/// Get a nonzero seed for the random stream of one chunk of reads, so that the
+/// reads only depend on the seed given and not on the threads. The first chunk
+/// uses the seed itself, so small runs come out as they did with one stream.
+static size_t chunk_seed(int seed_val, size_t chunk) {
+    if (chunk == 0 && seed_val != 0) {
+        return (uint32_t) seed_val;
+    }
+    seed_seq seq{(uint32_t) seed_val, (uint32_t) chunk, (uint32_t) (chunk >> 32)};
+    uint32_t seed;
+    seq.generate(&seed, &seed + 1);
+    return seed ? seed : 1;
+}
+
+/// Simulate num_reads reads in chunks of chunk_reads on all the threads, and
+/// write the output for each chunk to cout in order. simulate_chunk is given
+/// the chunk number, the number of its first read, its number of reads, and
+/// the string to put its output in.
+static void simulate_in_chunks(size_t num_reads, size_t chunk_reads,
+                               const function<void(size_t, size_t, size_t, string&)>& simulate_chunk) {
+    
+    size_t chunk_count = (num_reads + chunk_reads - 1) / chunk_reads;
+    // chunks to have in flight at once
+    const size_t wave_size = 4 * omp_get_max_threads();
+    
+    // the output of the previous wave, waiting to be written
+    vector<string> ready;
+    for (size_t wave_start = 0; wave_start < chunk_count || !ready.empty(); wave_start += wave_size) {
+        size_t wave_end = min(wave_start + wave_size, chunk_count);
+        vector<string> output(wave_end > wave_start ? wave_end - wave_start : 0);
+        
+#pragma omp parallel
+        {
+#pragma omp single nowait
+            {
+                // write out the previous wave in order
+                for (auto& data : ready) {
+                    cout.write(data.data(), data.size());
+                }
+            }
+            
+#pragma omp for schedule(dynamic, 1) nowait
+            for (size_t i = 0; i < output.size(); i++) {
+                size_t first_read = (wave_start + i) * chunk_reads;
+                simulate_chunk(wave_start + i, first_read, min(chunk_reads, num_reads - first_read), output[i]);
+            }
+        }
+        
+        ready = move(output);
+    }
+    cout.flush();
 }
 
 int main_sim(int argc, char** argv) {
@@ -95,11 +151,12 @@ int main_sim(int argc, char** argv) {
             {"scale-err", required_argument, 0, 'S'},
             {"frag-len", required_argument, 0, 'p'},
             {"frag-std-dev", required_argument, 0, 'v'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hl:n:s:e:i:fax:Jp:v:Nd:F:P:S:I",
+        c = getopt_long (argc, argv, "hl:n:s:e:i:fax:Jp:v:Nd:F:P:S:It:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -178,6 +235,10 @@ int main_sim(int argc, char** argv) {
             fragment_std_dev = atof(optarg);
             break;
             
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+            
         case 'h':
         case '?':
             help_sim(argv);
@@ -194,9 +255,6 @@ int main_sim(int argc, char** argv) {
         return 1;
     }
 
-    mt19937 rng;
-    rng.seed(seed_val);
-
     xg::XG* xgidx = nullptr;
     ifstream xg_stream(xg_name);
     if(xg_stream) {
@@ -213,117 +271,121 @@ int main_sim(int argc, char** argv) {
             return 1;
         }
     }
-
-    // Make a sample to sample reads with
-    Sampler sampler(xgidx, seed_val, forward_only, reads_may_contain_Ns);
     
-    // Make a Mapper to score reads, with the default parameters
-    Mapper rescorer(xgidx, nullptr, nullptr);
-    // We define a function to score a generated alignment under the mapper
-    auto rescore = [&] (Alignment& aln) {
-        // Score using exact distance.
-        aln.set_score(rescorer.score_alignment(aln, false));
+    // Reads are simulated in chunks of this many, each with its own random
+    // stream, and written out in order
+    size_t chunk_reads = 1000;
+    
+    // Turn a chunk's reads into output
+    auto format_chunk = [&](vector<Alignment>& alns, bool paired, string& output) {
+        stringstream out;
+        if (align_out) {
+            if (json_out) {
+                for (auto& aln : alns) {
+                    out << pb2json(aln) << endl;
+                }
+            } else {
+                function<Alignment(uint64_t)> lambda = [&alns](uint64_t n) { return alns[n]; };
+                stream::write(out, alns.size(), lambda);
+            }
+        } else if (paired) {
+            for (size_t i = 0; i + 1 < alns.size(); i += 2) {
+                out << alns[i].sequence() << "\t" << alns[i + 1].sequence() << endl;
+            }
+        } else {
+            for (auto& aln : alns) {
+                out << aln.sequence() << endl;
+            }
+        }
+        output = out.str();
     };
     
     if (fastq_name.empty()) {
         // Use the fixed error rate sampler
         
-        // Make a sample to sample reads with
-        Sampler sampler(xgidx, seed_val, forward_only, reads_may_contain_Ns, path_names);
-        
-        // Make a Mapper to score reads, with the default parameters
-        Mapper rescorer(xgidx, nullptr, nullptr);
-        // Override the "default" full length bonus, just like every other subcommand that uses a mapper ends up doing.
-        // TODO: is it safe to change the default?
-        rescorer.set_alignment_scores(default_match, default_mismatch, default_gap_open, default_gap_extension, default_full_length_bonus);
-        // Include the full length bonuses if requested.
-        rescorer.strip_bonuses = strip_bonuses;
+        // Make a Mapper for each thread to score reads, with the default parameters
+        vector<unique_ptr<Mapper>> rescorers;
+        for (int i = 0; i < omp_get_max_threads(); i++) {
+            rescorers.emplace_back(new Mapper(xgidx, nullptr, nullptr));
+            // Override the "default" full length bonus, just like every other subcommand that uses a mapper ends up doing.
+            // TODO: is it safe to change the default?
+            rescorers.back()->set_alignment_scores(default_match, default_mismatch, default_gap_open, default_gap_extension, default_full_length_bonus);
+            // Include the full length bonuses if requested.
+            rescorers.back()->strip_bonuses = strip_bonuses;
+        }
         // We define a function to score a generated alignment under the mapper
         auto rescore = [&] (Alignment& aln) {
             // Score using exact distance.
-            aln.set_score(rescorer.score_alignment(aln, false));
+            aln.set_score(rescorers[omp_get_thread_num()]->score_alignment(aln, false));
         };
         
         size_t max_iter = 1000;
-        int nonce = 1;
-        for (int i = 0; i < num_reads; ++i) {
-            // For each read we are going to generate
+        simulate_in_chunks(num_reads, chunk_reads, [&](size_t chunk, size_t first_read, size_t count, string& output) {
+            // Make a sampler to sample this chunk's reads with, numbering them
+            // as if they came from one sampler
+            Sampler sampler(xgidx, chunk_seed(seed_val, chunk), forward_only, reads_may_contain_Ns, path_names);
+            sampler.nonce = first_read;
             
-            if (fragment_length) {
-                // fragment_lenght is nonzero so make it two paired reads
-                auto alns = sampler.alignment_pair(read_length, fragment_length, fragment_std_dev, base_error, indel_error);
+            vector<Alignment> alns;
+            for (size_t i = 0; i < count; ++i) {
+                // For each read we are going to generate
                 
-                size_t iter = 0;
-                while (iter++ < max_iter) {
-                    // For up to max_iter iterations
-                    if (alns.front().sequence().size() < read_length
-                        || alns.back().sequence().size() < read_length) {
-                        // If our read was too short, try again
-                        alns = sampler.alignment_pair(read_length, fragment_length, fragment_std_dev, base_error, indel_error);
-                    }
-                }
-                
-                // write the alignment or its string
-                if (align_out) {
-                    // write it out as requested
+                if (fragment_length) {
+                    // fragment_lenght is nonzero so make it two paired reads
+                    auto read_pair = sampler.alignment_pair(read_length, fragment_length, fragment_std_dev, base_error, indel_error);
                     
-                    // We will need scores
-                    rescore(alns.front());
-                    rescore(alns.back());
+                    size_t iter = 0;
+                    while (iter++ < max_iter) {
+                        // For up to max_iter iterations
+                        if (read_pair.front().sequence().size() < read_length
+                            || read_pair.back().sequence().size() < read_length) {
+                            // If our read was too short, try again
+                            read_pair = sampler.alignment_pair(read_length, fragment_length, fragment_std_dev, base_error, indel_error);
+                        }
+                    }
                     
-                    if (json_out) {
-                        cout << pb2json(alns.front()) << endl;
-                        cout << pb2json(alns.back()) << endl;
-                    } else {
-                        function<Alignment(uint64_t)> lambda = [&alns](uint64_t n) { return alns[n]; };
-                        stream::write(cout, 2, lambda);
+                    if (align_out) {
+                        // We will need scores
+                        rescore(read_pair.front());
+                        rescore(read_pair.back());
                     }
+                    alns.emplace_back(move(read_pair.front()));
+                    alns.emplace_back(move(read_pair.back()));
                 } else {
-                    cout << alns.front().sequence() << "\t" << alns.back().sequence() << endl;
-                }
-            } else {
-                // Do single-end reads
-                auto aln = sampler.alignment_with_error(read_length, base_error, indel_error);
-                
-                size_t iter = 0;
-                while (iter++ < max_iter) {
-                    // For up to max_iter iterations
-                    if (aln.sequence().size() < read_length) {
-                        // If our read is too short, try again
-                        auto aln_prime = sampler.alignment_with_error(read_length, base_error, indel_error);
-                        if (aln_prime.sequence().size() > aln.sequence().size()) {
-                            // But only keep the new try if it is longer
-                            aln = aln_prime;
+                    // Do single-end reads
+                    auto aln = sampler.alignment_with_error(read_length, base_error, indel_error);
+                    
+                    size_t iter = 0;
+                    while (iter++ < max_iter) {
+                        // For up to max_iter iterations
+                        if (aln.sequence().size() < read_length) {
+                            // If our read is too short, try again
+                            auto aln_prime = sampler.alignment_with_error(read_length, base_error, indel_error);
+                            if (aln_prime.sequence().size() > aln.sequence().size()) {
+                                // But only keep the new try if it is longer
+                                aln = aln_prime;
+                            }
                         }
                     }
-                }
-                
-                // write the alignment or its string
-                if (align_out) {
-                    // write it out as requested
                     
-                    // We will need scores
-                    rescore(aln);
-                    
-                    if (json_out) {
-                        cout << pb2json(aln) << endl;
-                    } else {
-                        function<Alignment(uint64_t)> lambda = [&aln](uint64_t n) { return aln; };
-                        stream::write(cout, 1, lambda);
+                    if (align_out) {
+                        // We will need scores
+                        rescore(aln);
                     }
-                } else {
-                    cout << aln.sequence() << endl;
+                    alns.emplace_back(move(aln));
                 }
             }
-        }
-        
+            
+            format_chunk(alns, fragment_length, output);
+        });
     }
     else {
         // Use the trained error rate
         
         Aligner aligner(default_match, default_mismatch, default_gap_open, default_gap_extension, 5);
         
-        NGSSimulator sampler(*xgidx,
+        // Train the error model once; the chunks' simulators all share it
+        NGSSimulator trained(*xgidx,
                              fastq_name,
                              interleaved,
                              path_names,
@@ -336,50 +398,27 @@ int main_sim(int argc, char** argv) {
                              !reads_may_contain_Ns,
                              seed_val);
         
-        if (fragment_length) {
-            for (size_t i = 0; i < num_reads; i++) {
-                pair<Alignment, Alignment> read_pair = sampler.sample_read_pair();
-                read_pair.first.set_score(aligner.score_ungapped_alignment(read_pair.first, strip_bonuses));
-                read_pair.second.set_score(aligner.score_ungapped_alignment(read_pair.second, strip_bonuses));
-                
-                if (align_out) {
-                    if (json_out) {
-                        cout << pb2json(read_pair.first) << endl;
-                        cout << pb2json(read_pair.second) << endl;
-                    }
-                    else {
-                        function<Alignment(uint64_t)> lambda = [&read_pair](uint64_t n) {
-                            return n % 2 == 0 ? read_pair.first : read_pair.second;
-                        };
-                        stream::write(cout, 2, lambda);
-                    }
-                }
-                else {
-                    cout << read_pair.first.sequence() << "\t" << read_pair.second.sequence() << endl;
-                }
-            }
-        }
-        else {
-            for (size_t i = 0; i < num_reads; i++) {
-                Alignment read = sampler.sample_read();
-                read.set_score(aligner.score_ungapped_alignment(read, strip_bonuses));
-                
-                if (align_out) {
-                    if (json_out) {
-                        cout << pb2json(read) << endl;
-                    }
-                    else {
-                        function<Alignment(uint64_t)> lambda = [&read](uint64_t n) {
-                            return read;
-                        };
-                        stream::write(cout, 1, lambda);
-                    }
+        simulate_in_chunks(num_reads, chunk_reads, [&](size_t chunk, size_t first_read, size_t count, string& output) {
+            NGSSimulator sampler(trained, chunk_seed(seed_val, chunk), first_read);
+            
+            vector<Alignment> alns;
+            for (size_t i = 0; i < count; i++) {
+                if (fragment_length) {
+                    pair<Alignment, Alignment> read_pair = sampler.sample_read_pair();
+                    read_pair.first.set_score(aligner.score_ungapped_alignment(read_pair.first, strip_bonuses));
+                    read_pair.second.set_score(aligner.score_ungapped_alignment(read_pair.second, strip_bonuses));
+                    alns.emplace_back(move(read_pair.first));
+                    alns.emplace_back(move(read_pair.second));
                 }
                 else {
-                    cout << read.sequence() << endl;
+                    Alignment read = sampler.sample_read();
+                    read.set_score(aligner.score_ungapped_alignment(read, strip_bonuses));
+                    alns.emplace_back(move(read));
                 }
             }
-        }
+            
+            format_chunk(alns, fragment_length, output);
+        });
     }
     
 
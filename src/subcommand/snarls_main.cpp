@@ -13,6 +13,7 @@
 #include "../vg.hpp"
 #include "vg.pb.h"
 #include "../traversal_finder.hpp"
+#include "../algorithms/topological_sort.hpp"
 
 
 using namespace std;
@@ -28,6 +29,9 @@ void help_snarl(char** argv) {
          << "    -l, --leaf-only        restrict traversals to leaf ultrabubbles." << endl
          << "    -o, --top-level        restrict traversals to top level ultrabubbles" << endl
          << "    -m, --max-nodes N      only compute traversals for snarls with <= N nodes [10]" << endl
+         << "    -n, --max-traversals N stop after finding N traversals of a snarl [unlimited]" << endl
+         << "    -b, --max-steps N      stop after N search steps in a snarl [unlimited]" << endl
+         << "    -T, --threads N        find traversals of N snarls at once [numCPUs]" << endl
          << "    -t, --include-trivial  report snarls that consist of a single edge" << endl
          << "    -s, --sort-snarls      return snarls in sorted order by node ID (for topologically ordered graphs)" << endl;
 }
@@ -45,6 +49,8 @@ int main_snarl(int argc, char** argv) {
     bool leaf_only = false;
     bool top_level_only = false;
     int max_nodes = 10;
+    size_t max_traversals = 0;
+    size_t max_steps = 0;
     bool filter_trivial_snarls = true;
     bool sort_snarls = false;
     bool fill_path_names = false;
@@ -59,6 +65,9 @@ int main_snarl(int argc, char** argv) {
                 {"leaf-only", no_argument, 0, 'l'},
                 {"top-level", no_argument, 0, 'o'},
                 {"max-nodes", required_argument, 0, 'm'},
+                {"max-traversals", required_argument, 0, 'n'},
+                {"max-steps", required_argument, 0, 'b'},
+                {"threads", required_argument, 0, 'T'},
                 {"include-trivial", no_argument, 0, 't'},
                 {"sort-snarls", no_argument, 0, 's'},
                 {0, 0, 0, 0}
@@ -66,7 +75,7 @@ int main_snarl(int argc, char** argv) {
 
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "sr:ltopm:h?",
+        c = getopt_long (argc, argv, "sr:ltopm:n:b:T:h?",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -92,6 +101,18 @@ int main_snarl(int argc, char** argv) {
             max_nodes = atoi(optarg);
             break;
             
+        case 'n':
+            max_traversals = atoi(optarg);
+            break;
+            
+        case 'b':
+            max_steps = atoi(optarg);
+            break;
+            
+        case 'T':
+            omp_set_num_threads(atoi(optarg));
+            break;
+            
         case 't':
             filter_trivial_snarls = false;
             break;
@@ -138,13 +159,18 @@ int main_snarl(int argc, char** argv) {
         exit(1);
     }
 
-    // The only implemented snarl finder:
-    SnarlFinder* snarl_finder = new CactusSnarlFinder(*graph);
+    // Sort the graph, so the decomposition is rooted the same way as with a
+    // CactusSnarlFinder
+    algorithms::sort(graph);
+
+    // Find snarls one connected component at a time, without a second copy
+    // of the whole graph
+    HandleGraphSnarlFinder* snarl_finder = new HandleGraphSnarlFinder(graph, for_each_vg_path(*graph));
     
-    // Load up all the snarls
-    SnarlManager snarl_manager = snarl_finder->find_snarls();
-    vector<const Snarl*> snarl_roots = snarl_manager.top_level_snarls();
     if (fill_path_names){
+        // Load up all the snarls
+        SnarlManager snarl_manager = snarl_finder->find_snarls();
+        vector<const Snarl*> snarl_roots = snarl_manager.top_level_snarls();
         TraversalFinder* trav_finder = new PathBasedTraversalFinder(*graph, snarl_manager);
         for (const Snarl* snarl : snarl_roots ){
             if (filter_trivial_snarls) {
@@ -166,98 +192,124 @@ int main_snarl(int argc, char** argv) {
     }
 
 
-    TraversalFinder* trav_finder = new ExhaustiveTraversalFinder(*graph, snarl_manager);
-    
-    // Sort the top level Snarls
-    if (sort_snarls) {
-        // Ensure that all snarls are stored in sorted order
-        list<const Snarl*> snarl_stack;
-        for (const Snarl* root : snarl_roots) {
-            snarl_stack.push_back(root);
-            while (!snarl_stack.empty()) {
-                const Snarl* snarl = snarl_stack.back();
-                snarl_stack.pop_back();
-                if (snarl->start().node_id() > snarl->end().node_id()) {
-                    snarl_manager.flip(snarl);
-                }
-                for (const Snarl* child_snarl : snarl_manager.children_of(snarl)) {
-                    snarl_stack.push_back(child_snarl);
-                }
-            }
-        }
-        
-        // Sort the snarls by node ID
-        std::sort(snarl_roots.begin(), snarl_roots.end(), [](const Snarl* snarl_1, const Snarl* snarl_2) {
-            return snarl_1->start().node_id() < snarl_2->end().node_id();
-        });
-    }
-
-  
-
     // Protobuf output buffers
     vector<Snarl> snarl_buffer;
     vector<SnarlTraversal> traversal_buffer;
     
-    list<const Snarl*> stack;
-
-    for (const Snarl* root : snarl_roots) {
+    // Write out the snarls, and maybe traversals, from one SnarlManager
+    auto write_snarls = [&](SnarlManager& snarl_manager) {
+        vector<const Snarl*> snarl_roots = snarl_manager.top_level_snarls();
+        ExhaustiveTraversalFinder trav_finder(*graph, snarl_manager, false, max_traversals, max_steps);
         
-        stack.push_back(root);
+        // Ultrabubbles whose traversals we still need to find and write, in
+        // output order
+        vector<const Snarl*> trav_sites;
+        auto write_traversals = [&]() {
+            vector<vector<SnarlTraversal>> site_travs = trav_finder.find_traversals(trav_sites);
+            for (auto& travs : site_travs) {
+                traversal_buffer.insert(traversal_buffer.end(), travs.begin(), travs.end());
+                stream::write_buffered(trav_stream, traversal_buffer, buffer_size);
+            }
+            trav_sites.clear();
+        };
         
-        while (!stack.empty()) {
-            const Snarl* snarl = stack.back();
-            stack.pop_back();
-            
-            if (filter_trivial_snarls) {
-                auto contents = snarl_manager.shallow_contents(snarl, *graph, false);
-                if (contents.first.empty()) {
-                    // Nothing but the boundary nodes in this snarl
-                    continue;
+        // Sort the top level Snarls
+        if (sort_snarls) {
+            // Ensure that all snarls are stored in sorted order
+            list<const Snarl*> snarl_stack;
+            for (const Snarl* root : snarl_roots) {
+                snarl_stack.push_back(root);
+                while (!snarl_stack.empty()) {
+                    const Snarl* snarl = snarl_stack.back();
+                    snarl_stack.pop_back();
+                    if (snarl->start().node_id() > snarl->end().node_id()) {
+                        snarl_manager.flip(snarl);
+                    }
+                    for (const Snarl* child_snarl : snarl_manager.children_of(snarl)) {
+                        snarl_stack.push_back(child_snarl);
+                    }
                 }
             }
             
-            // Write our snarl tree
-            snarl_buffer.push_back(*snarl);
-            stream::write_buffered(cout, snarl_buffer, buffer_size);
+            // Sort the snarls by node ID
+            std::sort(snarl_roots.begin(), snarl_roots.end(), [](const Snarl* snarl_1, const Snarl* snarl_2) {
+                return snarl_1->start().node_id() < snarl_2->end().node_id();
+            });
+        }
+
+
+        list<const Snarl*> stack;
+
+        for (const Snarl* root : snarl_roots) {
+            
+            stack.push_back(root);
             
-            // Optionally write our traversals
-            if (!traversal_file.empty() && snarl->type() == ULTRABUBBLE &&
-                (!leaf_only || snarl_manager.is_leaf(snarl)) &&
-                (!top_level_only || snarl_manager.is_root(snarl)) &&
-                (snarl_manager.deep_contents(snarl, *graph, true).first.size() < max_nodes)) {
+            while (!stack.empty()) {
+                const Snarl* snarl = stack.back();
+                stack.pop_back();
+                
+                if (filter_trivial_snarls) {
+                    auto contents = snarl_manager.shallow_contents(snarl, *graph, false);
+                    if (contents.first.empty()) {
+                        // Nothing but the boundary nodes in this snarl
+                        continue;
+                    }
+                }
+                
+                // Write our snarl tree
+                snarl_buffer.push_back(*snarl);
+                stream::write_buffered(cout, snarl_buffer, buffer_size);
                 
+                // Optionally write our traversals
+                if (!traversal_file.empty() && snarl->type() == ULTRABUBBLE &&
+                    (!leaf_only || snarl_manager.is_leaf(snarl)) &&
+                    (!top_level_only || snarl_manager.is_root(snarl)) &&
+                    (snarl_manager.deep_contents(snarl, *graph, true).first.size() < max_nodes)) {
+                    
 #ifdef debug
-                cerr << "Look for traversals of " << pb2json(*snarl) << endl;
-#endif
-                vector<SnarlTraversal> travs = trav_finder->find_traversals(*snarl);
-#ifdef debug        
-                cerr << "Found " << travs.size() << endl;
+                    cerr << "Look for traversals of " << pb2json(*snarl) << endl;
 #endif
+                    // Find the traversals of a batch of snarls in parallel
+                    trav_sites.push_back(snarl);
+                    if (trav_sites.size() >= buffer_size * get_thread_count()) {
+                        write_traversals();
+                    }
+                }
                 
-                traversal_buffer.insert(traversal_buffer.end(), travs.begin(), travs.end());
-                stream::write_buffered(trav_stream, traversal_buffer, buffer_size);
-            }
-            
-            // Sort the child snarls by node ID?
-            if (sort_snarls) {
-                vector<const Snarl*> children = snarl_manager.children_of(snarl);
-                std::sort(children.begin(), children.end(), [](const Snarl* snarl_1, const Snarl* snarl_2) {
-                    return snarl_1->start().node_id() < snarl_2->end().node_id();
-                });
-                
-                for (const Snarl* child_snarl : children) {
-                    stack.push_back(child_snarl);
+                // Sort the child snarls by node ID?
+                if (sort_snarls) {
+                    vector<const Snarl*> children = snarl_manager.children_of(snarl);
+                    std::sort(children.begin(), children.end(), [](const Snarl* snarl_1, const Snarl* snarl_2) {
+                        return snarl_1->start().node_id() < snarl_2->end().node_id();
+                    });
+                    
+                    for (const Snarl* child_snarl : children) {
+                        stack.push_back(child_snarl);
+                    }
                 }
-            }
-            else {
-                for (const Snarl* child_snarl : snarl_manager.children_of(snarl)) {
-                    stack.push_back(child_snarl);
+                else {
+                    for (const Snarl* child_snarl : snarl_manager.children_of(snarl)) {
+                        stack.push_back(child_snarl);
+                    }
                 }
             }
+            
+            
         }
         
-        
+        write_traversals();
+    };
+    
+    if (sort_snarls || !traversal_file.empty()) {
+        // Snarls are sorted across the whole graph, or we want all our
+        // threads free to look for traversals
+        SnarlManager snarl_manager = snarl_finder->find_snarls();
+        write_snarls(snarl_manager);
+    } else {
+        // Write each component's snarls as soon as we have them
+        snarl_finder->for_each_component(write_snarls);
     }
+    
     // flush
     stream::write_buffered(cout, snarl_buffer, 0);
     if (!traversal_file.empty()) {
@@ -265,7 +317,6 @@ int main_snarl(int argc, char** argv) {
     }
     
     delete snarl_finder;
-    delete trav_finder;
     delete graph;
 
     return 0;
@@ -98,7 +98,7 @@ int main_sort(int argc, char *argv[]) {
         in.open(file_name.c_str());        
         if (gfa_input) {
             graph.reset(new VG());
-            graph->from_gfa(in);
+            graph->from_gfa(file_name);
         } else {
             graph.reset(new VG(in));
         }
@@ -14,6 +14,7 @@
 #include "../stream.hpp"
 #include "../utility.hpp"
 #include "../surjector.hpp"
+#include "../hts_writer.hpp"
 
 using namespace std;
 using namespace vg;
@@ -32,7 +33,8 @@ void help_surject(char** argv) {
          << "    -c, --cram-output       write CRAM to stdout" << endl
          << "    -b, --bam-output        write BAM to stdout" << endl
          << "    -s, --sam-output        write SAM to stdout" << endl
-         << "    -C, --compression N     level for compression [0-9]" << endl;
+         << "    -C, --compression N     level for compression [0-9]" << endl
+         << "    -T, --compression-threads N  use N extra threads to compress BAM or CRAM output [threads]" << endl;
 }
 
 int main_surject(int argc, char** argv) {
@@ -51,6 +53,7 @@ int main_surject(int argc, char** argv) {
     bool interleaved = false;
     string header_file;
     int compress_level = 9;
+    int compression_threads = -1;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -69,11 +72,12 @@ int main_surject(int argc, char** argv) {
             {"sam-output", no_argument, 0, 's'},
             {"header-from", required_argument, 0, 'H'},
             {"compress", required_argument, 0, 'C'},
+            {"compression-threads", required_argument, 0, 'T'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:p:F:P:icbsH:C:t:",
+        c = getopt_long (argc, argv, "hx:p:F:P:icbsH:C:t:T:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -128,6 +132,10 @@ int main_surject(int argc, char** argv) {
             compress_level = atoi(optarg);
             break;
 
+        case 'T':
+            compression_threads = atoi(optarg);
+            break;
+
         case 'h':
         case '?':
             help_surject(argv);
@@ -206,20 +214,10 @@ int main_surject(int argc, char** argv) {
                 stream::write_buffered(cout, buffer[i], 0); // flush
             }
         } else {
-            char out_mode[5];
-            string out_format = "";
-            strcpy(out_mode, "w");
-            if (output_type == "bam") { out_format = "b"; }
-            else if (output_type == "cram") { out_format = "c"; }
-            else { out_format = ""; }
-            strcat(out_mode, out_format.c_str());
-            if (compress_level >= 0) {
-                char tmp[2];
-                tmp[0] = compress_level + '0'; tmp[1] = '\0';
-                strcat(out_mode, tmp);
-            }
-            
             int thread_count = get_thread_count();
+            if (compression_threads < 0) {
+                compression_threads = thread_count;
+            }
             
             // bam/sam/cram output
             
@@ -228,14 +226,9 @@ int main_surject(int argc, char** argv) {
             // To generate the header, we need to know the read group for each sample name.
             map<string, string> rg_sample;
             
-            samFile* out = nullptr;
+            // Workers make the BAM records; this writes them out and compresses them
+            HTSWriter writer(output_type, compress_level, compression_threads);
             int buffer_limit = 100;
-
-            bam_hdr_t* hdr = nullptr;
-            int64_t count = 0;
-            // TODO: What good is this lock if we continue without getting it if the buffer is overfull???
-            omp_lock_t output_lock;
-            omp_init_lock(&output_lock);
             
             // We define a type to represent a surjected alignment, ready for
             // HTSlib output. It consists of surjected path name (or ""),
@@ -262,7 +255,7 @@ int main_surject(int argc, char** argv) {
                                                                                     path_reverse);
                 // Always use the surjected alignment, even if it surjects to unmapped.
                 
-                if (!hdr && !surj.read_group().empty() && !surj.sample_name().empty()) {
+                if (!writer.has_header() && !surj.read_group().empty() && !surj.sample_name().empty()) {
                     // There's no header yet (although we race its
                     // construction) and we have a sample and a read group.
                     
@@ -278,38 +271,12 @@ int main_surject(int argc, char** argv) {
             // We also define a function to emit the header if it hasn't been made already.
             // Note that the header will only list the samples and read groups in reads we have encountered so far!
             auto ensure_header = [&]() {
+                writer.ensure_header([&]() {
+                    bam_hdr_t* hdr;
 #pragma omp critical (hts_header)
-                {
-                    if (!hdr) {
-                        hdr = hts_string_header(header, path_length, rg_sample);
-                        if ((out = sam_open("-", out_mode)) == 0) {
-#pragma omp critical (cerr)
-                            cerr << "[vg surject] error: failed to open stdout for writing HTS output" << endl;
-                            exit(1);
-                        } else {
-                            // write the header
-                            if (sam_hdr_write(out, hdr) != 0) {
-#pragma omp critical (cerr)
-                                cerr << "[vg surject] error: failed to write the SAM header" << endl;
-                            }
-                        }
-                    }
-                }
-            };
-            
-            // Finally, we have a little widget function to write a BAM record and check for errors.
-            // Consumes the passed record.
-            auto write_bam_record = [&](bam1_t* b) {
-                assert(out != nullptr);
-                int r = 0;
-#pragma omp critical (cout)
-                r = sam_write1(out, hdr, b);
-                if (r == 0) {
-#pragma omp critical (cerr)
-                    cerr << "[vg surject] error: writing to stdout failed" << endl;
-                    exit(1);
-                }
-                bam_destroy1(b);
+                    hdr = hts_string_header(header, path_length, rg_sample);
+                    return hdr;
+                });
             };
             
             if (interleaved) {
@@ -328,50 +295,49 @@ int main_surject(int argc, char** argv) {
                             // Make sure we have emitted the header
                             ensure_header();
 
-                            // try to get a lock, and force things if we've built up a huge buffer waiting
-                            // TODO: Is continuing without the lock safe? And if so why do we have the lock in the first place?
-                            if (omp_test_lock(&output_lock) || buf.size() > 10*buffer_limit) {
-                                for (auto& surjected_pair : buf) {
-                                    // For each pair of surjected reads
+                            // Make the records here, and leave the writing and compression to the writer
+                            vector<bam1_t*> records;
+                            records.reserve(buf.size() * 2);
+                            for (auto& surjected_pair : buf) {
+                                // For each pair of surjected reads
+                            
+                                // Unpack the first read
+                                auto& name1 = get<0>(surjected_pair.first);
+                                auto& pos1 = get<1>(surjected_pair.first);
+                                auto& reverse1 = get<2>(surjected_pair.first);
+                                auto& surj1 = get<3>(surjected_pair.first);
                                 
-                                    // Unpack the first read
-                                    auto& name1 = get<0>(surjected_pair.first);
-                                    auto& pos1 = get<1>(surjected_pair.first);
-                                    auto& reverse1 = get<2>(surjected_pair.first);
-                                    auto& surj1 = get<3>(surjected_pair.first);
-                                    
-                                    // Unpack the second read
-                                    auto& name2 = get<0>(surjected_pair.second);
-                                    auto& pos2 = get<1>(surjected_pair.second);
-                                    auto& reverse2 = get<2>(surjected_pair.second);
-                                    auto& surj2 = get<3>(surjected_pair.second);
-                                    
-                                    // Compute CIGAR strings if actually surjected
-                                    string cigar1 = "", cigar2 = "";
-                                    if (name1 != "") {
-                                        size_t path_len1 = xgidx->path_length(name1);
-                                        cigar1 = cigar_against_path(surj1, reverse1, pos1, path_len1, 0);
-                                    }
-                                    if (name2 != "") {
-                                        size_t path_len2 = xgidx->path_length(name2);
-                                        cigar2 = cigar_against_path(surj2, reverse2, pos2, path_len2, 0);
-                                    }
-                                    
-                                    // TODO: compute template length based on
-                                    // pair distance and alignment content.
-                                    int template_length = 0;
-                                    
-                                    // Create and write paired BAM records referencing each other
-                                    write_bam_record(alignment_to_bam(header, surj1, name1, pos1, reverse1, cigar1,
-                                        name2, pos2, template_length));
-                                    write_bam_record(alignment_to_bam(header, surj2, name2, pos2, reverse2, cigar2,
-                                        name1, pos1, template_length));
+                                // Unpack the second read
+                                auto& name2 = get<0>(surjected_pair.second);
+                                auto& pos2 = get<1>(surjected_pair.second);
+                                auto& reverse2 = get<2>(surjected_pair.second);
+                                auto& surj2 = get<3>(surjected_pair.second);
                                 
+                                // Compute CIGAR strings if actually surjected
+                                string cigar1 = "", cigar2 = "";
+                                if (name1 != "") {
+                                    size_t path_len1 = xgidx->path_length(name1);
+                                    cigar1 = cigar_against_path(surj1, reverse1, pos1, path_len1, 0);
+                                }
+                                if (name2 != "") {
+                                    size_t path_len2 = xgidx->path_length(name2);
+                                    cigar2 = cigar_against_path(surj2, reverse2, pos2, path_len2, 0);
                                 }
                                 
-                                omp_unset_lock(&output_lock);
-                                buf.clear();
+                                // TODO: compute template length based on
+                                // pair distance and alignment content.
+                                int template_length = 0;
+                                
+                                // Create paired BAM records referencing each other
+                                records.push_back(alignment_to_bam(header, surj1, name1, pos1, reverse1, cigar1,
+                                    name2, pos2, template_length));
+                                records.push_back(alignment_to_bam(header, surj2, name2, pos2, reverse2, cigar2,
+                                    name1, pos1, template_length));
+                            
                             }
+                            
+                            writer.emit(std::move(records));
+                            buf.clear();
                         }
                 };
                 
@@ -453,33 +419,32 @@ int main_surject(int argc, char** argv) {
                         // Make sure we have emitted the header
                         ensure_header();
 
-                        // try to get a lock, and force things if we've built up a huge buffer waiting
-                        // TODO: Is continuing without the lock safe? And if so why do we have the lock in the first place?
-                        if (omp_test_lock(&output_lock) || buf.size() > 10*buffer_limit) {
-                            for (auto& s : buf) {
-                                // For each alignment in the buffer
-                                
-                                // Unpack it
-                                auto& name = get<0>(s);
-                                auto& pos = get<1>(s);
-                                auto& reverse = get<2>(s);
-                                auto& surj = get<3>(s);
-                                
-                                // Generate a CIGAR string for it
-                                string cigar = "";
-                                if (name != "") {
-                                    size_t path_len = xgidx->path_length(name);
-                                    cigar = cigar_against_path(surj, reverse, pos, path_len, 0);
-                                }
-                                
-                                // Create and write a single unpaired BAM record
-                                write_bam_record(alignment_to_bam(header, surj, name, pos, reverse, cigar));
-                                
+                        // Make the records here, and leave the writing and compression to the writer
+                        vector<bam1_t*> records;
+                        records.reserve(buf.size());
+                        for (auto& s : buf) {
+                            // For each alignment in the buffer
+                            
+                            // Unpack it
+                            auto& name = get<0>(s);
+                            auto& pos = get<1>(s);
+                            auto& reverse = get<2>(s);
+                            auto& surj = get<3>(s);
+                            
+                            // Generate a CIGAR string for it
+                            string cigar = "";
+                            if (name != "") {
+                                size_t path_len = xgidx->path_length(name);
+                                cigar = cigar_against_path(surj, reverse, pos, path_len, 0);
                             }
                             
-                            omp_unset_lock(&output_lock);
-                            buf.clear();
+                            // Create a single unpaired BAM record
+                            records.push_back(alignment_to_bam(header, surj, name, pos, reverse, cigar));
+                            
                         }
+                        
+                        writer.emit(std::move(records));
+                        buf.clear();
                     }
                 };
 
@@ -502,12 +467,9 @@ int main_surject(int argc, char** argv) {
             }
             
             
-            if (hdr != nullptr) {
-                bam_hdr_destroy(hdr);
-            }
-            assert(out != nullptr);
-            sam_close(out);
-            omp_destroy_lock(&output_lock);
+            // Even with no reads we want a valid file
+            ensure_header();
+            writer.close();
         }
     }
     cout.flush();
@@ -446,10 +446,8 @@ int main_view(int argc, char** argv) {
         }
         // VG can convert to any of the graph formats, so keep going
     } else if (input_type == "gfa") {
-        get_input_file(file_name, [&](istream& in) {
-            graph = new VG;
-            graph->from_gfa(in);
-        });
+        graph = new VG;
+        graph->from_gfa(file_name);
         // GFA can convert to any of the graph formats, so keep going
     } else if(input_type == "json") {
         assert(input_json);
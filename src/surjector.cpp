@@ -455,6 +455,22 @@ using namespace std;
             
             const xg::XGPath& xpath = xindex->get_path(path_rank_to_name[path_record.first]);
             
+            // if a single chunk already covers the whole read without any gaps, realigning it to
+            // the path would only reproduce it, so we can take it as the surjection directly
+            if (path_record.second.size() == 1 && is_full_ungapped_chunk(source, path_record.second.front())) {
+                
+                Alignment& surjected = path_surjections[path_record.first];
+                surjected = make_null_alignment(source);
+                *surjected.mutable_path() = path_record.second.front().second;
+                surjected.set_score(get_aligner(!source.quality().empty())->score_ungapped_alignment(surjected));
+                surjected.set_mapping_quality(source.mapping_quality());
+                
+#ifdef debug_anchored_surject
+                cerr << "path chunk covers the full read, taking it directly " << pb2json(surjected) << endl;
+#endif
+                continue;
+            }
+            
             // find the interval of the ref path we need to consider
             pair<size_t, size_t> ref_path_interval = compute_path_interval(source, path_record.first, xpath, path_record.second,
                                                                            &oriented_occurrences_memo);
@@ -463,16 +479,9 @@ using namespace std;
             cerr << "final path interval is " << ref_path_interval.first << ":" << ref_path_interval.second << endl;
 #endif
             
-            // get the path graph corresponding to this interval
-            unordered_map<id_t, pair<id_t, bool>> path_trans;
-            VG path_graph = extract_linearized_path_graph(ref_path_interval.first, ref_path_interval.second, xpath, path_trans);
-            
-            unordered_map<id_t, pair<id_t, bool>> split_trans;
-            VG split_path_graph = path_graph.split_strands(split_trans);
-            
-            split_path_graph.lazy_sort();
-            
-            auto node_trans = split_path_graph.overlay_node_translations(split_trans, path_trans);
+            // get the strand-split path graph corresponding to this interval
+            unordered_map<id_t, pair<id_t, bool>> node_trans;
+            VG split_path_graph = extract_split_path_graph(ref_path_interval.first, ref_path_interval.second, xpath, node_trans);
             
 #ifdef debug_anchored_surject
             cerr << "made split, linearized path graph " << pb2json(split_path_graph.graph) << endl;
@@ -738,42 +747,73 @@ using namespace std;
         return interval;
     }
     
-    VG Surjector::extract_linearized_path_graph(size_t first, size_t last, const xg::XGPath& xpath,
-                                                unordered_map<id_t, pair<id_t, bool>>& node_trans) {
+    VG Surjector::extract_split_path_graph(size_t first, size_t last, const xg::XGPath& xpath,
+                                           unordered_map<id_t, pair<id_t, bool>>& node_trans) {
         
 #ifdef debug_anchored_surject
         cerr << "extracting path graph for position interval " << first << ":" << last << " in path of length " << xpath.positions[xpath.positions.size() - 1] + xindex->node_length(xpath.node(xpath.ids.size() - 1)) << endl;
 #endif
         
-        VG path_graph;
+        VG split_path_graph;
         
         size_t begin = xpath.offset_at_position(first);
         size_t end = min<size_t>(xpath.positions.size(), xpath.offset_at_position(last) + 1);
         
-        Node* prev_node = nullptr;
+        // the sequence of each path step in the orientation the path takes it
+        vector<pair<id_t, bool>> steps;
+        vector<string> seqs;
+        steps.reserve(end - begin);
+        seqs.reserve(end - begin);
         for (size_t i = begin; i < end; i++) {
-            
-            id_t node_id = xpath.node(i);
-            string seq = xindex->node_sequence(node_id);
-            bool rev = xpath.directions[i];
-            
-            Node* node;
-            if (rev) {
-                node = path_graph.create_node(reverse_complement(seq));
+            steps.emplace_back(xpath.node(i), xpath.directions[i]);
+            seqs.push_back(xindex->node_sequence(steps.back().first));
+            if (steps.back().second) {
+                seqs.back() = reverse_complement(seqs.back());
             }
-            else {
-                node = path_graph.create_node(seq);
+        }
+        
+        // make the forward strand and then the reverse strand, each as a chain, so that the nodes
+        // are already in topological order and every node is a separate copy even if the path cycles
+        Node* prev_node = nullptr;
+        for (size_t i = 0; i < steps.size(); i++) {
+            Node* node = split_path_graph.create_node(seqs[i]);
+            if (prev_node) {
+                split_path_graph.create_edge(prev_node, node);
             }
-            
+            prev_node = node;
+            node_trans[node->id()] = steps[i];
+        }
+        prev_node = nullptr;
+        for (size_t i = steps.size(); i > 0; i--) {
+            Node* node = split_path_graph.create_node(reverse_complement(seqs[i - 1]));
             if (prev_node) {
-                path_graph.create_edge(prev_node, node);
+                split_path_graph.create_edge(prev_node, node);
             }
             prev_node = node;
-            
-            node_trans[node->id()] = make_pair(node_id, rev);
+            node_trans[node->id()] = make_pair(steps[i - 1].first, !steps[i - 1].second);
         }
         
-        return path_graph;
+        return split_path_graph;
+    }
+    
+    bool Surjector::is_full_ungapped_chunk(const Alignment& source, const path_chunk_t& chunk) const {
+        if (chunk.first.first != source.sequence().begin() || chunk.first.second != source.sequence().end()) {
+            return false;
+        }
+        // with base qualities, mismatches are scored differently when realigning, so only exact
+        // matches are guaranteed to get the same score
+        bool allow_mismatches = !adjust_alignments_for_base_quality || source.quality().empty();
+        for (size_t i = 0; i < chunk.second.mapping_size(); i++) {
+            const Mapping& mapping = chunk.second.mapping(i);
+            for (size_t j = 0; j < mapping.edit_size(); j++) {
+                const Edit& edit = mapping.edit(j);
+                if (edit.from_length() != edit.to_length() || edit.from_length() == 0 ||
+                    (!edit.sequence().empty() && !allow_mismatches)) {
+                    return false;
+                }
+            }
+        }
+        return true;
     }
     
     void Surjector::set_path_position(const Alignment& surjected, size_t best_path_rank, const xg::XGPath& xpath,
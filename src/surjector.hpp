@@ -47,7 +47,10 @@ using namespace std;
         /// a local type that represents a read interval matched to a portion of the alignment path
         using path_chunk_t = pair<pair<string::const_iterator, string::const_iterator>, Path>;
         
-    private:
+        /// use base quality adjusted scoring for reads with qualities
+        using Mapper::adjust_alignments_for_base_quality;
+        
+    protected:
         
         /// get the chunks of the alignment path that follow the given reference paths
         unordered_map<size_t, vector<path_chunk_t>>
@@ -60,9 +63,14 @@ using namespace std;
         compute_path_interval(const Alignment& source, size_t path_rank, const xg::XGPath& xpath, const vector<path_chunk_t>& path_chunks,
                               unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr);
         
-        /// make a linear graph that corresponds to a path interval, possibly duplicating nodes in case of cycles
-        VG extract_linearized_path_graph(size_t first, size_t last, const xg::XGPath& xpath,
-                                         unordered_map<id_t, pair<id_t, bool>>& node_trans);
+        /// make a graph with a forward and a reverse complement chain of nodes for a path interval, possibly
+        /// duplicating nodes in case of cycles, and record the original node and strand of each new node
+        VG extract_split_path_graph(size_t first, size_t last, const xg::XGPath& xpath,
+                                    unordered_map<id_t, pair<id_t, bool>>& node_trans);
+        
+        /// does this path chunk cover the entire read with only matches and (when they would score the
+        /// same on realignment) mismatches?
+        bool is_full_ungapped_chunk(const Alignment& source, const path_chunk_t& chunk) const;
         
         
         /// associate a path position and strand to a surjected alignment against this path
@@ -0,0 +1,362 @@
+#ifndef VG_THREADED_IO_HPP_INCLUDED
+#define VG_THREADED_IO_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** \file
+ * threaded_io.hpp: dedicated reader and writer threads for the parallel read
+ * mapping pipelines. A BatchReader parses input into batches ahead of the
+ * workers, and an OrderedWriter serializes results on its own thread, fed
+ * through a lock-free queue, optionally restoring input order.
+ */
+
+namespace vg {
+
+using namespace std;
+
+/// Sequence number of work that did not come from a numbered input
+const size_t NO_INPUT_SEQUENCE = numeric_limits<size_t>::max();
+
+/// The position in the input of the read, or read pair, that the calling
+/// thread is working on inside one of the parallel read iterators
+/// (fastq_*_for_each_parallel, hts_for_each_parallel and
+/// stream::for_each_parallel and friends), or NO_INPUT_SEQUENCE elsewhere.
+inline size_t& current_input_sequence(void) {
+    static thread_local size_t sequence = NO_INPUT_SEQUENCE;
+    return sequence;
+}
+
+/// Sets the current input sequence number for the lifetime of the object.
+class InputSequenceScope {
+public:
+    InputSequenceScope(size_t sequence) : previous(current_input_sequence()) {
+        current_input_sequence() = sequence;
+    }
+    ~InputSequenceScope(void) {
+        current_input_sequence() = previous;
+    }
+private:
+    size_t previous;
+};
+
+/**
+ * An unbounded multi-producer, single-consumer FIFO queue. Pushing is a
+ * single atomic exchange and never blocks; only the one consumer may pop.
+ * (This is Dmitry Vyukov's intrusive MPSC node queue.)
+ */
+template<typename T>
+class MPSCQueue {
+public:
+    MPSCQueue(void) : head(new Node()), tail(head.load()) {
+        // Nothing to do
+    }
+
+    ~MPSCQueue(void) {
+        T discard;
+        while (pop(discard)) {
+            // Drain
+        }
+        delete tail;
+    }
+
+    MPSCQueue(const MPSCQueue& other) = delete;
+    MPSCQueue& operator=(const MPSCQueue& other) = delete;
+
+    /// Add an item. Safe to call from any number of threads.
+    void push(T&& item) {
+        Node* node = new Node();
+        node->item = std::move(item);
+        Node* previous = head.exchange(node, memory_order_acq_rel);
+        previous->next.store(node, memory_order_release);
+    }
+
+    /// Take the oldest item, if any is visible. Only one thread may pop.
+    /// May spuriously report empty while a push is half done.
+    bool pop(T& item) {
+        Node* next = tail->next.load(memory_order_acquire);
+        if (next == nullptr) {
+            return false;
+        }
+        // The popped node becomes the new placeholder
+        item = std::move(next->item);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+private:
+    struct Node {
+        atomic<Node*> next{nullptr};
+        T item;
+    };
+
+    /// Most recently pushed node
+    atomic<Node*> head;
+    /// Placeholder before the oldest unpopped node; owned by the consumer
+    Node* tail;
+};
+
+/**
+ * Writes batches of output items on a dedicated thread. Worker threads call
+ * emit(), which only enqueues; the writer function runs on the writer thread,
+ * one batch at a time, so it needs no locking.
+ *
+ * In ordered mode, batches are tagged with their input sequence number and
+ * written in that order. Batches that arrive early wait in a reorder window;
+ * if more than reorder_window of them are waiting, the oldest is written
+ * anyway and the sequence moves on, so a lost or very slow read costs output
+ * order but never stalls the workers or grows memory without bound. Batches
+ * with no sequence number, or one that has already been passed, are written
+ * as soon as they arrive.
+ *
+ * Every sequence number should be emitted at least once, even with no items,
+ * so that the window can move past it. Emitting a sequence number more than
+ * once is allowed and keeps all the items together.
+ */
+template<typename Item>
+class OrderedWriter {
+public:
+
+    /// Default number of out-of-order batches to hold before giving up on order
+    static const size_t DEFAULT_REORDER_WINDOW = 1 << 16;
+
+    OrderedWriter(const function<void(vector<Item>&)>& writer, bool ordered = false,
+                  size_t reorder_window = DEFAULT_REORDER_WINDOW) :
+        writer(writer), ordered(ordered), reorder_window(max(reorder_window, (size_t) 1)),
+        done(false), writer_thread(&OrderedWriter::run, this) {
+        // Nothing to do
+    }
+
+    ~OrderedWriter(void) {
+        finish();
+    }
+
+    OrderedWriter(const OrderedWriter& other) = delete;
+    OrderedWriter& operator=(const OrderedWriter& other) = delete;
+
+    /// Queue items for output under the calling thread's current input sequence number.
+    void emit(vector<Item>&& items) {
+        emit(current_input_sequence(), std::move(items));
+    }
+
+    /// Queue items for output under the given input sequence number.
+    void emit(size_t sequence, vector<Item>&& items) {
+        queue.push(make_pair(sequence, std::move(items)));
+    }
+
+    /// Wait for everything emitted so far to be written and stop the writer
+    /// thread. Must not race with emit(). Safe to call more than once.
+    void finish(void) {
+        if (writer_thread.joinable()) {
+            done.store(true, memory_order_release);
+            writer_thread.join();
+        }
+    }
+
+    /// Number of batches that had to be written out of order because the window filled.
+    size_t order_violations(void) const {
+        return violations;
+    }
+
+private:
+
+    typedef pair<size_t, vector<Item>> batch_t;
+
+    void write(vector<Item>& items) {
+        if (!items.empty()) {
+            writer(items);
+        }
+    }
+
+    /// Write out waiting batches that are now next in line
+    void write_ready(void) {
+        auto it = pending.begin();
+        while (it != pending.end() && it->first == next_sequence) {
+            write(it->second);
+            ++next_sequence;
+            it = pending.erase(it);
+        }
+    }
+
+    void handle(batch_t& batch) {
+        size_t sequence = batch.first;
+        if (!ordered || sequence == NO_INPUT_SEQUENCE || sequence < next_sequence) {
+            write(batch.second);
+        } else if (sequence == next_sequence) {
+            write(batch.second);
+            ++next_sequence;
+            write_ready();
+        } else {
+            auto& waiting = pending[sequence];
+            if (waiting.empty()) {
+                waiting = std::move(batch.second);
+            } else {
+                std::move(batch.second.begin(), batch.second.end(), back_inserter(waiting));
+            }
+            if (pending.size() > reorder_window) {
+                // Give up on whatever we are waiting for
+                auto oldest = pending.begin();
+                write(oldest->second);
+                next_sequence = oldest->first + 1;
+                pending.erase(oldest);
+                ++violations;
+                write_ready();
+            }
+        }
+    }
+
+    void run(void) {
+        batch_t batch;
+        size_t idle = 0;
+        while (true) {
+            if (queue.pop(batch)) {
+                handle(batch);
+                idle = 0;
+            } else if (done.load(memory_order_acquire)) {
+                // All producers have finished, so anything left is visible now
+                while (queue.pop(batch)) {
+                    handle(batch);
+                }
+                break;
+            } else if (++idle < 64) {
+                this_thread::yield();
+            } else {
+                // Back off to a light sleep when the workers are slower than us
+                this_thread::sleep_for(chrono::microseconds(min(idle, (size_t) 1000)));
+            }
+        }
+        for (auto& waiting : pending) {
+            // Reads at the end never showed up; flush what we have in order
+            write(waiting.second);
+        }
+        pending.clear();
+    }
+
+    function<void(vector<Item>&)> writer;
+    bool ordered;
+    size_t reorder_window;
+
+    MPSCQueue<batch_t> queue;
+    atomic<bool> done;
+
+    // Writer thread state
+    map<size_t, vector<Item>> pending;
+    size_t next_sequence = 0;
+    size_t violations = 0;
+
+    // Declared last so that it starts after everything it uses is constructed
+    thread writer_thread;
+};
+
+template<typename Item>
+const size_t OrderedWriter<Item>::DEFAULT_REORDER_WINDOW;
+
+/**
+ * Fills batches of input on a dedicated thread, keeping up to max_ready of
+ * them waiting, so that parsing and decompression overlap with the work of
+ * whichever thread is handing batches out. The fill function is only ever
+ * called on the reader thread; it should fill the batch it is given and
+ * return false once the input is exhausted (the batch it filled on that call
+ * is still used if it is not empty). Exceptions thrown by the fill function
+ * are rethrown from next().
+ */
+template<typename Batch>
+class BatchReader {
+public:
+
+    BatchReader(const function<bool(Batch&)>& fill, const function<bool(const Batch&)>& is_empty,
+                size_t max_ready = 64) :
+        fill(fill), is_empty(is_empty), max_ready(max(max_ready, (size_t) 1)),
+        reader_thread(&BatchReader::run, this) {
+        // Nothing to do
+    }
+
+    ~BatchReader(void) {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        space_available.notify_all();
+        reader_thread.join();
+    }
+
+    BatchReader(const BatchReader& other) = delete;
+    BatchReader& operator=(const BatchReader& other) = delete;
+
+    /// Get the next batch, in input order. Returns false at the end of the input.
+    bool next(Batch& batch) {
+        unique_lock<mutex> guard(lock);
+        batch_available.wait(guard, [&]() { return !ready.empty() || finished; });
+        if (ready.empty()) {
+            if (error) {
+                rethrow_exception(error);
+            }
+            return false;
+        }
+        batch = std::move(ready.front());
+        ready.pop_front();
+        guard.unlock();
+        space_available.notify_one();
+        return true;
+    }
+
+private:
+
+    void run(void) {
+        try {
+            bool more = true;
+            while (more) {
+                Batch batch;
+                more = fill(batch);
+                unique_lock<mutex> guard(lock);
+                if (!is_empty(batch)) {
+                    space_available.wait(guard, [&]() { return ready.size() < max_ready || stopping; });
+                    if (stopping) {
+                        break;
+                    }
+                    ready.emplace_back(std::move(batch));
+                    guard.unlock();
+                    batch_available.notify_one();
+                }
+            }
+        } catch (...) {
+            lock_guard<mutex> guard(lock);
+            error = current_exception();
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            finished = true;
+        }
+        batch_available.notify_all();
+    }
+
+    function<bool(Batch&)> fill;
+    function<bool(const Batch&)> is_empty;
+    size_t max_ready;
+
+    mutex lock;
+    condition_variable batch_available;
+    condition_variable space_available;
+    deque<Batch> ready;
+    bool finished = false;
+    bool stopping = false;
+    exception_ptr error;
+
+    thread reader_thread;
+};
+
+}
+
+#endif
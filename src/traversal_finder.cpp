@@ -129,9 +129,11 @@ vector<SnarlTraversal> PathBasedTraversalFinder::find_traversals(const Snarl& si
 }
    
 ExhaustiveTraversalFinder::ExhaustiveTraversalFinder(VG& graph, SnarlManager& snarl_manager,
-                                                     bool include_reversing_traversals) :
+                                                     bool include_reversing_traversals,
+                                                     size_t max_traversals, size_t max_steps) :
     graph(graph), snarl_manager(snarl_manager),
-    include_reversing_traversals(include_reversing_traversals) {
+    include_reversing_traversals(include_reversing_traversals),
+    max_traversals(max_traversals), max_steps(max_steps) {
     // nothing more to do
 }
     
@@ -139,94 +141,124 @@ ExhaustiveTraversalFinder::~ExhaustiveTraversalFinder() {
     // no heap objects
 }
 
-void ExhaustiveTraversalFinder::stack_up_valid_walks(NodeTraversal walk_head, vector<NodeTraversal>& stack) {
-    
-    id_t head_id = walk_head.node->id();
-
-    // get all edges involving this node so we can filter them down to valid walks
-    for (Edge* edge : graph.edges_of(walk_head.node)) {
-        Node* next_node = nullptr;
-        bool next_backward;
-        bool from_start;
-        // determine id and orientation of our nodes given that they can
-        // be either from or to in the edge
-        if (head_id == edge->from()) {
-            next_node = graph.get_node(edge->to());
-            next_backward = edge->to_end();
-            from_start = edge->from_start();
-        } else {
-            next_node = graph.get_node(edge->from());
-            next_backward = !edge->from_start();
-            from_start = !edge->to_end();
+void ExhaustiveTraversalFinder::stack_up_valid_walks(const handle_t& walk_head, size_t depth,
+                                                     vector<pair<handle_t, size_t>>& stack) {
+    
+    size_t first_pushed = stack.size();
+    
+    // walk off the end of the handle, to wherever the derived class allows
+    graph.follow_edges(walk_head, false, [&](const handle_t& next) {
+        if (visit_next_node(walk_head, next)) {
+            stack.emplace_back(next, depth);
         }
-        // are we walking the same direction relative to head_id?
-        if (walk_head.backward == from_start &&
-            // derived classes can use this to filter search
-            visit_next_node(next_node, edge)) {
-            // add the next traversal in the walk to the stack            
-            stack.push_back(NodeTraversal(next_node, next_backward));
+    });
+    
+    if (max_traversals || max_steps) {
+        // With a budget, make sure the heaviest steps come off the stack first
+        vector<pair<double, handle_t>> weighted;
+        for (size_t i = first_pushed; i < stack.size(); i++) {
+            weighted.emplace_back(step_weight(walk_head, stack[i].first), stack[i].first);
+        }
+        stable_sort(weighted.begin(), weighted.end(), [](const pair<double, handle_t>& a,
+                                                         const pair<double, handle_t>& b) {
+            return a.first < b.first;
+        });
+        for (size_t i = 0; i < weighted.size(); i++) {
+            stack[first_pushed + i].first = weighted[i].second;
         }
     }
 }
 
-void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversals,
-                                               NodeTraversal traversal_start,
-                                               set<NodeTraversal>& stop_at,
-                                               set<NodeTraversal>& yield_at) {
-    // keeps track of the walk of the DFS traversal
-    list<Visit> path;
+bool ExhaustiveTraversalFinder::out_of_budget(const SiteSearch& search) const {
+    return (max_traversals && search.traversals.size() >= max_traversals) ||
+        (max_steps && search.steps >= max_steps);
+}
+
+void ExhaustiveTraversalFinder::yield_traversal(SiteSearch& search, const vector<Step>& path) {
     
-    // these mark the start of the edges out of the node that is on the head of the path
-    // they can be used to see how many nodes we need to peel off the path when we're
-    // backtracking
-    NodeTraversal stack_sentinel(nullptr);
+    // the same visits may be reached more than once (e.g. both through a
+    // child snarl and around it), so check the traversals with this hash
+    size_t hash = path.size();
+    for (auto& step : path) {
+        size_t step_hash = step.child ? std::hash<const Snarl*>()(step.child) : (size_t) as_integer(step.handle);
+        hash ^= step_hash + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    }
+    auto range = search.index_by_hash.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        const SnarlTraversal& found = search.traversals[it->second];
+        bool same = found.visit_size() == path.size();
+        for (size_t i = 0; same && i < path.size(); i++) {
+            const Visit& visit = found.visit(i);
+            if (path[i].child) {
+                same = visit.node_id() == 0 &&
+                    visit.snarl().start().node_id() == path[i].child->start().node_id() &&
+                    visit.snarl().start().backward() == path[i].child->start().backward() &&
+                    visit.snarl().end().node_id() == path[i].child->end().node_id() &&
+                    visit.snarl().end().backward() == path[i].child->end().backward();
+            } else {
+                same = visit.node_id() == graph.get_id(path[i].handle) &&
+                    visit.backward() == graph.get_is_reverse(path[i].handle);
+            }
+        }
+        if (same) {
+            return;
+        }
+    }
+    
+    // record the traversal in the return value
+    search.index_by_hash.emplace(hash, search.traversals.size());
+    search.traversals.emplace_back();
+    for (auto& step : path) {
+        Visit* visit = search.traversals.back().add_visit();
+        if (step.child) {
+            *visit->mutable_snarl()->mutable_start() = step.child->start();
+            *visit->mutable_snarl()->mutable_end() = step.child->end();
+        } else {
+            visit->set_node_id(graph.get_id(step.handle));
+            visit->set_backward(graph.get_is_reverse(step.handle));
+        }
+    }
+}
+
+void ExhaustiveTraversalFinder::add_traversals(SiteSearch& search,
+                                               const handle_t& traversal_start,
+                                               const vector<handle_t>& stop_at,
+                                               const vector<handle_t>& yield_at) {
+    // keeps track of the walk of the DFS traversal
+    vector<Step> path;
     
-    // initialize stack for DFS traversal of site
-    vector<NodeTraversal> stack{traversal_start};
+    // initialize stack for DFS traversal of site, recording with each handle
+    // how long the path was when it was stacked up, so we know how many steps
+    // to peel off the path when we backtrack to it
+    vector<pair<handle_t, size_t>> stack{make_pair(traversal_start, (size_t) 0)};
     
-    while (stack.size()) {
+    while (stack.size() && !out_of_budget(search)) {
         
-        NodeTraversal node_traversal = stack.back();
+        handle_t here = stack.back().first;
+        path.resize(stack.back().second);
         stack.pop_back();
+        search.steps++;
         
-        // we have traversed all of edges out of the head of the path, so we can pop it off
-        if (node_traversal == stack_sentinel) {
-            path.pop_back();
-            continue;
-        }
+        path.push_back(Step{here, nullptr});
         
         // have we finished a traversal through the site?
-        if (stop_at.count(node_traversal)) {
-            if (yield_at.count(node_traversal)) {
+        if (find(stop_at.begin(), stop_at.end(), here) != stop_at.end()) {
+            if (find(yield_at.begin(), yield_at.end(), here) != yield_at.end()) {
                 // yield path as a snarl traversal
-                traversals.emplace_back();
-                
-                // record the traversal in the return value
-                for (auto iter = path.begin(); iter != path.end(); iter++) {
-                    *traversals.back().add_visit() = *iter;
-                }
-                // add the final visit
-                *traversals.back().add_visit() = to_visit(node_traversal);
+                yield_traversal(search, path);
             }
             
             // don't proceed to add more onto the DFS stack
             continue;
         }
         
-        // mark the beginning of this node's edges forward in the stack
-        stack.push_back(stack_sentinel);
-        
-        // make a visit through the node traversal and add it to the path
-        path.emplace_back();
-        path.back().set_node_id(node_traversal.node->id());
-        path.back().set_backward(node_traversal.backward);
-        
         // does this traversal point into a child snarl?
-        const Snarl* into_snarl = snarl_manager.into_which_snarl(node_traversal.node->id(),
-                                                                 node_traversal.backward);
+        id_t here_id = graph.get_id(here);
+        bool here_backward = graph.get_is_reverse(here);
+        const Snarl* into_snarl = snarl_manager.into_which_snarl(here_id, here_backward);
                                                                  
 #ifdef debug
-        cerr << "Traversal " << node_traversal.node->id() << " " << node_traversal.backward << " enters";
+        cerr << "Traversal " << here_id << " " << here_backward << " enters";
         if (into_snarl != nullptr) {
             cerr << " " << pb2json(*into_snarl) << endl;
         } else {
@@ -234,37 +266,28 @@ void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversal
         }
 #endif
                                                                  
-        if (into_snarl && !(node_traversal == traversal_start)) {
+        if (into_snarl && here != traversal_start) {
             // add a visit for the child snarl
-            path.emplace_back();
-            *path.back().mutable_snarl()->mutable_start() = into_snarl->start();
-            *path.back().mutable_snarl()->mutable_end() = into_snarl->end();
-            
-            // mark the beginning of this child snarls edges forward in the stack
-            stack.push_back(stack_sentinel);
+            path.push_back(Step{here, into_snarl});
             
             // which side of the snarl does the traversal point into?
-            if (into_snarl->start().node_id() == node_traversal.node->id()
-                && into_snarl->start().backward() == node_traversal.backward) {
+            if (into_snarl->start().node_id() == here_id
+                && into_snarl->start().backward() == here_backward) {
                 // Into the start
 #ifdef debug
                 cerr << "Entered child through its start" << endl;
 #endif
                 if (into_snarl->start_end_reachable()) {
                     // skip to the other side and proceed in the orientation that the end node takes.
-                    stack.push_back(to_node_traversal(into_snarl->end(), graph));
-#ifdef debug
-                    cerr << "Stack up " << stack.back().node->id() << " " << stack.back().backward << endl;
-#endif
+                    stack.emplace_back(graph.get_handle(into_snarl->end().node_id(),
+                                                        into_snarl->end().backward()), path.size());
                 }
                 
                 // if the same side is also reachable, add it to the stack too
                 if (into_snarl->start_self_reachable()) {
                     // Make sure to flip it around so we come out of the snarl instead of going in again,
-                    stack.push_back(to_rev_node_traversal(into_snarl->start(), graph).reverse());
-#ifdef debug
-                    cerr << "Stack up " << stack.back().node->id() << " " << stack.back().backward << endl;
-#endif
+                    stack.emplace_back(graph.get_handle(into_snarl->start().node_id(),
+                                                        into_snarl->start().backward()), path.size());
                 }
                 
             }
@@ -277,57 +300,68 @@ void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversal
                     // skip to the other side and proceed in the orientation
                     // *opposite* what the start node takes (i.e. out of the
                     // snarl)
-                    stack.push_back(to_node_traversal(into_snarl->start(), graph).reverse());
-#ifdef debug
-                    cerr << "Stack up " << stack.back().node->id() << " " << stack.back().backward << endl;
-#endif
+                    stack.emplace_back(graph.get_handle(into_snarl->start().node_id(),
+                                                        !into_snarl->start().backward()), path.size());
                 }
                 
                 // if the same side is also reachable, add it to the stack too
                 if (into_snarl->end_self_reachable()) {
-                    stack.push_back(to_rev_node_traversal(into_snarl->end(), graph));
-#ifdef debug
-                    cerr << "Stack up " << stack.back().node->id() << " " << stack.back().backward << endl;
-#endif
+                    stack.emplace_back(graph.get_handle(into_snarl->end().node_id(),
+                                                        !into_snarl->end().backward()), path.size());
                 }
             }
         }
         else {
             // add all of the node traversals we can reach through valid walks to stack
-            stack_up_valid_walks(node_traversal, stack);
+            stack_up_valid_walks(here, path.size(), stack);
         }
     }
+    
+#ifdef debug
+    if (out_of_budget(search)) {
+        cerr << "Stopped search after " << search.steps << " steps and " << search.traversals.size() << " traversals" << endl;
+    }
+#endif
 }
     
 vector<SnarlTraversal> ExhaustiveTraversalFinder::find_traversals(const Snarl& site) {
 
-    vector<SnarlTraversal> to_return;
+    SiteSearch search;
     
-    NodeTraversal site_end = to_node_traversal(site.end(), graph);
-    NodeTraversal site_start = to_node_traversal(site.start(), graph);
-    NodeTraversal site_rev_start = NodeTraversal(site_start.node, !site_start.backward);
+    handle_t site_end = graph.get_handle(site.end().node_id(), site.end().backward());
+    handle_t site_start = graph.get_handle(site.start().node_id(), site.start().backward());
+    handle_t site_rev_start = graph.flip(site_start);
     
     // stop searching when the traversal is leaving the site
-    set<NodeTraversal> stop_at;
-    stop_at.insert(site_end);
-    stop_at.insert(site_rev_start);
+    vector<handle_t> stop_at{site_end, site_rev_start};
     
     // choose which side(s) can be the end of the traversal
-    set<NodeTraversal> yield_at;
-    yield_at.insert(site_end);
+    vector<handle_t> yield_at{site_end};
     if (include_reversing_traversals) {
-        yield_at.insert(site_rev_start);
+        yield_at.push_back(site_rev_start);
     }
     
     // search forward from the start and add any traversals that leave the indicated boundaries
-    add_traversals(to_return, site_start, stop_at, yield_at);
+    add_traversals(search, site_start, stop_at, yield_at);
 
     if (site.end_self_reachable() && include_reversing_traversals) {
         // if the end is reachable from itself, also look for traversals that both enter and
         // leave through the end
-        yield_at.erase(site_rev_start);
-        add_traversals(to_return, NodeTraversal(site_end.node, !site_end.backward),
-                       stop_at, yield_at);
+        yield_at.pop_back();
+        add_traversals(search, graph.flip(site_end), stop_at, yield_at);
+    }
+    
+    return move(search.traversals);
+}
+
+vector<vector<SnarlTraversal>> ExhaustiveTraversalFinder::find_traversals(const vector<const Snarl*>& sites) {
+    vector<vector<SnarlTraversal>> to_return(sites.size());
+    
+    // the search only reads the graph and the snarl manager, and sites can
+    // differ a lot in size, so hand them out one at a time
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < sites.size(); i++) {
+        to_return[i] = find_traversals(*sites[i]);
     }
     
     return to_return;
@@ -337,10 +371,14 @@ SupportRestrictedTraversalFinder::SupportRestrictedTraversalFinder(AugmentedGrap
                                                                    SnarlManager& snarl_manager,
                                                                    int min_node_support,
                                                                    int min_edge_support,
-                                                                   bool include_reversing_traversals) :
+                                                                   bool include_reversing_traversals,
+                                                                   size_t max_traversals,
+                                                                   size_t max_steps) :
     ExhaustiveTraversalFinder(augmented_graph.graph,
                               snarl_manager,
-                              include_reversing_traversals),
+                              include_reversing_traversals,
+                              max_traversals,
+                              max_steps),
     aug(augmented_graph),
     min_node_support(min_node_support),
     min_edge_support(min_edge_support) {
@@ -348,9 +386,21 @@ SupportRestrictedTraversalFinder::SupportRestrictedTraversalFinder(AugmentedGrap
 
 SupportRestrictedTraversalFinder::~SupportRestrictedTraversalFinder() {}
 
-bool SupportRestrictedTraversalFinder::visit_next_node(const Node* node, const Edge* edge) {
-    return aug.get_alignments(node->id()).size() >= min_node_support &&
-        aug.get_alignments(NodeSide::pair_from_edge(*edge)).size() >= min_edge_support;
+pair<size_t, size_t> SupportRestrictedTraversalFinder::step_support(const handle_t& from, const handle_t& to) const {
+    // we leave the right side of from and enter the left side of to
+    pair<NodeSide, NodeSide> edge = minmax(NodeSide(aug.graph.get_id(from), !aug.graph.get_is_reverse(from)),
+                                           NodeSide(aug.graph.get_id(to), aug.graph.get_is_reverse(to)));
+    return make_pair(aug.get_alignments(aug.graph.get_id(to)).size(), aug.get_alignments(edge).size());
+}
+
+bool SupportRestrictedTraversalFinder::visit_next_node(const handle_t& from, const handle_t& to) {
+    auto support = step_support(from, to);
+    return support.first >= min_node_support && support.second >= min_edge_support;
+}
+
+double SupportRestrictedTraversalFinder::step_weight(const handle_t& from, const handle_t& to) {
+    auto support = step_support(from, to);
+    return min(support.first, support.second);
 }
 
 
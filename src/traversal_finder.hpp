@@ -42,33 +42,80 @@ public:
     virtual vector<SnarlTraversal> find_traversals(const Snarl& site) = 0;
 };
 
+/**
+ * Enumerates the traversals of a snarl by depth-first search on the handles
+ * of the graph, stepping over child snarls. Traversals that visit the same
+ * nodes and child snarls in the same orders are only reported once.
+ *
+ * The search can be given a budget, as a number of traversals to find and/or
+ * a number of search steps to take per site, after which it reports what it
+ * has found so far. With a budget, the heaviest next steps (according to
+ * step_weight()) are searched first, so the traversals kept are found
+ * greedily along the heaviest branches.
+ */
 class ExhaustiveTraversalFinder : public TraversalFinder {
     
     VG& graph;
     SnarlManager& snarl_manager;
     bool include_reversing_traversals;
+    // Stop after finding this many traversals of a site, or never if 0
+    size_t max_traversals;
+    // Stop after taking this many search steps in a site, or never if 0
+    size_t max_steps;
     
 public:
     ExhaustiveTraversalFinder(VG& graph, SnarlManager& snarl_manager,
-                              bool include_reversing_traversals = false);
+                              bool include_reversing_traversals = false,
+                              size_t max_traversals = 0, size_t max_steps = 0);
     
     virtual ~ExhaustiveTraversalFinder();
     
     /**
-     * Exhaustively enumerate all traversals through the site. Only valid for
-     * acyclic Snarls.
+     * Exhaustively enumerate all traversals through the site, up to the
+     * budget. Only valid for acyclic Snarls.
      */
     virtual vector<SnarlTraversal> find_traversals(const Snarl& site);
     
+    /**
+     * Enumerate the traversals of each of the given sites, splitting the
+     * sites up between OMP threads. Returns the traversals of each site in
+     * the order of the sites.
+     */
+    vector<vector<SnarlTraversal>> find_traversals(const vector<const Snarl*>& sites);
+    
 protected:
-    void stack_up_valid_walks(NodeTraversal walk_head, vector<NodeTraversal>& stack);
-    virtual bool visit_next_node(const Node*, const Edge*) { return true; }
-    void add_traversals(vector<SnarlTraversal>& traversals, NodeTraversal traversal_start,
-                        set<NodeTraversal>& stop_at, set<NodeTraversal>& yield_at);
+    /// One step of a traversal in progress: a node visit, or a visit to the
+    /// child snarl that the handle reads into if child is set.
+    struct Step {
+        handle_t handle;
+        const Snarl* child;
+    };
+    
+    /// The traversals found for one site, and their hashes for deduplication.
+    struct SiteSearch {
+        vector<SnarlTraversal> traversals;
+        unordered_multimap<size_t, size_t> index_by_hash;
+        size_t steps = 0;
+    };
+    
+    /// Push each handle we can walk to from walk_head onto the stack, to be
+    /// visited after cutting the current path back to depth steps.
+    void stack_up_valid_walks(const handle_t& walk_head, size_t depth, vector<pair<handle_t, size_t>>& stack);
+    /// Derived classes can filter the search by refusing steps. Must be safe
+    /// to call from multiple threads.
+    virtual bool visit_next_node(const handle_t& from, const handle_t& to) { return true; }
+    /// Derived classes can weight the steps, for searches with a budget. Must
+    /// be safe to call from multiple threads.
+    virtual double step_weight(const handle_t& from, const handle_t& to) { return 0.0; }
+    bool out_of_budget(const SiteSearch& search) const;
+    void add_traversals(SiteSearch& search, const handle_t& traversal_start,
+                        const vector<handle_t>& stop_at, const vector<handle_t>& yield_at);
+    void yield_traversal(SiteSearch& search, const vector<Step>& path);
 };
 
 /** Does exhaustive traversal, but restricting to nodes and edges that meet 
     support thresholds (counts of reads that touch them, taken from augmented graph).
+    With a budget, better supported steps are searched first.
 */
 class SupportRestrictedTraversalFinder : public ExhaustiveTraversalFinder {
 public:
@@ -80,10 +127,15 @@ public:
                                      SnarlManager& snarl_manager,
                                      int min_node_support = 1,                                     
                                      int min_edge_support = 1,
-                                     bool include_reversing_traversals = false);
+                                     bool include_reversing_traversals = false,
+                                     size_t max_traversals = 0,
+                                     size_t max_steps = 0);
     virtual ~SupportRestrictedTraversalFinder();
 protected:
-    virtual bool visit_next_node(const Node*, const Edge*);
+    virtual bool visit_next_node(const handle_t& from, const handle_t& to);
+    virtual double step_weight(const handle_t& from, const handle_t& to);
+    /// Get the read counts on the node we step to and on the edge we use
+    pair<size_t, size_t> step_support(const handle_t& from, const handle_t& to) const;
 };
 
 class ReadRestrictedTraversalFinder : public TraversalFinder {
@@ -3,11 +3,13 @@
 /// unit tests for Alignments and their utility functions
 ///
 
+#include <fstream>
 #include <iostream>
 #include <string>
 #include "../json2pb.h"
 #include "../vg.pb.h"
 #include "../alignment.hpp"
+#include "../threaded_io.hpp"
 #include "catch.hpp"
 
 namespace vg {
@@ -110,5 +112,53 @@ TEST_CASE("Alignment trimming works even on unaligned reads", "[alignment]") {
     
 }
 
+TEST_CASE("FASTQ input is split into whole records and parsed on demand", "[alignment][fastq]") {
+
+    string filename = temp_file::create();
+    {
+        ofstream out(filename);
+        out << "@read1 some comment\nGATTACA\n+\nIIIIIII\n"
+            << "\n"
+            << "@read2/1\r\nCAT\r\n+\r\n#$%\r\n"
+            << "@read3\nA\n+\nI";
+    }
+
+    SECTION("Records are found across chunk boundaries") {
+        for (size_t chunk_bytes : {1, 5, 1000}) {
+            FastqBlockReader reader(filename, 0, chunk_bytes);
+            FastqBlock block;
+            vector<Alignment> reads;
+            while (reader.read(block, 2)) {
+                REQUIRE(block.size() <= 2);
+                for (size_t i = 0; i < block.size(); i++) {
+                    reads.emplace_back();
+                    block.get(i, reads.back());
+                }
+            }
+            REQUIRE(reads.size() == 3);
+            REQUIRE(reads[0].name() == "read1");
+            REQUIRE(reads[0].sequence() == "GATTACA");
+            REQUIRE(reads[0].quality() == string(7, 40));
+            REQUIRE(reads[1].name() == "read2/1");
+            REQUIRE(reads[1].sequence() == "CAT");
+            REQUIRE(reads[1].quality() == string({2, 3, 4}));
+            REQUIRE(reads[2].name() == "read3");
+            REQUIRE(reads[2].sequence() == "A");
+        }
+    }
+
+    SECTION("Parallel iteration numbers the pairs") {
+        vector<string> first_names(1);
+        size_t pairs = fastq_paired_interleaved_for_each_parallel(filename, [&](Alignment& mate1, Alignment& mate2) {
+            REQUIRE(current_input_sequence() == 0);
+            first_names[0] = mate1.name();
+        });
+        REQUIRE(pairs == 1);
+        REQUIRE(first_names[0] == "read1");
+    }
+
+    temp_file::remove(filename);
+}
+
 }
 }
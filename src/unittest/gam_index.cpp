@@ -0,0 +1,138 @@
+/// \file gam_index.cpp
+///
+/// Unit tests for the GAMIndex class, which stores sorted alignments in
+/// compressed blocks with a node range index.
+///
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <cstdio>
+#include <unistd.h>
+#include "../vg.pb.h"
+#include "../gam_index.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+// Make an alignment that visits the given nodes in order
+static Alignment gam_index_alignment(const string& name, const vector<int64_t>& nodes) {
+    Alignment aln;
+    aln.set_name(name);
+    aln.set_sequence("A");
+    for (size_t i = 0; i < nodes.size(); i++) {
+        Mapping* mapping = aln.mutable_path()->add_mapping();
+        mapping->mutable_position()->set_node_id(nodes[i]);
+        mapping->set_rank(i + 1);
+    }
+    return aln;
+}
+
+// Make a unique temporary file name
+static string gam_index_temp_name() {
+    char temp_name[] = "/tmp/vg-gam-index-XXXXXX";
+    int fd = mkstemp(temp_name);
+    REQUIRE(fd >= 0);
+    close(fd);
+    return string(temp_name);
+}
+
+TEST_CASE("GAMIndex answers range and node queries over several blocks", "[gam][gamindex]") {
+
+    string filename = gam_index_temp_name();
+
+    {
+        // Use tiny blocks so queries have to cross block boundaries
+        GAMIndex::Writer writer(filename, 2);
+        writer.add(gam_index_alignment("a", {1, 2}));
+        writer.add(gam_index_alignment("b", {2, 3}));
+        writer.add(gam_index_alignment("c", {3, 10}));
+        writer.add(gam_index_alignment("d", {3, 4}));
+        writer.add(gam_index_alignment("unmapped1", {}));
+        writer.add(gam_index_alignment("e", {5}));
+        writer.add(gam_index_alignment("f", {7, 6}));
+        writer.finish();
+    }
+
+    GAMIndex index(filename);
+
+    auto names_in_range = [&](int64_t id1, int64_t id2) {
+        vector<string> names;
+        index.for_alignment_in_range(id1, id2, [&](const Alignment& aln) {
+            names.push_back(aln.name());
+        });
+        return names;
+    };
+
+    auto names_on_nodes = [&](const vector<int64_t>& ids) {
+        multiset<string> names;
+        index.for_alignment_to_nodes(ids, [&](const Alignment& aln) {
+            names.insert(aln.name());
+        });
+        return names;
+    };
+
+    SECTION("All alignments are stored") {
+        REQUIRE(index.size() == 7);
+        vector<string> names;
+        index.for_each_alignment([&](const Alignment& aln) {
+            names.push_back(aln.name());
+        });
+        REQUIRE(names == vector<string>({"a", "b", "c", "d", "e", "f", "unmapped1"}));
+    }
+
+    SECTION("Range queries find alignments by their lowest node") {
+        REQUIRE(names_in_range(1, 1) == vector<string>({"a"}));
+        REQUIRE(names_in_range(3, 3) == vector<string>({"c", "d"}));
+        REQUIRE(names_in_range(2, 5) == vector<string>({"b", "c", "d", "e"}));
+        REQUIRE(names_in_range(6, 6) == vector<string>({"f"}));
+        REQUIRE(names_in_range(8, 100).empty());
+    }
+
+    SECTION("Node queries find every alignment touching the nodes exactly once") {
+        REQUIRE(names_on_nodes({10}) == multiset<string>({"c"}));
+        REQUIRE(names_on_nodes({3}) == multiset<string>({"b", "c", "d"}));
+        REQUIRE(names_on_nodes({2, 3, 3}) == multiset<string>({"a", "b", "c", "d"}));
+        REQUIRE(names_on_nodes({7}) == multiset<string>({"f"}));
+        REQUIRE(names_on_nodes({8, 9}).empty());
+    }
+
+    index.close();
+    unlink(filename.c_str());
+}
+
+TEST_CASE("GAMIndex answers queries correctly on unsorted input", "[gam][gamindex]") {
+
+    string filename = gam_index_temp_name();
+
+    {
+        GAMIndex::Writer writer(filename, 1);
+        writer.add(gam_index_alignment("a", {5, 6}));
+        writer.add(gam_index_alignment("b", {4, 3}));
+        writer.add(gam_index_alignment("c", {8, 1, 9}));
+        writer.finish();
+    }
+
+    GAMIndex index(filename);
+
+    vector<string> names;
+    index.for_alignment_in_range(1, 4, [&](const Alignment& aln) {
+        names.push_back(aln.name());
+    });
+    REQUIRE(names == vector<string>({"c", "b"}));
+
+    names.clear();
+    index.for_alignment_to_nodes({6, 9}, [&](const Alignment& aln) {
+        names.push_back(aln.name());
+    });
+    REQUIRE(names.size() == 2);
+
+    index.close();
+    unlink(filename.c_str());
+}
+
+}
+}
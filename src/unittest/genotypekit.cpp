@@ -426,6 +426,67 @@ TEST_CASE("ExhaustiveTraversalFinder finds all paths on a bubble with an inverte
   REQUIRE(found_trav_2);
 }
 
+TEST_CASE("ExhaustiveTraversalFinder stays within its budget", "[genotype]") {
+  // Two bubbles in a row, with four traversals between them
+  VG graph;
+  vector<Node*> nodes;
+  for (string seq : {"A", "C", "G", "T", "A", "C", "G"}) {
+    nodes.push_back(graph.create_node(seq));
+  }
+  graph.create_edge(nodes[0], nodes[1]);
+  graph.create_edge(nodes[0], nodes[2]);
+  graph.create_edge(nodes[1], nodes[3]);
+  graph.create_edge(nodes[2], nodes[3]);
+  graph.create_edge(nodes[3], nodes[4]);
+  graph.create_edge(nodes[3], nodes[5], false, true);
+  graph.create_edge(nodes[4], nodes[6]);
+  graph.create_edge(nodes[5], nodes[6], true, false);
+    
+  Snarl site;
+  site.mutable_start()->set_node_id(nodes[0]->id());
+  site.mutable_end()->set_node_id(nodes[6]->id());
+  site.set_type(ULTRABUBBLE);
+    
+  list<Snarl> snarls{site};
+  SnarlManager manager(snarls.begin(), snarls.end());
+  const Snarl* snarl = manager.top_level_snarls().front();
+  
+  ExhaustiveTraversalFinder finder(graph, manager);
+  vector<SnarlTraversal> all = finder.find_traversals(*snarl);
+  REQUIRE(all.size() == 4);
+  
+  SECTION("Each traversal is found once") {
+    set<string> seen;
+    for (auto& trav : all) {
+      REQUIRE(trav.visit_size() == 5);
+      seen.insert(pb2json(trav));
+    }
+    REQUIRE(seen.size() == 4);
+  }
+  
+  SECTION("The search stops after enough traversals") {
+    ExhaustiveTraversalFinder budgeted(graph, manager, false, 3);
+    REQUIRE(budgeted.find_traversals(*snarl).size() == 3);
+  }
+  
+  SECTION("The search stops after enough steps") {
+    ExhaustiveTraversalFinder budgeted(graph, manager, false, 0, 3);
+    REQUIRE(budgeted.find_traversals(*snarl).empty());
+  }
+  
+  SECTION("Sites can be searched in parallel") {
+    vector<const Snarl*> sites(20, snarl);
+    vector<vector<SnarlTraversal>> found = finder.find_traversals(sites);
+    REQUIRE(found.size() == sites.size());
+    for (auto& travs : found) {
+      REQUIRE(travs.size() == all.size());
+      for (size_t i = 0; i < travs.size(); i++) {
+        REQUIRE(pb2json(travs[i]) == pb2json(all[i]));
+      }
+    }
+  }
+}
+
 TEST_CASE("SiteFinder can differntiate ultrabubbles from snarls", "[genotype]") {
 
   SECTION("Directed cycle does not count as ultrabubble") {
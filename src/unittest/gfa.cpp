@@ -0,0 +1,124 @@
+/**
+ * \file
+ * unittest/gfa.cpp: test cases for the streaming GFA reader and writer.
+ */
+
+#include "catch.hpp"
+
+#include "../gfa.hpp"
+
+#include <sstream>
+#include <string>
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE( "GFAReader turns GFA lines into Graph chunks", "[gfa]" ) {
+
+    auto read_all = [](const string& gfa, size_t block_bytes, bool& overlaps) {
+        stringstream in(gfa);
+        GFAText text(in);
+        GFAReader reader(text, block_bytes);
+        Graph all;
+        reader.for_each_chunk([&](Graph& chunk) {
+            all.MergeFrom(chunk);
+        });
+        overlaps = reader.has_overlaps();
+        return all;
+    };
+
+    SECTION("Numeric names are kept and others numbered after them") {
+        string gfa = "H\tVN:Z:1.0\n"
+                     "S\tb\tGATT\n"
+                     "S\t5\tACA\n"
+                     "L\tb\t+\t5\t-\t0M\n"
+                     "S\ta\tT\n"
+                     "L\t5\t-\ta\t+\t*\n";
+        for (size_t block_bytes : {1, 8, 1000}) {
+            bool overlaps;
+            Graph graph = read_all(gfa, block_bytes, overlaps);
+            REQUIRE(!overlaps);
+            REQUIRE(graph.node_size() == 3);
+            REQUIRE(graph.node(0).id() == 6);
+            REQUIRE(graph.node(0).name() == "b");
+            REQUIRE(graph.node(1).id() == 5);
+            REQUIRE(graph.node(2).id() == 7);
+            REQUIRE(graph.edge_size() == 2);
+            REQUIRE(graph.edge(0).from() == 6);
+            REQUIRE(!graph.edge(0).from_start());
+            REQUIRE(graph.edge(0).to() == 5);
+            REQUIRE(graph.edge(0).to_end());
+            REQUIRE(graph.edge(1).from_start());
+            REQUIRE(graph.edge(1).to() == 7);
+        }
+    }
+
+    SECTION("Both path forms give ranked mappings") {
+        string gfa = "S 1 GATT\n"
+                     "P 1 old + 4M\n"
+                     "S 2 ACA\n"
+                     "L 1 + 2 + 2M\n"
+                     "P 2 old - 3M\n"
+                     "P\tnew\t2-,1+\t3M,4M\n";
+        for (size_t block_bytes : {1, 1000}) {
+            bool overlaps;
+            Graph graph = read_all(gfa, block_bytes, overlaps);
+            REQUIRE(overlaps);
+            REQUIRE(graph.edge(0).overlap() == 2);
+
+            vector<tuple<string, id_t, bool, size_t>> visits;
+            for (auto& path : graph.path()) {
+                for (auto& mapping : path.mapping()) {
+                    visits.emplace_back(path.name(), mapping.position().node_id(),
+                                        mapping.position().is_reverse(), mapping.rank());
+                }
+            }
+            REQUIRE(visits.size() == 4);
+            REQUIRE((visits[0] == make_tuple(string("old"), (id_t) 1, false, (size_t) 1)));
+            REQUIRE((visits[1] == make_tuple(string("old"), (id_t) 2, true, (size_t) 2)));
+            REQUIRE((visits[2] == make_tuple(string("new"), (id_t) 2, true, (size_t) 1)));
+            REQUIRE((visits[3] == make_tuple(string("new"), (id_t) 1, false, (size_t) 2)));
+        }
+    }
+
+    SECTION("Links to missing named segments are errors") {
+        stringstream in("S\ta\tA\nL\ta\t+\tb\t+\t0M\n");
+        GFAText text(in);
+        GFAReader reader(text);
+        REQUIRE_THROWS(reader.for_each_chunk([](Graph& chunk) {}));
+    }
+}
+
+TEST_CASE( "GFA lines are written in order", "[gfa]" ) {
+
+    Node node;
+    node.set_id(3);
+    node.set_sequence("GATTACA");
+    Edge edge;
+    edge.set_from(3);
+    edge.set_to(4);
+    edge.set_to_end(true);
+
+    stringstream out;
+    write_gfa_lines(out, 5, [&](size_t i, string& buffer) {
+        if (i == 0) {
+            append_gfa_segment(buffer, node);
+        } else if (i == 1) {
+            append_gfa_link(buffer, edge);
+        } else if (i == 2) {
+            append_gfa_path(buffer, "x", {make_tuple(3, false, 7), make_tuple(4, true, 2)});
+        } else {
+            buffer += to_string(i) + "\n";
+        }
+    }, 2);
+
+    REQUIRE(out.str() == "S\t3\tGATTACA\n"
+                         "L\t3\t+\t4\t-\t0M\n"
+                         "P\tx\t3+,4-\t7M,2M\n"
+                         "3\n4\n");
+}
+
+}
+}
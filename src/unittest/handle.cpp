@@ -315,6 +315,51 @@ TEST_CASE("VG and XG handle implementations are correct", "[handle][vg][xg]") {
         }
     }
 
+    SECTION("Inlined and bulk edge iteration agree with the virtual interface") {
+        auto check = [&](const HandleGraph* g, const function<void(const handle_t&, bool, vector<handle_t>&)>& inlined) {
+            for (Node* node : {n0, n1, n2, n3, n4, n5, n6, n7, n8, n9}) {
+                for (bool orientation : {false, true}) {
+                    for (bool go_left : {false, true}) {
+                        handle_t node_handle = g->get_handle(node->id(), orientation);
+                        vector<handle_t> expected;
+                        g->follow_edges(node_handle, go_left, [&](const handle_t& next) {
+                            expected.push_back(next);
+                        });
+                        vector<handle_t> neighbors{node_handle};
+                        g->get_neighbors(node_handle, go_left, neighbors);
+                        REQUIRE(neighbors == expected);
+                        neighbors.clear();
+                        inlined(node_handle, go_left, neighbors);
+                        REQUIRE(neighbors == expected);
+                    }
+                }
+            }
+        };
+
+        check(&vg, [&](const handle_t& handle, bool go_left, vector<handle_t>& out) {
+            vg.follow_edges(handle, go_left, [&](const handle_t& next) {
+                out.push_back(next);
+            });
+        });
+        check(&xg_index, [&](const handle_t& handle, bool go_left, vector<handle_t>& out) {
+            xg_index.follow_edges(handle, go_left, [&](const handle_t& next) {
+                out.push_back(next);
+            });
+        });
+
+        // Stopping early works without a std::function too
+        size_t seen = 0;
+        xg_index.for_each_handle([&](const handle_t& handle) {
+            return ++seen < 3;
+        });
+        REQUIRE(seen == 3);
+        seen = 0;
+        vg.for_each_handle([&](const handle_t& handle) {
+            return ++seen < 3;
+        });
+        REQUIRE(seen == 3);
+    }
+
 }
 
 TEST_CASE("Mutable handle graphs work", "[handle][vg]") {
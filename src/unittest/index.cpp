@@ -0,0 +1,217 @@
+/**
+ * \file
+ * unittest/index.cpp: test cases for bulk loading the RocksDB Index
+ */
+
+#include "catch.hpp"
+#include "../index.hpp"
+#include "../vg.hpp"
+#include "../json2pb.h"
+
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+// Make a fresh directory name for an index
+static string index_temp_dir() {
+    char temp_name[] = "/tmp/vg-index-XXXXXX";
+    REQUIRE(mkdtemp(temp_name) != nullptr);
+    return string(temp_name);
+}
+
+// Get everything stored in an index
+static map<string, string> index_contents(string& dir) {
+    Index index;
+    index.open_read_only(dir);
+    map<string, string> contents;
+    index.for_all([&](string& key, string& value) {
+        contents[key] = value;
+    });
+    index.close();
+    return contents;
+}
+
+TEST_CASE( "Bulk loading an Index stores the same entries as batched writes", "[index]" ) {
+
+    // A graph with a reversing edge, a self loop and two paths
+    const string graph_json = R"(
+    {
+        "node": [
+            {"id": 1, "sequence": "GATTACA"},
+            {"id": 2, "sequence": "CT"},
+            {"id": 3, "sequence": "GGA"},
+            {"id": 4, "sequence": "TTTCAG"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4, "to_end": true},
+            {"from": 4, "to": 4}
+        ],
+        "path": [
+            {"name": "ref", "mapping": [
+                {"position": {"node_id": 1}, "edit": [{"from_length": 7, "to_length": 7}], "rank": 1},
+                {"position": {"node_id": 2}, "edit": [{"from_length": 2, "to_length": 2}], "rank": 2},
+                {"position": {"node_id": 4}, "edit": [{"from_length": 6, "to_length": 6}], "rank": 3}
+            ]},
+            {"name": "alt", "mapping": [
+                {"position": {"node_id": 1}, "edit": [{"from_length": 7, "to_length": 7}], "rank": 1},
+                {"position": {"node_id": 3}, "edit": [{"from_length": 3, "to_length": 3}], "rank": 2},
+                {"position": {"node_id": 4, "is_reverse": true}, "edit": [{"from_length": 6, "to_length": 6}], "rank": 3}
+            ]}
+        ]
+    }
+    )";
+
+    Graph chunk;
+    json2pb(chunk, graph_json.c_str(), graph_json.size());
+    VG graph;
+    graph.merge(chunk);
+
+    string batched_dir = index_temp_dir();
+    string bulk_dir = index_temp_dir();
+
+    SECTION("Graphs, paths and kmers match") {
+        {
+            Index batched;
+            batched.open_for_write(batched_dir);
+            batched.load_graph(graph);
+            batched.load_paths(graph);
+            batched.load_kmers(graph, 4);
+            batched.close();
+        }
+        {
+            Index bulk;
+            bulk.open_for_bulk_load(bulk_dir);
+            bulk.load_graph(graph);
+            bulk.load_paths(graph);
+            bulk.load_kmers(graph, 4);
+            bulk.close();
+        }
+
+        auto batched = index_contents(batched_dir);
+        auto bulk = index_contents(bulk_dir);
+        REQUIRE(!bulk.empty());
+        REQUIRE(bulk == batched);
+
+        // Every forward-strand 4-mer start, worked out by hand. Some cross
+        // one or two nodes, and some read into node 4 or 3 backward over the
+        // reversing edge. From 4+3 both the self loop and node 3 read CAGT.
+        set<string> expected_kmers {
+            "GATT 1 0", "ATTA 1 1", "TTAC 1 2", "TACA 1 3",
+            "ACAC 1 4", "ACAG 1 4", "CACT 1 5", "CAGG 1 5", "ACTT 1 6", "AGGA 1 6",
+            "CTTT 2 0", "TTTT 2 1",
+            "GGAC 3 0", "GACT 3 1", "ACTG 3 2",
+            "TTTC 4 0", "TTCA 4 1", "TCAG 4 2", "CAGT 4 3",
+            "AGTT 4 4", "AGTC 4 4", "GTTT 4 5", "GTCC 4 5"
+        };
+        Index index;
+        index.open_read_only(bulk_dir);
+        set<string> kmers;
+        string kmer_prefix = string(1, '\0') + "k" + string(1, '\0');
+        for (auto& entry : bulk) {
+            if (entry.first.compare(0, kmer_prefix.size(), kmer_prefix) == 0) {
+                string kmer;
+                int64_t id;
+                int32_t pos;
+                index.parse_kmer(entry.first, entry.second, kmer, id, pos);
+                REQUIRE(kmers.insert(kmer + " " + to_string(id) + " " + to_string(pos)).second);
+            }
+        }
+        REQUIRE(kmers == expected_kmers);
+
+        REQUIRE(index.stored_kmer_sizes() == set<int>{4});
+        map<int64_t, vector<int32_t>> positions;
+        index.get_kmer_positions("TACA", positions);
+        REQUIRE(positions.size() == 1);
+        REQUIRE(positions[1] == vector<int32_t>{3});
+        positions.clear();
+        // Crosses the edge from 1 to 3
+        index.get_kmer_positions("ACAG", positions);
+        REQUIRE(positions.size() == 1);
+        REQUIRE(positions[1] == vector<int32_t>{4});
+        positions.clear();
+        // Reads from 3 into 4 backward
+        index.get_kmer_positions("ACTG", positions);
+        REQUIRE(positions.size() == 1);
+        REQUIRE(positions[3] == vector<int32_t>{2});
+        positions.clear();
+        // Reads from 4 into 3 backward
+        index.get_kmer_positions("AGTC", positions);
+        REQUIRE(positions.size() == 1);
+        REQUIRE(positions[4] == vector<int32_t>{4});
+        positions.clear();
+        // Crosses all of 2 on its way from 1 to 4
+        index.get_kmer_positions("ACTT", positions);
+        REQUIRE(positions.size() == 1);
+        REQUIRE(positions[1] == vector<int32_t>{6});
+        index.close();
+    }
+
+    SECTION("Sharded ingestion matches store_batch") {
+        // Enough items for several shards, with repeated keys where the last value should win
+        vector<pair<string, string>> items;
+        map<string, string> expected;
+        for (size_t i = 0; i < 200000; i++) {
+            string key = string(1, '\0') + "t" + to_string((i * 7919) % 150000);
+            string value = to_string(i);
+            items.emplace_back(key, value);
+            expected[key] = value;
+        }
+
+        {
+            Index batched;
+            batched.open_for_write(batched_dir);
+            batched.store_batch(expected);
+            batched.close();
+        }
+        {
+            Index bulk;
+            bulk.open_for_bulk_load(bulk_dir);
+            bulk.ingest_sharded(items);
+            bulk.close();
+        }
+        REQUIRE(index_contents(bulk_dir) == index_contents(batched_dir));
+    }
+
+    SECTION("Overlapping shards are ingested correctly") {
+        // Every shard sets every key, so the last shard's values should win
+        vector<vector<pair<string, string>>> shards(3);
+        map<string, string> expected;
+        for (size_t i = 0; i < shards.size(); i++) {
+            for (size_t j = 0; j < 1000; j++) {
+                string key = string(1, '\0') + "t" + to_string(j);
+                shards[i].emplace_back(key, to_string(i));
+                expected[key] = to_string(i);
+            }
+        }
+
+        {
+            Index batched;
+            batched.open_for_write(batched_dir);
+            batched.store_batch(expected);
+            batched.close();
+        }
+        {
+            Index bulk;
+            bulk.open_for_bulk_load(bulk_dir);
+            bulk.ingest_shards(shards);
+            bulk.close();
+        }
+        REQUIRE(index_contents(bulk_dir) == index_contents(batched_dir));
+    }
+
+    rocksdb::DestroyDB(batched_dir, rocksdb::Options());
+    rocksdb::DestroyDB(bulk_dir, rocksdb::Options());
+}
+
+}
+}
@@ -0,0 +1,115 @@
+/**
+ * \file
+ * unittest/kmer.cpp: test cases for enumerating kmers in graphs
+ */
+
+#include "catch.hpp"
+#include "../kmer.hpp"
+#include "../vg.hpp"
+
+#include <omp.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+// Describe a position as ID, strand and offset
+static string describe_pos(const pos_t& pos) {
+    return to_string(id(pos)) + (is_rev(pos) ? "-" : "+") + to_string(offset(pos));
+}
+
+// Describe a kmer and its context, with the context in a fixed order
+static string describe_kmer(const kmer_t& kmer) {
+    vector<string> prev, next;
+    for (size_t i = 0; i < kmer.prev_pos.size(); i++) {
+        prev.push_back(describe_pos(kmer.prev_pos[i]) + ":" + kmer.prev_char[i]);
+    }
+    for (size_t i = 0; i < kmer.next_pos.size(); i++) {
+        next.push_back(describe_pos(kmer.next_pos[i]) + ":" + kmer.next_char[i]);
+    }
+    sort(prev.begin(), prev.end());
+    sort(next.begin(), next.end());
+    stringstream out;
+    out << kmer.seq << " " << describe_pos(kmer.begin) << " [";
+    for (auto& p : prev) out << " " << p;
+    out << " ] [";
+    for (auto& n : next) out << " " << n;
+    out << " ]";
+    return out.str();
+}
+
+TEST_CASE( "for_each_kmer finds every kmer and its context", "[kmer]" ) {
+
+    // 1+ reads into 2+ and 3+, and 2+ reads into 3- over a reversing edge
+    VG graph;
+    handle_t h1 = graph.create_handle("AC");
+    handle_t h2 = graph.create_handle("G");
+    handle_t h3 = graph.create_handle("TT");
+    graph.create_edge(h1, h2);
+    graph.create_edge(h1, h3);
+    graph.create_edge(h2, graph.flip(h3));
+
+    // Worked out by hand, on both strands
+    vector<string> expected {
+        "ACG 1+0 [ ] [ 3-0:A ]",
+        "ACT 1+0 [ ] [ 3+1:T ]",
+        "CGA 1+1 [ 1+0:A ] [ 3-1:A ]",
+        "CTT 1+1 [ 1+0:A ] [ 2-0:C ]",
+        "GAA 2+0 [ 1+1:C ] [ 1-0:G ]",
+        "CGT 2-0 [ 3+1:T ] [ ]",
+        "TTC 3+0 [ 1+1:C ] [ 1-0:G ]",
+        "TCG 3+1 [ 3+0:T ] [ 1-1:T ]",
+        "AAG 3-0 [ 2+0:G ] [ 1-1:T ]",
+        "AGT 3-1 [ 3-0:A ] [ ]"
+    };
+    sort(expected.begin(), expected.end());
+
+    auto collect = [&](size_t k) {
+        vector<string> found;
+        for_each_kmer(graph, k, [&](const kmer_t& kmer) {
+#pragma omp critical (found)
+                found.push_back(describe_kmer(kmer));
+            });
+        sort(found.begin(), found.end());
+        return found;
+    };
+
+    int thread_count = get_thread_count();
+
+    SECTION("One thread finds the kmers") {
+        omp_set_num_threads(1);
+        REQUIRE(collect(3) == expected);
+        omp_set_num_threads(thread_count);
+    }
+
+    SECTION("Several threads find the same kmers") {
+        omp_set_num_threads(4);
+        REQUIRE(collect(3) == expected);
+        omp_set_num_threads(thread_count);
+    }
+
+    SECTION("Kmers can end right after their node") {
+        vector<string> found = collect(2);
+        REQUIRE(find(found.begin(), found.end(), "CG 1+1 [ 1+0:A ] [ 3-0:A ]") != found.end());
+        REQUIRE(find(found.begin(), found.end(), "CT 1+1 [ 1+0:A ] [ 3+1:T ]") != found.end());
+        REQUIRE(find(found.begin(), found.end(), "TT 3+0 [ 1+1:C ] [ 2-0:C ]") != found.end());
+        // Each base on either strand starts one, except the last of 1-, which
+        // leads nowhere, and the last of 1+, which starts two
+        REQUIRE(found.size() == 10);
+    }
+
+    SECTION("Kmers can span the whole graph but no more") {
+        // Both walks go from 1+ to 1-, one each way around
+        REQUIRE((collect(7) == vector<string>{"ACGAAGT 1+0 [ ] [ ]", "ACTTCGT 1+0 [ ] [ ]"}));
+        REQUIRE(collect(8).empty());
+        REQUIRE(collect(0).empty());
+    }
+}
+
+}
+}
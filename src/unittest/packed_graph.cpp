@@ -0,0 +1,291 @@
+/**
+ * \file
+ * unittest/packed_graph.cpp: test cases for the packed vectors and the PackedGraph.
+ */
+
+#include "catch.hpp"
+
+#include "../packed_graph.hpp"
+#include "../packed_structs.hpp"
+#include "../stream.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE( "Packed vectors store what they are given", "[packed]" ) {
+
+    SECTION("PackedVector widens to fit") {
+        PackedVector v;
+        vector<uint64_t> truth;
+        for (uint64_t i = 0; i < 1000; i++) {
+            uint64_t value = (i * 7919) % (1 << (i % 40));
+            v.append(value);
+            truth.push_back(value);
+        }
+        v.set(10, numeric_limits<uint64_t>::max());
+        truth[10] = numeric_limits<uint64_t>::max();
+        REQUIRE(v.size() == truth.size());
+        for (size_t i = 0; i < truth.size(); i++) {
+            REQUIRE(v.get(i) == truth[i]);
+        }
+        v.resize(5);
+        v.resize(10);
+        REQUIRE(v.get(7) == 0);
+    }
+
+    SECTION("PagedVector stores values on both sides of its anchors") {
+        PagedVector v(8);
+        vector<uint64_t> truth;
+        for (uint64_t i = 0; i < 100; i++) {
+            uint64_t value = i % 5 == 0 ? 0 : 1000000 + (i % 2 ? i : -i);
+            v.append(value);
+            truth.push_back(value);
+        }
+        v.set(33, 1);
+        truth[33] = 1;
+        for (size_t i = 0; i < truth.size(); i++) {
+            REQUIRE(v.get(i) == truth[i]);
+        }
+    }
+}
+
+TEST_CASE( "PackedGraph supports handle graph operations", "[packed][handle]" ) {
+
+    PackedGraph graph;
+    handle_t h1 = graph.create_handle("GATTACA");
+    handle_t h2 = graph.create_handle("CNT");
+    handle_t h3 = graph.create_handle("AAGG", 10);
+    graph.create_edge(h1, h2);
+    graph.create_edge(h2, graph.flip(h3));
+    graph.create_edge(h1, h3);
+    graph.create_edge(h1, h3);
+
+    auto next_of = [&](const handle_t& h, bool go_left) {
+        vector<handle_t> found;
+        graph.follow_edges(h, go_left, [&](const handle_t& next) {
+            found.push_back(next);
+        });
+        return found;
+    };
+
+    SECTION("Nodes and edges are visible") {
+        REQUIRE(graph.node_size() == 3);
+        REQUIRE(graph.edge_size() == 3);
+        REQUIRE(graph.get_id(h3) == 10);
+        REQUIRE(graph.get_sequence(h2) == "CNT");
+        REQUIRE(graph.get_sequence(graph.flip(h1)) == "TGTAATC");
+        REQUIRE(next_of(h1, false).size() == 2);
+        REQUIRE(next_of(h3, false).size() == 1);
+        REQUIRE(next_of(h3, false).front() == graph.flip(h2));
+        REQUIRE(next_of(graph.flip(h2), true).size() == 1);
+        REQUIRE(next_of(graph.flip(h2), true).front() == h3);
+        REQUIRE(graph.max_node_id() == 10);
+        REQUIRE(graph.min_node_id() == 1);
+    }
+
+    SECTION("Self loops are stored once") {
+        graph.create_edge(h1, graph.flip(h1));
+        graph.create_edge(h2, h2);
+        REQUIRE(graph.edge_size() == 5);
+        REQUIRE(next_of(h1, false).size() == 3);
+        REQUIRE(next_of(h2, true).size() == 2);
+        graph.destroy_edge(h1, graph.flip(h1));
+        graph.destroy_edge(h2, h2);
+        REQUIRE(graph.edge_size() == 3);
+        REQUIRE(next_of(h2, true).size() == 1);
+    }
+
+    SECTION("Destroying a node removes its edges and path visits") {
+        graph.append_step("p", h1);
+        graph.append_step("p", h2);
+        graph.append_step("p", graph.flip(h3));
+        graph.destroy_handle(h2);
+        REQUIRE(graph.node_size() == 2);
+        REQUIRE(graph.edge_size() == 1);
+        REQUIRE(!graph.has_node(2));
+        REQUIRE(graph.path_step_count("p") == 2);
+    }
+
+    SECTION("Dividing a node updates edges and paths") {
+        graph.append_step("p", h1);
+        graph.append_step("p", graph.flip(h3));
+        graph.append_step("q", h3);
+        auto parts = graph.divide_handle(graph.flip(h3), vector<size_t>{1, 3});
+        REQUIRE(parts.size() == 3);
+        REQUIRE(graph.get_sequence(parts[0]) == "C");
+        REQUIRE(graph.get_sequence(parts[1]) == "CT");
+        REQUIRE(graph.get_sequence(parts[2]) == "T");
+        REQUIRE(graph.get_id(parts[2]) == 10);
+        REQUIRE(graph.has_edge(h1, graph.forward(parts[2])));
+        REQUIRE(graph.has_edge(h2, parts[0]));
+        REQUIRE(graph.has_edge(parts[0], parts[1]));
+
+        vector<handle_t> p, q;
+        graph.for_each_step("p", [&](const handle_t& h) { p.push_back(h); });
+        graph.for_each_step("q", [&](const handle_t& h) { q.push_back(h); });
+        REQUIRE((p == vector<handle_t>{h1, parts[0], parts[1], parts[2]}));
+        REQUIRE((q == vector<handle_t>{graph.flip(parts[2]), graph.flip(parts[1]), graph.flip(parts[0])}));
+    }
+
+    SECTION("Applying an orientation flips the sequence and edges") {
+        handle_t flipped = graph.apply_orientation(graph.flip(h3));
+        REQUIRE(graph.get_sequence(flipped) == "CCTT");
+        REQUIRE(graph.has_edge(h2, flipped));
+        REQUIRE(graph.has_edge(h1, graph.flip(flipped)));
+    }
+
+    SECTION("Swapping and renumbering keep the graph intact") {
+        graph.swap_handles(h1, h3);
+        vector<id_t> order;
+        graph.for_each_handle([&](const handle_t& h) { order.push_back(graph.get_id(h)); });
+        REQUIRE((order == vector<id_t>{10, 2, 1}));
+        graph.compact_ids();
+        REQUIRE(graph.get_sequence(graph.get_handle(1)) == "AAGG");
+        REQUIRE(graph.has_edge(graph.get_handle(3), graph.get_handle(1)));
+        graph.increment_node_ids(100);
+        REQUIRE(graph.min_node_id() == 101);
+        REQUIRE(graph.has_edge(graph.get_handle(102), graph.get_handle(101, true)));
+    }
+
+    SECTION("Graphs survive serialization") {
+        graph.append_step("p", h1);
+        graph.append_step("p", graph.flip(h3));
+        graph.create_path("empty");
+        stringstream buffer;
+        graph.serialize_to_ostream(buffer, 1);
+        PackedGraph loaded(buffer);
+        REQUIRE(loaded.node_size() == 3);
+        REQUIRE(loaded.edge_size() == 3);
+        REQUIRE(loaded.get_sequence(loaded.get_handle(2)) == "CNT");
+        REQUIRE(loaded.has_edge(loaded.get_handle(2), loaded.get_handle(10, true)));
+        REQUIRE(loaded.path_count() == 2);
+        vector<handle_t> p;
+        loaded.for_each_step("p", [&](const handle_t& h) { p.push_back(h); });
+        REQUIRE((p == vector<handle_t>{loaded.get_handle(1), loaded.get_handle(10, true)}));
+    }
+}
+
+TEST_CASE( "PackedGraph reclaims space from destroyed nodes", "[packed][handle]" ) {
+
+    // A long chain visited by two paths
+    PackedGraph graph;
+    vector<handle_t> chain;
+    for (size_t i = 0; i < 6000; i++) {
+        chain.push_back(graph.create_handle(string(1 + i % 3, "ACGT"[i % 4])));
+        if (i > 0) {
+            graph.create_edge(chain[i - 1], chain[i]);
+        }
+        graph.append_step("p", chain[i]);
+    }
+    for (size_t i = chain.size(); i > 0; i--) {
+        graph.append_step("q", graph.flip(chain[i - 1]));
+    }
+    size_t full_memory = graph.memory_usage();
+
+    // Keep every sixth node
+    vector<handle_t> kept;
+    for (size_t i = 0; i < chain.size(); i++) {
+        if (i % 6 == 0) {
+            kept.push_back(chain[i]);
+        } else {
+            graph.destroy_handle(chain[i]);
+        }
+    }
+    REQUIRE(graph.node_size() == kept.size());
+    REQUIRE(graph.edge_size() == 0);
+    REQUIRE(graph.memory_usage() < full_memory / 2);
+
+    vector<handle_t> nodes, p, q;
+    graph.for_each_handle([&](const handle_t& h) { nodes.push_back(h); });
+    graph.for_each_step("p", [&](const handle_t& h) { p.push_back(h); });
+    graph.for_each_step("q", [&](const handle_t& h) { q.push_back(graph.flip(h)); });
+    reverse(q.begin(), q.end());
+    REQUIRE(nodes == kept);
+    REQUIRE(p == kept);
+    REQUIRE(q == kept);
+    REQUIRE(graph.path_step_count("p") == kept.size());
+    for (size_t i = 0; i < kept.size(); i++) {
+        REQUIRE(graph.get_sequence(kept[i]) == string(1 + (6 * i) % 3, "ACGT"[(6 * i) % 4]));
+    }
+
+    SECTION("The compacted graph can still be edited") {
+        handle_t added = graph.create_handle("GATTACA");
+        graph.create_edge(kept[0], added);
+        graph.create_edge(added, kept[1]);
+        graph.append_step("p", added);
+        REQUIRE(graph.has_edge(kept[0], added));
+        REQUIRE(graph.path_step_count("p") == kept.size() + 1);
+
+        auto parts = graph.divide_handle(added, vector<size_t>{3});
+        REQUIRE(graph.has_edge(kept[0], parts[0]));
+        REQUIRE(graph.has_edge(parts[1], kept[1]));
+        graph.destroy_handle(kept[1]);
+        REQUIRE(!graph.has_edge(parts[1], kept[1]));
+        REQUIRE(graph.path_step_count("p") == kept.size() + 1);
+        REQUIRE(graph.path_step_count("q") == kept.size() - 1);
+
+        stringstream buffer;
+        graph.serialize_to_ostream(buffer);
+        PackedGraph loaded(buffer);
+        REQUIRE(loaded.node_size() == graph.node_size());
+        REQUIRE(loaded.path_step_count("p") == kept.size() + 1);
+    }
+}
+
+TEST_CASE( "PackedGraph rejects paths it can't store", "[packed]" ) {
+
+    // A node with a path over part of it
+    Graph g;
+    Node* node = g.add_node();
+    node->set_id(1);
+    node->set_sequence("GATT");
+    Mapping* mapping = g.add_path()->add_mapping();
+    g.mutable_path(0)->set_name("x");
+    mapping->mutable_position()->set_node_id(1);
+    mapping->set_rank(1);
+    Edit* edit = mapping->add_edit();
+
+    auto load = [&]() {
+        stringstream buffer;
+        function<Graph(uint64_t)> lambda = [&](uint64_t i) { return g; };
+        stream::write(buffer, 1, lambda);
+        PackedGraph loaded(buffer);
+        return loaded.path_step_count("x");
+    };
+
+    SECTION("Full length matches are kept") {
+        edit->set_from_length(4);
+        edit->set_to_length(4);
+        REQUIRE(load() == 1);
+    }
+
+    SECTION("Substitutions are rejected") {
+        edit->set_from_length(4);
+        edit->set_to_length(4);
+        edit->set_sequence("CATT");
+        REQUIRE_THROWS_AS(load(), UnsupportedPathError);
+    }
+
+    SECTION("Offsets are rejected") {
+        mapping->mutable_position()->set_offset(1);
+        edit->set_from_length(3);
+        edit->set_to_length(3);
+        REQUIRE_THROWS_AS(load(), UnsupportedPathError);
+    }
+
+    SECTION("Matches over part of a node are rejected") {
+        edit->set_from_length(3);
+        edit->set_to_length(3);
+        REQUIRE_THROWS_AS(load(), UnsupportedPathError);
+    }
+}
+
+}
+}
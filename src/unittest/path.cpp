@@ -0,0 +1,92 @@
+/**
+ * \file
+ * unittest/path.cpp: test cases for keeping the Paths indexes up to date.
+ */
+
+#include "catch.hpp"
+
+#include "../path.hpp"
+
+#include <string>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE( "Paths keep their indexes up to date as mappings change", "[path]" ) {
+
+    Paths paths;
+    for (string name : {"a", "b"}) {
+        Path path;
+        path.set_name(name);
+        for (id_t id = 1; id <= 5; id++) {
+            Mapping* mapping = path.add_mapping();
+            mapping->mutable_position()->set_node_id(id);
+            mapping->set_rank(id * 2);
+        }
+        paths.extend(path);
+    }
+    paths.compact_ranks();
+
+    // Check that the ranks count up from 1 and that every index agrees with
+    // the lists
+    auto check = [&](const string& name, const vector<id_t>& ids) {
+        auto& path = paths._paths.at(name);
+        REQUIRE(path.size() == ids.size());
+        size_t rank = 1;
+        for (auto& m : path) {
+            REQUIRE(m.node_id() == ids[rank - 1]);
+            REQUIRE(m.rank == rank);
+            REQUIRE(paths.mappings_by_rank[name][rank] == &m);
+            REQUIRE(paths.mapping_path_name(&m) == name);
+            REQUIRE(paths.get_node_mapping(m.node_id())[paths.get_path_id(name)].count(&m));
+            rank++;
+        }
+    };
+
+    SECTION("Extended paths are ranked from 1") {
+        check("a", {1, 2, 3, 4, 5});
+        check("b", {1, 2, 3, 4, 5});
+    }
+
+    SECTION("Only changed paths are renumbered") {
+        mapping_t* third = paths.mappings_by_rank["a"][3];
+        auto next = paths.remove_mapping(third);
+        mapping_t extra;
+        extra.set_node_id(7);
+        extra.rank = 3;
+        paths.insert_mapping(next, "a", extra);
+        paths.append_mapping("a", 8, 100);
+        paths.compact_ranks();
+        check("a", {1, 2, 7, 4, 5, 8});
+        check("b", {1, 2, 3, 4, 5});
+    }
+
+    SECTION("Batches compact once at the end") {
+        {
+            Paths::Batch batch(paths);
+            paths.remove_mapping(paths.mappings_by_rank["b"][1]);
+            paths.compact_ranks();
+            paths.append_mapping("b", 9, 100);
+            paths.compact_ranks();
+            REQUIRE(paths._paths.at("b").back().rank == 100);
+        }
+        check("b", {2, 3, 4, 5, 9});
+    }
+
+    SECTION("Renumbering nodes moves their path records") {
+        paths.increment_node_ids(10);
+        check("a", {11, 12, 13, 14, 15});
+        REQUIRE(!paths.has_node_mapping(1));
+        hash_map<id_t, id_t> swap;
+        swap[11] = 12;
+        swap[12] = 11;
+        paths.swap_node_ids(swap);
+        check("b", {12, 11, 13, 14, 15});
+    }
+}
+
+}
+}
@@ -360,6 +360,49 @@ TEST_CASE("PathIndex translation can divide the last node", "[pathindex]") {
     }
     
 }
+
+TEST_CASE("PathIndex finds positions on paths that revisit nodes", "[pathindex]") {
+    
+    // Make a path that goes 1, 2-, 1, 3 with nodes of lengths 2, 3 and 1
+    Path path;
+    vector<pair<id_t, bool>> visits{{1, false}, {2, true}, {1, false}, {3, false}};
+    map<id_t, size_t> lengths{{1, 2}, {2, 3}, {3, 1}};
+    for (auto& visit : visits) {
+        Mapping* mapping = path.add_mapping();
+        mapping->mutable_position()->set_node_id(visit.first);
+        mapping->mutable_position()->set_is_reverse(visit.second);
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(lengths[visit.first]);
+        edit->set_to_length(lengths[visit.first]);
+    }
+    
+    PathIndex index(path);
+    
+    SECTION("Every position finds the occurrence that covers it") {
+        vector<id_t> expected{1, 1, 2, 2, 2, 1, 1, 3};
+        for (size_t i = 0; i < expected.size(); i++) {
+            REQUIRE(index.at_position(i).node == expected[i]);
+            REQUIRE(index.node_length(index.find_position(i)) == lengths[expected[i]]);
+        }
+        REQUIRE(index.at_position(3).is_end == true);
+        REQUIRE(index.find_position(6) - index.begin() == 2);
+        REQUIRE(index.find_position(7) + 1 == index.end());
+    }
+    
+    SECTION("Nodes are indexed at their first occurrences") {
+        REQUIRE(index.by_id.size() == 3);
+        REQUIRE(index.by_id.at(1) == make_pair((size_t) 0, false));
+        REQUIRE(index.by_id.at(2) == make_pair((size_t) 2, true));
+        REQUIRE(index.by_id.at(3).first == 7);
+        REQUIRE(!index.path_contains_node(4));
+        REQUIRE(index.by_id[4].first == 0);
+    }
+    
+    SECTION("Ranges round out to node boundaries") {
+        REQUIRE(index.round_outward(1, 4) == make_pair((size_t) 0, (size_t) 5));
+        REQUIRE(index.round_outward(5, 8) == make_pair((size_t) 5, (size_t) 8));
+    }
+}
    
 }
 }
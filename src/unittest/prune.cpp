@@ -0,0 +1,151 @@
+/**
+ * \file
+ * unittest/prune.cpp: test cases for pruning complex regions of graphs
+ */
+
+#include "catch.hpp"
+#include "../prune.hpp"
+#include "../vg.hpp"
+
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+// Run find_edges_to_prune() and get the edges it finds in a comparable form,
+// checking that none is reported twice
+static set<pair<int64_t, int64_t>> edges_to_prune(const HandleGraph& graph, size_t k, size_t edge_max) {
+    vector<edge_t> found = find_edges_to_prune(graph, k, edge_max);
+    set<pair<int64_t, int64_t>> edges;
+    for (auto& edge : found) {
+        edges.emplace(as_integer(edge.first), as_integer(edge.second));
+    }
+    REQUIRE(edges.size() == found.size());
+    return edges;
+}
+
+TEST_CASE( "find_edges_to_prune finds the edges that take walks over the fork limit", "[prune]" ) {
+
+    VG graph;
+    // Make the canonical form of an edge, as find_edges_to_prune() reports it
+    auto edge = [&](const handle_t& left, const handle_t& right) {
+        edge_t canonical = graph.edge_handle(left, right);
+        return make_pair(as_integer(canonical.first), as_integer(canonical.second));
+    };
+    using edge_set = set<pair<int64_t, int64_t>>;
+
+    SECTION("Walks stop at the second bubble in a chain") {
+        handle_t h1 = graph.create_handle("A");
+        handle_t h2 = graph.create_handle("C");
+        handle_t h3 = graph.create_handle("G");
+        handle_t h4 = graph.create_handle("T");
+        handle_t h5 = graph.create_handle("A");
+        handle_t h6 = graph.create_handle("C");
+        handle_t h7 = graph.create_handle("G");
+        graph.create_edge(h1, h2);
+        graph.create_edge(h1, h3);
+        graph.create_edge(h2, h4);
+        graph.create_edge(h3, h4);
+        graph.create_edge(h4, h5);
+        graph.create_edge(h4, h6);
+        graph.create_edge(h5, h7);
+        graph.create_edge(h6, h7);
+
+        edge_set pruned { edge(h2, h4), edge(h3, h4), edge(h4, h5), edge(h4, h6) };
+        // A 3-mer from node 1 is the first to reach the second bubble
+        REQUIRE(edges_to_prune(graph, 2, 1).empty());
+        REQUIRE(edges_to_prune(graph, 3, 1) == pruned);
+        REQUIRE(edges_to_prune(graph, 5, 1) == pruned);
+        // With room for both bubbles nothing goes
+        REQUIRE(edges_to_prune(graph, 5, 2).empty());
+        REQUIRE(edges_to_prune(graph, 0, 0).empty());
+    }
+
+    SECTION("Walks around a cycle are limited") {
+        handle_t h1 = graph.create_handle("A");
+        handle_t h2 = graph.create_handle("C");
+        handle_t h3 = graph.create_handle("G");
+        graph.create_edge(h1, h2);
+        graph.create_edge(h2, h1);
+        graph.create_edge(h2, h3);
+
+        // Going around the cycle from node 2 crosses its fork again
+        REQUIRE(edges_to_prune(graph, 2, 1).empty());
+        REQUIRE((edges_to_prune(graph, 3, 1) == edge_set { edge(h2, h1), edge(h2, h3) }));
+        REQUIRE((edges_to_prune(graph, 100, 1) == edge_set { edge(h2, h1), edge(h2, h3) }));
+        REQUIRE((edges_to_prune(graph, 2, 0) == edge_set { edge(h2, h1), edge(h2, h3) }));
+    }
+
+    SECTION("Walks follow reversing edges") {
+        handle_t h1 = graph.create_handle("A");
+        handle_t h2 = graph.create_handle("C");
+        handle_t h3 = graph.create_handle("G");
+        handle_t h4 = graph.create_handle("T");
+        handle_t h5 = graph.create_handle("A");
+        handle_t h6 = graph.create_handle("C");
+        graph.create_edge(h4, h1);
+        graph.create_edge(h1, h2);
+        // Leaving node 1 we read node 3 backward, and then the reverse of
+        // nodes 5 and 6
+        graph.create_edge(h1, graph.flip(h3));
+        graph.create_edge(h5, h3);
+        graph.create_edge(h6, h3);
+
+        REQUIRE(edges_to_prune(graph, 1, 1).empty());
+        REQUIRE((edges_to_prune(graph, 2, 1) == edge_set { edge(h5, h3), edge(h6, h3) }));
+        REQUIRE((edges_to_prune(graph, 4, 1) == edge_set { edge(h5, h3), edge(h6, h3) }));
+        REQUIRE(edges_to_prune(graph, 4, 2).empty());
+    }
+
+    SECTION("Zero length nodes add no bases to walks") {
+        handle_t h1 = graph.create_handle("A");
+        handle_t h2 = graph.create_handle("C");
+        handle_t h3 = graph.create_handle("G");
+        handle_t h4 = graph.create_handle("");
+        handle_t h5 = graph.create_handle("A");
+        handle_t h6 = graph.create_handle("C");
+        graph.create_edge(h1, h2);
+        graph.create_edge(h1, h3);
+        graph.create_edge(h2, h4);
+        graph.create_edge(h3, h4);
+        graph.create_edge(h4, h5);
+        graph.create_edge(h4, h6);
+
+        // A 2-mer from node 1 reaches the second fork through node 4, but
+        // the reverse 2-mers from nodes 5 and 6 stop at node 1
+        REQUIRE((edges_to_prune(graph, 2, 1) == edge_set { edge(h4, h5), edge(h4, h6) }));
+        REQUIRE(edges_to_prune(graph, 1, 1).empty());
+    }
+
+    SECTION("Walks only leave nodes shorter than k") {
+        handle_t h1 = graph.create_handle("AAAAA");
+        handle_t h2 = graph.create_handle("C");
+        handle_t h3 = graph.create_handle("G");
+        handle_t h4 = graph.create_handle("TTTTT");
+        handle_t h5 = graph.create_handle("A");
+        handle_t h6 = graph.create_handle("C");
+        handle_t h7 = graph.create_handle("GGGGG");
+        graph.create_edge(h1, h2);
+        graph.create_edge(h1, h3);
+        graph.create_edge(h2, h4);
+        graph.create_edge(h3, h4);
+        graph.create_edge(h4, h5);
+        graph.create_edge(h4, h6);
+        graph.create_edge(h5, h7);
+        graph.create_edge(h6, h7);
+
+        // Getting from one bubble to the next takes 6 bases
+        REQUIRE(edges_to_prune(graph, 3, 1).empty());
+        REQUIRE(edges_to_prune(graph, 6, 1).empty());
+        REQUIRE((edges_to_prune(graph, 7, 1) == edge_set { edge(h2, h4), edge(h3, h4), edge(h4, h5), edge(h4, h6) }));
+        REQUIRE((edges_to_prune(graph, 1, 0) == edge_set { edge(h1, h2), edge(h1, h3), edge(h4, h5), edge(h4, h6),
+                                                           edge(h2, h4), edge(h3, h4), edge(h5, h7), edge(h6, h7) }));
+    }
+}
+
+}
+}
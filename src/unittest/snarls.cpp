@@ -2918,7 +2918,165 @@ namespace vg {
             }
             
         }
-        
-        
+
+        TEST_CASE("HandleGraphSnarlFinder finds the same snarls as CactusSnarlFinder", "[snarls]") {
+            
+            // Two components: a chain of two bubbles with a path through it,
+            // and a bubble nested in a deletion
+            const string graph_json = R"(
+            
+            {
+                "node": [
+                    {"id": 1, "sequence": "G"},
+                    {"id": 2, "sequence": "A"},
+                    {"id": 3, "sequence": "T"},
+                    {"id": 4, "sequence": "GGG"},
+                    {"id": 5, "sequence": "T"},
+                    {"id": 6, "sequence": "A"},
+                    {"id": 7, "sequence": "C"},
+                    {"id": 8, "sequence": "CA"},
+                    {"id": 9, "sequence": "T"},
+                    {"id": 10, "sequence": "G"},
+                    {"id": 11, "sequence": "A"},
+                    {"id": 12, "sequence": "CC"}
+                ],
+                "edge": [
+                    {"from": 1, "to": 2},
+                    {"from": 1, "to": 3},
+                    {"from": 2, "to": 4},
+                    {"from": 3, "to": 4},
+                    {"from": 4, "to": 5},
+                    {"from": 4, "to": 6},
+                    {"from": 5, "to": 7},
+                    {"from": 6, "to": 7},
+                    {"from": 8, "to": 9},
+                    {"from": 8, "to": 12},
+                    {"from": 9, "to": 10},
+                    {"from": 9, "to": 11},
+                    {"from": 10, "to": 11},
+                    {"from": 11, "to": 12}
+                ],
+                "path": [
+                    {"name": "ref", "mapping": [
+                        {"position": {"node_id": 1}, "rank": 1},
+                        {"position": {"node_id": 2}, "rank": 2},
+                        {"position": {"node_id": 4}, "rank": 3},
+                        {"position": {"node_id": 5}, "rank": 4},
+                        {"position": {"node_id": 7}, "rank": 5}
+                    ]}
+                ]
+            }
+            
+            )";
+            
+            VG graph;
+            Graph chunk;
+            json2pb(chunk, graph_json.c_str(), graph_json.size());
+            graph.extend(chunk);
+            
+            // Describe each snarl by its boundary nodes, its parent's, and its type
+            auto describe = [](SnarlManager& snarl_manager) {
+                set<tuple<id_t, id_t, id_t, id_t, int>> described;
+                snarl_manager.for_each_snarl_preorder([&](const Snarl* snarl) {
+                    const Snarl* parent = snarl_manager.parent_of(snarl);
+                    described.emplace(min(snarl->start().node_id(), snarl->end().node_id()),
+                                      max(snarl->start().node_id(), snarl->end().node_id()),
+                                      parent ? min(parent->start().node_id(), parent->end().node_id()) : 0,
+                                      parent ? max(parent->start().node_id(), parent->end().node_id()) : 0,
+                                      snarl->type());
+                });
+                return described;
+            };
+            
+            SnarlManager cactus_snarls = CactusSnarlFinder(graph).find_snarls();
+            HandleGraphSnarlFinder finder(&graph, for_each_vg_path(graph));
+            
+            SECTION("The merged snarls match") {
+                SnarlManager snarl_manager = finder.find_snarls();
+                REQUIRE(describe(snarl_manager) == describe(cactus_snarls));
+                REQUIRE(snarl_manager.top_level_snarls().size() == cactus_snarls.top_level_snarls().size());
+                REQUIRE(snarl_manager.chains_of(nullptr).size() == cactus_snarls.chains_of(nullptr).size());
+            }
+            
+            SECTION("Components come one at a time, in node order") {
+                vector<set<tuple<id_t, id_t, id_t, id_t, int>>> components;
+                finder.for_each_component([&](SnarlManager& snarl_manager) {
+                    components.push_back(describe(snarl_manager));
+                });
+                REQUIRE(components.size() == 2);
+                REQUIRE(get<0>(*components[0].begin()) < 8);
+                REQUIRE(get<0>(*components[1].begin()) >= 8);
+                
+                set<tuple<id_t, id_t, id_t, id_t, int>> all;
+                for (auto& component : components) {
+                    all.insert(component.begin(), component.end());
+                }
+                REQUIRE(all == describe(cactus_snarls));
+            }
+            
+            SECTION("A single node component has no snarls") {
+                graph.create_node("GATTACA");
+                size_t components = 0;
+                size_t snarls = 0;
+                finder.for_each_component([&](SnarlManager& snarl_manager) {
+                    components++;
+                    snarl_manager.for_each_snarl_preorder([&](const Snarl* snarl) {
+                        snarls++;
+                    });
+                });
+                REQUIRE(components == 3);
+                REQUIRE(snarls == describe(cactus_snarls).size());
+            }
+        }
+
+        TEST_CASE("SnarlManager answers tree queries about copies of its snarls", "[snarls]") {
+            
+            // A chain of two snarls, with a child in the first one, and
+            // enough other top-level snarls to need several blocks of records
+            vector<Snarl> snarls(3);
+            snarls[0].mutable_start()->set_node_id(1);
+            snarls[0].mutable_end()->set_node_id(3);
+            snarls[1].mutable_start()->set_node_id(3);
+            snarls[1].mutable_end()->set_node_id(5);
+            snarls[2].mutable_start()->set_node_id(10);
+            snarls[2].mutable_end()->set_node_id(12);
+            transfer_boundary_info(snarls[0], *snarls[2].mutable_parent());
+            for (id_t i = 0; i < 3000; i++) {
+                snarls.emplace_back();
+                snarls.back().mutable_start()->set_node_id(100 + 3 * i);
+                snarls.back().mutable_end()->set_node_id(101 + 3 * i);
+            }
+            
+            SnarlManager snarl_manager(snarls.begin(), snarls.end());
+            
+            const Snarl* first = snarl_manager.into_which_snarl(1, false);
+            const Snarl* second = snarl_manager.into_which_snarl(3, false);
+            const Snarl* child = snarl_manager.into_which_snarl(10, false);
+            
+            SECTION("Managed snarls know their places in the tree") {
+                REQUIRE(snarl_manager.top_level_snarls().size() == 3002);
+                REQUIRE(snarl_manager.chain_of(first) == snarl_manager.chain_of(second));
+                REQUIRE(snarl_manager.chain_of(first)->size() == 2);
+                REQUIRE(snarl_manager.children_of(first) == vector<const Snarl*>{child});
+                REQUIRE(snarl_manager.parent_of(child) == first);
+                REQUIRE(snarl_manager.is_leaf(child));
+                REQUIRE(snarl_manager.is_root(snarl_manager.into_which_snarl(100 + 3 * 2999, false)));
+            }
+            
+            SECTION("Copies are answered for by the managed snarls") {
+                Snarl copy = *first;
+                REQUIRE(snarl_manager.manage(copy) == first);
+                REQUIRE(snarl_manager.children_of(&copy) == vector<const Snarl*>{child});
+                REQUIRE(snarl_manager.chain_of(&copy) == snarl_manager.chain_of(first));
+            }
+            
+            SECTION("Flipped snarls stay in the tree") {
+                snarl_manager.flip(child);
+                REQUIRE(child->start().node_id() == 12);
+                REQUIRE(snarl_manager.parent_of(child) == first);
+                REQUIRE(snarl_manager.manage(*child) == child);
+                REQUIRE(snarl_manager.children_of(first) == vector<const Snarl*>{child});
+            }
+        }
     }
 }
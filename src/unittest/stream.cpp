@@ -0,0 +1,271 @@
+/// \file stream.cpp
+///
+/// Unit tests for reading and writing streams of Protobuf messages.
+///
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include "../stream.hpp"
+#include "../utility.hpp"
+#include "../vg.pb.h"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+// Write a gzipped stream with the given contents, which need not be valid
+static string gzip_stream(const function<void(::google::protobuf::io::CodedOutputStream&)>& write) {
+    string data;
+    ::google::protobuf::io::StringOutputStream raw_out(&data);
+    ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
+    {
+        ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+        write(coded_out);
+    }
+    gzip_out.Close();
+    return data;
+}
+
+// Write chunks of alignments, each prefixed with its count, even if 0
+static string chunked_stream(const vector<vector<Alignment>>& chunks) {
+    return gzip_stream([&](::google::protobuf::io::CodedOutputStream& coded_out) {
+        for (auto& chunk : chunks) {
+            coded_out.WriteVarint64(chunk.size());
+            for (auto& aln : chunk) {
+                string s;
+                aln.SerializeToString(&s);
+                coded_out.WriteVarint32(s.size());
+                coded_out.WriteRaw(s.data(), s.size());
+            }
+        }
+    });
+}
+
+// Record what for_each_ordered_parallel() does, as "count N" for each count
+// and the name of each alignment
+static vector<string> read_ordered(const string& data) {
+    vector<string> events;
+    istringstream in(data);
+    function<void(Alignment&)> lambda = [&](Alignment& aln) {
+        events.push_back(aln.name());
+    };
+    function<void(uint64_t)> handle_count = [&](uint64_t count) {
+        events.push_back("count " + to_string(count));
+    };
+    stream::for_each_ordered_parallel(in, lambda, handle_count);
+    return events;
+}
+
+TEST_CASE("for_each_ordered_parallel reads messages and counts in stream order", "[stream]") {
+
+    int thread_count = get_thread_count();
+
+    // Chunks of assorted sizes, some empty, some with empty messages, which
+    // are counted but not passed on
+    vector<vector<Alignment>> chunks { vector<Alignment>(3), {}, vector<Alignment>(20), vector<Alignment>(1),
+                                       {}, vector<Alignment>(50), {} };
+    vector<string> expected;
+    size_t named = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        expected.push_back("count " + to_string(chunks[i].size()));
+        for (size_t j = 0; j < chunks[i].size(); j++) {
+            if (i == 2 && j % 4 == 1) {
+                // Leave this one empty
+                continue;
+            }
+            chunks[i][j].set_name("read" + to_string(named++));
+            expected.push_back(chunks[i][j].name());
+        }
+    }
+    string data = chunked_stream(chunks);
+
+    SECTION("Batches can hold several chunks or parts of chunks") {
+        for (int threads : { 1, 2, 3, 8 }) {
+            // This sets the batch size
+            omp_set_num_threads(threads);
+            REQUIRE(read_ordered(data) == expected);
+        }
+        omp_set_num_threads(thread_count);
+    }
+
+    SECTION("Empty streams have no counts or messages") {
+        REQUIRE(read_ordered(chunked_stream({})).empty());
+        REQUIRE(read_ordered(chunked_stream({ {}, {} })) == vector<string>({"count 0", "count 0"}));
+    }
+
+    SECTION("Errors from the lambda come out") {
+        omp_set_num_threads(2);
+        istringstream in(data);
+        size_t seen = 0;
+        function<void(Alignment&)> lambda = [&](Alignment& aln) {
+            if (++seen == 30) {
+                throw runtime_error("lambda failed");
+            }
+        };
+        function<void(uint64_t)> no_count = [](uint64_t) {};
+        REQUIRE_THROWS_WITH(stream::for_each_ordered_parallel(in, lambda, no_count), "lambda failed");
+        REQUIRE(seen == 30);
+        omp_set_num_threads(thread_count);
+    }
+
+    SECTION("Corrupt and truncated streams are errors") {
+        Alignment aln;
+        aln.set_name("read");
+        string message;
+        aln.SerializeToString(&message);
+
+        // A chunk that promises more messages than there are
+        string truncated = gzip_stream([&](::google::protobuf::io::CodedOutputStream& coded_out) {
+            coded_out.WriteVarint64(5);
+            for (size_t i = 0; i < 2; i++) {
+                coded_out.WriteVarint32(message.size());
+                coded_out.WriteRaw(message.data(), message.size());
+            }
+        });
+        REQUIRE_THROWS_AS(read_ordered(truncated), runtime_error);
+
+        // A message that ends partway through
+        string cut_short = gzip_stream([&](::google::protobuf::io::CodedOutputStream& coded_out) {
+            coded_out.WriteVarint64(1);
+            coded_out.WriteVarint32(message.size());
+            coded_out.WriteRaw(message.data(), message.size() - 2);
+        });
+        REQUIRE_THROWS_AS(read_ordered(cut_short), runtime_error);
+
+        // A message too long to read, after enough good ones to fill a batch
+        string too_long = gzip_stream([&](::google::protobuf::io::CodedOutputStream& coded_out) {
+            coded_out.WriteVarint64(101);
+            for (size_t i = 0; i < 100; i++) {
+                coded_out.WriteVarint32(message.size());
+                coded_out.WriteRaw(message.data(), message.size());
+            }
+            coded_out.WriteVarint32(stream::MAX_PROTOBUF_SIZE + 1);
+        });
+        REQUIRE_THROWS_AS(read_ordered(too_long), runtime_error);
+
+        // A message that isn't an alignment
+        string garbage = gzip_stream([&](::google::protobuf::io::CodedOutputStream& coded_out) {
+            coded_out.WriteVarint64(1);
+            coded_out.WriteVarint32(3);
+            coded_out.WriteRaw("\xff\xff\xff", 3);
+        });
+        REQUIRE_THROWS_AS(read_ordered(garbage), runtime_error);
+    }
+}
+
+TEST_CASE("write_parallel output reads back the same way with every reader", "[stream]") {
+
+    int thread_count = get_thread_count();
+    omp_set_num_threads(2);
+
+    // Each chunk is a Graph holding a few of the nodes, so there are many
+    // more chunks than threads, and several waves of them
+    size_t node_count = 100;
+    function<Graph(uint64_t, uint64_t)> lambda = [&](uint64_t start, uint64_t length) {
+        Graph chunk;
+        for (uint64_t i = start; i < start + length; i++) {
+            Node* node = chunk.add_node();
+            node->set_id(i + 1);
+            node->set_sequence(string(1 + i % 5, "ACGT"[i % 4]));
+        }
+        return chunk;
+    };
+    vector<uint64_t> progress;
+    function<void(uint64_t)> written = [&](uint64_t elements) {
+        progress.push_back(elements);
+    };
+    stringstream buffer;
+    REQUIRE(stream::write_parallel(buffer, node_count, 3, lambda, written));
+    string data = buffer.str();
+    omp_set_num_threads(thread_count);
+
+    REQUIRE(!progress.empty());
+    REQUIRE(is_sorted(progress.begin(), progress.end()));
+    REQUIRE(progress.back() == node_count);
+
+    vector<int64_t> expected;
+    for (size_t i = 0; i < node_count; i++) {
+        expected.push_back(i + 1);
+    }
+    auto check_node = [](const Node& node) {
+        size_t i = node.id() - 1;
+        REQUIRE(node.sequence() == string(1 + i % 5, "ACGT"[i % 4]));
+    };
+
+    SECTION("for_each reads the chunks in order") {
+        istringstream in(data);
+        vector<int64_t> ids;
+        size_t chunks = 0;
+        function<void(Graph&)> each = [&](Graph& chunk) {
+            chunks++;
+            for (auto& node : chunk.node()) {
+                check_node(node);
+                ids.push_back(node.id());
+            }
+        };
+        stream::for_each(in, each);
+        REQUIRE(chunks == 34);
+        REQUIRE(ids == expected);
+    }
+
+    SECTION("for_each_parallel reads all the chunks") {
+        for (int threads : { 1, 4 }) {
+            omp_set_num_threads(threads);
+            istringstream in(data);
+            vector<int64_t> ids;
+            function<void(Graph&)> each = [&](Graph& chunk) {
+#pragma omp critical (ids)
+                for (auto& node : chunk.node()) {
+                    ids.push_back(node.id());
+                }
+            };
+            stream::for_each_parallel(in, each);
+            sort(ids.begin(), ids.end());
+            REQUIRE(ids == expected);
+        }
+        omp_set_num_threads(thread_count);
+    }
+
+    SECTION("for_each_ordered_parallel reads the chunks in order") {
+        for (int threads : { 1, 4 }) {
+            omp_set_num_threads(threads);
+            istringstream in(data);
+            vector<int64_t> ids;
+            vector<uint64_t> counts;
+            function<void(Graph&)> each = [&](Graph& chunk) {
+                for (auto& node : chunk.node()) {
+                    check_node(node);
+                    ids.push_back(node.id());
+                }
+            };
+            function<void(uint64_t)> handle_count = [&](uint64_t count) {
+                counts.push_back(count);
+            };
+            stream::for_each_ordered_parallel(in, each, handle_count);
+            REQUIRE(ids == expected);
+            // Each chunk is a group of one message
+            REQUIRE(counts == vector<uint64_t>(34, 1));
+        }
+        omp_set_num_threads(thread_count);
+    }
+
+    SECTION("Writing nothing makes a stream with nothing in it") {
+        stringstream empty;
+        REQUIRE(stream::write_parallel(empty, 0, 3, lambda));
+        size_t chunks = 0;
+        function<void(Graph&)> each = [&](Graph& chunk) {
+            chunks++;
+        };
+        stream::for_each(empty, each);
+        REQUIRE(chunks == 0);
+    }
+}
+
+}
+}
@@ -0,0 +1,249 @@
+/// \file surjector.cpp
+///
+/// unit tests for surjecting alignments onto paths
+
+#include <iostream>
+#include <set>
+#include <tuple>
+#include "../json2pb.h"
+#include "vg.pb.h"
+#include "../surjector.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+// We define a child class to expose the protected stuff for testing
+class TestSurjector : public Surjector {
+public:
+    using Surjector::Surjector;
+    using Surjector::extract_split_path_graph;
+    using Surjector::is_full_ungapped_chunk;
+};
+
+// Make an alignment or graph from its JSON
+template<typename Message>
+static Message from_json(const string& json) {
+    Message message;
+    json2pb(message, json.c_str(), json.size());
+    return message;
+}
+
+TEST_CASE( "Reads that a single path chunk covers without gaps are surjected directly", "[surject]" ) {
+
+    Graph graph = from_json<Graph>(R"({
+        "node": [
+            {"id": 1, "sequence": "GATT"},
+            {"id": 2, "sequence": "ACA"},
+            {"id": 3, "sequence": "CTTG"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 2, "to": 3}
+        ],
+        "path": [
+            {"name": "ref", "mapping": [
+                {"position": {"node_id": 1}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 1},
+                {"position": {"node_id": 2}, "edit": [{"from_length": 3, "to_length": 3}], "rank": 2},
+                {"position": {"node_id": 3}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 3}
+            ]}
+        ]
+    })");
+    xg::XG xg_index(graph);
+    TestSurjector surjector(&xg_index);
+
+    // Matches the whole path
+    Alignment matched = from_json<Alignment>(R"({
+        "name": "read",
+        "sequence": "GATTACACTTG",
+        "mapping_quality": 30,
+        "fragment_prev": {"name": "prev"},
+        "fragment_next": {"name": "next"},
+        "path": {"mapping": [
+            {"position": {"node_id": 1}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 1},
+            {"position": {"node_id": 2}, "edit": [{"from_length": 3, "to_length": 3}], "rank": 2},
+            {"position": {"node_id": 3}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 3}
+        ]}
+    })");
+
+    // Has a mismatch at the start of node 3
+    Alignment mismatched = from_json<Alignment>(R"({
+        "name": "read",
+        "sequence": "GATTACAGTTG",
+        "path": {"mapping": [
+            {"position": {"node_id": 1}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 1},
+            {"position": {"node_id": 2}, "edit": [{"from_length": 3, "to_length": 3}], "rank": 2},
+            {"position": {"node_id": 3}, "edit": [{"from_length": 1, "to_length": 1, "sequence": "G"},
+                                                  {"from_length": 3, "to_length": 3}], "rank": 3}
+        ]}
+    })");
+
+    auto chunk_of = [](const Alignment& aln, size_t begin, size_t end, const Path& path) {
+        return Surjector::path_chunk_t(make_pair(aln.sequence().begin() + begin, aln.sequence().begin() + end), path);
+    };
+
+    SECTION("A full length match is taken with its score and fragment links") {
+        string path_name;
+        int64_t path_pos;
+        bool path_rev;
+        Alignment surjected = surjector.path_anchored_surject(matched, set<string>{"ref"}, path_name, path_pos, path_rev);
+
+        REQUIRE(surjected.path().mapping_size() == 3);
+        for (size_t i = 0; i < 3; i++) {
+            REQUIRE(surjected.path().mapping(i).position().node_id() == i + 1);
+            REQUIRE(!surjected.path().mapping(i).position().is_reverse());
+            REQUIRE(mapping_from_length(surjected.path().mapping(i)) == mapping_from_length(matched.path().mapping(i)));
+            REQUIRE(mapping_to_length(surjected.path().mapping(i)) == mapping_to_length(matched.path().mapping(i)));
+        }
+        // 11 matches and both full length bonuses
+        REQUIRE(surjected.score() == 21);
+        REQUIRE(surjected.sequence() == matched.sequence());
+        REQUIRE(surjected.mapping_quality() == 30);
+        REQUIRE(surjected.fragment_prev().name() == "prev");
+        REQUIRE(surjected.fragment_next().name() == "next");
+        REQUIRE(path_name == "ref");
+        REQUIRE(path_pos == 0);
+        REQUIRE(!path_rev);
+    }
+
+    SECTION("A full length chunk with a mismatch is taken when qualities don't matter") {
+        REQUIRE(surjector.is_full_ungapped_chunk(mismatched, chunk_of(mismatched, 0, 11, mismatched.path())));
+
+        string path_name;
+        int64_t path_pos;
+        bool path_rev;
+        Alignment surjected = surjector.path_anchored_surject(mismatched, set<string>{"ref"}, path_name, path_pos, path_rev);
+        REQUIRE(surjected.path().mapping_size() == 3);
+        REQUIRE(surjected.path().mapping(2).edit(0).sequence() == "G");
+        // 10 matches, a mismatch and both full length bonuses
+        REQUIRE(surjected.score() == 16);
+    }
+
+    SECTION("A full length match is a full ungapped chunk") {
+        REQUIRE(surjector.is_full_ungapped_chunk(matched, chunk_of(matched, 0, 11, matched.path())));
+    }
+
+    SECTION("A chunk over part of the read is not") {
+        Path partial = matched.path();
+        partial.mutable_mapping()->RemoveLast();
+        REQUIRE(!surjector.is_full_ungapped_chunk(matched, chunk_of(matched, 0, 7, partial)));
+        REQUIRE(!surjector.is_full_ungapped_chunk(matched, chunk_of(matched, 4, 11, matched.path())));
+    }
+
+    SECTION("Chunks with indels are not") {
+        Alignment deleted = from_json<Alignment>(R"({
+            "sequence": "GATTAACTTG",
+            "path": {"mapping": [
+                {"position": {"node_id": 1}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 1},
+                {"position": {"node_id": 2}, "edit": [{"from_length": 1, "to_length": 1},
+                                                      {"from_length": 1},
+                                                      {"from_length": 1, "to_length": 1}], "rank": 2},
+                {"position": {"node_id": 3}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 3}
+            ]}
+        })");
+        REQUIRE(!surjector.is_full_ungapped_chunk(deleted, chunk_of(deleted, 0, 10, deleted.path())));
+
+        Alignment inserted = from_json<Alignment>(R"({
+            "sequence": "GATTACATCTTG",
+            "path": {"mapping": [
+                {"position": {"node_id": 1}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 1},
+                {"position": {"node_id": 2}, "edit": [{"from_length": 3, "to_length": 3},
+                                                      {"to_length": 1, "sequence": "T"}], "rank": 2},
+                {"position": {"node_id": 3}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 3}
+            ]}
+        })");
+        REQUIRE(!surjector.is_full_ungapped_chunk(inserted, chunk_of(inserted, 0, 12, inserted.path())));
+    }
+
+    SECTION("Chunks with mismatches are not when realignment would score them by base quality") {
+        mismatched.set_quality(string(mismatched.sequence().size(), 30));
+        surjector.adjust_alignments_for_base_quality = true;
+        REQUIRE(!surjector.is_full_ungapped_chunk(mismatched, chunk_of(mismatched, 0, 11, mismatched.path())));
+
+        // Exact matches score the same either way
+        matched.set_quality(string(matched.sequence().size(), 30));
+        REQUIRE(surjector.is_full_ungapped_chunk(matched, chunk_of(matched, 0, 11, matched.path())));
+
+        // And without qualities there is nothing to adjust
+        mismatched.clear_quality();
+        REQUIRE(surjector.is_full_ungapped_chunk(mismatched, chunk_of(mismatched, 0, 11, mismatched.path())));
+    }
+}
+
+TEST_CASE( "Split path graphs have a forward and a reverse complement chain", "[surject]" ) {
+
+    // The path goes around a cycle through node 1 twice, and then backward
+    // through node 3
+    Graph graph = from_json<Graph>(R"({
+        "node": [
+            {"id": 1, "sequence": "GAT"},
+            {"id": 2, "sequence": "TA"},
+            {"id": 3, "sequence": "CAGG"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 2, "to": 1},
+            {"from": 1, "to": 3, "to_end": true}
+        ],
+        "path": [
+            {"name": "cycle", "mapping": [
+                {"position": {"node_id": 1}, "edit": [{"from_length": 3, "to_length": 3}], "rank": 1},
+                {"position": {"node_id": 2}, "edit": [{"from_length": 2, "to_length": 2}], "rank": 2},
+                {"position": {"node_id": 1}, "edit": [{"from_length": 3, "to_length": 3}], "rank": 3},
+                {"position": {"node_id": 3, "is_reverse": true}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 4}
+            ]}
+        ]
+    })");
+    xg::XG xg_index(graph);
+    TestSurjector surjector(&xg_index);
+    const xg::XGPath& xpath = xg_index.get_path("cycle");
+
+    // Get the sequence and the edges of the graph, which numbers its nodes
+    // from 1 in the order it makes them
+    auto sequences_of = [](VG& split) {
+        vector<string> sequences;
+        for (id_t id = 1; id <= split.node_size(); id++) {
+            REQUIRE(split.has_node(id));
+            sequences.push_back(split.get_node(id)->sequence());
+        }
+        return sequences;
+    };
+    auto edges_of = [](VG& split) {
+        set<tuple<id_t, id_t, bool, bool>> edges;
+        for (size_t i = 0; i < split.graph.edge_size(); i++) {
+            const Edge& edge = split.graph.edge(i);
+            edges.emplace(edge.from(), edge.to(), edge.from_start(), edge.to_end());
+        }
+        return edges;
+    };
+    using edge_set = set<tuple<id_t, id_t, bool, bool>>;
+    using trans_t = unordered_map<id_t, pair<id_t, bool>>;
+
+    SECTION("The whole path gets a copy of node 1 for each visit on each strand") {
+        trans_t node_trans;
+        VG split = surjector.extract_split_path_graph(0, 11, xpath, node_trans);
+
+        REQUIRE((sequences_of(split) == vector<string>{"GAT", "TA", "GAT", "CCTG", "CAGG", "ATC", "TA", "ATC"}));
+        REQUIRE((edges_of(split) == edge_set{
+            make_tuple(1, 2, false, false), make_tuple(2, 3, false, false), make_tuple(3, 4, false, false),
+            make_tuple(5, 6, false, false), make_tuple(6, 7, false, false), make_tuple(7, 8, false, false)
+        }));
+        REQUIRE((node_trans == trans_t{
+            {1, {1, false}}, {2, {2, false}}, {3, {1, false}}, {4, {3, true}},
+            {5, {3, false}}, {6, {1, true}}, {7, {2, true}}, {8, {1, true}}
+        }));
+    }
+
+    SECTION("An interval gets only the steps it overlaps") {
+        // From the end of node 2 to the middle of the second visit to node 1
+        trans_t node_trans;
+        VG split = surjector.extract_split_path_graph(4, 6, xpath, node_trans);
+
+        REQUIRE((sequences_of(split) == vector<string>{"TA", "GAT", "ATC", "TA"}));
+        REQUIRE((edges_of(split) == edge_set{make_tuple(1, 2, false, false), make_tuple(3, 4, false, false)}));
+        REQUIRE((node_trans == trans_t{{1, {2, false}}, {2, {1, false}}, {3, {1, true}}, {4, {2, true}}}));
+    }
+}
+
+}
+}
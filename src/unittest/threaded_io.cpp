@@ -0,0 +1,114 @@
+/// \file threaded_io.cpp
+///
+/// Unit tests for the reader and writer threads used by the parallel mappers.
+///
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include "../threaded_io.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("OrderedWriter restores input order from many threads", "[threadedio]") {
+
+    vector<size_t> written;
+    size_t total = 20000;
+
+    {
+        OrderedWriter<size_t> writer([&](vector<size_t>& items) {
+            written.insert(written.end(), items.begin(), items.end());
+        }, true);
+
+#pragma omp parallel for schedule(dynamic, 7) num_threads(4)
+        for (size_t i = 0; i < total; i++) {
+            InputSequenceScope sequence(i);
+            if (i % 3 == 0) {
+                // Reads that produce nothing still have to be accounted for
+                writer.emit(vector<size_t>());
+            } else {
+                writer.emit(vector<size_t>{i, i});
+            }
+        }
+
+        writer.finish();
+        REQUIRE(writer.order_violations() == 0);
+    }
+
+    vector<size_t> expected;
+    for (size_t i = 0; i < total; i++) {
+        if (i % 3 != 0) {
+            expected.push_back(i);
+            expected.push_back(i);
+        }
+    }
+    REQUIRE(written == expected);
+}
+
+TEST_CASE("OrderedWriter gives up on a missing sequence number when its window fills", "[threadedio]") {
+
+    vector<size_t> written;
+    OrderedWriter<size_t> writer([&](vector<size_t>& items) {
+        written.insert(written.end(), items.begin(), items.end());
+    }, true, 2);
+
+    // Sequence number 0 never arrives
+    writer.emit(3, vector<size_t>{3});
+    writer.emit(1, vector<size_t>{1});
+    writer.emit(2, vector<size_t>{2});
+    // Work that isn't from the input goes straight out
+    writer.emit(NO_INPUT_SEQUENCE, vector<size_t>{100});
+    writer.finish();
+
+    REQUIRE(writer.order_violations() == 1);
+    REQUIRE(written == vector<size_t>({1, 2, 3, 100}));
+}
+
+TEST_CASE("BatchReader delivers batches in order and passes on errors", "[threadedio]") {
+
+    SECTION("All batches arrive, and empty ones are dropped") {
+        size_t filled = 0;
+        BatchReader<vector<int>> reader([&](vector<int>& batch) {
+            filled++;
+            if (filled != 2) {
+                batch.push_back(filled);
+            }
+            return filled < 5;
+        }, [](const vector<int>& batch) {
+            return batch.empty();
+        }, 1);
+
+        vector<int> batch, seen;
+        while (reader.next(batch)) {
+            REQUIRE(batch.size() == 1);
+            seen.push_back(batch.front());
+        }
+        REQUIRE(seen == vector<int>({1, 3, 4, 5}));
+    }
+
+    SECTION("An exception in the reader comes out of next() after the good batches") {
+        size_t filled = 0;
+        BatchReader<vector<int>> reader([&](vector<int>& batch) {
+            if (++filled > 2) {
+                throw runtime_error("corrupt input");
+            }
+            batch.push_back(filled);
+            return true;
+        }, [](const vector<int>& batch) {
+            return batch.empty();
+        });
+
+        vector<int> batch;
+        REQUIRE(reader.next(batch));
+        REQUIRE(reader.next(batch));
+        REQUIRE_THROWS_AS(reader.next(batch), runtime_error);
+    }
+}
+
+}
+}
@@ -0,0 +1,102 @@
+/**
+ * \file
+ * unittest/unchop.cpp: test cases for finding and merging runs of nodes and
+ * sets of sibling nodes on a handle graph.
+ */
+
+#include "catch.hpp"
+
+#include "../algorithms/unchop.hpp"
+#include "../packed_graph.hpp"
+
+#include <string>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE( "Simple components are found and merged", "[unchop]" ) {
+
+    // 1 -> 2 -> 3- -> 4 -> 5, 4 -> 6, and a cycle 7 -> 8 -> 7
+    PackedGraph graph;
+    vector<handle_t> h;
+    for (string seq : {"GA", "TT", "GT", "C", "A", "G", "AC", "GG"}) {
+        h.push_back(graph.create_handle(seq));
+    }
+    graph.create_edge(h[0], h[1]);
+    graph.create_edge(h[1], graph.flip(h[2]));
+    graph.create_edge(graph.flip(h[2]), h[3]);
+    graph.create_edge(h[3], h[4]);
+    graph.create_edge(h[3], h[5]);
+    graph.create_edge(h[6], h[7]);
+    graph.create_edge(h[7], h[6]);
+
+    SECTION("Runs stop at branches and are oriented from their first node") {
+        auto runs = algorithms::simple_components(&graph);
+        REQUIRE(runs.size() == 2);
+        REQUIRE(runs[0] == vector<handle_t>({h[0], h[1], graph.flip(h[2]), h[3]}));
+        REQUIRE(runs[1].size() == 2);
+        REQUIRE(runs[1].back() == h[6]);
+    }
+
+    SECTION("Runs are broken where the caller says so") {
+        auto runs = algorithms::simple_components(&graph, [&](const handle_t& left, const handle_t& right) {
+            return graph.get_id(left) != graph.get_id(h[1]);
+        });
+        REQUIRE(runs.size() == 3);
+        REQUIRE(runs[0] == vector<handle_t>({h[0], h[1]}));
+        REQUIRE(runs[1] == vector<handle_t>({graph.flip(h[3]), h[2]}));
+    }
+
+    SECTION("Merging keeps the sequence and the outside edges") {
+        REQUIRE(algorithms::unchop(&graph) == 2);
+        REQUIRE(graph.node_size() == 4);
+        vector<string> seqs;
+        graph.for_each_handle([&](const handle_t& handle) {
+            seqs.push_back(graph.get_sequence(handle));
+        });
+        REQUIRE(seqs == vector<string>({"A", "G", "GATTACC", "GGAC"}));
+        graph.for_each_handle([&](const handle_t& handle) {
+            if (graph.get_sequence(handle) == "GATTACC") {
+                size_t right = 0;
+                graph.follow_edges(handle, false, [&](const handle_t& next) {
+                    REQUIRE(!graph.get_is_reverse(next));
+                    right++;
+                });
+                REQUIRE(right == 2);
+            } else if (graph.get_sequence(handle) == "GGAC") {
+                REQUIRE(graph.has_edge(handle, handle));
+            }
+        });
+        REQUIRE(algorithms::simple_components(&graph).empty());
+    }
+}
+
+TEST_CASE( "Sibling sets share all their neighbors", "[unchop]" ) {
+
+    // 1 -> {2, 3-} and {4, 5} -> 6
+    PackedGraph graph;
+    vector<handle_t> h;
+    for (string seq : {"A", "CA", "CT", "GA", "GT", "C"}) {
+        h.push_back(graph.create_handle(seq));
+    }
+    graph.create_edge(h[0], h[1]);
+    graph.create_edge(h[0], graph.flip(h[2]));
+    graph.create_edge(h[3], h[5]);
+    graph.create_edge(h[4], h[5]);
+
+    SECTION("Sets with mixed orientations are left out") {
+        REQUIRE(algorithms::sibling_sets(&graph, true).empty());
+    }
+
+    SECTION("Sets are found on the right sides too") {
+        auto sets = algorithms::sibling_sets(&graph, false);
+        REQUIRE(sets.size() == 1);
+        REQUIRE(sets[0] == vector<handle_t>({h[3], h[4]}));
+    }
+}
+
+}
+}
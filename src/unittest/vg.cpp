@@ -5,6 +5,11 @@
 #include "catch.hpp"
 #include "../vg.hpp"
 #include "../utility.hpp"
+#include "../stream.hpp"
+
+#include <omp.h>
+#include <algorithm>
+#include <sstream>
 
 namespace vg {
 namespace unittest {
@@ -1606,7 +1611,7 @@ TEST_CASE("add_nodes_and_edges() should connect all nodes", "[vg][edit]") {
     // This can be empty if no changes have been made yet
     map<pos_t, Node*> node_translation;
     // As can this
-    map<pair<pos_t, string>, vector<Node*>> added_seqs;
+    unordered_map<pair<pos_t, string>, vector<Node*>> added_seqs;
     // And this
     map<Node*, Path> added_nodes;
     
@@ -2127,5 +2132,116 @@ TEST_CASE("create_handle() correctly creates handles using given sequence and id
     
 }
 
+// Describe the nodes, edges and path visits in a graph, which may be made of
+// several chunks, in a fixed order
+static vector<string> graph_contents(const Graph& graph) {
+    vector<string> contents;
+    for (auto& node : graph.node()) {
+        contents.push_back("node " + to_string(node.id()) + " " + node.sequence());
+    }
+    for (auto& edge : graph.edge()) {
+        contents.push_back("edge " + to_string(edge.from()) + (edge.from_start() ? "-" : "+") + " "
+                           + to_string(edge.to()) + (edge.to_end() ? "-" : "+"));
+    }
+    for (auto& path : graph.path()) {
+        for (auto& mapping : path.mapping()) {
+            contents.push_back("path " + path.name() + " " + to_string(mapping.rank()) + " "
+                               + to_string(mapping.position().node_id()) + (mapping.position().is_reverse() ? "-" : "+"));
+        }
+    }
+    sort(contents.begin(), contents.end());
+    return contents;
+}
+
+TEST_CASE("A graph saved in many compressed chunks loads back the same way with every reader", "[vg][stream]") {
+
+    // A chain with some skipping edges, and paths that span many chunks
+    Graph source;
+    size_t node_count = 40;
+    for (size_t i = 1; i <= node_count; i++) {
+        Node* node = source.add_node();
+        node->set_id(i);
+        node->set_sequence(string(1 + i % 3, "ACGT"[i % 4]));
+        if (i < node_count) {
+            Edge* edge = source.add_edge();
+            edge->set_from(i);
+            edge->set_to(i + 1);
+        }
+        if (i % 2 == 0 && i + 2 <= node_count) {
+            Edge* edge = source.add_edge();
+            edge->set_from(i);
+            edge->set_to(i + 2);
+        }
+    }
+    Path* ref = source.add_path();
+    ref->set_name("ref");
+    for (size_t i = 1; i <= node_count; i++) {
+        Mapping* mapping = ref->add_mapping();
+        mapping->mutable_position()->set_node_id(i);
+        mapping->set_rank(i);
+    }
+    // Backward along the even nodes
+    Path* alt = source.add_path();
+    alt->set_name("alt");
+    for (size_t i = node_count; i > 0; i -= 2) {
+        Mapping* mapping = alt->add_mapping();
+        mapping->mutable_position()->set_node_id(i);
+        mapping->mutable_position()->set_is_reverse(true);
+        mapping->set_rank(alt->mapping_size());
+    }
+    vector<string> expected = graph_contents(source);
+
+    int thread_count = get_thread_count();
+    omp_set_num_threads(2);
+    VG graph;
+    graph.merge(source);
+    stringstream buffer;
+    // 3 nodes per chunk, so 14 chunks
+    graph.serialize_to_ostream(buffer, 3);
+    string data = buffer.str();
+
+    SECTION("Loading a VG puts the chunks back together") {
+        for (int threads : { 1, 4 }) {
+            omp_set_num_threads(threads);
+            istringstream in(data);
+            VG loaded(in);
+            REQUIRE(graph_contents(loaded.graph) == expected);
+            REQUIRE(loaded.graph.node_size() == node_count);
+            for (size_t i = 0; i < node_count; i++) {
+                REQUIRE(loaded.graph.node(i).id() == i + 1);
+            }
+        }
+    }
+
+    SECTION("for_each reads every chunk in order") {
+        istringstream in(data);
+        Graph all;
+        size_t chunks = 0;
+        function<void(Graph&)> lambda = [&](Graph& chunk) {
+            chunks++;
+            all.MergeFrom(chunk);
+        };
+        stream::for_each(in, lambda);
+        REQUIRE(chunks == 14);
+        REQUIRE(graph_contents(all) == expected);
+        for (size_t i = 0; i < node_count; i++) {
+            REQUIRE(all.node(i).id() == i + 1);
+        }
+    }
+
+    SECTION("for_each_parallel reads every chunk") {
+        istringstream in(data);
+        Graph all;
+        function<void(Graph&)> lambda = [&](Graph& chunk) {
+#pragma omp critical (all)
+            all.MergeFrom(chunk);
+        };
+        stream::for_each_parallel(in, lambda);
+        REQUIRE(graph_contents(all) == expected);
+    }
+
+    omp_set_num_threads(thread_count);
+}
+
 }
 }
@@ -2553,6 +2553,59 @@ namespace vg {
         
         }
         
+        TEST_CASE( "A connecting graph extractor gives the same results when it is reused", "[algorithms]" ) {
+            VG vg;
+            
+            Node* n0 = vg.create_node("CGA");
+            Node* n1 = vg.create_node("TTGG");
+            Node* n2 = vg.create_node("GT");
+            Node* n3 = vg.create_node("ATG");
+            Node* n4 = vg.create_node("TGAG");
+            Node* n5 = vg.create_node("CA");
+            Node* n6 = vg.create_node("T");
+            
+            vg.create_edge(n0, n1);
+            vg.create_edge(n1, n2);
+            vg.create_edge(n1, n3);
+            vg.create_edge(n1, n4, false, true);
+            vg.create_edge(n1, n5);
+            vg.create_edge(n3, n3);
+            vg.create_edge(n4, n6, true, false);
+            vg.create_edge(n5, n6);
+            
+            vector<pair<pos_t, pos_t>> queries{
+                make_pair(make_pos_t(n0->id(), false, 1), make_pos_t(n6->id(), false, 0)),
+                make_pair(make_pos_t(n1->id(), false, 2), make_pos_t(n3->id(), false, 1)),
+                make_pair(make_pos_t(n6->id(), true, 0), make_pos_t(n1->id(), true, 1)),
+                make_pair(make_pos_t(n0->id(), false, 0), make_pos_t(n2->id(), false, 1))
+            };
+            
+            algorithms::ConnectingGraphExtractor extractor;
+            for (size_t pass = 0; pass < 2; pass++) {
+                for (auto& query : queries) {
+                    Graph reused;
+                    auto reused_trans = extractor.extract(&vg, reused, 12, query.first, query.second,
+                                                          false, false, true, true, true);
+                    
+                    Graph fresh;
+                    auto fresh_trans = algorithms::ConnectingGraphExtractor().extract(&vg, fresh, 12, query.first, query.second,
+                                                                                      false, false, true, true, true);
+                    
+                    REQUIRE(reused_trans == fresh_trans);
+                    REQUIRE(reused.node_size() == fresh.node_size());
+                    REQUIRE(reused.edge_size() == fresh.edge_size());
+                    for (int i = 0; i < reused.node_size(); i++) {
+                        REQUIRE(reused.node(i).id() == fresh.node(i).id());
+                        REQUIRE(reused.node(i).sequence() == fresh.node(i).sequence());
+                        if (i > 0) {
+                            // nodes come out in ID order
+                            REQUIRE(reused.node(i - 1).id() < reused.node(i).id());
+                        }
+                    }
+                }
+            }
+        }
+        
         TEST_CASE( "Containing graph extraction algorithm produces expected results", "[algorithms]" ) {
             
             VG vg;
@@ -3518,6 +3571,45 @@ namespace vg {
             
             }
         }
+        
+        TEST_CASE( "Components are labeled and sorted separately",
+                  "[algorithms][topologicalsort]" ) {
+            
+            // Three components, with their nodes interleaved in the graph
+            VG vg;
+            
+            vector<Node*> n;
+            for (string seq : {"A", "C", "G", "T", "AA", "CC", "GG", "TT"}) {
+                n.push_back(vg.create_node(seq));
+            }
+            vg.create_edge(n[2], n[0]);
+            vg.create_edge(n[0], n[5]);
+            vg.create_edge(n[6], n[3]);
+            vg.create_edge(n[3], n[6]);
+            vg.create_edge(n[7], n[1]);
+            vg.create_edge(n[4], n[1]);
+            
+            vector<handle_t> nodes;
+            auto labels = algorithms::weakly_connected_component_labels(&vg, nodes);
+            
+            REQUIRE(nodes.size() == 8);
+            REQUIRE(labels == vector<size_t>({0, 1, 0, 2, 1, 0, 2, 1}));
+            for (size_t i = 0; i < nodes.size(); i++) {
+                REQUIRE(vg.get_id(nodes[i]) == n[i]->id());
+            }
+            
+            auto handle_sort = algorithms::topological_sort(&vg);
+            REQUIRE(handle_sort.size() == 8);
+            
+            // The components are interleaved by ID, as if they were sorted
+            // together: the heads go lowest ID first, and the cycle waits
+            // until nothing else is left
+            vector<handle_t> expected;
+            for (size_t i : {2, 0, 4, 5, 7, 1, 3, 6}) {
+                expected.push_back(vg.get_handle(n[i]->id(), false));
+            }
+            REQUIRE(handle_sort == expected);
+        }
         TEST_CASE("distance_to_head() using HandleGraph produces expected results", "[vg]") {
             VG vg;
             Node* n0 = vg.create_node("AA");
@@ -4,6 +4,7 @@
 // We need to use ultrabubbles for dot output
 #include "genotypekit.hpp"
 #include "algorithms/topological_sort.hpp"
+#include "algorithms/unchop.hpp"
 #include <raptor2/raptor2.h>
 #include <stPinchGraphs.h>
 
@@ -31,19 +32,23 @@ void VG::from_istream(istream& in, bool showp, bool warn_on_duplicates) {
         create_progress("loading graph", count);
     };
 
-    // the graph is read in chunks, which are attached to this graph
+    // the graph is read in chunks, which are decoded in parallel and attached
+    // to this graph in order
     uint64_t i = 0;
     function<void(Graph&)> lambda = [this, &i, &warn_on_duplicates](Graph& g) {
         update_progress(++i);
+        // Grow the indexes ahead of the chunk, with headroom, so they don't
+        // rehash in the middle of it
+        reserve_for(g.node_size(), g.edge_size());
         // We usually expect these to not overlap in nodes or edges, so complain unless we've been told not to.
         extend(g, warn_on_duplicates);
     };
 
-    stream::for_each(in, lambda, handle_count);
+    stream::for_each_ordered_parallel(in, lambda, handle_count);
 
     // Collate all the path mappings we got from all the different chunks. A
     // mapping from any chunk might fall anywhere in a path (because paths may
-    // loop around cycles), so we need to sort on ranks.
+    // loop around cycles), so we need to sort on ranks. Paths sort in parallel.
     paths.sort_by_mapping_rank();
     paths.rebuild_mapping_aux();
 
@@ -77,6 +82,24 @@ VG::VG(function<bool(Graph&)>& get_next_graph, bool showp, bool warn_on_duplicat
     paths.to_graph(graph);
 }
 
+void VG::reserve_for(size_t more_nodes, size_t more_edges) {
+    size_t nodes = graph.node_size() + more_nodes;
+    if (nodes > graph.node().Capacity()) {
+        nodes = max(nodes, (size_t) graph.node().Capacity() * 2);
+        graph.mutable_node()->Reserve(nodes);
+        // resize() on the hash maps rehashes to hold this many entries
+        node_by_id.resize(nodes);
+        node_index.resize(nodes);
+    }
+    size_t edges = graph.edge_size() + more_edges;
+    if (edges > graph.edge().Capacity()) {
+        edges = max(edges, (size_t) graph.edge().Capacity() * 2);
+        graph.mutable_edge()->Reserve(edges);
+        edge_by_sides.resize(edges);
+        edge_index.resize(edges);
+    }
+}
+
 handle_t VG::get_handle(const id_t& node_id, bool is_reverse) const {
     // Handle is ID in low bits and orientation in high bit
     
@@ -133,48 +156,20 @@ string VG::get_sequence(const handle_t& handle) const {
 }
 
 bool VG::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
-    // Are we reverse?
-    bool is_reverse = get_is_reverse(handle);
-    
-    // Which edges will we look at?
-    auto& edge_set = (go_left != is_reverse) ? edges_on_start : edges_on_end;
-    
-    // Look up edges of this node specifically
-    auto found = edge_set.find(get_id(handle));
-    if (found != edge_set.end()) {
-        // There are (or may be) edges
-        for (auto& id_and_flip : found->second) {
-            // For each edge destination and the flag that says if we flip orientation or not
-            bool new_reverse = (is_reverse != id_and_flip.second);
-            if (!iteratee(get_handle(id_and_flip.first, new_reverse))) {
-                // Iteratee said to stop
-                return false;
-            }
-        }
-    }
-    
-    return true;
+    // The template does the work
+    return follow_edges<const function<bool(const handle_t&)>&>(handle, go_left, iteratee);
+}
+
+void VG::get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& neighbors) const {
+    neighbors.clear();
+    follow_edges(handle, go_left, [&](const handle_t& other) {
+        neighbors.push_back(other);
+    });
 }
 
 void VG::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
-    if (parallel) {
-#pragma omp parallel for schedule(dynamic,1)
-        for (id_t i = 0; i < graph.node_size(); ++i) {
-            // For each node in the backing graph
-            // Get its ID and make a handle to it forward
-            // And pass it to the iteratee
-            if (!iteratee(get_handle(graph.node(i).id(), false))) {
-                // Iteratee stopped, but we can't do anything if we want to run this in parallel
-                //return;
-            }
-        }
-    } else { // same but serial
-        for (id_t i = 0; i < graph.node_size(); ++i) {
-            if (!iteratee(get_handle(graph.node(i).id(), false))) {
-                return;
-            }
-        }
-    }
+    // The template does the work
+    for_each_handle<const function<bool(const handle_t&)>&>(iteratee, parallel);
 }
 
 size_t VG::node_size() const {
@@ -352,6 +347,12 @@ void VG::serialize_to_ostream(ostream& out, id_t chunk_size) {
     // This makes sure mapping ranks are updated to reflect their actual
     // positions along their paths.
     sync_paths();
+
+    // Chunks are built concurrently, so make sure every lookup they do finds
+    // an existing entry instead of inserting one.
+    for (size_t j = 0; j < graph.node_size(); ++j) {
+        paths.get_node_mapping(graph.mutable_node(j));
+    }
     
     create_progress("saving graph", graph.node_size());
     
@@ -407,14 +408,15 @@ void VG::serialize_to_ostream(ostream& out, id_t chunk_size) {
         // the nodes they cross are stored in graph.nodes
         g.paths.to_graph(g.graph);
 
-        update_progress(element_start);
         return g.graph;
     
     };
 
-    // Write all the dynamically sized chunks, starting with our selected chunk
-    // size as a guess.
-    stream::write(out, graph.node_size(), chunk_size, lambda);
+    // Build and compress the chunks in parallel; they are written in order.
+    function<void(uint64_t)> written = [this](uint64_t elements) {
+        update_progress(elements);
+    };
+    stream::write_parallel(out, graph.node_size(), chunk_size, lambda, written);
 
     destroy_progress();
 }
@@ -974,40 +976,29 @@ set<set<NodeTraversal>> VG::identically_oriented_sibling_sets(const set<set<Node
 }
 
 void VG::simplify_siblings(void) {
-    // make a list of all the sets of siblings
-    set<set<NodeTraversal>> to_sibs;
-    for_each_node([this, &to_sibs](Node* n) {
-            auto trav = NodeTraversal(n, false);
-            auto tsibs = full_siblings_to(trav);
-            tsibs.insert(trav);
-            if (tsibs.size() > 1) {
-                to_sibs.insert(tsibs);
+    // nothing here reads the path ranks, so compact them once at the end
+    Paths::Batch batch(paths);
+
+    // the sibling sets come out transitive and identically oriented
+    auto as_traversals = [this](const vector<vector<handle_t>>& sets) {
+        set<set<NodeTraversal>> sibs;
+        for (auto& handles : sets) {
+            set<NodeTraversal> s;
+            for (auto& handle : handles) {
+                s.emplace(get_node(get_id(handle)), get_is_reverse(handle));
             }
-        });
-        
-    // make the sibling sets transitive
-    // by removing any that are intransitive
-    // then simplify
-    simplify_to_siblings(
-        identically_oriented_sibling_sets(
-            transitive_sibling_sets(to_sibs)));
+            sibs.insert(s);
+        }
+        return sibs;
+    };
+
+    // simplify the sets of siblings with the same upstream sides
+    simplify_to_siblings(as_traversals(algorithms::sibling_sets(this, true)));
     // and remove any null nodes that result
     remove_null_nodes_forwarding_edges();
 
-    // make a list of the from-siblings
-    set<set<NodeTraversal>> from_sibs;
-    for_each_node([this, &from_sibs](Node* n) {
-            auto trav = NodeTraversal(n, false);
-            auto fsibs = full_siblings_from(trav);
-            fsibs.insert(trav);
-            if (fsibs.size() > 1) {
-                from_sibs.insert(fsibs);
-            }
-        });
     // then do the from direction
-    simplify_from_siblings(
-        identically_oriented_sibling_sets(
-            transitive_sibling_sets(from_sibs)));
+    simplify_from_siblings(as_traversals(algorithms::sibling_sets(this, false)));
     // and remove any null nodes that result
     remove_null_nodes_forwarding_edges();
 
@@ -1511,7 +1502,12 @@ void VG::flip_doubly_reversed_edges(void) {
 // without affecting the sequence or path space of the graph
 // so we don't unchop nodes when they have mismatched path sets
 void VG::unchop(void) {
-    for (auto& comp : simple_multinode_components()) {
+    for (auto& run : simple_component_handles(2)) {
+        // look the nodes up as we go, as merging moves them around
+        list<NodeTraversal> comp;
+        for (auto& handle : run) {
+            comp.emplace_back(get_node(get_id(handle)), get_is_reverse(handle));
+        }
         concat_nodes(comp);
     }
     // rebuild path ranks, as these will be affected by mapping merging
@@ -1651,15 +1647,22 @@ bool VG::mapping_is_total_match(const Mapping& m) {
 }
 
 bool VG::nodes_are_perfect_path_neighbors(NodeTraversal left, NodeTraversal right) {
+    // get the mappings for each node, by path ID
+    // we only look things up here, so this can run in several threads at once
+    static const map<int64_t, set<mapping_t*>> no_mappings;
+    auto f1 = paths.node_mapping.find(left.node->id());
+    auto f2 = paths.node_mapping.find(right.node->id());
+    auto& m1 = f1 == paths.node_mapping.end() ? no_mappings : f1->second;
+    auto& m2 = f2 == paths.node_mapping.end() ? no_mappings : f2->second;
+
     // it is not possible for the nodes to be perfect neighbors if
     // they do not have exactly the same counts of paths
-    if (paths.of_node(left.node->id()) != paths.of_node(right.node->id())) return false;
+    if (m1.size() != m2.size()) return false;
+    for (auto i1 = m1.begin(), i2 = m2.begin(); i1 != m1.end(); ++i1, ++i2) {
+        if (i1->first != i2->first) return false;
+    }
     // now we know that the paths are identical in count and name between the two nodes
 
-    // get the mappings for each node
-    auto m1 = paths.get_node_mapping_by_path_name(left.node->id());
-    auto m2 = paths.get_node_mapping_by_path_name(right.node->id());
-
     // verify that they are all perfect matches that take up their entire nodes
     /*
     for (auto& p : m1) {
@@ -1680,12 +1683,12 @@ bool VG::nodes_are_perfect_path_neighbors(NodeTraversal left, NodeTraversal righ
     // the right node in the correct relative order and orientation.
 
     // order the mappings by rank so we can quickly check if everything is adjacent
-    // Holds mappings by path name, then rank.
-    map<string, map<int, mapping_t*>> r1, r2;
+    // Holds mappings by path ID, then rank.
+    map<int64_t, map<int, mapping_t*>> r1, r2;
     for (auto& p : m1) {
         auto& name = p.first;
         auto& mp1 = p.second;
-        auto& mp2 = m2[name];
+        auto& mp2 = m2.at(name);
         for (auto* m : mp1) r1[name][m->rank] = m;
         for (auto* m : mp2) r2[name][m->rank] = m;
     }
@@ -1731,128 +1734,25 @@ bool VG::nodes_are_perfect_path_neighbors(NodeTraversal left, NodeTraversal righ
 // changing the path space of the graph
 // respects stored paths
 set<list<NodeTraversal>> VG::simple_components(int min_size) {
-
-    // go around and establish groupings
-    set<Node*> seen;
     set<list<NodeTraversal>> components;
-    for_each_node([this, min_size, &components, &seen](Node* n) {
-            if (seen.count(n)) return;
-            
-#ifdef debug
-            cerr << "Component based on " << n->id() << endl;
-#endif
-            
-            seen.insert(n);
-            // go left and right through each as far as we have only single edges connecting us
-            // to nodes that have only single edges coming in or out
-            // that go to other nodes
-            list<NodeTraversal> c;
-            // go left
-            {
-                NodeTraversal l(n, false);
-                vector<NodeTraversal> prev = nodes_prev(l);
-#ifdef debug
-                cerr << "\tLeft: ";
-                for (auto& x : prev) {
-                    cerr << x << "(" << node_count_next(x) << " edges right) ";
-                }
-                cerr << endl;
-#endif
-                while (prev.size() == 1
-                       && node_count_next(prev.front()) == 1) {   
-                       
-                    // While there's only one node left of here, and one node right of that node...
-                    auto last = l;
-                    // Move over left to that node
-                    l = prev.front();
-                    // avoid merging if it breaks stored paths
-                    if (!nodes_are_perfect_path_neighbors(l, last)) {
-#ifdef debug
-                        cerr << "\tNot perfect neighbors!" << endl;
-#endif
-                        break;
-                    }
-                    // avoid merging if it's already in this or any other component (catch self loops)
-                    if (seen.count(l.node)) {
-#ifdef debug
-                        cerr << "\tAlready seen!" << endl;
-#endif
-                        break;
-                    }
-                    prev = nodes_prev(l);
-#ifdef debug
-                    cerr << "\tLeft: ";
-                    for (auto& x : prev) {
-                        cerr << x << "(" << node_count_next(x) << " edges right) ";
-                    }
-                    cerr << endl;
-#endif
-                    c.push_front(l);
-                    seen.insert(l.node);
-                }
-            }
-            // add the node (in the middle)
-            c.push_back(NodeTraversal(n, false));
-            // go right
-            {
-                NodeTraversal r(n, false);
-                vector<NodeTraversal> next = nodes_next(r);
-#ifdef debug
-                cerr << "\tRight: ";
-                for (auto& x : next) {
-                    cerr << x << "(" << node_count_prev(x) << " edges left) ";
-                }
-                cerr << endl;
-#endif
-                while (next.size() == 1
-                       && node_count_prev(next.front()) == 1) {   
-                       
-                    // While there's only one node right of here, and one node left of that node...
-                    auto last = r;
-                    // Move over right to that node
-                    r = next.front();
-                    // avoid merging if it breaks stored paths
-                    if (!nodes_are_perfect_path_neighbors(last, r)) {
-#ifdef debug
-                        cerr << "\tNot perfect neighbors!" << endl;
-#endif
-                        break;
-                    }
-                    // avoid merging if it's already in this or any other component (catch self loops)
-                    if (seen.count(r.node)) {
-#ifdef debug
-                        cerr << "\tAlready seen!" << endl;
-#endif
-                        break;
-                    }
-                    next = nodes_next(r);
-#ifdef debug
-                    cerr << "\tRight: ";
-                    for (auto& x : next) {
-                        cerr << x << "(" << node_count_prev(x) << " edges left) ";
-                    }
-                    cerr << endl;
-#endif
-                    c.push_back(r);
-                    seen.insert(r.node);
-                }
-            }
-            if (c.size() >= min_size) {
-                components.insert(c);
-            }
-        });
-#ifdef debug
-    cerr << "components " << endl;
-    for (auto& c : components) {
-        for (auto x : c) {
-            cerr << x << " ";
+    for (auto& run : simple_component_handles(min_size)) {
+        list<NodeTraversal> c;
+        for (auto& handle : run) {
+            c.emplace_back(get_node(get_id(handle)), get_is_reverse(handle));
         }
-        cerr << endl;
+        components.insert(c);
     }
-#endif
     return components;
 }
 
+vector<vector<handle_t>> VG::simple_component_handles(int min_size) {
+    // avoid merging if it breaks stored paths
+    return algorithms::simple_components(this, [&](const handle_t& left, const handle_t& right) {
+            return nodes_are_perfect_path_neighbors(NodeTraversal(get_node(get_id(left)), get_is_reverse(left)),
+                                                    NodeTraversal(get_node(get_id(right)), get_is_reverse(right)));
+        }, max(min_size, 1));
+}
+
 map<string, vector<mapping_t>>
     VG::concat_mappings_for_nodes(const list<NodeTraversal>& nodes) {
 
@@ -2516,8 +2416,10 @@ void VG::compact_ids(void) {
     for_each_edge([&new_id](Edge* e) {
             e->set_from(new_id[e->from()]);
             e->set_to(new_id[e->to()]); });
+    // the path index is renumbered in place, so only rebuild our own
     paths.swap_node_ids(new_id);
-    rebuild_indexes();
+    clear_indexes_no_resize();
+    build_indexes_no_init_size();
 }
 
 void VG::increment_node_ids(id_t increment) {
@@ -2528,7 +2430,9 @@ void VG::increment_node_ids(id_t increment) {
             e->set_from(e->from()+increment);
             e->set_to(e->to()+increment);
         });
-    rebuild_indexes();
+    // the path index is renumbered in place, so only rebuild our own
+    clear_indexes_no_resize();
+    build_indexes_no_init_size();
     paths.increment_node_ids(increment);
 }
 
@@ -2676,76 +2580,24 @@ void VG::dice_nodes(int max_node_size) {
 }
 
 void VG::from_gfa(istream& in, bool showp) {
-    // c++... split...
-    // for line in stdin
-    string line;
-    auto too_many_fields = [&line]() {
-        cerr << "[vg] error: too many fields in line " << endl << line << endl;
-        exit(1);
-    };
+    GFAText text(in);
+    from_gfa(text);
+}
 
-    bool reduce_overlaps = false;
-    GFAKluge gg;
-    gg.parse_gfa_file(in);
-
-    map<string, sequence_elem, custom_key> name_to_seq = gg.get_name_to_seq();
-    map<std::string, vector<edge_elem> > seq_to_edges = gg.get_seq_to_edges();
-    map<string, sequence_elem>::iterator it;
-    id_t curr_id = 1;
-    map<string, id_t> id_names;
-    std::function<id_t(const string&)> get_add_id = [&](const string& name) -> id_t {
-        if (is_number(name)) {
-            return std::stol(name);
-        } else {
-            auto id = id_names.find(name);
-            if (id == id_names.end()) {
-                id_names[name] = curr_id;
-                return curr_id++;
-            } else {
-                return id->second;
-            }
-        }
-    };
-    for (it = name_to_seq.begin(); it != name_to_seq.end(); it++){
-        auto source_id = get_add_id((it->second).name);
-        //Make us some nodes
-        Node n;
-        n.set_sequence((it->second).sequence);
-        n.set_id(source_id);
-        n.set_name((it->second).name);
-        add_node(n);
-        // Now some edges. Since they're placed in this map
-        // by their from_node, it's no big deal to just iterate
-        // over them.
-        for (edge_elem l : seq_to_edges[(it->second).name]){
-            auto sink_id = get_add_id(l.sink_name);
-            Edge e;
-            e.set_from(source_id);
-            e.set_to(sink_id);
-            e.set_from_start(!l.source_orientation_forward);
-            e.set_to_end(!l.sink_orientation_forward);
-            // get the cigar
-            auto cigar_elems = vcflib::splitCigar(l.alignment);
-            if (cigar_elems.size() == 1
-                && cigar_elems.front().first > 0
-                && cigar_elems.front().second == "M") {
-                    reduce_overlaps = true;
-                    e.set_overlap(cigar_elems.front().first);
-            }
-            add_edge(e);
-        }
-        // for (path_elem p: seq_to_paths[(it->second).name]){
-        //     paths.append_mapping(p.name, source_id, p.rank ,p.is_reverse);
-        // }
+void VG::from_gfa(const string& filename, bool showp) {
+    GFAText text(filename);
+    from_gfa(text);
+}
+
+void VG::from_gfa(const GFAText& text) {
+    GFAReader reader(text);
+    reserve_for(reader.segment_count(), 0);
+    reader.for_each_chunk([&](Graph& g) {
+        reserve_for(g.node_size(), g.edge_size());
+        extend(g);
+    });
+    if (reader.has_overlaps()) {
         // remove overlapping sequences from the graph
-    }
-    map<string, path_elem> n_to_p = gg.get_name_to_path();
-    for (auto name_path : n_to_p){
-        for (int np = 0; np < name_path.second.segment_names.size(); np++){
-            paths.append_mapping(name_path.first, stol(name_path.second.segment_names[np]), np + 1, !name_path.second.orientations[np]);
-        }
-    }
-    if (reduce_overlaps) {
         bluntify();
     }
 }
@@ -4554,8 +4406,6 @@ void VG::expand_path(list<NodeTraversal>& path, vector<list<NodeTraversal>::iter
 
 // The correct way to edit the graph
 vector<Translation> VG::edit(vector<Path>& paths_to_add, bool save_paths, bool update_paths, bool break_at_ends) {
-    // Collect the breakpoints
-    map<id_t, set<pos_t>> breakpoints;
 
 #ifdef debug
     for (auto& p : paths_to_add) {
@@ -4563,33 +4413,69 @@ vector<Translation> VG::edit(vector<Path>& paths_to_add, bool save_paths, bool u
     }
 #endif
 
-    std::vector<Path> simplified_paths;
-
-    for(auto path : paths_to_add) {
-        // Simplify the path, just to eliminate adjacent match Edits in the same
-        // Mapping (because we don't have or want a breakpoint there)
-        simplified_paths.push_back(simplify(path));
+    // Simplify the paths, just to eliminate adjacent match Edits in the same
+    // Mapping (because we don't have or want a breakpoint there)
+    std::vector<Path> simplified_paths(paths_to_add.size());
+#pragma omp parallel for schedule(dynamic, 64)
+    for (size_t i = 0; i < paths_to_add.size(); ++i) {
+        simplified_paths[i] = simplify(paths_to_add[i]);
     }
 
     // If we are going to actually add the paths to the graph, we need to break at path ends
     break_at_ends |= save_paths;
 
-    for(auto path : simplified_paths) {
-        // Add in breakpoints from each path
-        find_breakpoints(path, breakpoints, break_at_ends);
+    // Collect the breakpoints from each path in parallel, flipped onto the
+    // forward strand, in a flat list per thread
+    vector<vector<pos_t>> thread_breakpoints(get_thread_count());
+#pragma omp parallel for schedule(dynamic, 64)
+    for (size_t i = 0; i < simplified_paths.size(); ++i) {
+        auto& found = thread_breakpoints[omp_get_thread_num()];
+        size_t kept = found.size();
+        find_breakpoints(simplified_paths[i], found, break_at_ends);
+        for (size_t j = kept; j < found.size(); ++j) {
+            // Invert the breakpoints that are on the reverse strand, as
+            // forwardize_breakpoints() does
+            pos_t pos = found[j];
+            size_t node_length = get_node(id(pos))->sequence().size();
+            if (offset(pos) == node_length) continue;
+            if (offset(pos) > node_length) {
+#pragma omp critical (cerr)
+                cerr << "VG::edit error: failure, position " << pos << " is not inside node "
+                     << pb2json(*get_node(id(pos))) << endl;
+                assert(false);
+            }
+            found[kept++] = is_rev(pos) ? reverse(pos, node_length) : pos;
+        }
+        found.resize(kept);
     }
 
-    // Invert the breakpoints that are on the reverse strand
-    breakpoints = forwardize_breakpoints(breakpoints);
+    // Sort them together, so the map fills in order
+    vector<pos_t> all_breakpoints;
+    for (auto& found : thread_breakpoints) {
+        all_breakpoints.insert(all_breakpoints.end(), found.begin(), found.end());
+        vector<pos_t>().swap(found);
+    }
+    std::sort(all_breakpoints.begin(), all_breakpoints.end());
+    map<id_t, set<pos_t>> breakpoints;
+    for (auto& pos : all_breakpoints) {
+        auto& node_breakpoints = breakpoints.emplace_hint(breakpoints.end(), id(pos), set<pos_t>())->second;
+        node_breakpoints.emplace_hint(node_breakpoints.end(), pos);
+    }
+    vector<pos_t>().swap(all_breakpoints);
 
     // Clear existing path ranks.
     paths.clear_mapping_ranks();
 
     // get the node sizes, for use when making the translation
-    map<id_t, size_t> orig_node_sizes;
+    vector<pair<id_t, size_t>> node_sizes;
+    node_sizes.reserve(graph.node_size());
     for_each_node([&](Node* node) {
-            orig_node_sizes[node->id()] = node->sequence().size();
+            node_sizes.emplace_back(node->id(), node->sequence().size());
         });
+    std::sort(node_sizes.begin(), node_sizes.end());
+    // Sorted input fills the map in linear time
+    map<id_t, size_t> orig_node_sizes(node_sizes.begin(), node_sizes.end());
+    vector<pair<id_t, size_t>>().swap(node_sizes);
 
     // Break any nodes that need to be broken. Save the map we need to translate
     // from offsets on old nodes to new nodes. Note that this would mess up the
@@ -4598,7 +4484,7 @@ vector<Translation> VG::edit(vector<Path>& paths_to_add, bool save_paths, bool u
     auto node_translation = ensure_breakpoints(breakpoints);
 
     // we remember the sequences of nodes we've added at particular positions on the forward strand
-    map<pair<pos_t, string>, vector<Node*>> added_seqs;
+    unordered_map<pair<pos_t, string>, vector<Node*>> added_seqs;
     // we will record the nodes that we add, so we can correctly make the returned translation
     map<Node*, Path> added_nodes;
     for(auto& path : simplified_paths) {
@@ -4686,7 +4572,7 @@ vector<Translation> VG::edit_fast(const Path& path, set<NodeSide>& dangling) {
 #endif
     
     // we remember the sequences of nodes we've added at particular positions on the forward strand
-    map<pair<pos_t, string>, vector<Node*>> added_seqs;
+    unordered_map<pair<pos_t, string>, vector<Node*>> added_seqs;
     // we will record the nodes that we add, so we can correctly make the returned translation for novel insert nodes
     map<Node*, Path> added_nodes;
     // create new nodes/wire things up.
@@ -4742,7 +4628,7 @@ vector<Translation> VG::make_translation(const map<pos_t, Node*>& node_translati
                                          const map<id_t, size_t>& orig_node_sizes) {
     vector<Translation> translation;
     // invert the translation
-    map<Node*, pos_t> inv_node_trans;
+    unordered_map<Node*, pos_t> inv_node_trans;
     for (auto& t : node_translation) {
         if (!is_rev(t.first)) {
             inv_node_trans[t.second] = t.first;
@@ -4826,9 +4712,11 @@ vector<Translation> VG::make_translation(const map<pos_t, Node*>& node_translati
         }
         return f->second;
     };
-    for (auto& trans : translation) {
-        reverse_translation.emplace_back();
-        auto& rev_trans = reverse_translation.back();
+    reverse_translation.resize(translation.size());
+#pragma omp parallel for schedule(dynamic, 64)
+    for (size_t i = 0; i < translation.size(); ++i) {
+        auto& trans = translation[i];
+        auto& rev_trans = reverse_translation[i];
         *rev_trans.mutable_to() = simplify(reverse_complement_path(trans.to(), get_curr_node_length));
         *rev_trans.mutable_from() = simplify(reverse_complement_path(trans.from(), get_orig_node_length));
     }
@@ -4861,8 +4749,15 @@ map<id_t, set<pos_t>> VG::forwardize_breakpoints(const map<id_t, set<pos_t>>& br
     return fwd;
 }
 
-// returns breakpoints on the forward strand of the nodes
 void VG::find_breakpoints(const Path& path, map<id_t, set<pos_t>>& breakpoints, bool break_ends) {
+    vector<pos_t> found;
+    find_breakpoints(path, found, break_ends);
+    for (auto& pos : found) {
+        breakpoints[id(pos)].insert(pos);
+    }
+}
+
+void VG::find_breakpoints(const Path& path, vector<pos_t>& breakpoints, bool break_ends) const {
     // We need to work out what offsets we will need to break each node at, if
     // we want to add in all the new material and edges in this path.
 
@@ -4924,7 +4819,7 @@ void VG::find_breakpoints(const Path& path, map<id_t, set<pos_t>>& breakpoints,
 
                 // We need to snip between edit_first_position and edit_first_position - direction.
                 // Note that it doesn't matter if we put breakpoints at 0 and 1-past-the-end; those will be ignored.
-                breakpoints[node_id].insert(edit_first_position);
+                breakpoints.push_back(edit_first_position);
             }
 
             if (!edit_is_match(e) || (j == m.edit_size() - 1 && (i != path.mapping_size() - 1 || break_ends))) {
@@ -4939,7 +4834,7 @@ void VG::find_breakpoints(const Path& path, map<id_t, set<pos_t>>& breakpoints,
 #endif
 
                 // We also need to snip between edit_last_position and edit_last_position + direction.
-                breakpoints[node_id].insert(edit_last_position);
+                breakpoints.push_back(edit_last_position);
             }
 
             // TODO: for an insertion or substitution, note that we need a new
@@ -5051,7 +4946,7 @@ map<pos_t, Node*> VG::ensure_breakpoints(const map<id_t, set<pos_t>>& breakpoint
 
 Path VG::add_nodes_and_edges(const Path& path,
                              const map<pos_t, Node*>& node_translation,
-                             map<pair<pos_t, string>, vector<Node*>>& added_seqs,
+                             unordered_map<pair<pos_t, string>, vector<Node*>>& added_seqs,
                              map<Node*, Path>& added_nodes,
                              const map<id_t, size_t>& orig_node_sizes,
                              size_t max_node_size) {
@@ -5069,7 +4964,7 @@ Path VG::add_nodes_and_edges(const Path& path,
 
 Path VG::add_nodes_and_edges(const Path& path,
                              const map<pos_t, Node*>& node_translation,
-                             map<pair<pos_t, string>, vector<Node*>>& added_seqs,
+                             unordered_map<pair<pos_t, string>, vector<Node*>>& added_seqs,
                              map<Node*, Path>& added_nodes,
                              const map<id_t, size_t>& orig_node_sizes,
                              set<NodeSide>& dangling,
@@ -6191,61 +6086,29 @@ void VG::to_dot(ostream& out,
 
 
 void VG::to_gfa(ostream& out) {
-  GFAKluge gg;
-  gg.set_version(1.0);
-  for (auto h : gg.get_header()){
-    out << h.second.to_string();
-  }
-
-    // TODO moving to GFAKluge
-    // problem: protobuf longs don't easily go to strings....
-    for (int i = 0; i < graph.node_size(); ++i){
-        sequence_elem s_elem;
-        Node* n = graph.mutable_node(i);
-        // Fill seq element for a node
-        s_elem.name = to_string(n->id());
-        s_elem.sequence = n->sequence();
-        out << s_elem.to_string_1() << endl;
-        //gg.add_sequence(s_elem);
-    }
-    
-    auto& pathmap = this->paths._paths;
-    for (auto p : pathmap){
-        path_elem p_elem;
-        p_elem.name = p.first;
-        for (auto m : p.second){
-            p_elem.segment_names.push_back( std::to_string(m.node_id()) );
-            p_elem.orientations.push_back( !m.is_reverse() );
-            Node* n = get_node( m.node_id() );
-            stringstream cigaro;
-            //cigaro << n->sequence().size() << (p.mapping(m_ind.position().is_reverse()) ? "M" : "M");
-            cigaro << n->sequence().size() << (m.is_reverse() ? "M" : "M");
-            p_elem.overlaps.push_back( cigaro.str() );
-        }
-        out << p_elem.to_string() << endl;
-        //gg.add_path(p_elem.name, p_elem);
+    out << GFA_HEADER;
+
+    // Lines are formatted in parallel and written in order
+    write_gfa_lines(out, graph.node_size(), [&](size_t i, string& buffer) {
+        append_gfa_segment(buffer, graph.node(i));
+    });
+
+    vector<const pair<const string, list<mapping_t>>*> path_list;
+    for (auto& p : paths._paths) {
+        path_list.push_back(&p);
     }
+    write_gfa_lines(out, path_list.size(), [&](size_t i, string& buffer) {
+        vector<tuple<id_t, bool, size_t>> visits;
+        visits.reserve(path_list[i]->second.size());
+        for (auto& m : path_list[i]->second) {
+            visits.emplace_back(m.node_id(), m.is_reverse(), get_node(m.node_id())->sequence().size());
+        }
+        append_gfa_path(buffer, path_list[i]->first, visits);
+    }, 1);
 
-    for (int i = 0; i < graph.edge_size(); ++i) {
-        Edge* e = graph.mutable_edge(i);
-        edge_elem ee;
-        ee.type = 1;
-        ee.source_name = to_string(e->from());
-        ee.sink_name = to_string(e->to());
-        ee.source_orientation_forward = ! e->from_start();
-        ee.sink_orientation_forward =  ! e->to_end();
-        ee.alignment = std::to_string(e->overlap()) + "M";
-        out << ee.to_string_1() << endl;;
-        //gg.add_edge(ee.source_name, ee);
-        //link_elem l;
-        //l.source_name = to_string(e->from());
-        //l.sink_name = to_string(e->to());
-        //l.source_orientation_forward = ! e->from_start();
-        //l.sink_orientation_forward =  ! e->to_end();
-        //l.cigar = std::to_string(e->overlap()) + "M";
-        //gg.add_link(l.source_name, l);
-    }
-    //gg.output_to_stream(cout);
+    write_gfa_lines(out, graph.edge_size(), [&](size_t i, string& buffer) {
+        append_gfa_link(buffer, graph.edge(i));
+    });
 }
 
 void VG::to_turtle(ostream& out, const string& rdf_base_uri, bool precompress) {
@@ -40,7 +40,7 @@
 #include "colors.hpp"
 
 #include "types.hpp"
-#include "gfakluge.hpp"
+#include "gfa.hpp"
 
 #include "nodetraversal.hpp"
 #include "nodeside.hpp"
@@ -113,15 +113,24 @@ public:
     /// continue. Returns true if we finished and false if we stopped early.
     virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
     
-    // Copy over the template for nice calls
-    using HandleGraph::follow_edges;
+    /// Loop over all the handles to next/previous (right/left) nodes, with
+    /// an iteratee that returns either bool or void, which gets inlined
+    /// instead of being called through a std::function.
+    template<typename Iteratee>
+    bool follow_edges(const handle_t& handle, bool go_left, Iteratee&& iteratee) const;
+    
+    /// Get all the handles to next/previous (right/left) nodes at once.
+    virtual void get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& neighbors) const;
     
     /// Loop over all the nodes in the graph in their local forward
     /// orientations, in their internal stored order. Stop if the iteratee returns false.
     virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
     
-    // Copy over the template for nice calls
-    using HandleGraph::for_each_handle;
+    /// Loop over all the nodes in the graph in their local forward
+    /// orientations, with an iteratee that returns either bool or void and
+    /// gets inlined. Stop if the iteratee returns false, unless in parallel.
+    template<typename Iteratee>
+    void for_each_handle(Iteratee&& iteratee, bool parallel = false) const;
     
     /// Return the number of nodes in the graph
     virtual size_t node_size() const;
@@ -300,6 +309,9 @@ public:
     set<list<NodeTraversal>> simple_components(int min_size = 1);
     /// Get the simple components of multiple nodes.
     set<list<NodeTraversal>> simple_multinode_components(void);
+    /// Get the simple components as runs of handles, in node order. Found in
+    /// parallel.
+    vector<vector<handle_t>> simple_component_handles(int min_size = 1);
     /// Get the strongly connected components of the graph.
     set<set<id_t> > strongly_connected_components(void);
     /// Get only multi-node strongly connected components.
@@ -368,6 +380,11 @@ public:
 
     /// Build a graph from a GFA stream.
     void from_gfa(istream& in, bool showp = false);
+    /// Build a graph from a GFA file, mapping it into memory if possible. "-"
+    /// reads standard input.
+    void from_gfa(const string& filename, bool showp = false);
+    /// Build a graph from GFA text already in memory.
+    void from_gfa(const GFAText& text);
     /// Build a graph from a Turtle stream.
     void from_turtle(string filename, string baseuri, bool showp = false);
 
@@ -492,6 +509,9 @@ public:
     /// Paths::rebuild_mapping_aux() after you are done adding in graphs to this
     /// graph.
     void extend(Graph& graph, bool warn_on_duplicates = false);
+    /// Make room in the graph and its indexes for this many more nodes and
+    /// edges, growing at least geometrically.
+    void reserve_for(size_t more_nodes, size_t more_edges);
     // TODO: Do a member group for these overloads
 
     /// Add another graph into this graph, attaching tails to heads.
@@ -545,6 +565,10 @@ public:
     /// If break_ends is true, emits breakpoints at the ends of the path, even
     /// if it starts/ends with perfect matches.
     void find_breakpoints(const Path& path, map<id_t, set<pos_t>>& breakpoints, bool break_ends = true);
+    /// Append the breakpoints that find_breakpoints() would add to a map to a
+    /// flat vector instead, in path order and possibly repeated. Safe to call
+    /// from multiple threads.
+    void find_breakpoints(const Path& path, vector<pos_t>& breakpoints, bool break_ends = true) const;
     /// Take a map from node ID to a set of offsets at which new nodes should
     /// start (which may include 0 and 1-past-the-end, which should be ignored),
     /// break the specified nodes at those positions. Returns a map from old
@@ -580,7 +604,7 @@ public:
     /// divisions, and translations.
     Path add_nodes_and_edges(const Path& path,
                              const map<pos_t, Node*>& node_translation,
-                             map<pair<pos_t, string>, vector<Node*>>& added_seqs,
+                             unordered_map<pair<pos_t, string>, vector<Node*>>& added_seqs,
                              map<Node*, Path>& added_nodes,
                              const map<id_t, size_t>& orig_node_sizes,
                              set<NodeSide>& dangling,
@@ -589,7 +613,7 @@ public:
     /// This version doesn't require a set of dangling sides to populate                         
     Path add_nodes_and_edges(const Path& path,
                              const map<pos_t, Node*>& node_translation,
-                             map<pair<pos_t, string>, vector<Node*>>& added_seqs,
+                             unordered_map<pair<pos_t, string>, vector<Node*>>& added_seqs,
                              map<Node*, Path>& added_nodes,
                              const map<id_t, size_t>& orig_node_sizes,
                              size_t max_node_size = 1024);
@@ -1264,6 +1288,47 @@ private:
 
 };
 
+template<typename Iteratee>
+bool VG::follow_edges(const handle_t& handle, bool go_left, Iteratee&& iteratee) const {
+    // Handles are the ID in the low bits and the orientation in the high bit
+    bool is_reverse = as_integer(handle) & HIGH_BIT;
+    
+    // Which edges will we look at?
+    auto& edge_set = (go_left != is_reverse) ? edges_on_start : edges_on_end;
+    
+    // Look up edges of this node specifically
+    auto found = edge_set.find(as_integer(handle) & LOW_BITS);
+    if (found != edge_set.end()) {
+        for (auto& id_and_flip : found->second) {
+            // For each edge destination and the flag that says if we flip orientation or not
+            bool new_reverse = (is_reverse != id_and_flip.second);
+            if (!call_iteratee(iteratee, as_handle((int64_t) (id_and_flip.first | (new_reverse ? HIGH_BIT : 0))))) {
+                // Iteratee said to stop
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+template<typename Iteratee>
+void VG::for_each_handle(Iteratee&& iteratee, bool parallel) const {
+    if (parallel) {
+#pragma omp parallel for schedule(dynamic,1)
+        for (id_t i = 0; i < graph.node_size(); ++i) {
+            // Iteratee stopping can't stop the other threads
+            call_iteratee(iteratee, as_handle((int64_t) graph.node(i).id()));
+        }
+    } else { // same but serial
+        for (id_t i = 0; i < graph.node_size(); ++i) {
+            if (!call_iteratee(iteratee, as_handle((int64_t) graph.node(i).id()))) {
+                return;
+            }
+        }
+    }
+}
+
 } // end namespace vg
 
 #endif
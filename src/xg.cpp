@@ -1634,133 +1634,21 @@ string XG::get_sequence(const handle_t& handle) const {
     }
 }
 
-bool XG::edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const {
-    // Return true if we want an edge of the given type, where we are the from
-    // or to node (according to is_to), when we are looking off the right or
-    // left side of the node (according to want_left), and when the node is
-    // forward or reverse (accoridng to is_reverse).
-    
-    // Edge type encoding:
-    // 1: end to start
-    // 2: end to end
-    // 3: start to start
-    // 4: start to end
-    
-    // First compute what we want looking off the right of a node in the forward direction.
-    bool wanted = !is_to && (type == 1 || type == 2) || is_to && (type == 2 || type == 4);
-    
-    // We computed whether we wanted it assuming we were looking off the right. The complement is what we want looking off the left.
-    wanted = wanted != want_left;
-    
-    // We computed whether we wanted ot assuming we were in the forward orientation. The complement is what we want in the reverse orientation.
-    wanted = wanted != is_reverse;
-    
-    return wanted;
-}
-
-bool XG::do_edges(const size_t& g, const size_t& start, const size_t& count, bool is_to,
-    bool want_left, bool is_reverse, const function<bool(const handle_t&)>& iteratee) const {
-    
-    // OK go over all those edges
-    for (size_t i = 0; i < count; i++) {
-        // What edge type is the edge?
-        int type = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_TYPE_OFFSET];
-        
-        // Make sure we got a valid edge type and we haven't wandered off into non-edge data.
-        assert(type >= 0);
-        assert(type <= 3);
-        
-        if (edge_filter(type, is_to, want_left, is_reverse)) {
-            
-            // What's the offset to the other node?
-            int64_t offset = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_OFFSET_OFFSET];
-            
-            // Make sure we haven't gone off the rails into non-edge data.
-            assert((int64_t) g + offset >= 0);
-            assert(g + offset < g_iv.size());
-            
-            // Should we invert?
-            // We only invert if we cross an end to end edge. Or a start to start edge
-            bool new_reverse = is_reverse != (type == 2 || type == 3);
-            
-            // Compose the handle for where we are going
-            handle_t next_handle = as_handle((g + offset) | (new_reverse ? HIGH_BIT : 0));
-            
-            // We want this edge
-            
-            if (!iteratee(next_handle)) {
-                // Stop iterating
-                return false;
-            }
-        }
-        else {
-            // TODO: delete this after using it to debug
-            int64_t offset = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_OFFSET_OFFSET];
-            bool new_reverse = is_reverse != (type == 2 || type == 3);
-            handle_t next_handle = as_handle((g + offset) | (new_reverse ? HIGH_BIT : 0));
-        }
-    }
-    // Iteratee didn't stop us.
-    return true;
-}
-
 bool XG::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
+    // The template does the work
+    return follow_edges<const function<bool(const handle_t&)>&>(handle, go_left, iteratee);
+}
 
-    // Unpack the handle
-    size_t g = as_integer(handle) & LOW_BITS;
-    bool is_reverse = get_is_reverse(handle);
-
-    // How many edges are there of each type?
-    size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
-    size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
-    
-    // Where does each edge run start?
-    size_t to_start = g + G_NODE_HEADER_LENGTH;
-    size_t from_start = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
-    
-    // We will look for all the edges on the appropriate side, which means we have to check the from and to edges
-    if (do_edges(g, to_start, edges_to_count, true, go_left, is_reverse, iteratee)) {
-        // All the edges where we're to were accepted, so do the edges where we're from
-        return do_edges(g, from_start, edges_from_count, false, go_left, is_reverse, iteratee);
-    } else {
-        return false;
-    }
+void XG::get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& neighbors) const {
+    neighbors.clear();
+    follow_edges(handle, go_left, [&](const handle_t& other) {
+        neighbors.push_back(other);
+    });
 }
 
 void XG::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
-    // How big is the g vector entry size we are on?
-    size_t entry_size = 0;
-    auto lambda = [&](size_t g) {
-        // Make the handle
-        // We need to make sure our index won't set the orientation bit.
-        assert((g & (~LOW_BITS)) == 0);
-        
-        // Just make it into a handle; we're always forward.
-        handle_t handle = as_handle(g);
-        
-        // Run the iteratee
-        if (!iteratee(handle)) {
-            // The iteratee is bored and wants to stop.
-            return;
-        }
-    
-        // How many edges are there of each type on this record?
-        size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
-        size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
-        
-        // This record is the header plus all the edge records it contains
-        entry_size = G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * (edges_to_count + edges_from_count);
-    };
-    if (parallel) {
-#pragma omp parallel for schedule(dynamic,1)
-        for (size_t g = 0; g < g_iv.size(); g += entry_size) {
-            lambda(g);
-        }
-    } else {
-        for (size_t g = 0; g < g_iv.size(); g += entry_size) {
-            lambda(g);
-        }
-    }
+    // The template does the work
+    for_each_handle<const function<bool(const handle_t&)>&>(iteratee, parallel);
 }
 
 size_t XG::node_size() const {
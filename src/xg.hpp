@@ -223,11 +223,21 @@ public:
     /// them to a callback which returns false to stop iterating and true to
     /// continue.
     virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+    /// Loop over all the handles to next/previous (right/left) nodes, with
+    /// an iteratee that returns either bool or void, which gets inlined
+    /// instead of being called through a std::function.
+    template<typename Iteratee>
+    bool follow_edges(const handle_t& handle, bool go_left, Iteratee&& iteratee) const;
+    /// Get all the handles to next/previous (right/left) nodes at once.
+    virtual void get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& neighbors) const;
     /// Loop over all the nodes in the graph in their local forward
     /// orientations, in their internal stored order. Stop if the iteratee returns false.
     virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
-    // Copy over the tamplate version
-    using HandleGraph::for_each_handle;
+    /// Loop over all the nodes in the graph in their local forward
+    /// orientations, with an iteratee that returns either bool or void and
+    /// gets inlined. Stop if the iteratee returns false, unless in parallel.
+    template<typename Iteratee>
+    void for_each_handle(Iteratee&& iteratee, bool parallel = false) const;
     /// Return the number of nodes in the graph
     virtual size_t node_size() const;
 
@@ -611,19 +621,20 @@ private:
     const static size_t HIGH_BIT = (size_t)1 << 63;
     const static size_t LOW_BITS = 0x7FFFFFFFFFFFFFFF;
     
-    /// This is a utility function for the edge exploration. It says whether we
-    /// want to visit an edge depending on its type, whether we're the to or
-    /// from node, whether we want to look left or right, and whether we're
-    /// forward or reverse on the node.
-    bool edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const;
+    /// This is a utility function for the edge exploration. It gives a mask
+    /// with bit t set if we want to visit edges of type t, depending on whether
+    /// we're the to or from node, whether we want to look left or right, and
+    /// whether we're forward or reverse on the node.
+    static int edge_type_mask(bool is_to, bool want_left, bool is_reverse);
     
     // This loops over the given number of edge records for the given g node,
     // starting at the given start g vector position. For all the edges that are
-    // wanted by edge_filter given the is_to, want_left, and is_reverse flags,
+    // wanted by edge_type_mask given the is_to, want_left, and is_reverse flags,
     // the iteratee is called. Returns true if the iteratee never returns false,
     // or false (and stops iteration) as soon as the iteratee returns false.
+    template<typename Iteratee>
     bool do_edges(const size_t& g, const size_t& start, const size_t& count,
-        bool is_to, bool want_left, bool is_reverse, const function<bool(const handle_t&)>& iteratee) const;
+        bool is_to, bool want_left, bool is_reverse, Iteratee& iteratee) const;
     
     ////////////////////////////////////////////////////////////////////////////
     // Here are the bits we need to keep around to talk about the sequence
@@ -796,6 +807,98 @@ private:
     void tn_bake();
 };
 
+template<typename Iteratee>
+bool XG::follow_edges(const handle_t& handle, bool go_left, Iteratee&& iteratee) const {
+
+    // Unpack the handle
+    size_t g = as_integer(handle) & LOW_BITS;
+    bool is_reverse = as_integer(handle) & HIGH_BIT;
+
+    // How many edges are there of each type?
+    size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
+    size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+    
+    // Where does each edge run start?
+    size_t to_start = g + G_NODE_HEADER_LENGTH;
+    size_t from_start = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
+    
+    // We will look for all the edges on the appropriate side, which means we
+    // have to check the edges where we're to and then the ones where we're from
+    return do_edges(g, to_start, edges_to_count, true, go_left, is_reverse, iteratee)
+        && do_edges(g, from_start, edges_from_count, false, go_left, is_reverse, iteratee);
+}
+
+template<typename Iteratee>
+void XG::for_each_handle(Iteratee&& iteratee, bool parallel) const {
+    if (parallel) {
+        // Node records have different sizes, so find each one from its rank
+#pragma omp parallel for schedule(dynamic,1)
+        for (size_t rank = 1; rank <= node_count; rank++) {
+            // Iteratee stopping can't stop the other threads
+            call_iteratee(iteratee, as_handle((int64_t) g_bv_select(rank)));
+        }
+    } else {
+        // Each record is the header plus all the edge records it contains
+        for (size_t g = 0; g < g_iv.size();
+             g += G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * (g_iv[g + G_NODE_TO_COUNT_OFFSET] + g_iv[g + G_NODE_FROM_COUNT_OFFSET])) {
+            // Handles to record starts are always forward
+            if (!call_iteratee(iteratee, as_handle((int64_t) g))) {
+                return;
+            }
+        }
+    }
+}
+
+inline int XG::edge_type_mask(bool is_to, bool want_left, bool is_reverse) {
+    // Edge type encoding:
+    // 1: end to start
+    // 2: end to end
+    // 3: start to start
+    // 4: start to end
+    
+    // First compute what we want looking off the right of a node in the forward direction.
+    int wanted = is_to ? (1 << 2) | (1 << 4) : (1 << 1) | (1 << 2);
+    
+    // Looking off the left wants the complement, and so does being in the
+    // reverse orientation.
+    if (want_left != is_reverse) {
+        wanted ^= (1 << 1) | (1 << 2) | (1 << 3) | (1 << 4);
+    }
+    
+    return wanted;
+}
+
+template<typename Iteratee>
+bool XG::do_edges(const size_t& g, const size_t& start, const size_t& count, bool is_to,
+    bool want_left, bool is_reverse, Iteratee& iteratee) const {
+    
+    // Work out which edge types we want once for all the edges
+    int wanted = edge_type_mask(is_to, want_left, is_reverse);
+    
+    // OK go over all those edges
+    for (size_t i = 0; i < count; i++) {
+        // What edge type is the edge?
+        int type = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_TYPE_OFFSET];
+        
+        if ((wanted >> type) & 1) {
+            
+            // What's the offset to the other node?
+            int64_t offset = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_OFFSET_OFFSET];
+            
+            // Should we invert?
+            // We only invert if we cross an end to end edge. Or a start to start edge
+            bool new_reverse = is_reverse != (type == 2 || type == 3);
+            
+            // Compose the handle for where we are going, and stop if the iteratee says to
+            if (!call_iteratee(iteratee, as_handle((int64_t) ((g + offset) | (new_reverse ? HIGH_BIT : 0))))) {
+                return false;
+            }
+        }
+    }
+    // Iteratee didn't stop us.
+    return true;
+}
+
 class XGPath {
 public:
     XGPath(void) = default;
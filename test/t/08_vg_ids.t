@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 7
+plan tests 8
 
 num_nodes=$(vg construct -r small/x.fa -v small/x.vcf.gz | vg ids -c - | vg view -g - | grep ^S | wc -l)
 
@@ -38,6 +38,10 @@ rm sorted.vg
 
 is $(vg ids -s ids/unordered.vg | vg view -j - | jq -r -c '.node[1] == {"id":"2","sequence":"T"}') "true" "sorting assigns node IDs in topological order"
 
+vg view -Jv ids/edited_path.json > edited.vg
+is $(vg ids -s edited.vg | vg view -j - | jq -c '[.path[0].mapping[] | [(.position.node_id | tonumber), ((.position.offset // 0) | tonumber), ([.edit[] | .sequence // ""] | join(""))]]') '[[1,1,""],[2,0,"T"],[3,0,""]]' "sorting keeps paths with offsets and edits"
+rm -f edited.vg
+
 # this test now breaks under the current VG.paths semantics, which require our paths to record the exact match lengths of the nodes
 #vg ids -s graphs/snp1kg-brca2-unsorted.vg | vg validate -
 #is $? 0 "can handle graphs with out-of-order mappings"
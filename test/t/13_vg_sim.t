@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 12
+plan tests 14
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 vg index -x x.xg x.vg
@@ -23,6 +23,10 @@ is $(vg sim -s 33232 -l 100 -n 100 -J -x x.xg | grep is_reverse | wc -l) 50 "ali
 
 is $(vg sim -s 1337 -l 100 -n 100 -e 0.1 -i 0.1 -J -x x.xg | jq .sequence | wc -c) 10300 "high simulated error rates do not change the number of bases generated"
 
+is $(vg sim -s 1337 -l 50 -n 2500 -e 0.01 -i 0.01 -t 1 -x x.xg | md5sum | cut -f 1 -d " ") $(vg sim -s 1337 -l 50 -n 2500 -e 0.01 -i 0.01 -t 4 -x x.xg | md5sum | cut -f 1 -d " ") "simulated reads do not depend on the number of threads"
+
+is $(vg sim -s 1337 -l 50 -n 2500 -p 200 -v 20 -a -t 4 -x x.xg | vg view -a - | jq -r .name | sort | uniq | wc -l) 5000 "reads simulated on several threads have distinct names"
+
 is $(vg sim -l 100 -n 100 -x x.xg -aJ | jq 'select(.path.mapping[0].is_reverse)' | wc -l) 0 \
    "vg sim creates forward-strand reads when asked"
    
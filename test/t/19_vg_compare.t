@@ -19,8 +19,8 @@ vg view -J -v compare/graph1.json > graph1.vg
 vg view -J -v compare/graph2.json > graph2.vg
 
 # Index 6mers
-vg index -k 6 -d graph1.idx graph1.vg
-vg index -k 6 -d graph2.idx graph2.vg
+vg index -K -k 6 -d graph1.idx graph1.vg
+vg index -K -k 6 -d graph2.idx graph2.vg
 
 # compare
 vg compare graph1.idx graph2.idx  > comparison.json